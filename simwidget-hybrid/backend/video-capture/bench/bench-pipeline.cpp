@@ -0,0 +1,379 @@
+// Pipeline benchmark on synthetic frames (bench/frame-source.h)
+// Runs each capture-pipeline stage on the frames of every scene at 720p,
+// 1080p, 1440p and 4K and reports per-stage latency (mean, p50, p99, max
+// from common/latency-histogram.h) and throughput. No DXGI needed, so the
+// numbers can be compared across machines, compilers and SIMD levels.
+//
+// Stages, in pipeline order, each fed the way the services feed it:
+//   copy      - pitch-stripping copy out of the padded "staging" frame (pool)
+//   convert   - BGRA -> YCbCr 4:2:0 of the packed frame (one thread)
+//   scale     - 2:1 box downscale out of the staging frame (pool)
+//   encode    - built-in JPEG encoder, full frame (pool bands)
+//   delta     - tile hashing against the previous frame with dirty-rect hints
+//   serialize - raw delta payload (tile header + dirty tiles) as sent on the wire
+//   lossless  - lossless codec with XOR against the previous frame (pool)
+//
+// --replay FILE runs the same stages over a recording from a capture
+// service (common/capture-file.h) instead of the synthetic scenes, with its
+// recorded dirty rects; --realtime keeps the recorded frame spacing.
+//
+// Compile: g++ -O2 -std=c++17 -pthread bench/bench-pipeline.cpp -o bin/bench-pipeline
+//     or:  cl /EHsc /O2 /Fe:bin\bench-pipeline.exe bench\bench-pipeline.cpp
+// Usage:   bench-pipeline [--sizes 720p,1080p,1440p,4k] [--scenes static,needle,scroll,motion,noise]
+//                         [--frames N] [--warmup N] [--threads N] [--quality Q] [--json FILE]
+//          bench-pipeline --replay FILE [--realtime] [--frames N] [--warmup N] [--threads N] [--quality Q] [--json FILE]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "../common/capture-file.h"
+#include "../common/color-convert.h"
+#include "../common/frame-scaler.h"
+#include "../common/job-system.h"
+#include "../common/jpeg-encoder.h"
+#include "../common/latency-histogram.h"
+#include "../common/lossless-codec.h"
+#include "../common/tile-delta.h"
+#include "frame-source.h"
+
+#define BENCH_JSON_VERSION 1
+
+struct Resolution {
+    const char* name;
+    uint32_t width, height;
+};
+
+static const Resolution resolutions[] = {
+    { "720p", 1280, 720 },
+    { "1080p", 1920, 1080 },
+    { "1440p", 2560, 1440 },
+    { "4k", 3840, 2160 },
+};
+static const int resolutionCount = sizeof(resolutions) / sizeof(resolutions[0]);
+
+enum Stage {
+    STAGE_COPY,
+    STAGE_CONVERT,
+    STAGE_SCALE,
+    STAGE_ENCODE,
+    STAGE_DELTA,
+    STAGE_SERIALIZE,
+    STAGE_LOSSLESS,
+    STAGE_COUNT
+};
+static const char* const stageNames[STAGE_COUNT] = {
+    "copy", "convert", "scale", "encode", "delta", "serialize", "lossless"
+};
+
+struct StageResult {
+    LatencyHistogram histogram;
+    double sumMs = 0;
+    uint64_t frames = 0;
+    uint64_t bytes = 0;          // Output bytes (encoders / serializer)
+    uint64_t dirtyTiles = 0;     // delta only
+};
+
+// One result row: a stage at one size on one scene (or recording)
+struct Row {
+    const Resolution* resolution;
+    const char* scene;
+    int stage;
+    uint64_t frames;
+    double meanMs, p50Ms, p99Ms, maxMs;
+    double mpixPerSec;           // Source pixels per second at the mean time
+    double bytesPerFrame;
+    double dirtyTiles;           // Average per frame (delta), -1 otherwise
+};
+
+typedef std::chrono::steady_clock Clock;
+
+static double MsSince(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+static void Record(StageResult& r, Clock::time_point start, bool measured) {
+    double ms = MsSince(start);
+    if (!measured) return;
+    r.histogram.Record((uint64_t)(ms * 1000 + 0.5));
+    r.sumMs += ms;
+    r.frames++;
+}
+
+// True if name is in the comma-separated list (null list = everything)
+static bool Selected(const char* list, const char* name) {
+    if (!list) return true;
+    size_t length = strlen(name);
+    for (const char* p = list; *p; ) {
+        const char* end = strchr(p, ',');
+        size_t n = end ? (size_t)(end - p) : strlen(p);
+        if (n == length && strncmp(p, name, n) == 0) return true;
+        if (!end) break;
+        p = end + 1;
+    }
+    return false;
+}
+
+static const uint8_t* NextFrame(FrameSource& source) { return source.Next(); }
+
+// Recordings start over when they run out
+static const uint8_t* NextFrame(CaptureFileReader& source) {
+    const uint8_t* frame = source.Next();
+    if (!frame && source.Seek(0)) frame = source.Next();
+    return frame;
+}
+
+// Run every stage over warmup + frames frames from source (a FrameSource or
+// a CaptureFileReader) of res's size
+template <typename Source>
+static bool RunFrames(Source& source, const Resolution& res, const char* scene, int frames, int warmup, int quality,
+                      JobSystem* jobs, std::vector<Row>* rows) {
+    uint32_t w = res.width, h = res.height;
+    std::vector<uint8_t> packed((size_t)w * h * 4);
+
+    std::vector<uint8_t> lumaPlane((size_t)w * h);
+    std::vector<uint8_t> cbPlane((size_t)ChromaWidth(w, CHROMA_420) * ChromaHeight(h, CHROMA_420));
+    std::vector<uint8_t> crPlane(cbPlane.size());
+    YCbCrPlanes planes = { lumaPlane.data(), cbPlane.data(), crPlane.data(), w, ChromaWidth(w, CHROMA_420) };
+
+    FrameScaler scaler;
+    uint32_t scaledW = ScaledSize(w, 0.5), scaledH = ScaledSize(h, 0.5);
+    if (!scaler.Configure(w, h, scaledW, scaledH)) return false;
+    scaler.SetJobSystem(jobs);
+    std::vector<uint8_t> scaled((size_t)scaledW * scaledH * 4);
+
+    BaselineJpegEncoder jpeg;
+    if (!jpeg.Configure(quality, CHROMA_420)) return false;
+    jpeg.SetJobSystem(jobs);
+    jpeg.Reserve(w, h);
+    std::vector<uint8_t> jpegOut(jpeg.MaxEncodedSize(w, h));
+
+    TileDelta delta;
+    if (!delta.Initialize(w, h)) return false;
+    std::vector<uint8_t> deltaOut(DELTA_TILE_HEADER_SIZE + (size_t)delta.GetTileCount() / 8 + 1 + packed.size());
+
+    LosslessEncoder lossless;
+    if (!lossless.Initialize(w, h, true)) return false;
+    lossless.SetJobSystem(jobs);
+    std::vector<uint8_t> losslessOut(lossless.MaxEncodedSize());
+
+    StageResult results[STAGE_COUNT];
+    for (int f = 0; f < warmup + frames; f++) {
+        const uint8_t* src = NextFrame(source);
+        if (!src) return false;
+        uint32_t stride = source.GetStride();
+        int hintCount;
+        const TileRect* hints = source.GetDirtyRects(&hintCount);
+        bool measured = f >= warmup;
+
+        auto start = Clock::now();
+        ParallelCopyRows(jobs, packed.data(), (size_t)w * 4, src, stride, (size_t)w * 4, h);
+        Record(results[STAGE_COPY], start, measured);
+
+        start = Clock::now();
+        ConvertBgraToYCbCr(packed.data(), w * 4, w, h, CHROMA_420, planes);
+        Record(results[STAGE_CONVERT], start, measured);
+
+        start = Clock::now();
+        scaler.Scale(src, stride, scaled.data(), (size_t)scaledW * 4);
+        Record(results[STAGE_SCALE], start, measured);
+
+        start = Clock::now();
+        int jpegSize = jpeg.Encode(packed.data(), w * 4, w, h, jpegOut.data(), jpegOut.size());
+        Record(results[STAGE_ENCODE], start, measured);
+        if (jpegSize < 0) return false;
+
+        // The first frame is the keyframe every client starts from
+        start = Clock::now();
+        int dirty = delta.Detect(packed.data(), w * 4, hints, hintCount, f == 0);
+        Record(results[STAGE_DELTA], start, measured);
+
+        start = Clock::now();
+        size_t deltaSize = dirty > 0 ? delta.WriteRawDelta(packed.data(), w * 4, deltaOut.data()) : 0;
+        Record(results[STAGE_SERIALIZE], start, measured);
+
+        start = Clock::now();
+        int losslessSize = lossless.Encode(packed.data(), (size_t)w * 4, true, losslessOut.data(), losslessOut.size());
+        Record(results[STAGE_LOSSLESS], start, measured);
+        if (losslessSize < 0) return false;
+
+        if (measured) {
+            results[STAGE_ENCODE].bytes += (uint64_t)jpegSize;
+            results[STAGE_DELTA].dirtyTiles += (uint64_t)dirty;
+            results[STAGE_SERIALIZE].bytes += deltaSize;
+            results[STAGE_LOSSLESS].bytes += (uint64_t)losslessSize;
+        }
+    }
+
+    for (int s = 0; s < STAGE_COUNT; s++) {
+        StageResult& r = results[s];
+        LatencySnapshot snapshot;
+        r.histogram.Snapshot(&snapshot);
+        Row row;
+        row.resolution = &res;
+        row.scene = scene;
+        row.stage = s;
+        row.frames = r.frames;
+        row.meanMs = r.frames ? r.sumMs / r.frames : 0;
+        row.p50Ms = snapshot.Percentile(50) / 1000.0;
+        row.p99Ms = snapshot.Percentile(99) / 1000.0;
+        row.maxMs = snapshot.maxUs / 1000.0;
+        row.mpixPerSec = row.meanMs > 0 ? (double)w * h / (row.meanMs * 1000) : 0;
+        bool hasBytes = s == STAGE_ENCODE || s == STAGE_SERIALIZE || s == STAGE_LOSSLESS;
+        row.bytesPerFrame = hasBytes && r.frames ? (double)r.bytes / r.frames : -1;
+        row.dirtyTiles = s == STAGE_DELTA && r.frames ? (double)r.dirtyTiles / r.frames : -1;
+        rows->push_back(row);
+    }
+    return true;
+}
+
+// One synthetic scene at one size
+static bool RunCase(const Resolution& res, FrameScene scene, int frames, int warmup, int quality, JobSystem* jobs,
+                    std::vector<Row>* rows) {
+    FrameSource source;
+    if (!source.Initialize(res.width, res.height, scene)) return false;
+    return RunFrames(source, res, FrameSceneName(scene), frames, warmup, quality, jobs, rows);
+}
+
+static void PrintRow(FILE* out, const Row& row) {
+    char extra[64] = "";
+    if (row.bytesPerFrame >= 0) snprintf(extra, sizeof(extra), "%10.1f KB", row.bytesPerFrame / 1024);
+    if (row.dirtyTiles >= 0) snprintf(extra, sizeof(extra), "%8.1f tiles", row.dirtyTiles);
+    fprintf(out,"%-6s %-7s %-10s %9.3f %9.3f %9.3f %9.3f %10.0f %s\n", row.resolution->name, row.scene,
+        stageNames[row.stage], row.meanMs, row.p50Ms, row.p99Ms, row.maxMs, row.mpixPerSec, extra);
+}
+
+static const char* CompilerName() {
+#if defined(_MSC_VER)
+    static char name[32];
+    snprintf(name, sizeof(name), "msvc %d", _MSC_VER);
+    return name;
+#elif defined(__clang__)
+    return "clang " __clang_version__;
+#elif defined(__GNUC__)
+    return "gcc " __VERSION__;
+#else
+    return "unknown";
+#endif
+}
+
+static bool WriteJson(const char* path, const std::vector<Row>& rows, int frames, int warmup, int quality,
+                      int threads) {
+    FILE* f = strcmp(path, "-") == 0 ? stdout : fopen(path, "w");
+    if (!f) return false;
+    fprintf(f, "{\n");
+    fprintf(f, "  \"version\": %d,\n", BENCH_JSON_VERSION);
+    fprintf(f, "  \"unixTime\": %lld,\n", (long long)time(nullptr));
+    fprintf(f, "  \"machine\": { \"simd\": \"%s\", \"hardwareThreads\": %u, \"compiler\": \"%s\" },\n",
+        SimdLevelName(GetSimdLevel()), std::thread::hardware_concurrency(), CompilerName());
+    fprintf(f, "  \"config\": { \"frames\": %d, \"warmup\": %d, \"quality\": %d, \"poolThreads\": %d, "
+        "\"chroma\": \"4:2:0\", \"scale\": 0.5, \"tileSize\": %d },\n", frames, warmup, quality, threads,
+        DELTA_TILE_SIZE);
+    fprintf(f, "  \"results\": [\n");
+    for (size_t i = 0; i < rows.size(); i++) {
+        const Row& r = rows[i];
+        fprintf(f, "    { \"resolution\": \"%s\", \"width\": %u, \"height\": %u, \"scene\": \"%s\", \"stage\": \"%s\", "
+            "\"frames\": %llu, \"meanMs\": %.4f, \"p50Ms\": %.3f, \"p99Ms\": %.3f, \"maxMs\": %.3f, "
+            "\"mpixPerSec\": %.1f", r.resolution->name, r.resolution->width, r.resolution->height,
+            r.scene, stageNames[r.stage], (unsigned long long)r.frames, r.meanMs, r.p50Ms, r.p99Ms,
+            r.maxMs, r.mpixPerSec);
+        if (r.bytesPerFrame >= 0) fprintf(f, ", \"bytesPerFrame\": %.0f", r.bytesPerFrame);
+        if (r.dirtyTiles >= 0) fprintf(f, ", \"dirtyTiles\": %.1f", r.dirtyTiles);
+        fprintf(f, " }%s\n", i + 1 < rows.size() ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+    if (f != stdout) fclose(f);
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    const char* sizes = nullptr;
+    const char* scenes = nullptr;
+    const char* jsonPath = nullptr;
+    const char* replayPath = nullptr;
+    bool realtime = false;
+    int frames = 30;
+    int warmup = 3;
+    int quality = 70;
+    int threads = JobSystem::DefaultWorkerCount();
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--sizes") == 0 && i + 1 < argc) sizes = argv[++i];
+        else if (strcmp(argv[i], "--scenes") == 0 && i + 1 < argc) scenes = argv[++i];
+        else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) frames = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--warmup") == 0 && i + 1 < argc) warmup = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--quality") == 0 && i + 1 < argc) quality = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) jsonPath = argv[++i];
+        else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) replayPath = argv[++i];
+        else if (strcmp(argv[i], "--realtime") == 0) realtime = true;
+        else {
+            printf("Unknown option: %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (frames < 1) frames = 1;
+    if (warmup < 0) warmup = 0;
+    if (threads < 0) threads = 0;
+    if (quality < 1 || quality > 100) quality = 70;
+
+    // With the JSON on stdout the table goes to stderr
+    FILE* table = jsonPath && strcmp(jsonPath, "-") == 0 ? stderr : stdout;
+    fprintf(table, "Pipeline benchmark: %d frames (+%d warmup) per case, pool threads %d, SIMD %s, quality %d\n",
+        frames, warmup, threads, SimdLevelName(GetSimdLevel()), quality);
+    fprintf(table, "%-6s %-7s %-10s %9s %9s %9s %9s %10s %s\n", "size", "scene", "stage", "mean ms", "p50 ms",
+        "p99 ms", "max ms", "MPix/s", "output");
+    fflush(table);
+
+    JobSystem jobs;
+    jobs.Start(threads);
+    std::vector<Row> rows;
+
+    CaptureFileReader replay;
+    static Resolution replaySize = { "replay", 0, 0 };
+    if (replayPath) {
+        if (!replay.Open(replayPath)) {
+            fprintf(table, "Can't open recording %s\n", replayPath);
+            return 1;
+        }
+        replay.SetJobSystem(&jobs);
+        replay.SetRealtime(realtime);
+        replaySize.width = replay.GetWidth();
+        replaySize.height = replay.GetHeight();
+        fprintf(table, "Replaying %s: %ux%u, %u frames over %.1f s, %s%s%s\n", replayPath, replay.GetWidth(),
+            replay.GetHeight(), replay.GetFrameCount(), replay.GetDurationUs() / 1e6, CaptureCodecName(replay.GetCodec()),
+            replay.IsComplete() ? "" : ", index rebuilt", realtime ? ", realtime" : "");
+        if (!RunFrames(replay, replaySize, "replay", frames, warmup, quality, &jobs, &rows)) {
+            fprintf(table, "%s: setup, decode or encode failed\n", replayPath);
+            return 1;
+        }
+        for (const Row& row : rows) PrintRow(table, row);
+    }
+    for (int r = 0; r < resolutionCount && !replayPath; r++) {
+        if (!Selected(sizes, resolutions[r].name)) continue;
+        for (int s = 0; s < SCENE_COUNT; s++) {
+            if (!Selected(scenes, FrameSceneName((FrameScene)s))) continue;
+            size_t first = rows.size();
+            if (!RunCase(resolutions[r], (FrameScene)s, frames, warmup, quality, &jobs, &rows)) {
+                fprintf(table, "%s %s: setup or encode failed\n", resolutions[r].name, FrameSceneName((FrameScene)s));
+                return 1;
+            }
+            for (size_t i = first; i < rows.size(); i++) PrintRow(table, rows[i]);
+            fflush(table);
+        }
+    }
+    jobs.Stop();
+
+    if (rows.empty()) {
+        fprintf(table, "Nothing selected (sizes: 720p,1080p,1440p,4k; scenes: static,needle,scroll,motion,noise)\n");
+        return 1;
+    }
+    if (jsonPath && !WriteJson(jsonPath, rows, frames, warmup, quality, threads)) {
+        fprintf(table, "Failed to write %s\n", jsonPath);
+        return 1;
+    }
+    if (jsonPath && table == stdout) printf("Results written to %s\n", jsonPath);
+    return 0;
+}
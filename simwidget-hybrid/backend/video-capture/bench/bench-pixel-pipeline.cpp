@@ -0,0 +1,269 @@
+// Pixel pipeline benchmark - fused single pass vs the separate passes
+// Feeds synthetic frames (bench/frame-source.h, padded pitch) through the
+// capture-side pixel work two ways and reports time and memory traffic:
+//   multi - what the services did before common/pixel-pipeline.h: strip the
+//           pitch (FrameScaler::Scale, a plain row copy at scale 1), then
+//           TileDelta::Detect over the packed frame, then ConvertBgraToYCbCr
+//           over it again; each pass on the pool like the services run it
+//   fused - PixelPipeline::Run doing the same stages in one pass
+// Stage sets:
+//   delta - scale + tile hash, keeping BGRA (raw / delta channels)
+//   jpeg  - scale + YCbCr 4:2:0 into MCU-padded planes, no BGRA kept
+//   all   - scale + tile hash + YCbCr, keeping BGRA
+// Traffic is modeled, not measured: every pass counts the bytes it reads and
+// writes once (source frame, packed BGRA, planes), so "MB/frame" shows what
+// fusing removes and "GB/s" is that model over the measured time. Every
+// tile is hashed (no dirty-rect hints) so both paths do the same work.
+//
+// Compile: g++ -O2 -std=c++17 -pthread bench/bench-pixel-pipeline.cpp -o bin/bench-pixel-pipeline
+//     or:  cl /EHsc /O2 /Fe:bin\bench-pixel-pipeline.exe bench\bench-pixel-pipeline.cpp
+// Usage:   bench-pixel-pipeline [--sizes 1080p,4k] [--scales 1,0.75,0.5] [--stages delta,jpeg,all]
+//                               [--scene motion] [--frames N] [--warmup N] [--threads N]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+#include "../common/color-convert.h"
+#include "../common/frame-scaler.h"
+#include "../common/job-system.h"
+#include "../common/jpeg-encoder.h"
+#include "../common/latency-histogram.h"
+#include "../common/pixel-pipeline.h"
+#include "../common/tile-delta.h"
+#include "frame-source.h"
+
+struct Resolution {
+    const char* name;
+    uint32_t width, height;
+};
+
+static const Resolution resolutions[] = {
+    { "720p", 1280, 720 },
+    { "1080p", 1920, 1080 },
+    { "1440p", 2560, 1440 },
+    { "4k", 3840, 2160 },
+};
+static const int resolutionCount = sizeof(resolutions) / sizeof(resolutions[0]);
+
+enum StageSet {
+    STAGES_DELTA,
+    STAGES_JPEG,
+    STAGES_ALL,
+    STAGES_COUNT
+};
+static const char* const stageSetNames[STAGES_COUNT] = { "delta", "jpeg", "all" };
+
+static bool KeepsBgra(int set) { return set != STAGES_JPEG; }
+static bool Hashes(int set) { return set != STAGES_JPEG; }
+static bool Converts(int set) { return set != STAGES_DELTA; }
+
+struct PathResult {
+    LatencyHistogram histogram;
+    double sumMs = 0;
+    uint64_t frames = 0;
+    double bytesPerFrame = 0;    // Modeled memory traffic
+    int dirtyTiles = 0;          // Last frame, to show both paths agree
+};
+
+typedef std::chrono::steady_clock Clock;
+
+static double MsSince(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+static void Record(PathResult& r, Clock::time_point start, bool measured) {
+    double ms = MsSince(start);
+    if (!measured) return;
+    r.histogram.Record((uint64_t)(ms * 1000 + 0.5));
+    r.sumMs += ms;
+    r.frames++;
+}
+
+// True if name is in the comma-separated list (null list = everything)
+static bool Selected(const char* list, const char* name) {
+    if (!list) return true;
+    size_t length = strlen(name);
+    for (const char* p = list; *p; ) {
+        const char* end = strchr(p, ',');
+        size_t n = end ? (size_t)(end - p) : strlen(p);
+        if (n == length && strncmp(p, name, n) == 0) return true;
+        if (!end) break;
+        p = end + 1;
+    }
+    return false;
+}
+
+static void PrintResult(const Resolution& res, double scale, int set, const char* path, const PathResult& r,
+                        double baselineMs) {
+    LatencySnapshot snapshot;
+    r.histogram.Snapshot(&snapshot);
+    double meanMs = r.frames ? r.sumMs / r.frames : 0;
+    double gbPerSec = meanMs > 0 ? r.bytesPerFrame / (meanMs * 1e6) : 0;
+    char speedup[16] = "";
+    if (baselineMs > 0 && meanMs > 0) snprintf(speedup, sizeof(speedup), "%.2fx", baselineMs / meanMs);
+    printf("%-6s %5.2f %-6s %-6s %9.3f %9.3f %10.1f %8.2f %8d %s\n", res.name, scale, stageSetNames[set], path,
+        meanMs, snapshot.Percentile(99) / 1000.0, r.bytesPerFrame / (1024.0 * 1024.0), gbPerSec, r.dirtyTiles,
+        speedup);
+}
+
+// Both paths over warmup + frames frames of one size, scale and stage set
+static bool RunCase(const Resolution& res, double scale, int set, FrameScene scene, int frames, int warmup,
+                    JobSystem* jobs) {
+    FrameSource source;
+    if (!source.Initialize(res.width, res.height, scene)) return false;
+    uint32_t w = ScaledSize(res.width, scale), h = ScaledSize(res.height, scale);
+    size_t srcBytes = (size_t)res.width * res.height * 4;
+    size_t bgraBytes = (size_t)w * h * 4;
+
+    // Multi-pass: scaler into packed BGRA, then detect and convert over it
+    FrameScaler scaler;
+    if (!scaler.Configure(res.width, res.height, w, h)) return false;
+    scaler.SetJobSystem(jobs);
+    std::vector<uint8_t> packed(bgraBytes);
+    TileDelta multiTiles;
+    if (!multiTiles.Initialize(w, h)) return false;
+    YCbCrPlanes multiPlanes;
+    size_t planeBytes = JpegFramePlanes(w, h, CHROMA_420, nullptr, &multiPlanes);
+    std::vector<uint8_t> multiPlaneBuffer(planeBytes);
+    JpegFramePlanes(w, h, CHROMA_420, multiPlaneBuffer.data(), &multiPlanes);
+
+    // Fused: one pass into its own outputs
+    PixelPipeline pipeline;
+    if (!pipeline.Configure(res.width, res.height, w, h)) return false;
+    pipeline.SetJobSystem(jobs);
+    std::vector<uint8_t> fusedBgra(bgraBytes);
+    TileDelta fusedTiles;
+    if (!fusedTiles.Initialize(w, h)) return false;
+    std::vector<uint8_t> fusedPlaneBuffer(planeBytes);
+    PixelTargets targets;
+    if (KeepsBgra(set)) {
+        targets.bgra = fusedBgra.data();
+        targets.bgraStride = (size_t)w * 4;
+    }
+    if (Hashes(set)) targets.tiles = &fusedTiles;
+    if (Converts(set)) {
+        JpegFramePlanes(w, h, CHROMA_420, fusedPlaneBuffer.data(), &targets.planes, &targets.paddedWidth,
+            &targets.paddedHeight);
+        targets.subsampling = CHROMA_420;
+    }
+
+    // Conversion in the encoder's MCU-row bands (even rows for 4:2:0)
+    uint32_t bands = (h + PIPELINE_BAND_ROWS - 1) / PIPELINE_BAND_ROWS;
+    auto convert = [&](uint32_t begin, uint32_t end) {
+        for (uint32_t b = begin; b < end; b++) {
+            uint32_t y = b * PIPELINE_BAND_ROWS;
+            uint32_t rows = std::min<uint32_t>(PIPELINE_BAND_ROWS, h - y);
+            YCbCrPlanes strip = multiPlanes;
+            strip.y += (size_t)y * multiPlanes.yStride;
+            strip.cb += (size_t)(y / 2) * multiPlanes.cStride;
+            strip.cr += (size_t)(y / 2) * multiPlanes.cStride;
+            ConvertBgraToYCbCr(&packed[(size_t)y * w * 4], w * 4, w, rows, CHROMA_420, strip);
+        }
+    };
+
+    // Modeled traffic per frame (see the header comment)
+    size_t yuvBytes = (size_t)w * h + 2 * (size_t)ChromaWidth(w, CHROMA_420) * ChromaHeight(h, CHROMA_420);
+    PathResult multi, fused;
+    multi.bytesPerFrame = (double)(srcBytes + bgraBytes);
+    if (Hashes(set)) multi.bytesPerFrame += (double)bgraBytes;
+    if (Converts(set)) multi.bytesPerFrame += (double)(bgraBytes + yuvBytes);
+    fused.bytesPerFrame = (double)srcBytes;
+    if (KeepsBgra(set)) fused.bytesPerFrame += (double)bgraBytes;
+    if (Converts(set)) fused.bytesPerFrame += (double)yuvBytes;
+
+    for (int f = 0; f < warmup + frames; f++) {
+        const uint8_t* src = source.Next();
+        uint32_t stride = source.GetStride();
+        bool measured = f >= warmup;
+
+        auto start = Clock::now();
+        scaler.Scale(src, stride, packed.data(), (size_t)w * 4);
+        if (Hashes(set)) multi.dirtyTiles = multiTiles.Detect(packed.data(), w * 4, nullptr, -1, f == 0);
+        if (Converts(set)) jobs->ParallelFor(bands, 1, convert);
+        Record(multi, start, measured);
+
+        start = Clock::now();
+        int dirty = pipeline.Run(src, stride, targets, nullptr, -1, f == 0);
+        Record(fused, start, measured);
+        if (dirty < 0) return false;
+        fused.dirtyTiles = dirty;
+    }
+
+    PrintResult(res, scale, set, "multi", multi, 0);
+    PrintResult(res, scale, set, "fused", fused, multi.frames ? multi.sumMs / multi.frames : 0);
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    const char* sizes = "1080p,4k";
+    const char* scales = "1,0.75,0.5";
+    const char* stages = nullptr;
+    const char* sceneName = "motion";
+    int frames = 30;
+    int warmup = 3;
+    int threads = JobSystem::DefaultWorkerCount();
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--sizes") == 0 && i + 1 < argc) sizes = argv[++i];
+        else if (strcmp(argv[i], "--scales") == 0 && i + 1 < argc) scales = argv[++i];
+        else if (strcmp(argv[i], "--stages") == 0 && i + 1 < argc) stages = argv[++i];
+        else if (strcmp(argv[i], "--scene") == 0 && i + 1 < argc) sceneName = argv[++i];
+        else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) frames = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--warmup") == 0 && i + 1 < argc) warmup = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) threads = atoi(argv[++i]);
+        else {
+            printf("Unknown option: %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (frames < 1) frames = 1;
+    if (warmup < 0) warmup = 0;
+    if (threads < 0) threads = 0;
+
+    FrameScene scene = SCENE_COUNT;
+    for (int s = 0; s < SCENE_COUNT; s++) {
+        if (strcmp(sceneName, FrameSceneName((FrameScene)s)) == 0) scene = (FrameScene)s;
+    }
+    if (scene == SCENE_COUNT) {
+        printf("Unknown scene: %s (static,needle,scroll,motion,noise)\n", sceneName);
+        return 1;
+    }
+
+    printf("Pixel pipeline benchmark: %s scene, %d frames (+%d warmup) per case, pool threads %d, SIMD %s\n",
+        sceneName, frames, warmup, threads, SimdLevelName(GetSimdLevel()));
+    printf("%-6s %5s %-6s %-6s %9s %9s %10s %8s %8s %s\n", "size", "scale", "stages", "path", "mean ms", "p99 ms",
+        "MB/frame", "GB/s", "dirty", "speedup");
+    fflush(stdout);
+
+    JobSystem jobs;
+    jobs.Start(threads);
+    int cases = 0;
+    for (int r = 0; r < resolutionCount; r++) {
+        if (!Selected(sizes, resolutions[r].name)) continue;
+        for (const char* p = scales; *p; ) {
+            double scale = atof(p);
+            if (scale > 0 && scale <= 1) {
+                for (int set = 0; set < STAGES_COUNT; set++) {
+                    if (!Selected(stages, stageSetNames[set])) continue;
+                    if (!RunCase(resolutions[r], scale, set, scene, frames, warmup, &jobs)) {
+                        printf("%s %.2f %s: setup failed\n", resolutions[r].name, scale, stageSetNames[set]);
+                        return 1;
+                    }
+                    cases++;
+                    fflush(stdout);
+                }
+            }
+            const char* comma = strchr(p, ',');
+            if (!comma) break;
+            p = comma + 1;
+        }
+    }
+    jobs.Stop();
+
+    if (cases == 0) {
+        printf("Nothing selected (sizes: 720p,1080p,1440p,4k; scales: 0-1; stages: delta,jpeg,all)\n");
+        return 1;
+    }
+    return 0;
+}
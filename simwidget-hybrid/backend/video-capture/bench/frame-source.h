@@ -0,0 +1,327 @@
+// Frame Source - synthetic desktop frames for benchmarks and tests
+// Stands in for Desktop Duplication off Windows: every Next() renders the
+// next frame of a scene into a BGRA buffer with a GPU-like padded pitch and
+// reports DXGI-style dirty rects for it. Scenes cover the workloads the
+// capture services see:
+//   static  - cockpit panel, nothing changes (dirty rect count 0)
+//   needle  - the same panel with gauge needles creeping a little per frame
+//   scroll  - a moving map scrolling diagonally in its panel
+//   motion  - full-screen pan with changing lighting (every pixel changes)
+//   noise   - random pixels, worst case for every codec
+// Output is deterministic for a given size, scene and frame number.
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include "../common/tile-delta.h"
+
+#define FRAME_SOURCE_PITCH_ALIGN 256   // Row pitch alignment, as DXGI staging textures
+#define FRAME_SOURCE_MAP_SIZE 1024     // Tileable map texture (power of two)
+#define FRAME_SOURCE_GAUGES 6
+
+enum FrameScene {
+    SCENE_STATIC = 0,
+    SCENE_NEEDLE = 1,
+    SCENE_SCROLL = 2,
+    SCENE_MOTION = 3,
+    SCENE_NOISE = 4,
+    SCENE_COUNT = 5
+};
+
+inline const char* FrameSceneName(FrameScene scene) {
+    switch (scene) {
+        case SCENE_STATIC: return "static";
+        case SCENE_NEEDLE: return "needle";
+        case SCENE_SCROLL: return "scroll";
+        case SCENE_MOTION: return "motion";
+        case SCENE_NOISE: return "noise";
+        default: return "unknown";
+    }
+}
+
+// Pixels the scroll scene moves per frame
+#define FRAME_SOURCE_SCROLL_X 3
+#define FRAME_SOURCE_SCROLL_Y 2
+
+class FrameSource {
+private:
+    uint32_t width = 0, height = 0, stride = 0;
+    FrameScene scene = SCENE_STATIC;
+    uint64_t frame = 0;
+    uint32_t rng = 1;
+    std::vector<uint8_t> base;      // Cockpit panel without needles
+    std::vector<uint8_t> pixels;    // Current frame
+    std::vector<uint8_t> map;       // FRAME_SOURCE_MAP_SIZE^2 BGRA, wraps both ways
+    std::vector<TileRect> dirty;
+    std::vector<double> sinX, cosX; // Motion lighting, per column
+    TileRect mapRect = {};
+    TileRect gauges[FRAME_SOURCE_GAUGES] = {};
+
+    uint32_t Random() {
+        rng ^= rng << 13;
+        rng ^= rng >> 17;
+        rng ^= rng << 5;
+        return rng;
+    }
+
+    static void Put(uint8_t* p, uint8_t b, uint8_t g, uint8_t r) {
+        p[0] = b;
+        p[1] = g;
+        p[2] = r;
+        p[3] = 255;
+    }
+
+    uint8_t* At(std::vector<uint8_t>& image, int32_t x, int32_t y) { return &image[(size_t)y * stride + (size_t)x * 4]; }
+
+    void FillRect(std::vector<uint8_t>& image, int32_t x0, int32_t y0, int32_t x1, int32_t y1,
+                  uint8_t b, uint8_t g, uint8_t r) {
+        x0 = x0 < 0 ? 0 : x0;
+        y0 = y0 < 0 ? 0 : y0;
+        x1 = x1 > (int32_t)width ? (int32_t)width : x1;
+        y1 = y1 > (int32_t)height ? (int32_t)height : y1;
+        for (int32_t y = y0; y < y1; y++) {
+            for (int32_t x = x0; x < x1; x++) Put(At(image, x, y), b, g, r);
+        }
+    }
+
+    // Thick line as a run of small squares
+    void DrawLine(std::vector<uint8_t>& image, double x0, double y0, double x1, double y1, int thickness,
+                  uint8_t b, uint8_t g, uint8_t r) {
+        double length = sqrt((x1 - x0) * (x1 - x0) + (y1 - y0) * (y1 - y0));
+        int steps = (int)length + 1;
+        for (int i = 0; i <= steps; i++) {
+            int32_t x = (int32_t)(x0 + (x1 - x0) * i / steps);
+            int32_t y = (int32_t)(y0 + (y1 - y0) * i / steps);
+            FillRect(image, x - thickness / 2, y - thickness / 2, x + (thickness + 1) / 2, y + (thickness + 1) / 2,
+                b, g, r);
+        }
+    }
+
+    // Smooth value noise over the wrapping map lattice
+    static double Lattice(uint32_t x, uint32_t y, uint32_t period, uint32_t seed) {
+        x %= period;
+        y %= period;
+        uint32_t h = x * 374761393u + y * 668265263u + seed * 2246822519u;
+        h = (h ^ (h >> 13)) * 1274126177u;
+        return ((h ^ (h >> 16)) & 0xFFFF) / 65535.0;
+    }
+
+    static double ValueNoise(double x, double y, uint32_t cell, uint32_t seed) {
+        uint32_t period = FRAME_SOURCE_MAP_SIZE / cell;
+        double fx = x / cell, fy = y / cell;
+        uint32_t ix = (uint32_t)fx, iy = (uint32_t)fy;
+        double tx = fx - ix, ty = fy - iy;
+        tx = tx * tx * (3 - 2 * tx);
+        ty = ty * ty * (3 - 2 * ty);
+        double a = Lattice(ix, iy, period, seed), b = Lattice(ix + 1, iy, period, seed);
+        double c = Lattice(ix, iy + 1, period, seed), d = Lattice(ix + 1, iy + 1, period, seed);
+        return (a + (b - a) * tx) * (1 - ty) + (c + (d - c) * tx) * ty;
+    }
+
+    // Terrain with water, roads and labels; tiles seamlessly
+    void BuildMap() {
+        const uint32_t size = FRAME_SOURCE_MAP_SIZE;
+        map.resize((size_t)size * size * 4);
+        for (uint32_t y = 0; y < size; y++) {
+            for (uint32_t x = 0; x < size; x++) {
+                double h = 0.5 * ValueNoise(x, y, 256, 1) + 0.25 * ValueNoise(x, y, 64, 2) +
+                           0.15 * ValueNoise(x, y, 16, 3) + 0.1 * ValueNoise(x, y, 4, 4);
+                uint8_t* p = &map[((size_t)y * size + x) * 4];
+                if (h < 0.42) Put(p, (uint8_t)(150 + 200 * h), (uint8_t)(90 + 100 * h), 40);
+                else if (h < 0.62) Put(p, (uint8_t)(50 + 60 * h), (uint8_t)(110 + 120 * h), (uint8_t)(60 + 60 * h));
+                else Put(p, (uint8_t)(60 + 80 * h), (uint8_t)(100 + 90 * h), (uint8_t)(120 + 120 * h));
+                if (x % 128 < 3 || y % 160 < 2) Put(p, 40, 170, 230);   // Roads
+            }
+        }
+        for (int i = 0; i < 60; i++) {
+            // Labels: dark blocks with light "glyph" columns
+            uint32_t lx = Random() % size, ly = Random() % size;
+            for (uint32_t y = 0; y < 12; y++) {
+                for (uint32_t x = 0; x < 64; x++) {
+                    uint8_t* p = &map[(((ly + y) % size) * size + (lx + x) % size) * 4];
+                    bool glyph = y > 2 && y < 10 && (x % 6) < 3 && ((x * 7 + y * 3 + i) % 5) != 0;
+                    Put(p, glyph ? 230 : 20, glyph ? 230 : 20, glyph ? 230 : 20);
+                }
+            }
+        }
+    }
+
+    // Map texture at offset (ox, oy) into rect of image
+    void BlitMap(std::vector<uint8_t>& image, const TileRect& rect, uint32_t ox, uint32_t oy) {
+        const uint32_t size = FRAME_SOURCE_MAP_SIZE;
+        for (int32_t y = rect.top; y < rect.bottom; y++) {
+            const uint8_t* row = &map[(size_t)((oy + y - rect.top) & (size - 1)) * size * 4];
+            uint32_t x = 0, w = (uint32_t)(rect.right - rect.left);
+            while (x < w) {
+                uint32_t sx = (ox + x) & (size - 1);
+                uint32_t run = size - sx < w - x ? size - sx : w - x;
+                memcpy(At(image, rect.left + (int32_t)x, y), row + sx * 4, (size_t)run * 4);
+                x += run;
+            }
+        }
+    }
+
+    void DrawGauge(std::vector<uint8_t>& image, const TileRect& r) {
+        double cx = (r.left + r.right) / 2.0, cy = (r.top + r.bottom) / 2.0;
+        double radius = (r.right - r.left) / 2.0 - 2;
+        for (int32_t y = r.top; y < r.bottom; y++) {
+            for (int32_t x = r.left; x < r.right; x++) {
+                double d = sqrt((x - cx) * (x - cx) + (y - cy) * (y - cy));
+                if (d > radius) continue;
+                if (d > radius - 4) Put(At(image, x, y), 200, 200, 200);
+                else Put(At(image, x, y), (uint8_t)(25 + d * 10 / radius), 22, 20);
+            }
+        }
+        for (int tick = 0; tick < 12; tick++) {
+            double a = tick * 3.14159265 / 6;
+            DrawLine(image, cx + cos(a) * radius * 0.78, cy + sin(a) * radius * 0.78,
+                cx + cos(a) * radius * 0.92, cy + sin(a) * radius * 0.92, 2, 240, 240, 240);
+        }
+    }
+
+    void BuildPanel() {
+        // Dark panel with a vertical gradient, frame lines and text-like labels
+        for (uint32_t y = 0; y < height; y++) {
+            uint8_t shade = (uint8_t)(30 + 20 * y / height);
+            for (uint32_t x = 0; x < width; x++) Put(At(base, x, y), shade, shade, (uint8_t)(shade + 4));
+        }
+        for (uint32_t x = 0; x < width; x += width / 8) FillRect(base, x, 0, x + 2, height, 70, 70, 74);
+        for (uint32_t y = 0; y < height; y += height / 6) FillRect(base, 0, y, width, y + 2, 70, 70, 74);
+
+        // Gauges in a 3 x 2 grid on the left, map panel on the right
+        int32_t cell = (int32_t)(height * 0.7 / 2);
+        if (cell * 3 > (int32_t)(width * 0.55)) cell = (int32_t)(width * 0.55 / 3);
+        for (int i = 0; i < FRAME_SOURCE_GAUGES; i++) {
+            int32_t x = 8 + (i % 3) * cell, y = 8 + (i / 3) * cell;
+            gauges[i] = { x + 4, y + 4, x + cell - 4, y + cell - 4 };
+            DrawGauge(base, gauges[i]);
+        }
+        mapRect = { (int32_t)(width * 0.58), 8, (int32_t)width - 8, (int32_t)(height * 0.72) };
+
+        // Label rows along the bottom
+        for (int32_t y = (int32_t)(height * 0.76); y + 14 < (int32_t)height; y += 22) {
+            for (int32_t x = 12; x + 120 < (int32_t)width; x += 160) {
+                FillRect(base, x, y, x + 120, y + 14, 15, 15, 15);
+                for (int32_t gx = x + 3; gx < x + 117; gx += 7) {
+                    if ((Random() & 3) == 0) continue;
+                    FillRect(base, gx, y + 3, gx + 4, y + 11, 90, 230, 120);
+                }
+            }
+        }
+    }
+
+    void Needle(const TileRect& r, int index, double angle) {
+        double cx = (r.left + r.right) / 2.0, cy = (r.top + r.bottom) / 2.0;
+        double radius = (r.right - r.left) / 2.0 - 2;
+        DrawLine(pixels, cx, cy, cx + cos(angle) * radius * 0.75, cy + sin(angle) * radius * 0.75, 4,
+            index % 2 ? 40 : 30, index % 2 ? 200 : 120, 250);
+        FillRect(pixels, (int32_t)cx - 5, (int32_t)cy - 5, (int32_t)cx + 5, (int32_t)cy + 5, 180, 180, 180);
+    }
+
+    double NeedleAngle(int index, uint64_t n) const {
+        return -1.2 + index * 0.7 + sin((double)n * 0.02 * (index + 1)) * 0.8;
+    }
+
+    void CopyRect(const std::vector<uint8_t>& from, const TileRect& r) {
+        for (int32_t y = r.top; y < r.bottom; y++) {
+            size_t offset = (size_t)y * stride + (size_t)r.left * 4;
+            memcpy(&pixels[offset], &from[offset], (size_t)(r.right - r.left) * 4);
+        }
+    }
+
+public:
+    bool Initialize(uint32_t frameWidth, uint32_t frameHeight, FrameScene frameScene) {
+        if (frameWidth < 64 || frameHeight < 64 || frameScene < 0 || frameScene >= SCENE_COUNT) return false;
+        width = frameWidth;
+        height = frameHeight;
+        stride = (width * 4 + FRAME_SOURCE_PITCH_ALIGN - 1) / FRAME_SOURCE_PITCH_ALIGN * FRAME_SOURCE_PITCH_ALIGN;
+        scene = frameScene;
+        frame = 0;
+        rng = 0x9E3779B9u;
+        base.assign((size_t)stride * height, 0);
+        BuildMap();
+        BuildPanel();
+        BlitMap(base, mapRect, 0, 0);
+        pixels = base;
+        dirty.reserve(FRAME_SOURCE_GAUGES);   // Keeps GetDirtyRects() non-null
+        sinX.resize(width);
+        cosX.resize(width);
+        for (uint32_t x = 0; x < width; x++) {
+            sinX[x] = sin(x * 0.004);
+            cosX[x] = cos(x * 0.004);
+        }
+        for (int i = 0; i < FRAME_SOURCE_GAUGES; i++) Needle(gauges[i], i, NeedleAngle(i, 0));
+        return true;
+    }
+
+    // Render the next frame. Returns the pixels (GetStride() bytes per row),
+    // valid until the next call.
+    const uint8_t* Next() {
+        frame++;
+        dirty.clear();
+        TileRect full = { 0, 0, (int32_t)width, (int32_t)height };
+        switch (scene) {
+            case SCENE_STATIC:
+                break;
+            case SCENE_NEEDLE:
+                for (int i = 0; i < FRAME_SOURCE_GAUGES; i++) {
+                    CopyRect(base, gauges[i]);
+                    Needle(gauges[i], i, NeedleAngle(i, frame));
+                    dirty.push_back(gauges[i]);
+                }
+                break;
+            case SCENE_SCROLL:
+                BlitMap(pixels, mapRect, (uint32_t)(frame * FRAME_SOURCE_SCROLL_X),
+                    (uint32_t)(frame * FRAME_SOURCE_SCROLL_Y));
+                dirty.push_back(mapRect);
+                break;
+            case SCENE_MOTION: {
+                BlitMap(pixels, full, (uint32_t)(frame * 11), (uint32_t)(frame * 5));
+                // Lighting sweeps across the view so no two frames are a pure shift:
+                // 24 * sin(x * 0.004 + y * 0.003 + phase), split per row and column
+                double phase = frame * 0.05;
+                for (uint32_t y = 0; y < height; y++) {
+                    uint8_t* p = &pixels[(size_t)y * stride];
+                    double sinY = 24 * sin(y * 0.003 + phase), cosY = 24 * cos(y * 0.003 + phase);
+                    for (uint32_t x = 0; x < width; x++, p += 4) {
+                        int light = (int)(sinX[x] * cosY + cosX[x] * sinY);
+                        for (int c = 0; c < 3; c++) {
+                            int v = p[c] + light;
+                            p[c] = (uint8_t)(v < 0 ? 0 : (v > 255 ? 255 : v));
+                        }
+                    }
+                }
+                dirty.push_back(full);
+                break;
+            }
+            case SCENE_NOISE:
+                for (uint32_t y = 0; y < height; y++) {
+                    uint32_t* row = (uint32_t*)&pixels[(size_t)y * stride];
+                    for (uint32_t x = 0; x < width; x++) row[x] = Random() | 0xFF000000u;
+                }
+                dirty.push_back(full);
+                break;
+            default:
+                break;
+        }
+        return pixels.data();
+    }
+
+    // DXGI-style dirty rects of the last Next() (count 0 = nothing changed).
+    // Never null, so it can go straight to TileDelta::Detect() as hints.
+    const TileRect* GetDirtyRects(int* count) const {
+        *count = (int)dirty.size();
+        return dirty.data();
+    }
+
+    const uint8_t* GetPixels() const { return pixels.data(); }
+    uint32_t GetWidth() const { return width; }
+    uint32_t GetHeight() const { return height; }
+    uint32_t GetStride() const { return stride; }
+    uint64_t GetFrameNumber() const { return frame; }
+    FrameScene GetScene() const { return scene; }
+    const TileRect& GetMapRect() const { return mapRect; }
+};
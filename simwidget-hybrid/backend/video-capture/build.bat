@@ -39,7 +39,7 @@ if not exist "bin" mkdir bin
 REM Build TCP Capture Service (Raw)
 echo.
 echo Building TCP Capture Service (Raw)...
-cl /EHsc /O2 /Fe:bin\capture-service.exe capture-service.cpp /link d3d11.lib dxgi.lib ole32.lib ws2_32.lib
+cl /EHsc /O2 /Fe:bin\capture-service.exe capture-service.cpp /link d3d11.lib dxgi.lib ole32.lib ws2_32.lib winmm.lib
 if %errorlevel% neq 0 (
     echo FAILED: capture-service.exe
 ) else (
@@ -49,7 +49,7 @@ if %errorlevel% neq 0 (
 REM Build TCP Capture Service (JPEG)
 echo.
 echo Building TCP Capture Service (JPEG)...
-cl /EHsc /O2 /Fe:bin\capture-jpeg.exe capture-service-jpeg.cpp /link d3d11.lib dxgi.lib ole32.lib oleaut32.lib ws2_32.lib windowscodecs.lib
+cl /EHsc /O2 /Fe:bin\capture-jpeg.exe capture-service-jpeg.cpp /link d3d11.lib dxgi.lib ole32.lib oleaut32.lib ws2_32.lib windowscodecs.lib winmm.lib
 if %errorlevel% neq 0 (
     echo FAILED: capture-jpeg.exe
 ) else (
@@ -59,13 +59,147 @@ if %errorlevel% neq 0 (
 REM Build Shared Memory Capture
 echo.
 echo Building Shared Memory Capture...
-cl /EHsc /O2 /Fe:bin\shm-capture.exe shm-capture\shm-capture.cpp /link d3d11.lib dxgi.lib
+cl /EHsc /O2 /Fe:bin\shm-capture.exe shm-capture\shm-capture.cpp /link d3d11.lib dxgi.lib winmm.lib
 if %errorlevel% neq 0 (
     echo FAILED: shm-capture.exe
 ) else (
     echo SUCCESS: bin\shm-capture.exe
 )
 
+REM Build portable tests (no DXGI needed)
+echo.
+echo Building tests...
+cl /EHsc /O2 /Fe:bin\test-tile-delta.exe tests\test-tile-delta.cpp
+if %errorlevel% neq 0 (
+    echo FAILED: test-tile-delta.exe
+) else (
+    echo SUCCESS: bin\test-tile-delta.exe
+)
+cl /EHsc /O2 /Fe:bin\test-color-convert.exe tests\test-color-convert.cpp
+if %errorlevel% neq 0 (
+    echo FAILED: test-color-convert.exe
+) else (
+    echo SUCCESS: bin\test-color-convert.exe
+)
+cl /EHsc /O2 /Fe:bin\test-jpeg-encoder.exe tests\test-jpeg-encoder.cpp
+if %errorlevel% neq 0 (
+    echo FAILED: test-jpeg-encoder.exe
+) else (
+    echo SUCCESS: bin\test-jpeg-encoder.exe
+)
+
+cl /EHsc /O2 /Fe:bin\test-job-system.exe tests\test-job-system.cpp
+if %errorlevel% neq 0 (
+    echo FAILED: test-job-system.exe
+) else (
+    echo SUCCESS: bin\test-job-system.exe
+)
+
+cl /EHsc /O2 /Fe:bin\test-frame-scaler.exe tests\test-frame-scaler.cpp
+if %errorlevel% neq 0 (
+    echo FAILED: test-frame-scaler.exe
+) else (
+    echo SUCCESS: bin\test-frame-scaler.exe
+)
+
+cl /EHsc /O2 /Fe:bin\test-lossless-codec.exe tests\test-lossless-codec.cpp
+if %errorlevel% neq 0 (
+    echo FAILED: test-lossless-codec.exe
+) else (
+    echo SUCCESS: bin\test-lossless-codec.exe
+)
+
+cl /EHsc /O2 /Fe:bin\test-shm-ring.exe tests\test-shm-ring.cpp
+if %errorlevel% neq 0 (
+    echo FAILED: test-shm-ring.exe
+) else (
+    echo SUCCESS: bin\test-shm-ring.exe
+)
+
+cl /EHsc /O2 /Fe:bin\test-rate-controller.exe tests\test-rate-controller.cpp
+if %errorlevel% neq 0 (
+    echo FAILED: test-rate-controller.exe
+) else (
+    echo SUCCESS: bin\test-rate-controller.exe
+)
+
+cl /EHsc /O2 /Fe:bin\test-frame-pacer.exe tests\test-frame-pacer.cpp
+if %errorlevel% neq 0 (
+    echo FAILED: test-frame-pacer.exe
+) else (
+    echo SUCCESS: bin\test-frame-pacer.exe
+)
+
+cl /EHsc /O2 /Fe:bin\test-latency-histogram.exe tests\test-latency-histogram.cpp
+if %errorlevel% neq 0 (
+    echo FAILED: test-latency-histogram.exe
+) else (
+    echo SUCCESS: bin\test-latency-histogram.exe
+)
+
+cl /EHsc /O2 /Fe:bin\test-broadcast-server.exe tests\test-broadcast-server.cpp
+if %errorlevel% neq 0 (
+    echo FAILED: test-broadcast-server.exe
+) else (
+    echo SUCCESS: bin\test-broadcast-server.exe
+)
+
+cl /EHsc /O2 /Fe:bin\test-wire-protocol.exe tests\test-wire-protocol.cpp
+if %errorlevel% neq 0 (
+    echo FAILED: test-wire-protocol.exe
+) else (
+    echo SUCCESS: bin\test-wire-protocol.exe
+)
+
+cl /EHsc /O2 /Fe:bin\test-websocket.exe tests\test-websocket.cpp
+if %errorlevel% neq 0 (
+    echo FAILED: test-websocket.exe
+) else (
+    echo SUCCESS: bin\test-websocket.exe
+)
+
+cl /EHsc /O2 /Fe:bin\test-capture-file.exe tests\test-capture-file.cpp
+if %errorlevel% neq 0 (
+    echo FAILED: test-capture-file.exe
+) else (
+    echo SUCCESS: bin\test-capture-file.exe
+)
+
+cl /EHsc /O2 /Fe:bin\test-pixel-pipeline.exe tests\test-pixel-pipeline.cpp
+if %errorlevel% neq 0 (
+    echo FAILED: test-pixel-pipeline.exe
+) else (
+    echo SUCCESS: bin\test-pixel-pipeline.exe
+)
+
+cl /EHsc /O2 /Fe:bin\test-move-detect.exe tests\test-move-detect.cpp
+if %errorlevel% neq 0 (
+    echo FAILED: test-move-detect.exe
+) else (
+    echo SUCCESS: bin\test-move-detect.exe
+)
+
+cl /EHsc /O2 /Fe:bin\test-tile-codec.exe tests\test-tile-codec.cpp
+if %errorlevel% neq 0 (
+    echo FAILED: test-tile-codec.exe
+) else (
+    echo SUCCESS: bin\test-tile-codec.exe
+)
+
+cl /EHsc /O2 /Fe:bin\bench-pipeline.exe bench\bench-pipeline.cpp
+if %errorlevel% neq 0 (
+    echo FAILED: bench-pipeline.exe
+) else (
+    echo SUCCESS: bin\bench-pipeline.exe
+)
+
+cl /EHsc /O2 /Fe:bin\bench-pixel-pipeline.exe bench\bench-pixel-pipeline.cpp
+if %errorlevel% neq 0 (
+    echo FAILED: bench-pixel-pipeline.exe
+) else (
+    echo SUCCESS: bin\bench-pixel-pipeline.exe
+)
+
 REM Cleanup obj files
 del *.obj 2>nul
 
@@ -74,4 +208,4 @@ echo Build complete!
 echo.
 echo Run:
 echo   bin\capture-service.exe    - TCP server on port 9998
-echo   bin\shm-capture.exe [fps]  - Shared memory capture
+echo   bin\shm-capture.exe [fps] [poolThreads] [--output N] [--list-outputs]  - Shared memory capture
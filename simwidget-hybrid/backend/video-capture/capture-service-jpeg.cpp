@@ -1,6 +1,51 @@
 // High-Performance Screen Capture Service with JPEG Compression
-// Uses Windows Desktop Duplication API + WIC for JPEG encoding
+// Uses Windows Desktop Duplication API + the built-in SIMD JPEG encoder
+// (common/jpeg-encoder.h); --wic switches back to WIC for comparison
 // Target: 60+ FPS at 1920x1080
+//
+// Pipeline: capture thread -> encode workers -> sender, handing off through
+// bounded rings of preallocated slots (common/frame-ring.h). A slow stage
+// drops the oldest queued frame instead of stalling the stages before it.
+// One capture/encode feeds every connected client (common/broadcast-server.h).
+// Delta mode (--delta) encodes only the 64x64 tiles that changed since the
+// previous frame (common/tile-delta.h), each as its own small JPEG - or with
+// --tile-codecs as solid, palette or lossless where that fits its content
+// (common/tile-codec.h).
+// Row copies and full-frame JPEG bands are spread over a shared work-stealing
+// pool (common/job-system.h, --threads); output does not depend on its size.
+// --scale shrinks frames straight out of the staging texture
+// (common/frame-scaler.h), so every later stage handles fewer pixels.
+// Crop, scale, delta tile hashing and - for frames that go out whole - the
+// YCbCr conversion run as one pass over the mapped frame
+// (common/pixel-pipeline.h); the built-in encoder takes those frames as
+// planes and skips its own conversion.
+// --moves turns scrolled and panned content into copy-rect commands
+// (common/move-detect.h) in front of the tile delta, taken from DXGI's move
+// rects or found by block search; only the tiles left over are encoded.
+// --roi streams named desktop rectangles as separate channels (one port
+// each) from the same duplicated frame; only their pixels are processed.
+// The capture thread is paced to --fps deadlines (common/frame-pacer.h) and
+// grabs whatever the desktop shows at each one, so frames leave evenly spaced.
+// --target-fps / --max-kbps turn on closed-loop rate control per channel
+// (common/rate-controller.h): JPEG quality (and with --adaptive-scale the
+// output size) follows encode time, frame size and how fast clients drain.
+// Every stage is timed on the steady clock into lock-free histograms
+// (common/latency-histogram.h); press Enter for p50 / p99 / p99.9 per stage.
+// Each frame header carries its sequence number and capture timestamp so
+// clients can measure glass-to-glass latency themselves.
+// Clients speak wire protocol v2 (common/wire-protocol.h): a channel with a
+// keyframe-only client encodes keyframes only, capture runs no faster than
+// the fastest client wants, and adaptive scale stays above the clients'
+// minimum. v1 clients keep the old header.
+// --ws PORT serves each channel to browsers as WebSocket binary messages
+// (common/websocket.h) on PORT, PORT+1, ...; no bridge process needed.
+// --record FILE (or "rec FILE" / "stop" on the console) writes the captured
+// desktop region, timestamps and dirty rects to a capture file
+// (common/capture-file.h, lossless unless --record-raw) for replay.
+// --output N[:fps[:quality]] picks monitors by their --list-outputs number
+// (dxgi-outputs.h), on any adapter. Each captured output has its own
+// duplication and capture thread with its own pacing and quality, and is
+// streamed as its own channel; all of them share the encoders and pool.
 
 #define WIN32_LEAN_AND_MEAN
 #include <winsock2.h>
@@ -9,12 +54,211 @@
 #include <dxgi1_2.h>
 #include <wincodec.h>
 #include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
 #include <chrono>
-#pragma comment(lib, "ws2_32.lib")
+#include <thread>
+#include <vector>
+#include "common/broadcast-server.h"
+#include "common/capture-file.h"
+#include "common/frame-ring.h"
+#include "common/frame-pacer.h"
+#include "common/frame-scaler.h"
+#include "common/job-system.h"
+#include "common/jpeg-encoder.h"
+#include "common/latency-histogram.h"
+#include "common/move-detect.h"
+#include "common/pixel-pipeline.h"
+#include "common/rate-controller.h"
+#include "common/tile-codec.h"
+#include "common/tile-delta.h"
+#include "common/wire-protocol.h"
+#include "dxgi-outputs.h"
 #pragma comment(lib, "windowscodecs.lib")
 
-#define PORT 9998
+#define PORT 9998            // First channel; each further --roi gets the next port
 #define BUFFER_SIZE 2097152  // 2MB for compressed frames
+#define RAW_SLOTS 4          // Captured frames waiting for an encoder (per channel)
+#define ENCODED_SLOTS 4      // Encoded frames waiting for the sender (per channel)
+                             // (plus two per client: in flight + pending)
+#define DEFAULT_ENCODERS 2
+#define MAX_CHANNELS 8                // --roi regions
+#define JPEG_DELTA_FLAG 0x8000        // v1 header: set in the height field of delta frames
+#define JPEG_HEADER_SIZE WIRE_HEADER_SIZE  // Frame header in front of the payload
+#define KEYFRAME_MIN_INTERVAL_MS 250  // Rate limit for client resync requests
+#define DEFAULT_FPS 60                // Capture pacing (--fps, 0 = as fast as the desktop updates)
+#define DEFAULT_TARGET_FPS 60         // Rate control target when unpaced and only --max-kbps is given
+#define RATE_MIN_QUALITY 20           // Rate control never goes below this quality
+
+static_assert(sizeof(RECT) == sizeof(TileRect), "DXGI dirty rects are passed as TileRect");
+
+static std::atomic<bool> running(true);
+
+// Pipeline stages timed per frame
+enum Stage {
+    STAGE_PRESENT,   // Desktop present -> frame acquired (waiting for the pacer deadline)
+    STAGE_ACQUIRE,   // AcquireNextFrame call
+    STAGE_COPY,      // CopySubresourceRegion + Map (waits for the GPU copy)
+    STAGE_SCALE,     // Crop / scale / delta detection / YCbCr per channel
+    STAGE_QUEUE,     // Raw ring -> encoder
+    STAGE_ENCODE,
+    STAGE_REORDER,   // Encoded ring -> broadcast, including the sequencer's hold
+    STAGE_SEND,      // Broadcast -> last byte written, per client
+    STAGE_TOTAL,     // Capture timestamp -> last byte written, per client
+    STAGE_COUNT
+};
+static const char* const stageNames[STAGE_COUNT] = {
+    "present", "acquire", "copy", "scale", "queue", "encode", "reorder", "send", "total"
+};
+static LatencyStages latency(stageNames, STAGE_COUNT);
+static CaptureRecorder recorder;
+
+// Restores capture order in front of the sender. Encoders finish out of
+// order; a keyframe can go out as soon as it is newer than the last frame
+// sent, but a delta must directly follow its predecessor. Deltas that arrive
+// early are held; if the predecessor never comes the stream is marked broken
+// and the held deltas are discarded until the capture thread's keyframe.
+class FrameSequencer {
+private:
+    FrameRing* ring = nullptr;
+    std::atomic<bool>* streamBroken = nullptr;
+    std::vector<FrameSlot*> held;
+    size_t maxHeld = 0;
+    uint64_t lastSeq = 0;
+    bool synced = false;
+
+    void DropHeld(uint64_t upToSeq) {
+        for (size_t i = 0; i < held.size(); ) {
+            if (held[i]->seq <= upToSeq) {
+                ring->Release(held[i]);
+                held.erase(held.begin() + i);
+            } else {
+                i++;
+            }
+        }
+    }
+
+public:
+    // broken is raised whenever the stream needs a keyframe to recover
+    void Initialize(FrameRing* frameRing, size_t holdLimit, std::atomic<bool>* broken) {
+        ring = frameRing;
+        maxHeld = holdLimit;
+        streamBroken = broken;
+    }
+
+    // Take ownership of frame; send(frame) is called for each frame that is
+    // ready, in order. Frames are released after send returns.
+    template <class SendFn>
+    void Push(FrameSlot* frame, SendFn send) {
+        if (frame->seq <= lastSeq) {
+            ring->Release(frame);
+            return;
+        }
+
+        if (!(frame->flags & FRAME_FLAG_DELTA)) {
+            DropHeld(frame->seq);
+            synced = true;
+        } else if (!synced || frame->seq != lastSeq + 1) {
+            held.push_back(frame);
+            if (held.size() > maxHeld) Resync();
+            return;
+        }
+
+        while (frame) {
+            send(frame);
+            lastSeq = frame->seq;
+            ring->Release(frame);
+
+            // Next in line may already be waiting
+            frame = nullptr;
+            for (size_t i = 0; i < held.size(); i++) {
+                if (held[i]->seq == lastSeq + 1) {
+                    frame = held[i];
+                    held.erase(held.begin() + i);
+                    break;
+                }
+            }
+        }
+    }
+
+    // A frame was lost: forget held deltas and wait for the next keyframe
+    void Resync() {
+        DropHeld(UINT64_MAX);
+        synced = false;
+        *streamBroken = true;
+    }
+
+    void Reset() {
+        DropHeld(UINT64_MAX);
+        lastSeq = 0;
+        synced = false;
+    }
+};
+
+// One streamed region of a monitor. A monitor without --roi is a single
+// channel covering all of it; each --roi adds a channel on the next port.
+// Channels on one output share its duplicated frame and capture thread, all
+// channels share the encode workers and the pool, and each has its own
+// pixel pipeline, delta tiles, clients, keyframe and rate state.
+struct Channel {
+    char name[32] = "desktop";
+    int output = 0;                            // Index into the captured outputs
+    UINT x = 0, y = 0, width = 0, height = 0;  // Source rectangle on that output
+    UINT outWidth = 0, outHeight = 0;          // After scaling (current scale step)
+    int port = PORT;
+    PixelPipeline pixels;                      // Crop / scale / hash / YCbCr in one pass
+    int planarChroma = PIPELINE_NO_CHROMA;     // Whole frames leave capture as YCbCr (built-in encoder)
+    TileDelta delta[RATE_SCALE_STEPS];         // Tile grid per scale step
+    std::vector<TileRect> hints;               // Dirty rects in channel coordinates
+    bool useMoves = false;                     // --moves: deltas carry copy-rect moves
+    MoveDetector moves;                        // Previous frame at the current scale step
+    std::vector<MoveVector> moveHints;         // DXGI move offsets in channel coordinates
+    bool useTileCodecs = false;                // --tile-codecs: delta tiles pick their codec
+
+    // Output size per rate-control scale step (only step 0 without --adaptive-scale)
+    UINT stepWidth[RATE_SCALE_STEPS] = {};
+    UINT stepHeight[RATE_SCALE_STEPS] = {};
+
+    // Capture thread
+    uint64_t seq = 0;
+    bool needKeyframe = true;
+    int appliedStep = 0;
+    std::chrono::steady_clock::time_point lastKeyframe;
+
+    // Set by the sender's rate controller
+    std::atomic<int> quality{70};
+    std::atomic<int> scaleStep{0};
+
+    // Encoders -> rate controller, taken by the sender
+    std::atomic<uint64_t> encodedFrames{0};
+    std::atomic<uint64_t> encodedBytes{0};
+    std::atomic<uint64_t> encodeUs{0};
+
+    std::atomic<bool> clientConnected{false};
+    std::atomic<bool> keyframeRequested{false};  // A client wants to resync
+    std::atomic<bool> deltasAllowed{true};       // False while a client takes keyframes only
+    std::atomic<bool> movesAllowed{true};        // False while a client can't apply moves
+    std::atomic<bool> tileCodecsAllowed{true};   // False while a client can't decode tile codecs
+    std::atomic<int> fpsLimit{0};                // BroadcastServer::GetClientFpsLimit()
+    std::atomic<bool> streamBroken{false};       // A frame was lost mid-pipeline
+
+    // Sender
+    BroadcastServer server;
+    FrameSequencer sequencer;
+    uint64_t lastSent = 0;
+    int lastFrameSize = 0;
+    RateController rate;
+    uint64_t rateSent = 0, rateSendUs = 0, rateDropped = 0;
+
+    // Tile grid matching a raw frame (the scale step may have moved on since)
+    const TileDelta* TilesFor(const FrameSlot* raw) const {
+        for (int s = 0; s < RATE_SCALE_STEPS; s++) {
+            if (stepWidth[s] == raw->width && stepHeight[s] == raw->height) return &delta[s];
+        }
+        return &delta[0];
+    }
+};
 
 class ScreenCapture {
 private:
@@ -22,64 +266,117 @@ private:
     ID3D11DeviceContext* context = nullptr;
     IDXGIOutputDuplication* duplication = nullptr;
     ID3D11Texture2D* stagingTexture = nullptr;
-    IWICImagingFactory* wicFactory = nullptr;
     UINT width = 0, height = 0;
+    D3D11_BOX region = {};  // Part of the desktop any channel needs
     bool hasFrame = false;
-    int jpegQuality = 70;  // 0-100, lower = smaller/faster
-
-public:
-    bool Initialize() {
-        // Initialize COM for WIC
-        CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+    bool mapped = false;
+    D3D11_MAPPED_SUBRESOURCE mapping = {};
+    DXGI_OUTDUPL_FRAME_INFO frameInfo = {};
+    std::vector<TileRect> dirtyRects;
+    int dirtyCount = -2;    // -2 = not fetched for this frame yet
+    std::vector<DXGI_OUTDUPL_MOVE_RECT> moveRects;
+    int moveCount = 0;
+    std::vector<TileRect> recordRects;
+    LARGE_INTEGER qpcFrequency = {};
+    uint64_t captureUs = 0; // Timestamp of the acquired frame
 
-        // Create WIC factory
-        HRESULT hr = CoCreateInstance(CLSID_WICImagingFactory, nullptr,
-            CLSCTX_INPROC_SERVER, IID_PPV_ARGS(&wicFactory));
-        if (FAILED(hr)) {
-            printf("Failed to create WIC factory: 0x%08X\n", hr);
-            return false;
+    // Dirty rects DXGI reported for the acquired frame, in desktop
+    // coordinates, including the destinations of its move rects (DXGI
+    // leaves those out of the dirty rects). Fetched once per frame. Returns
+    // the rect count, or -1 (rects = nullptr) when there is no usable metadata.
+    int GetDirtyRects(const TileRect** rects) {
+        *rects = dirtyRects.data();
+        if (dirtyCount != -2) {
+            if (dirtyCount < 0) *rects = nullptr;
+            return dirtyCount;
         }
-
-        // Create D3D11 device
-        D3D_FEATURE_LEVEL featureLevel;
-        hr = D3D11CreateDevice(nullptr, D3D_DRIVER_TYPE_HARDWARE, nullptr,
-            0, nullptr, 0, D3D11_SDK_VERSION, &device, &featureLevel, &context);
-        if (FAILED(hr)) {
-            printf("Failed to create D3D device: 0x%08X\n", hr);
-            return false;
+        if (frameInfo.LastPresentTime.QuadPart == 0) {
+            // Only the cursor changed - the desktop image is identical
+            dirtyCount = 0;
+            return 0;
         }
+        dirtyCount = -1;
+        *rects = nullptr;
+        if (frameInfo.TotalMetadataBufferSize == 0) return -1;
 
-        // Get DXGI device
-        IDXGIDevice* dxgiDevice;
-        hr = device->QueryInterface(__uuidof(IDXGIDevice), (void**)&dxgiDevice);
-        if (FAILED(hr)) return false;
+        dirtyRects.resize(frameInfo.TotalMetadataBufferSize / sizeof(RECT) + 1);
+        UINT bytes = 0;
+        HRESULT hr = duplication->GetFrameDirtyRects((UINT)(dirtyRects.size() * sizeof(RECT)),
+            (RECT*)dirtyRects.data(), &bytes);
+        if (FAILED(hr)) return -1;
+        int count = (int)(bytes / sizeof(RECT));
 
-        IDXGIAdapter* adapter;
-        hr = dxgiDevice->GetAdapter(&adapter);
-        dxgiDevice->Release();
-        if (FAILED(hr)) return false;
+        moveRects.resize(frameInfo.TotalMetadataBufferSize / sizeof(DXGI_OUTDUPL_MOVE_RECT) + 1);
+        hr = duplication->GetFrameMoveRects((UINT)(moveRects.size() * sizeof(DXGI_OUTDUPL_MOVE_RECT)),
+            moveRects.data(), &bytes);
+        if (FAILED(hr)) return -1;
+        moveCount = (int)(bytes / sizeof(DXGI_OUTDUPL_MOVE_RECT));
+        dirtyRects.resize(count);
+        for (int i = 0; i < moveCount; i++) {
+            const RECT& d = moveRects[i].DestinationRect;
+            dirtyRects.push_back({ d.left, d.top, d.right, d.bottom });
+        }
+        *rects = dirtyRects.data();
+        dirtyCount = (int)dirtyRects.size();
+        return dirtyCount;
+    }
 
-        IDXGIOutput* output;
-        hr = adapter->EnumOutputs(0, &output);
-        adapter->Release();
-        if (FAILED(hr)) return false;
+    // Offsets of the acquired frame's move rects that land in a channel,
+    // mapped to its (scaled) coordinates; a shift that doesn't scale to
+    // whole pixels can't be an exact copy and is left to the block search.
+    // Returns the number of offsets in ch.moveHints.
+    int GetChannelMoves(Channel& ch) {
+        const TileRect* rects;
+        ch.moveHints.clear();
+        if (GetDirtyRects(&rects) < 0) return 0;
+        for (int i = 0; i < moveCount; i++) {
+            const DXGI_OUTDUPL_MOVE_RECT& m = moveRects[i];
+            const RECT& d = m.DestinationRect;
+            if (d.right <= (LONG)ch.x || d.left >= (LONG)(ch.x + ch.width) ||
+                d.bottom <= (LONG)ch.y || d.top >= (LONG)(ch.y + ch.height)) continue;
+            int64_t dx = (int64_t)(d.left - m.SourcePoint.x) * ch.outWidth;
+            int64_t dy = (int64_t)(d.top - m.SourcePoint.y) * ch.outHeight;
+            if (dx % ch.width != 0 || dy % ch.height != 0) continue;
+            ch.moveHints.push_back({ (int32_t)(dx / ch.width), (int32_t)(dy / ch.height) });
+        }
+        return (int)ch.moveHints.size();
+    }
 
-        IDXGIOutput1* output1;
-        hr = output->QueryInterface(__uuidof(IDXGIOutput1), (void**)&output1);
-        output->Release();
-        if (FAILED(hr)) return false;
+    // The frame's dirty rects clipped to a channel and mapped into its
+    // (scaled) coordinates. Same return convention as GetDirtyRects().
+    int GetChannelHints(Channel& ch, const TileRect** hints) {
+        const TileRect* rects;
+        int count = GetDirtyRects(&rects);
+        *hints = nullptr;
+        if (count < 0) return -1;
 
-        hr = output1->DuplicateOutput(device, &duplication);
-        output1->Release();
-        if (FAILED(hr)) {
-            printf("Failed to create duplication: 0x%08X\n", hr);
-            return false;
+        ch.hints.clear();
+        for (int i = 0; i < count; i++) {
+            TileRect r = rects[i];
+            r.left = std::max(r.left, (int32_t)ch.x) - (int32_t)ch.x;
+            r.top = std::max(r.top, (int32_t)ch.y) - (int32_t)ch.y;
+            r.right = std::min(r.right, (int32_t)(ch.x + ch.width)) - (int32_t)ch.x;
+            r.bottom = std::min(r.bottom, (int32_t)(ch.y + ch.height)) - (int32_t)ch.y;
+            if (r.left >= r.right || r.top >= r.bottom) continue;  // Elsewhere on the desktop
+            if (ch.pixels.GetFilter() != SCALE_COPY) ch.pixels.MapRect(&r.left, &r.top, &r.right, &r.bottom);
+            ch.hints.push_back(r);
         }
+        int clipped = (int)ch.hints.size();
+        if (clipped == 0) ch.hints.resize(1);  // Valid pointer for a count of 0
+        *hints = ch.hints.data();
+        return clipped;
+    }
+
+public:
+    // Duplicate one monitor (dxgi-outputs.h) on a device of its own adapter
+    bool Initialize(const DxgiOutputInfo& output) {
+        if (!OpenOutput(output, &device, &context, &duplication)) return false;
 
         DXGI_OUTDUPL_DESC desc;
         duplication->GetDesc(&desc);
         width = desc.ModeDesc.Width;
         height = desc.ModeDesc.Height;
+        region = { 0, 0, 0, width, height, 1 };
 
         // Create staging texture
         D3D11_TEXTURE2D_DESC texDesc = {};
@@ -92,63 +389,215 @@ public:
         texDesc.Usage = D3D11_USAGE_STAGING;
         texDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
 
-        hr = device->CreateTexture2D(&texDesc, nullptr, &stagingTexture);
+        HRESULT hr = device->CreateTexture2D(&texDesc, nullptr, &stagingTexture);
+        QueryPerformanceFrequency(&qpcFrequency);
         return SUCCEEDED(hr);
     }
 
-    void SetQuality(int q) { jpegQuality = q; }
+    // Only this part of the desktop is copied to the staging texture
+    // (the bounding box of all channels)
+    void SetRegion(UINT left, UINT top, UINT right, UINT bottom) {
+        region = { left, top, 0, right, bottom, 1 };
+    }
 
-    int CaptureFrameJPEG(BYTE* buffer, int maxSize) {
-        DXGI_OUTDUPL_FRAME_INFO frameInfo;
+    // Acquire the next desktop frame and map the staging copy of the region.
+    // Returns 0, -2 on timeout or -1 on error. The frame stays held until
+    // ReleaseFrame(). Its timestamp is when the desktop presented it, or
+    // when it was acquired for cursor-only updates.
+    int AcquireFrame(UINT timeoutMs) {
         IDXGIResource* resource = nullptr;
+        ReleaseFrame();
 
-        if (hasFrame) {
-            duplication->ReleaseFrame();
-            hasFrame = false;
-        }
-
-        HRESULT hr = duplication->AcquireNextFrame(16, &frameInfo, &resource);
+        uint64_t startUs = LatencyNowUs();
+        HRESULT hr = duplication->AcquireNextFrame(timeoutMs, &frameInfo, &resource);
         if (hr == DXGI_ERROR_WAIT_TIMEOUT) return -2;
         if (FAILED(hr)) return -1;
         hasFrame = true;
+        dirtyCount = -2;
+        moveCount = 0;
+        uint64_t acquiredUs = LatencyNowUs();
+        latency.Record(STAGE_ACQUIRE, acquiredUs - startUs);
+        captureUs = acquiredUs;
+        if (frameInfo.LastPresentTime.QuadPart != 0) {
+            uint64_t presentUs = LatencyQpcToUs(frameInfo.LastPresentTime.QuadPart, qpcFrequency.QuadPart);
+            if (presentUs <= acquiredUs) {
+                captureUs = presentUs;
+                latency.Record(STAGE_PRESENT, acquiredUs - presentUs);
+            }
+        }
 
         ID3D11Texture2D* texture;
         hr = resource->QueryInterface(__uuidof(ID3D11Texture2D), (void**)&texture);
         resource->Release();
         if (FAILED(hr)) return -1;
 
-        context->CopyResource(stagingTexture, texture);
+        context->CopySubresourceRegion(stagingTexture, 0, region.left, region.top, 0, texture, 0, &region);
         texture->Release();
 
-        D3D11_MAPPED_SUBRESOURCE mapped;
-        hr = context->Map(stagingTexture, 0, D3D11_MAP_READ, 0, &mapped);
+        hr = context->Map(stagingTexture, 0, D3D11_MAP_READ, 0, &mapping);
         if (FAILED(hr)) return -1;
+        mapped = true;
+        latency.Record(STAGE_COPY, LatencyNowUs() - acquiredUs);
+        return 0;
+    }
+
+    // Crop (and scale) a channel's rectangle of the acquired frame into slot,
+    // pitch stripped. Frames that are sure to go out whole (no delta, or a
+    // keyframe) are written as YCbCr planes and flagged FRAME_FLAG_YCBCR when
+    // the channel has planarChroma set. With delta set, the dirty map is
+    // stored right after the pixels and the slot is flagged FRAME_FLAG_DELTA
+    // unless it should go out as a keyframe; channels with useMoves also
+    // take moved tiles out of the map and store their move payload after it
+    // (FRAME_FLAG_MOVES), and channels with useTileCodecs flag deltas
+    // FRAME_FLAG_TILE_CODECS while every client decodes those. Returns -2
+    // if nothing changed, -1 on error, otherwise the number of pixel bytes
+    // written.
+    int CaptureChannel(Channel& ch, FrameSlot* slot, bool useDelta, bool keyframe) {
+        UINT rowBytes = ch.outWidth * 4;
+        TileDelta& delta = ch.delta[ch.appliedStep];
+        size_t mapSize = useDelta ? delta.GetTileCount() : 0;
+        if (useDelta && ch.useMoves) mapSize += MoveDetector::MaxMovesSize(delta.GetTileCount());
+        bool planar = ch.planarChroma != PIPELINE_NO_CHROMA && (!useDelta || keyframe);
+        uint64_t startUs = LatencyNowUs();
+
+        PixelTargets targets;
+        size_t size;
+        if (planar) {
+            targets.subsampling = (ChromaSubsampling)ch.planarChroma;
+            size = JpegFramePlanes(ch.outWidth, ch.outHeight, targets.subsampling, slot->data, &targets.planes,
+                &targets.paddedWidth, &targets.paddedHeight);
+        } else {
+            targets.bgra = slot->data;
+            targets.bgraStride = rowBytes;
+            size = (size_t)rowBytes * ch.outHeight;
+        }
+        if (size + mapSize > slot->capacity) return -1;
+
+        const TileRect* hints = nullptr;
+        int hintCount = -1;
+        if (useDelta) {
+            targets.tiles = &delta;
+            if (!keyframe) hintCount = GetChannelHints(ch, &hints);
+        }
+
+        // One pass in row bands across the pool
+        const BYTE* src = (const BYTE*)mapping.pData + (size_t)ch.y * mapping.RowPitch + (size_t)ch.x * 4;
+        int dirty = ch.pixels.Run(src, mapping.RowPitch, targets, hints, hintCount, keyframe);
+        if (dirty < 0) return -1;
+
+        slot->width = ch.outWidth;
+        slot->height = ch.outHeight;
+        slot->stride = planar ? 0 : rowBytes;
+        slot->size = size;
+        slot->flags = planar ? FRAME_FLAG_YCBCR : 0;
+        slot->timestampUs = captureUs;
+
+        if (useDelta && !keyframe && dirty == 0) return -2;  // Nothing visible changed
+
+        // Moved tiles leave the dirty map (keyframes only refresh the detector)
+        int moved = 0;
+        if (useDelta && ch.useMoves) {
+            int moveHintCount = keyframe ? 0 : GetChannelMoves(ch);
+            moved = ch.moves.Detect(slot->data, rowBytes, &delta, ch.moveHints.data(), moveHintCount,
+                !keyframe && ch.movesAllowed);
+        }
+
+        if (useDelta && !keyframe) {
+            // Past half the tiles, per-tile JPEG overhead outweighs the savings
+            if ((dirty - moved) * 2 <= delta.GetTileCount()) {
+                memcpy(slot->data + slot->size, delta.GetDirtyMap(), delta.GetTileCount());
+                slot->flags = FRAME_FLAG_DELTA;
+                if (ch.useTileCodecs && ch.tileCodecsAllowed) slot->flags |= FRAME_FLAG_TILE_CODECS;
+                if (moved) {
+                    ch.moves.WriteMoves(slot->data + slot->size + delta.GetTileCount());
+                    slot->flags |= FRAME_FLAG_MOVES;
+                }
+            }
+        }
+        latency.Record(STAGE_SCALE, LatencyNowUs() - startUs);
+        return (int)slot->size;
+    }
+
+    // Hand the copied region of the acquired frame to the recorder, dirty
+    // rects moved into region coordinates
+    void RecordFrame() {
+        const TileRect* rects;
+        int count = GetDirtyRects(&rects);
+        recordRects.clear();
+        for (int i = 0; i < count; i++) {
+            TileRect r = rects[i];
+            r.left = std::max(r.left, (int32_t)region.left) - (int32_t)region.left;
+            r.top = std::max(r.top, (int32_t)region.top) - (int32_t)region.top;
+            r.right = std::min(r.right, (int32_t)region.right) - (int32_t)region.left;
+            r.bottom = std::min(r.bottom, (int32_t)region.bottom) - (int32_t)region.top;
+            if (r.left < r.right && r.top < r.bottom) recordRects.push_back(r);
+        }
+        const BYTE* src = (const BYTE*)mapping.pData + (size_t)region.top * mapping.RowPitch + (size_t)region.left * 4;
+        recorder.Submit(src, mapping.RowPitch, captureUs, recordRects.data(), count < 0 ? -1 : (int)recordRects.size());
+    }
+
+    // Pixels are in the slots now - let DWM move on while we encode
+    void ReleaseFrame() {
+        if (mapped) {
+            context->Unmap(stagingTexture, 0);
+            mapped = false;
+        }
+        if (hasFrame) {
+            duplication->ReleaseFrame();
+            hasFrame = false;
+        }
+    }
 
-        // Encode to JPEG using WIC
+    UINT GetWidth() { return width; }
+    UINT GetHeight() { return height; }
+    UINT GetRegionWidth() { return region.right - region.left; }
+    UINT GetRegionHeight() { return region.bottom - region.top; }
+
+    void Cleanup() {
+        ReleaseFrame();
+        if (stagingTexture) stagingTexture->Release();
+        if (duplication) duplication->Release();
+        if (context) context->Release();
+        if (device) device->Release();
+    }
+};
+
+// JPEG encoder, one per encode worker. The built-in encoder keeps its tables
+// and scratch between frames; the WIC path creates its stream/encoder
+// objects per frame and is kept for comparison (--wic).
+class JpegEncoder {
+private:
+    IWICImagingFactory* wicFactory = nullptr;
+    BaselineJpegEncoder builtin;
+    TileCodecEncoder tileCodecs;
+    ChromaSubsampling subsampling = CHROMA_420;
+    int restartInterval = 0;
+    int jpegQuality = 70;  // 0-100, lower = smaller/faster
+
+    int EncodeWic(const BYTE* pixels, UINT stride, UINT width, UINT height, BYTE* out, int maxSize) {
         IWICStream* stream = nullptr;
         IWICBitmapEncoder* encoder = nullptr;
         IWICBitmapFrameEncode* frame = nullptr;
         IPropertyBag2* props = nullptr;
 
-        hr = wicFactory->CreateStream(&stream);
-        if (FAILED(hr)) { context->Unmap(stagingTexture, 0); return -1; }
+        HRESULT hr = wicFactory->CreateStream(&stream);
+        if (FAILED(hr)) return -1;
 
-        // Write to memory buffer (skip 8 bytes for header)
-        hr = stream->InitializeFromMemory(buffer + 8, maxSize - 8);
-        if (FAILED(hr)) { stream->Release(); context->Unmap(stagingTexture, 0); return -1; }
+        hr = stream->InitializeFromMemory(out, maxSize);
+        if (FAILED(hr)) { stream->Release(); return -1; }
 
         hr = wicFactory->CreateEncoder(GUID_ContainerFormatJpeg, nullptr, &encoder);
-        if (FAILED(hr)) { stream->Release(); context->Unmap(stagingTexture, 0); return -1; }
+        if (FAILED(hr)) { stream->Release(); return -1; }
 
         hr = encoder->Initialize(stream, WICBitmapEncoderNoCache);
-        if (FAILED(hr)) { encoder->Release(); stream->Release(); context->Unmap(stagingTexture, 0); return -1; }
+        if (FAILED(hr)) { encoder->Release(); stream->Release(); return -1; }
 
         hr = encoder->CreateNewFrame(&frame, &props);
-        if (FAILED(hr)) { encoder->Release(); stream->Release(); context->Unmap(stagingTexture, 0); return -1; }
+        if (FAILED(hr)) { encoder->Release(); stream->Release(); return -1; }
 
         // Set JPEG quality
         PROPBAG2 option = {};
-        option.pstrName = L"ImageQuality";
+        option.pstrName = (LPOLESTR)L"ImageQuality";
         VARIANT value;
         VariantInit(&value);
         value.vt = VT_R4;
@@ -157,19 +606,16 @@ public:
 
         hr = frame->Initialize(props);
         props->Release();
-        if (FAILED(hr)) { frame->Release(); encoder->Release(); stream->Release(); context->Unmap(stagingTexture, 0); return -1; }
+        if (FAILED(hr)) { frame->Release(); encoder->Release(); stream->Release(); return -1; }
 
         hr = frame->SetSize(width, height);
-        if (FAILED(hr)) { frame->Release(); encoder->Release(); stream->Release(); context->Unmap(stagingTexture, 0); return -1; }
+        if (FAILED(hr)) { frame->Release(); encoder->Release(); stream->Release(); return -1; }
 
         WICPixelFormatGUID format = GUID_WICPixelFormat32bppBGRA;
         hr = frame->SetPixelFormat(&format);
-        if (FAILED(hr)) { frame->Release(); encoder->Release(); stream->Release(); context->Unmap(stagingTexture, 0); return -1; }
-
-        // Write pixels (handle pitch)
-        hr = frame->WritePixels(height, mapped.RowPitch, height * mapped.RowPitch, (BYTE*)mapped.pData);
-        context->Unmap(stagingTexture, 0);
+        if (FAILED(hr)) { frame->Release(); encoder->Release(); stream->Release(); return -1; }
 
+        hr = frame->WritePixels(height, stride, (height - 1) * stride + width * 4, (BYTE*)pixels);
         if (FAILED(hr)) { frame->Release(); encoder->Release(); stream->Release(); return -1; }
 
         hr = frame->Commit();
@@ -184,127 +630,864 @@ public:
         ULARGE_INTEGER pos;
         LARGE_INTEGER zero = {};
         stream->Seek(zero, STREAM_SEEK_CUR, &pos);
-        int jpegSize = (int)pos.QuadPart;
         stream->Release();
+        return (int)pos.QuadPart;
+    }
 
-        // Write header: width (2 bytes), height (2 bytes), jpeg size (4 bytes)
-        ((USHORT*)buffer)[0] = (USHORT)width;
-        ((USHORT*)buffer)[1] = (USHORT)height;
-        ((UINT*)(buffer + 4))[0] = jpegSize;
+public:
+    // useWic: encode through WIC instead of the built-in encoder.
+    // subsampling / restart / jobs only apply to the built-in encoder; with a
+    // pool, full frames are encoded as parallel bands of JPEG_DEFAULT_BAND_ROWS
+    // MCU rows.
+    bool Initialize(bool useWic, ChromaSubsampling chroma, int restart, UINT maxWidth, JobSystem* jobs) {
+        subsampling = chroma;
+        restartInterval = restart;
+        if (!useWic) {
+            builtin.Configure(jpegQuality, subsampling, restartInterval);
+            builtin.SetJobSystem(jobs);
+            builtin.Reserve(maxWidth);
+            return true;
+        }
 
-        return 8 + jpegSize;
+        // Initialize COM for WIC
+        CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+
+        HRESULT hr = CoCreateInstance(CLSID_WICImagingFactory, nullptr,
+            CLSCTX_INPROC_SERVER, IID_PPV_ARGS(&wicFactory));
+        if (FAILED(hr)) {
+            printf("Failed to create WIC factory: 0x%08X\n", hr);
+            return false;
+        }
+        return true;
     }
 
-    UINT GetWidth() { return width; }
-    UINT GetHeight() { return height; }
+    void SetQuality(int q) { jpegQuality = q; }
+
+    // Encode a w x h block of BGRA pixels to JPEG at out.
+    // Returns the JPEG size or -1 on failure (including running out of space).
+    int EncodeJpeg(const BYTE* pixels, UINT stride, UINT width, UINT height, BYTE* out, int maxSize) {
+        if (wicFactory) return EncodeWic(pixels, stride, width, height, out, maxSize);
+
+        // No-op unless the quality changed since the last frame
+        if (!builtin.Configure(jpegQuality, subsampling, restartInterval)) return -1;
+        return builtin.Encode(pixels, stride, width, height, out, maxSize);
+    }
+
+    // Encode a whole frame the capture thread already converted
+    // (FRAME_FLAG_YCBCR: JpegFramePlanes() layout in the built-in encoder's
+    // subsampling). Returns the JPEG size or -1.
+    int EncodeJpegPlanes(const BYTE* data, UINT width, UINT height, BYTE* out, int maxSize) {
+        if (wicFactory) return -1;
+        if (!builtin.Configure(jpegQuality, subsampling, restartInterval)) return -1;
+        YCbCrPlanes planes;
+        JpegFramePlanes(width, height, subsampling, (uint8_t*)data, &planes);
+        return builtin.EncodePlanes(planes, width, height, out, maxSize);
+    }
+
+    // Encode a raw slot into out as [v2 frame header][payload]. Keyframes
+    // carry one JPEG. Delta frames (WIRE_FLAG_DELTA | WIRE_FLAG_TILES) carry
+    // the tile header (common/tile-delta.h) followed by [4B JPEG size][JPEG]
+    // for each dirty tile, behind the move payload (common/move-detect.h)
+    // when WIRE_FLAG_MOVES is set too. With WIRE_FLAG_TILE_CODECS each tile
+    // is [4B size | codec << 24][tile data] in the codec common/tile-codec.h
+    // picked for it, JPEG only for the tiles that need it. The v1 header for
+    // old clients goes to out->legacyHeader: [2B width]
+    // [2B height | JPEG_DELTA_FLAG][4B payload size][8B sequence number]
+    // [8B capture timestamp, us].
+    // Returns total bytes or -1.
+    int Encode(const FrameSlot* raw, FrameSlot* out, const TileDelta* tiles) {
+        BYTE* buffer = out->data;
+        int maxSize = (int)out->capacity;
+        UINT width = raw->width, height = raw->height;
+        int payloadSize;
+
+        if (raw->flags & FRAME_FLAG_DELTA) {
+            const uint8_t* dirtyMap = raw->data + (size_t)raw->stride * height;
+            BYTE* payload = buffer + JPEG_HEADER_SIZE;
+            int offset = 0;
+            if (raw->flags & FRAME_FLAG_MOVES) {
+                const uint8_t* moves = dirtyMap + tiles->GetTileCount();
+                offset = (int)MoveDetector::MaxMovesSize(tiles->GetTileCount());
+                offset = (int)ReadMovesSize(moves, offset);
+                if (offset == 0 || offset > maxSize - JPEG_HEADER_SIZE) return -1;
+                memcpy(payload, moves, offset);
+            }
+            offset += (int)tiles->WriteTileHeader(dirtyMap, payload + offset);
+            bool pickCodecs = (raw->flags & FRAME_FLAG_TILE_CODECS) != 0;
+            for (int t = 0; t < tiles->GetTileCount(); t++) {
+                if (!dirtyMap[t]) continue;
+                uint32_t x, y, w, h;
+                tiles->GetTileRect(t, &x, &y, &w, &h);
+                int space = maxSize - JPEG_HEADER_SIZE - offset - 4;
+                if (space <= 0) return -1;
+                const BYTE* tile = raw->data + (size_t)y * raw->stride + x * 4;
+                int codec = TILE_CODEC_JPEG;
+                int tileSize = 0;
+                if (pickCodecs) {
+                    tileSize = tileCodecs.Encode(tile, raw->stride, w, h, payload + offset + 4, space, &codec);
+                    if (tileSize < 0) return -1;
+                }
+                if (codec == TILE_CODEC_JPEG) {
+                    tileSize = EncodeJpeg(tile, raw->stride, w, h, payload + offset + 4, space);
+                    if (tileSize < 0) return -1;
+                }
+                uint32_t prefix = (uint32_t)tileSize | (pickCodecs ? (uint32_t)codec << TILE_CODEC_SHIFT : 0);
+                memcpy(payload + offset, &prefix, 4);
+                offset += 4 + tileSize;
+            }
+            payloadSize = offset;
+        } else if (raw->flags & FRAME_FLAG_YCBCR) {
+            payloadSize = EncodeJpegPlanes(raw->data, width, height, buffer + JPEG_HEADER_SIZE,
+                maxSize - JPEG_HEADER_SIZE);
+            if (payloadSize < 0) return -1;
+        } else {
+            // Write to memory buffer (skip the header)
+            payloadSize = EncodeJpeg(raw->data, raw->stride, width, height, buffer + JPEG_HEADER_SIZE,
+                maxSize - JPEG_HEADER_SIZE);
+            if (payloadSize < 0) return -1;
+        }
+
+        bool isDelta = (raw->flags & FRAME_FLAG_DELTA) != 0;
+        WireFrameHeader header;
+        header.codec = WIRE_CODEC_JPEG;
+        header.flags = isDelta ? WIRE_FLAG_DELTA | WIRE_FLAG_TILES : WIRE_FLAG_KEYFRAME;
+        if (raw->flags & FRAME_FLAG_MOVES) header.flags |= WIRE_FLAG_MOVES;
+        if (raw->flags & FRAME_FLAG_TILE_CODECS) header.flags |= WIRE_FLAG_TILE_CODECS;
+        header.width = (uint16_t)width;
+        header.height = (uint16_t)height;
+        header.seq = raw->seq;
+        header.captureUs = raw->timestampUs;
+        WireWriteHeader(header, buffer);
+
+        // v1 header: width (2 bytes), height (2 bytes), payload size (4 bytes),
+        // sequence number (8 bytes), capture timestamp (8 bytes)
+        BYTE* legacy = out->legacyHeader;
+        ((USHORT*)legacy)[0] = (USHORT)width;
+        ((USHORT*)legacy)[1] = (USHORT)(height | (isDelta ? JPEG_DELTA_FLAG : 0));
+        ((UINT*)(legacy + 4))[0] = payloadSize;
+        memcpy(legacy + 8, &raw->seq, 8);
+        memcpy(legacy + 16, &raw->timestampUs, 8);
+        out->hasLegacyHeader = true;
+
+        out->width = width;
+        out->height = height;
+        out->stride = 0;
+        out->seq = raw->seq;
+        out->channel = raw->channel;
+        out->flags = raw->flags;
+        out->timestampUs = raw->timestampUs;
+        out->size = JPEG_HEADER_SIZE + payloadSize;
+        return (int)out->size;
+    }
 
     void Cleanup() {
-        if (stagingTexture) stagingTexture->Release();
-        if (duplication) duplication->Release();
-        if (context) context->Release();
-        if (device) device->Release();
-        if (wicFactory) wicFactory->Release();
+        if (!wicFactory) return;
+        wicFactory->Release();
+        wicFactory = nullptr;
         CoUninitialize();
     }
 };
 
-int main(int argc, char* argv[]) {
-    int quality = 60;
-    if (argc > 1) quality = atoi(argv[1]);
+// Switch a channel to the scale step its rate controller picked (capture
+// thread). Clients pick up the new size from the next keyframe.
+static void ApplyScaleStep(Channel& ch, int step) {
+    ch.appliedStep = step;
+    ch.outWidth = ch.stepWidth[step];
+    ch.outHeight = ch.stepHeight[step];
+    ch.pixels.Configure(ch.width, ch.height, ch.outWidth, ch.outHeight);
+    if (ch.useMoves) ch.moves.Initialize(ch.outWidth, ch.outHeight);
+    ch.needKeyframe = true;
+}
 
-    printf("SimWidget JPEG Capture Service v2.0\n");
-    printf("Port: %d, Quality: %d\n", PORT, quality);
-    fflush(stdout);
+// Stage 1: acquire one frame of an output, then crop/scale it into a raw slot
+// per channel of that output that has clients (and hand it to the recorder
+// while recording, if this output is the recorded one). One thread per output.
+static void CaptureThread(ScreenCapture* capture, FrameRing* rawRing, std::vector<Channel>* channels,
+                          int output, bool useDelta, int fps, bool recordSource) {
+    FramePacer pacer;
+    int pacedFps = fps;
+    pacer.Start(pacedFps);
+    bool idle = true;
+    while (running) {
+        // Client resync requests are rate limited so a struggling client
+        // can't turn the whole stream into keyframes
+        auto now = std::chrono::steady_clock::now();
+        bool anyClients = false;
+        int wantedFps = -1;     // Fastest any channel's clients want (0 = unpaced)
+        for (auto& ch : *channels) {
+            if (ch.output != output) continue;
+            if (!ch.clientConnected) {
+                ch.needKeyframe = true;
+                continue;
+            }
+            anyClients = true;
+            int channelFps = WireCappedFps(fps, ch.fpsLimit);
+            if (wantedFps != 0 && (channelFps == 0 || channelFps > wantedFps)) wantedFps = channelFps;
+            if (!ch.deltasAllowed) ch.needKeyframe = true;
+            if (ch.keyframeRequested &&
+                now - ch.lastKeyframe >= std::chrono::milliseconds(KEYFRAME_MIN_INTERVAL_MS)) {
+                ch.keyframeRequested = false;
+                ch.needKeyframe = true;
+            }
+            if (ch.streamBroken.exchange(false)) ch.needKeyframe = true;
+        }
+        bool recording = recordSource && recorder.IsRecording();
+        if (!anyClients && !recording) {
+            idle = true;
+            Sleep(10);
+            continue;
+        }
+        if (idle) {
+            idle = false;
+            pacer.Reset();
+        }
+        if (wantedFps < 0) wantedFps = fps;  // Only recording
+        if (wantedFps != pacedFps) {
+            pacedFps = wantedFps;
+            pacer.Start(pacedFps);
+            printf("Output %d pacing: %d FPS%s\n", output, pacedFps, pacedFps > 0 ? "" : " (off)");
+            fflush(stdout);
+        }
 
-    ScreenCapture capture;
-    if (!capture.Initialize()) {
-        printf("Failed to initialize capture\n");
-        fflush(stdout);
-        return 1;
+        // Paced: wait for the deadline, then take whatever is on screen now
+        pacer.Wait();
+        if (pacer.GetStatsAgeMs() >= PACER_REPORT_MS) {
+            PacerStats stats;
+            pacer.TakeStats(&stats);
+            char prefix[32];
+            snprintf(prefix, sizeof(prefix), "[output %d] ", output);
+            PrintPacerStats(prefix, stats);
+            fflush(stdout);
+        }
+        int result = capture->AcquireFrame(pacer.IsPaced() ? 0 : 16);
+        if (result == -2) continue;
+        if (result < 0) {
+            // Dirty rects of the lost frame are gone
+            for (auto& ch : *channels) {
+                if (ch.output == output) ch.needKeyframe = true;
+            }
+            Sleep(1);
+            continue;
+        }
+        if (recording) capture->RecordFrame();
+
+        for (size_t i = 0; i < channels->size(); i++) {
+            Channel& ch = (*channels)[i];
+            if (ch.output != output || !ch.clientConnected) continue;
+            int step = ch.scaleStep;
+            if (step != ch.appliedStep) ApplyScaleStep(ch, step);
+
+            uint64_t droppedBefore = rawRing->GetDropped();
+            FrameSlot* slot = rawRing->AcquireWrite();
+            if (rawRing->GetDropped() != droppedBefore) {
+                // Reclaimed a frame nobody encoded - some delta chain is broken,
+                // possibly on another output's thread
+                for (auto& other : *channels) other.streamBroken = true;
+            }
+            if (!slot) {
+                // Every slot is held by an encoder; this channel skips the
+                // frame and its dirty rects with it
+                ch.needKeyframe = true;
+                continue;
+            }
+
+            result = capture->CaptureChannel(ch, slot, useDelta, ch.needKeyframe);
+            if (result <= 0) {
+                rawRing->Release(slot);
+                if (result != -2) ch.needKeyframe = true;
+                continue;
+            }
+
+            if (!(slot->flags & FRAME_FLAG_DELTA)) {
+                ch.needKeyframe = false;
+                ch.lastKeyframe = now;
+            }
+            slot->seq = ++ch.seq;
+            slot->channel = (uint32_t)i;
+            slot->handoffUs = LatencyNowUs();
+            rawRing->Publish(slot);
+        }
+        capture->ReleaseFrame();
     }
-    capture.SetQuality(quality);
-    printf("Capture initialized: %dx%d\n", capture.GetWidth(), capture.GetHeight());
-    fflush(stdout);
+}
+
+// Stage 2: raw slot -> encoded slot
+static void EncodeThread(JpegEncoder* encoder, FrameRing* rawRing, FrameRing* encodedRing,
+                         std::vector<Channel>* channels, bool useDelta) {
+    CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+    while (running) {
+        FrameSlot* raw = rawRing->AcquireRead(100);
+        if (!raw) continue;
+        Channel& ch = (*channels)[raw->channel];
+
+        FrameSlot* out = encodedRing->AcquireWrite();
+        if (!out) {
+            rawRing->Release(raw);
+            ch.streamBroken = true;
+            continue;
+        }
 
-    WSADATA wsaData;
-    WSAStartup(MAKEWORD(2, 2), &wsaData);
+        // Quality is per channel and follows its rate controller
+        encoder->SetQuality(ch.quality);
+        uint64_t startUs = LatencyNowUs();
+        latency.RecordSince(STAGE_QUEUE, raw->handoffUs, startUs);
+        int result = encoder->Encode(raw, out, useDelta ? ch.TilesFor(raw) : nullptr);
+        uint64_t endUs = LatencyNowUs();
+        rawRing->Release(raw);
 
-    SOCKET serverSocket = socket(AF_INET, SOCK_STREAM, 0);
+        if (result > 0) {
+            latency.Record(STAGE_ENCODE, endUs - startUs);
+            ch.encodeUs += endUs - startUs;
+            ch.encodedBytes += (uint64_t)result;
+            ch.encodedFrames++;
+            out->handoffUs = endUs;
+            encodedRing->Publish(out);
+        } else {
+            encodedRing->Release(out);
+            ch.streamBroken = true;
+        }
+    }
+    CoUninitialize();
+}
 
-    // Enable TCP_NODELAY for lower latency
-    int flag = 1;
-    setsockopt(serverSocket, IPPROTO_TCP, TCP_NODELAY, (char*)&flag, sizeof(flag));
+// Feed a channel's rate controller with the window's measurements and hand
+// its decision to the encoders / capture thread (sender thread)
+static void UpdateRate(Channel& ch, double nowMs) {
+    uint64_t us = ch.encodeUs.exchange(0);
+    uint64_t bytes = ch.encodedBytes.exchange(0);
+    uint64_t frames = ch.encodedFrames.exchange(0);
+    ch.rate.AddEncoded(frames, us / 1000.0, bytes);
 
-    sockaddr_in serverAddr = {};
-    serverAddr.sin_family = AF_INET;
-    serverAddr.sin_addr.s_addr = INADDR_ANY;
-    serverAddr.sin_port = htons(PORT);
+    uint64_t sent = ch.server.GetFramesSent();
+    uint64_t sendUs = ch.server.GetSendTimeUs();
+    uint64_t dropped = ch.server.GetFramesDropped();
+    ch.rate.AddSent(sent - ch.rateSent, (sendUs - ch.rateSendUs) / 1000.0, dropped - ch.rateDropped);
+    ch.rate.AddBacklog(ch.server.GetQueuedBytes());
+    ch.rateSent = sent;
+    ch.rateSendUs = sendUs;
+    ch.rateDropped = dropped;
 
-    bind(serverSocket, (sockaddr*)&serverAddr, sizeof(serverAddr));
-    listen(serverSocket, 5);
+    // Never below the scale a connected client accepts
+    if (ch.rate.SetMinScale(ch.server.GetMinScalePercent())) ch.scaleStep = ch.rate.GetScaleStep();
 
-    printf("Listening on port %d...\n", PORT);
+    if (!ch.rate.Update(nowMs)) return;
+    ch.quality = ch.rate.GetQuality();
+    ch.scaleStep = ch.rate.GetScaleStep();
+    const RateStats& s = ch.rate.GetLastStats();
+    printf("[%s] Rate: quality %d, scale x%.2f (limit: %s, %.0f fps, %.0f kbps, encode %.1f ms, send %.1f ms, backlog %u KB)\n",
+        ch.name, ch.rate.GetQuality(), ch.rate.GetScaleFactor(), RateLimitName(s.limit), s.fps, s.kbps,
+        s.encodeMs, s.sendMs, (unsigned)(s.backlogBytes / 1024));
     fflush(stdout);
+}
 
-    BYTE* frameBuffer = new BYTE[BUFFER_SIZE];
+static int recordCodec = CAPTURE_CODEC_LOSSLESS;
 
-    while (true) {
-        SOCKET clientSocket = accept(serverSocket, nullptr, nullptr);
-        if (clientSocket == INVALID_SOCKET) continue;
+static void StartRecording(const char* path, UINT width, UINT height) {
+    if (recorder.Start(path, width, height, recordCodec)) {
+        printf("Recording to %s (%ux%u, %s)\n", path, width, height, CaptureCodecName(recordCodec));
+    } else {
+        printf("Can't record to %s%s\n", path, recorder.IsRecording() ? " (already recording)" : "");
+    }
+    fflush(stdout);
+}
 
-        // Enable TCP_NODELAY on client socket too
-        setsockopt(clientSocket, IPPROTO_TCP, TCP_NODELAY, (char*)&flag, sizeof(flag));
+static void StopRecording() {
+    if (!recorder.IsRecording()) return;
+    recorder.Stop();
+    printf("Recording stopped: %llu frames, %llu dropped, %.1f MB%s\n",
+        (unsigned long long)recorder.GetFramesWritten(), (unsigned long long)recorder.GetFramesDropped(),
+        recorder.GetBytesWritten() / 1e6, recorder.HasFailed() ? " (write failed)" : "");
+    fflush(stdout);
+}
 
-        printf("Client connected\n");
+// Console: each line on stdin (Enter) prints the stage percentiles since
+// the previous report (only reads the histograms); "rec FILE" starts
+// recording the captured region and "stop" ends it.
+static void ReportThread(UINT width, UINT height) {
+    char line[512];
+    while (fgets(line, sizeof(line), stdin)) {
+        line[strcspn(line, "\r\n")] = 0;
+        if (strncmp(line, "rec ", 4) == 0) StartRecording(line + 4, width, height);
+        else if (strcmp(line, "stop") == 0) StopRecording();
+        else latency.Report("");
         fflush(stdout);
+    }
+}
 
-        int framesSent = 0;
-        auto startTime = std::chrono::steady_clock::now();
-        int lastFpsReport = 0;
+// --roi name=x,y,w,h[@scale][#output]
+struct RegionArg {
+    char name[32];
+    UINT x, y, width, height;
+    double scale;  // 0 = use --scale
+    int output;    // Output number (--list-outputs), 0 = first
+};
 
-        while (true) {
-            int frameSize = capture.CaptureFrameJPEG(frameBuffer, BUFFER_SIZE);
-            if (frameSize == -2) {
-                // Timeout, no new frame
-                continue;
+static bool ParseRegion(const char* text, RegionArg* region) {
+    memset(region, 0, sizeof(*region));
+    int fields = sscanf(text, "%31[^=]=%u,%u,%u,%u", region->name, &region->x, &region->y,
+        &region->width, &region->height);
+    const char* at = strchr(text, '@');
+    const char* hash = strchr(text, '#');
+    if (at && sscanf(at + 1, "%lf", &region->scale) != 1) return false;
+    if (hash && sscanf(hash + 1, "%d", &region->output) != 1) return false;
+    return fields == 5 && region->width > 0 && region->height > 0 && region->output >= 0;
+}
+
+// --output N[:fps[:quality]]
+struct OutputArg {
+    int index;
+    int fps;      // -1 = use --fps
+    int quality;  // -1 = use the quality argument
+};
+
+static bool ParseOutput(const char* text, OutputArg* output) {
+    output->fps = output->quality = -1;
+    int fields = sscanf(text, "%d:%d:%d", &output->index, &output->fps, &output->quality);
+    return fields >= 1 && output->index >= 0 && output->index < DXGI_MAX_OUTPUTS;
+}
+
+// One captured monitor: its own duplication, capture thread, pacing and
+// JPEG quality. Its channels go through the shared rings and encoders.
+struct CaptureOutput {
+    DxgiOutputInfo info;
+    int fps = 0;
+    int quality = 0;
+    int channels = 0;
+    ScreenCapture capture;
+};
+
+int main(int argc, char* argv[]) {
+    int quality = 60;
+    int encoderCount = DEFAULT_ENCODERS;
+    bool useDelta = false;
+    bool useMoves = false;
+    bool useTileCodecs = false;
+    bool useWic = false;
+    ChromaSubsampling subsampling = CHROMA_420;
+    int restartInterval = 0;
+    int threadCount = JobSystem::DefaultWorkerCount();
+    double scale = 1.0;
+    int fps = DEFAULT_FPS;
+    int targetFps = 0;
+    int maxKbps = 0;
+    bool adaptiveScale = false;
+    int wsPort = 0;
+    const char* recordPath = nullptr;
+    RegionArg regions[MAX_CHANNELS];
+    int regionCount = 0;
+    OutputArg outputArgs[DXGI_MAX_OUTPUTS];
+    int outputArgCount = 0;
+    bool listOutputs = false;
+    int positional = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--delta") == 0) {
+            useDelta = true;
+        } else if (strcmp(argv[i], "--moves") == 0) {
+            useMoves = true;
+        } else if (strcmp(argv[i], "--tile-codecs") == 0) {
+            useTileCodecs = true;
+        } else if (strcmp(argv[i], "--wic") == 0) {
+            useWic = true;
+        } else if (strcmp(argv[i], "--subsampling") == 0 && i + 1 < argc) {
+            int mode = atoi(argv[++i]);
+            subsampling = mode == 444 ? CHROMA_444 : (mode == 422 ? CHROMA_422 : CHROMA_420);
+        } else if (strcmp(argv[i], "--restart") == 0 && i + 1 < argc) {
+            restartInterval = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threadCount = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--scale") == 0 && i + 1 < argc) {
+            scale = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--fps") == 0 && i + 1 < argc) {
+            fps = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--target-fps") == 0 && i + 1 < argc) {
+            targetFps = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--max-kbps") == 0 && i + 1 < argc) {
+            maxKbps = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--adaptive-scale") == 0) {
+            adaptiveScale = true;
+        } else if (strcmp(argv[i], "--ws") == 0 && i + 1 < argc) {
+            wsPort = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            recordPath = argv[++i];
+        } else if (strcmp(argv[i], "--record-raw") == 0) {
+            recordCodec = CAPTURE_CODEC_RAW;
+        } else if (strcmp(argv[i], "--roi") == 0 && i + 1 < argc) {
+            if (regionCount == MAX_CHANNELS || !ParseRegion(argv[++i], &regions[regionCount])) {
+                printf("Invalid or too many --roi (max %d, format name=x,y,w,h[@scale])\n", MAX_CHANNELS);
+                fflush(stdout);
+                return 1;
             }
-            if (frameSize <= 0) {
-                Sleep(1);
-                continue;
+            regionCount++;
+        } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            if (outputArgCount == DXGI_MAX_OUTPUTS || !ParseOutput(argv[++i], &outputArgs[outputArgCount])) {
+                printf("Invalid --output (format N[:fps[:quality]], see --list-outputs)\n");
+                fflush(stdout);
+                return 1;
             }
+            outputArgCount++;
+        } else if (strcmp(argv[i], "--list-outputs") == 0) {
+            listOutputs = true;
+        } else if (positional == 0) {
+            quality = atoi(argv[i]);
+            positional++;
+        } else if (positional == 1) {
+            encoderCount = atoi(argv[i]);
+            positional++;
+        }
+    }
+    if (encoderCount < 1) encoderCount = 1;
+    if (restartInterval < 0) restartInterval = 0;
+    if (threadCount < 0) threadCount = 0;
+    if (quality < 1 || quality > 100) quality = 60;
+    if (maxKbps < 0) maxKbps = 0;
+    bool rateControl = targetFps > 0 || maxKbps > 0 || adaptiveScale;
+    if (fps < 0) fps = 0;
+    if (useMoves && !useDelta) {
+        printf("--moves needs --delta, ignored\n");
+        useMoves = false;
+    }
+    if (useTileCodecs && !useDelta) {
+        printf("--tile-codecs needs --delta, ignored\n");
+        useTileCodecs = false;
+    }
 
-            // Send frame size (4 bytes) then frame data
-            if (send(clientSocket, (char*)&frameSize, 4, 0) <= 0) break;
+    DxgiOutputInfo monitors[DXGI_MAX_OUTPUTS];
+    int monitorCount = EnumerateOutputs(monitors, DXGI_MAX_OUTPUTS);
+    if (listOutputs) {
+        printf("Outputs:\n");
+        PrintOutputs(monitors, monitorCount);
+        fflush(stdout);
+        return monitorCount > 0 ? 0 : 1;
+    }
 
-            int sent = 0;
-            while (sent < frameSize) {
-                int result = send(clientSocket, (char*)(frameBuffer + sent), frameSize - sent, 0);
-                if (result <= 0) break;
-                sent += result;
-            }
-            if (sent < frameSize) break;
+    // Outputs named by --output in that order, then any only an --roi names;
+    // without either just output 0 (the primary monitor on most systems)
+    for (int i = 0; i < regionCount; i++) {
+        bool listed = false;
+        for (int j = 0; j < outputArgCount; j++) listed = listed || outputArgs[j].index == regions[i].output;
+        if (!listed && outputArgCount < DXGI_MAX_OUTPUTS) outputArgs[outputArgCount++] = { regions[i].output, -1, -1 };
+    }
+    if (outputArgCount == 0) outputArgs[outputArgCount++] = { 0, -1, -1 };
 
-            framesSent++;
+    printf("SimWidget JPEG Capture Service v3.7\n");
+    printf("Port: %d, Quality: %d, Encoders: %d, Pool threads: %d, Mode: %s, Pacing: %d FPS%s\n", PORT, quality,
+        encoderCount, threadCount, useDelta ? (useMoves ? "delta + moves" : "delta") : "full", fps, fps > 0 ? "" : " (off)");
+    if (useTileCodecs) printf("Tile codecs: solid / palette / lossless / JPEG per delta tile\n");
+    if (useWic) {
+        printf("Encoder: WIC\n");
+    } else {
+        printf("Encoder: built-in, chroma %s, restart %d, SIMD: %s\n",
+            ChromaSubsamplingName(subsampling), restartInterval, SimdLevelName(GetSimdLevel()));
+    }
+    if (rateControl) {
+        printf("Rate control: target %d FPS (0 = each output's pacing), ceiling %d kbps (0 = none), "
+            "minimum quality %d, adaptive scale %s\n", targetFps, maxKbps, RATE_MIN_QUALITY, adaptiveScale ? "on" : "off");
+    }
+    fflush(stdout);
 
-            // Report FPS every second
-            auto now = std::chrono::steady_clock::now();
-            auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - startTime).count();
-            if (elapsed >= 1000) {
-                int fps = framesSent - lastFpsReport;
-                printf("FPS: %d, Size: %d KB\n", fps, frameSize / 1024);
+    // One duplication per output, each on a device of its own adapter
+    int outputCount = outputArgCount;
+    std::vector<CaptureOutput> outputs(outputCount);
+    for (int i = 0; i < outputCount; i++) {
+        const OutputArg& arg = outputArgs[i];
+        CaptureOutput& out = outputs[i];
+        if (arg.index >= monitorCount) {
+            printf("No output %d (%d found):\n", arg.index, std::max(monitorCount, 0));
+            PrintOutputs(monitors, monitorCount);
+            fflush(stdout);
+            return 1;
+        }
+        out.info = monitors[arg.index];
+        out.fps = arg.fps >= 0 ? arg.fps : fps;
+        out.quality = arg.quality >= 1 && arg.quality <= 100 ? arg.quality : quality;
+        if (!out.capture.Initialize(out.info)) {
+            printf("Failed to initialize capture of output %d\n", arg.index);
+            fflush(stdout);
+            return 1;
+        }
+        printf("Output %d: %s %ux%u at %ld,%ld (%s), %d FPS, quality %d\n", arg.index, out.info.name,
+            out.capture.GetWidth(), out.capture.GetHeight(), (long)out.info.desktop.left, (long)out.info.desktop.top,
+            out.info.adapterName, out.fps, out.quality);
+    }
+    fflush(stdout);
+
+    // --roi channels in the order given, then the whole of each output no
+    // --roi covers ("desktop" when only one output is captured)
+    RegionArg channelArgs[MAX_CHANNELS + DXGI_MAX_OUTPUTS];
+    int channelOutput[MAX_CHANNELS + DXGI_MAX_OUTPUTS];
+    int channelArgCount = 0;
+    for (int i = 0; i < regionCount; i++) {
+        for (int j = 0; j < outputCount; j++) {
+            if (outputArgs[j].index != regions[i].output) continue;
+            channelOutput[channelArgCount] = j;
+            channelArgs[channelArgCount++] = regions[i];
+            outputs[j].channels++;
+            break;
+        }
+    }
+    for (int j = 0; j < outputCount; j++) {
+        if (outputs[j].channels > 0) continue;
+        RegionArg& r = channelArgs[channelArgCount];
+        memset(&r, 0, sizeof(r));
+        if (outputCount == 1) strcpy(r.name, "desktop");
+        else snprintf(r.name, sizeof(r.name), "output%d", outputArgs[j].index);
+        r.width = outputs[j].capture.GetWidth();
+        r.height = outputs[j].capture.GetHeight();
+        r.output = outputArgs[j].index;
+        channelOutput[channelArgCount++] = j;
+        outputs[j].channels++;
+    }
+
+    // Shared by the capture thread and every encode worker
+    JobSystem jobs;
+    jobs.Start(threadCount);
+    recorder.SetJobSystem(&jobs);
+
+    std::vector<Channel> channels(channelArgCount);
+    std::vector<D3D11_BOX> bounds(outputCount);
+    for (int j = 0; j < outputCount; j++) {
+        bounds[j] = { outputs[j].capture.GetWidth(), outputs[j].capture.GetHeight(), 0, 0, 0, 1 };
+    }
+    UINT maxOutWidth = 0;
+    size_t rawSize = 0;
+    for (int i = 0; i < channelArgCount; i++) {
+        const RegionArg& r = channelArgs[i];
+        Channel& ch = channels[i];
+        CaptureOutput& out = outputs[channelOutput[i]];
+        ScreenCapture& capture = out.capture;
+        double s = r.scale > 0 ? r.scale : scale;
+        if (r.x + r.width > capture.GetWidth() || r.y + r.height > capture.GetHeight() || s <= 0 || s > 1) {
+            printf("Region %s (%u,%u %ux%u @%.3f) is outside the %ux%u output %d or has an invalid scale\n",
+                r.name, r.x, r.y, r.width, r.height, s, capture.GetWidth(), capture.GetHeight(), r.output);
+            fflush(stdout);
+            for (auto& o : outputs) o.capture.Cleanup();
+            return 1;
+        }
+
+        strcpy(ch.name, r.name);
+        ch.output = channelOutput[i];
+        ch.x = r.x;
+        ch.y = r.y;
+        ch.width = r.width;
+        ch.height = r.height;
+        ch.outWidth = ScaledSize(r.width, s);
+        ch.outHeight = ScaledSize(r.height, s);
+        ch.port = PORT + i;
+        ch.pixels.Configure(ch.width, ch.height, ch.outWidth, ch.outHeight);
+        ch.pixels.SetJobSystem(&jobs);
+        // The move detector reads keyframes as BGRA too
+        ch.planarChroma = useWic || useMoves ? PIPELINE_NO_CHROMA : (int)subsampling;
+        ch.useMoves = useMoves;
+        if (useMoves) ch.moves.Initialize(ch.outWidth, ch.outHeight);
+        ch.useTileCodecs = useTileCodecs;
+
+        // Smaller steps only shrink, so raw slots sized for step 0 fit them all
+        int steps = adaptiveScale ? RATE_SCALE_STEPS : 1;
+        for (int step = 0; step < steps; step++) {
+            ch.stepWidth[step] = step ? ScaledSize(r.width, s * RateScaleFactor(step)) : ch.outWidth;
+            ch.stepHeight[step] = step ? ScaledSize(r.height, s * RateScaleFactor(step)) : ch.outHeight;
+            if (useDelta && !ch.delta[step].Initialize(ch.stepWidth[step], ch.stepHeight[step])) {
+                printf("Failed to initialize delta tiles\n");
                 fflush(stdout);
-                lastFpsReport = framesSent;
-                startTime = now;
+                return 1;
             }
         }
 
-        closesocket(clientSocket);
-        printf("Client disconnected (sent %d frames)\n", framesSent);
+        // Quality and the rate target follow the channel's output
+        ch.quality = out.quality;
+        if (rateControl) {
+            int target = targetFps > 0 ? targetFps : (out.fps > 0 ? out.fps : DEFAULT_TARGET_FPS);
+            ch.rate.SetQualityRange(std::min(RATE_MIN_QUALITY, out.quality), out.quality);
+            ch.rate.SetAdaptiveScale(adaptiveScale);
+            ch.rate.Configure(target, maxKbps, encoderCount, out.quality);
+        }
+
+        D3D11_BOX& box = bounds[ch.output];
+        box.left = std::min(box.left, ch.x);
+        box.top = std::min(box.top, ch.y);
+        box.right = std::max(box.right, ch.x + ch.width);
+        box.bottom = std::max(box.bottom, ch.y + ch.height);
+        maxOutWidth = std::max(maxOutWidth, ch.outWidth);
+        // In delta mode each raw slot also carries the frame's dirty map (and
+        // with --moves its move payload); YCbCr frames are padded to whole MCUs
+        size_t size = (size_t)ch.outWidth * ch.outHeight * 4 + (useDelta ? ch.delta[0].GetTileCount() : 0);
+        if (useMoves) size += MoveDetector::MaxMovesSize(ch.delta[0].GetTileCount());
+        size_t planeSize = JpegFramePlanes(ch.outWidth, ch.outHeight, subsampling, nullptr, nullptr);
+        rawSize = std::max(rawSize, std::max(size, planeSize));
+
+        printf("Channel %s: output %d, %ux%u at %u,%u -> %ux%u (%s), port %d\n", ch.name, r.output, ch.width,
+            ch.height, ch.x, ch.y, ch.outWidth, ch.outHeight, ScaleFilterName(ch.pixels.GetFilter()), ch.port);
+        if (useDelta) {
+            printf("  delta: %dx%d tiles of %d px (SIMD: %s)\n", ch.delta[0].GetTilesX(), ch.delta[0].GetTilesY(),
+                ch.delta[0].GetTileSize(), SimdLevelName(GetSimdLevel()));
+        }
+    }
+    fflush(stdout);
+
+    // Only copy the part of each output some channel shows
+    for (int j = 0; j < outputCount; j++) {
+        outputs[j].capture.SetRegion(bounds[j].left, bounds[j].top, bounds[j].right, bounds[j].bottom);
+    }
+
+    // One encoder per worker - the built-in encoder keeps per-thread scratch
+    std::vector<JpegEncoder> encoders(encoderCount);
+    for (auto& encoder : encoders) {
+        if (!encoder.Initialize(useWic, subsampling, restartInterval, maxOutWidth, &jobs)) {
+            for (auto& o : outputs) o.capture.Cleanup();
+            return 1;
+        }
+    }
+
+    // Raw ring needs one slot per encoder in flight plus room to queue
+    int channelCount = (int)channels.size();
+    FrameRing rawRing, encodedRing;
+    if (!rawRing.Initialize(RAW_SLOTS * channelCount + encoderCount, rawSize) ||
+        !encodedRing.Initialize((ENCODED_SLOTS + 2 * BROADCAST_MAX_CLIENTS) * channelCount + encoderCount,
+            BUFFER_SIZE)) {
+        printf("Failed to allocate frame rings\n");
+        fflush(stdout);
+        return 1;
+    }
+
+    if (!NetStartup()) {
+        printf("Failed to initialize Winsock\n");
         fflush(stdout);
+        return 1;
+    }
+
+    for (auto& ch : channels) {
+        if (!ch.server.Start(ch.port)) {
+            printf("Failed to listen on port %d\n", ch.port);
+            fflush(stdout);
+            return 1;
+        }
+        int channelWsPort = wsPort + (int)(&ch - channels.data());
+        if (wsPort > 0 && !ch.server.StartWebSocket(channelWsPort)) {
+            printf("Failed to listen on WebSocket port %d\n", channelWsPort);
+            fflush(stdout);
+            return 1;
+        }
+        ch.sequencer.Initialize(&encodedRing, ENCODED_SLOTS + encoderCount, &ch.streamBroken);
+        ch.server.SetLatencyHistograms(&latency[STAGE_SEND], &latency[STAGE_TOTAL]);
+        ch.server.SetStreamInfo(WIRE_CODEC_JPEG, ch.outWidth, ch.outHeight, outputs[ch.output].fps);
+        ch.server.SetStreamMoves(useMoves);
+        ch.server.SetStreamTileCodecs(useTileCodecs);
     }
 
-    delete[] frameBuffer;
-    capture.Cleanup();
-    WSACleanup();
+    printf("Listening on port%s %d-%d (up to %d clients each)...\n", channelCount > 1 ? "s" : "",
+        PORT, PORT + channelCount - 1, BROADCAST_MAX_CLIENTS);
+    if (wsPort > 0 && channelCount > 1) {
+        printf("WebSocket endpoints: ws://localhost:%d/ to ws://localhost:%d/\n", wsPort, wsPort + channelCount - 1);
+    } else if (wsPort > 0) {
+        printf("WebSocket endpoint: ws://localhost:%d/\n", wsPort);
+    }
+    // Recording takes the first output's captured region
+    ScreenCapture& recorded = outputs[0].capture;
+    printf("Press Enter for per-stage latency percentiles, \"rec FILE\" / \"stop\" to record output %d\n",
+        outputArgs[0].index);
+    fflush(stdout);
+    if (recordPath) StartRecording(recordPath, recorded.GetRegionWidth(), recorded.GetRegionHeight());
+    std::thread(ReportThread, recorded.GetRegionWidth(), recorded.GetRegionHeight()).detach();
+
+    // Outputs capture in parallel, each paced on its own
+    std::vector<std::thread> captureThreads;
+    for (int j = 0; j < outputCount; j++) {
+        captureThreads.emplace_back(CaptureThread, &outputs[j].capture, &rawRing, &channels, j, useDelta,
+            outputs[j].fps, j == 0);
+    }
+    std::vector<std::thread> encodeThreads;
+    for (int i = 0; i < encoderCount; i++) {
+        encodeThreads.emplace_back(EncodeThread, &encoders[i], &rawRing, &encodedRing, &channels, useDelta);
+    }
+
+    // Stage 3: sender (this thread) - one encode per channel, broadcast to its clients
+    auto startTime = std::chrono::steady_clock::now();
+    uint64_t lastDropped = 0;
+    bool anyClients = false;
+
+    while (true) {
+        // Don't wait on the ring while clients still have bytes to write
+        bool pendingWrites = false;
+        for (auto& ch : channels) pendingWrites = pendingWrites || ch.server.HasPendingWrites();
+        uint64_t droppedBefore = encodedRing.GetDropped();
+        FrameSlot* frame = encodedRing.AcquireRead(pendingWrites ? 0 : 2);
+        if (encodedRing.GetDropped() != droppedBefore) {
+            // An encoded frame was reclaimed before we got to it
+            for (auto& ch : channels) ch.sequencer.Resync();
+        }
+        if (frame) {
+            // Encoders may finish out of order - the sequencer restores capture order
+            Channel& ch = channels[frame->channel];
+            ch.sequencer.Push(frame, [&](FrameSlot* ready) {
+                latency.RecordSince(STAGE_REORDER, ready->handoffUs, LatencyNowUs());
+                ch.lastFrameSize = (int)ready->size;
+                ch.server.Broadcast(&encodedRing, ready);
+            });
+        }
+
+        bool hadClients = anyClients;
+        anyClients = false;
+        for (int i = 0; i < channelCount; i++) {
+            Channel& ch = channels[i];
+            // Only the first server waits for socket activity
+            ch.server.Service(i == 0 && !frame ? 1 : 0);
+            if (ch.server.TakeKeyframeRequest()) ch.keyframeRequested = true;
+            ch.deltasAllowed = ch.server.AllClientsTakeDeltas();
+            ch.movesAllowed = ch.server.AllClientsTakeMoves();
+            ch.tileCodecsAllowed = ch.server.AllClientsTakeTileCodecs();
+            ch.fpsLimit = ch.server.GetClientFpsLimit();
+
+            // Clients still in the handshake don't get frames yet
+            bool connected = ch.server.GetStreamingClientCount() > 0;
+            if (ch.clientConnected && !connected) ch.sequencer.Reset();
+            ch.clientConnected = connected;
+            anyClients = anyClients || connected;
+            if (rateControl) {
+                UpdateRate(ch, std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now().time_since_epoch()).count());
+            }
+        }
+        if (hadClients && !anyClients) {
+            rawRing.Flush();
+            encodedRing.Flush();
+        }
+
+        // Report FPS every second
+        auto now = std::chrono::steady_clock::now();
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - startTime).count();
+        if (elapsed >= 1000 && anyClients) {
+            uint64_t dropped = rawRing.GetDropped() + encodedRing.GetDropped();
+            for (auto& ch : channels) dropped += ch.server.GetFramesDropped();
+            for (auto& ch : channels) {
+                uint64_t sent = ch.server.GetFramesSent();
+                int clients = ch.server.GetClientCount();
+                if (clients > 0) {
+                    printf("%s%s%sFPS: %d, Size: %d KB, Clients: %d, Dropped: %llu\n",
+                        channelCount > 1 ? "[" : "", channelCount > 1 ? ch.name : "", channelCount > 1 ? "] " : "",
+                        (int)((sent - ch.lastSent) / clients), ch.lastFrameSize / 1024, clients,
+                        (unsigned long long)(dropped - lastDropped));
+                }
+                ch.lastSent = sent;
+            }
+            fflush(stdout);
+            lastDropped = dropped;
+            startTime = now;
+        } else if (elapsed >= 1000) {
+            for (auto& ch : channels) ch.lastSent = ch.server.GetFramesSent();
+            startTime = now;
+        }
+    }
+
+    running = false;
+    rawRing.Close();
+    encodedRing.Close();
+    for (auto& t : captureThreads) t.join();
+    for (auto& t : encodeThreads) t.join();
+
+    for (auto& encoder : encoders) encoder.Cleanup();
+    jobs.Stop();
+    for (auto& o : outputs) o.capture.Cleanup();
+    for (auto& ch : channels) ch.server.Stop();
+    NetCleanup();
     return 0;
 }
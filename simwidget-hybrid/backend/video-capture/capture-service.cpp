@@ -1,6 +1,48 @@
 // High-Performance Screen Capture Service
 // Uses Windows Desktop Duplication API (DXGI) for minimal latency
-// Compile: cl /EHsc /O2 capture-service.cpp /link d3d11.lib dxgi.lib ole32.lib ws2_32.lib
+// Compile: cl /EHsc /O2 capture-service.cpp /link d3d11.lib dxgi.lib ole32.lib ws2_32.lib winmm.lib
+//
+// A capture thread fills frame slots; the main thread broadcasts each one to
+// every connected client (common/broadcast-server.h), sharing the slot
+// by reference count instead of copying it per client.
+//
+// Delta mode (--delta) sends only the 64x64 tiles that changed since the
+// previous frame (common/tile-delta.h), using DXGI dirty rects as a hint.
+// The full-frame staging copy is split into row bands across a small
+// work-stealing pool (common/job-system.h, --threads N). Delta keyframes are
+// copied and hashed in the same pass (common/pixel-pipeline.h). With
+// --moves, scrolled and panned tiles go out as copy-rect commands
+// (common/move-detect.h) ahead of the remaining tiles, from DXGI's move rects
+// or a block search against the previous frame.
+//
+// Lossless mode (--lossless) compresses each frame with a fast pixel-exact
+// codec (common/lossless-codec.h); with --xor, frames after a keyframe are
+// coded against the previous frame so unchanged pixels cost next to nothing.
+//
+// Capture is paced to --fps deadlines (common/frame-pacer.h): at each one the
+// thread takes whatever the desktop shows, so frames leave evenly spaced.
+//
+// Every stage is timed on the steady clock into lock-free histograms
+// (common/latency-histogram.h); press Enter for p50 / p99 / p99.9 per stage.
+// Each frame header carries its sequence number and capture timestamp so
+// clients can measure glass-to-glass latency themselves.
+//
+// Clients speak wire protocol v2 (common/wire-protocol.h): the hello says
+// whether they apply deltas and how fast they want frames. While one of them
+// takes keyframes only, every frame is captured as a keyframe; capture is
+// paced no faster than the fastest client wants. v1 clients keep the old
+// header (width, height | flags, seq, timestamp).
+//
+// --ws PORT also serves the stream to browsers as WebSocket binary messages
+// (common/websocket.h) next to the TCP port; no bridge process needed.
+//
+// --record FILE (or "rec FILE" on the console, "stop" to finish) writes every
+// captured frame with its timestamp and dirty rects to a capture file
+// (common/capture-file.h, lossless unless --record-raw) on a background
+// thread, for replay through the pipeline off Windows.
+//
+// --output N captures another monitor (numbered by --list-outputs, on any
+// adapter; dxgi-outputs.h) instead of the first one.
 
 #define WIN32_LEAN_AND_MEAN
 #include <winsock2.h>
@@ -8,10 +50,52 @@
 #include <d3d11.h>
 #include <dxgi1_2.h>
 #include <stdio.h>
-#pragma comment(lib, "ws2_32.lib")
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "common/broadcast-server.h"
+#include "common/capture-file.h"
+#include "common/frame-pacer.h"
+#include "common/frame-ring.h"
+#include "common/job-system.h"
+#include "common/latency-histogram.h"
+#include "common/lossless-codec.h"
+#include "common/move-detect.h"
+#include "common/pixel-pipeline.h"
+#include "common/tile-delta.h"
+#include "common/wire-protocol.h"
+#include "dxgi-outputs.h"
 
 #define PORT 9998
-#define BUFFER_SIZE 16777216  // 16MB max frame (supports up to 4K)
+#define FRAME_HEADER_SIZE WIRE_HEADER_SIZE  // Written at publish time (WriteFrameHeaders)
+#define FRAME_SLOTS 2         // Captured frames waiting for the sender
+                              // (plus two per client: in flight + pending)
+#define DELTA_FRAME_FLAG 0x80000000u  // v1 header: set in the height field of delta frames
+#define LOSSLESS_FRAME_FLAG 0x40000000u  // v1 header: set in the height field of lossless streams
+#define KEYFRAME_MIN_INTERVAL_MS 250  // Rate limit for client resync requests
+#define DEFAULT_FPS 60                // Capture pacing (--fps, 0 = as fast as the desktop updates)
+
+static_assert(sizeof(RECT) == sizeof(TileRect), "DXGI dirty rects are passed as TileRect");
+
+// Pipeline stages timed per frame
+enum Stage {
+    STAGE_PRESENT,   // Desktop present -> frame acquired (waiting for the pacer deadline)
+    STAGE_ACQUIRE,   // AcquireNextFrame call
+    STAGE_COPY,      // CopyResource + Map (waits for the GPU copy)
+    STAGE_PACK,      // Pixels / delta tiles / lossless stream into the slot
+    STAGE_QUEUE,     // Frame ring -> sender
+    STAGE_SEND,      // Broadcast -> last byte written, per client
+    STAGE_TOTAL,     // Capture timestamp -> last byte written, per client
+    STAGE_COUNT
+};
+static const char* const stageNames[STAGE_COUNT] = {
+    "present", "acquire", "copy", "pack", "queue", "send", "total"
+};
+static LatencyStages latency(stageNames, STAGE_COUNT);
+static CaptureRecorder recorder;
 
 class ScreenCapture {
 private:
@@ -20,48 +104,75 @@ private:
     IDXGIOutputDuplication* duplication = nullptr;
     ID3D11Texture2D* stagingTexture = nullptr;
     UINT width = 0, height = 0;
+    std::vector<TileRect> dirtyRects;
+    std::vector<DXGI_OUTDUPL_MOVE_RECT> moveRects;
+    std::vector<MoveVector> moveHints;
+    JobSystem* jobs = nullptr;
+    PixelPipeline pixels;  // Copy + tile hash for delta keyframes
+    LARGE_INTEGER qpcFrequency = {};
+
+    // The acquired frame (AcquireFrame() -> CaptureFrame())
+    DXGI_OUTDUPL_FRAME_INFO frameInfo = {};
+    D3D11_MAPPED_SUBRESOURCE mapping = {};
+    bool mapped = false;
+    uint64_t captureUs = 0;
+    uint64_t mappedUs = 0;
+
+    void Unmap() {
+        if (!mapped) return;
+        context->Unmap(stagingTexture, 0);
+        mapped = false;
+    }
+
+    // Dirty rects DXGI reported for the acquired frame, plus the destinations
+    // of its move rects (DXGI leaves those out of the dirty rects); the move
+    // offsets land in moveHints. Returns the rect count, or -1 (hints =
+    // nullptr) when there is no usable metadata.
+    int GetDirtyHints(const TileRect** hints) {
+        *hints = nullptr;
+        moveHints.clear();
+        if (frameInfo.LastPresentTime.QuadPart == 0) {
+            // Only the cursor changed - the desktop image is identical
+            dirtyRects.resize(1);
+            *hints = dirtyRects.data();
+            return 0;
+        }
+        if (frameInfo.TotalMetadataBufferSize == 0) return -1;
+
+        dirtyRects.resize(frameInfo.TotalMetadataBufferSize / sizeof(RECT) + 1);
+        UINT bytes = 0;
+        HRESULT hr = duplication->GetFrameDirtyRects((UINT)(dirtyRects.size() * sizeof(RECT)),
+            (RECT*)dirtyRects.data(), &bytes);
+        if (FAILED(hr)) return -1;
+        int count = (int)(bytes / sizeof(RECT));
+
+        moveRects.resize(frameInfo.TotalMetadataBufferSize / sizeof(DXGI_OUTDUPL_MOVE_RECT) + 1);
+        hr = duplication->GetFrameMoveRects((UINT)(moveRects.size() * sizeof(DXGI_OUTDUPL_MOVE_RECT)),
+            moveRects.data(), &bytes);
+        if (FAILED(hr)) return -1;
+        int moveCount = (int)(bytes / sizeof(DXGI_OUTDUPL_MOVE_RECT));
+        dirtyRects.resize(count);
+        for (int i = 0; i < moveCount; i++) {
+            const DXGI_OUTDUPL_MOVE_RECT& m = moveRects[i];
+            const RECT& d = m.DestinationRect;
+            dirtyRects.push_back({ d.left, d.top, d.right, d.bottom });
+            moveHints.push_back({ d.left - m.SourcePoint.x, d.top - m.SourcePoint.y });
+        }
+        *hints = dirtyRects.data();
+        return (int)dirtyRects.size();
+    }
 
 public:
-    bool Initialize() {
-        // Create D3D11 device
-        D3D_FEATURE_LEVEL featureLevel;
-        HRESULT hr = D3D11CreateDevice(nullptr, D3D_DRIVER_TYPE_HARDWARE, nullptr,
-            0, nullptr, 0, D3D11_SDK_VERSION, &device, &featureLevel, &context);
-        if (FAILED(hr)) return false;
-
-        // Get DXGI device
-        IDXGIDevice* dxgiDevice;
-        hr = device->QueryInterface(__uuidof(IDXGIDevice), (void**)&dxgiDevice);
-        if (FAILED(hr)) return false;
-
-        // Get adapter
-        IDXGIAdapter* adapter;
-        hr = dxgiDevice->GetAdapter(&adapter);
-        dxgiDevice->Release();
-        if (FAILED(hr)) return false;
-
-        // Get output (monitor)
-        IDXGIOutput* output;
-        hr = adapter->EnumOutputs(0, &output);
-        adapter->Release();
-        if (FAILED(hr)) return false;
-
-        // Get output1 for duplication
-        IDXGIOutput1* output1;
-        hr = output->QueryInterface(__uuidof(IDXGIOutput1), (void**)&output1);
-        output->Release();
-        if (FAILED(hr)) return false;
-
-        // Create duplication
-        hr = output1->DuplicateOutput(device, &duplication);
-        output1->Release();
-        if (FAILED(hr)) return false;
+    // Duplicate one monitor (dxgi-outputs.h) on a device of its own adapter
+    bool Initialize(const DxgiOutputInfo& output) {
+        if (!OpenOutput(output, &device, &context, &duplication)) return false;
 
         // Get output description
         DXGI_OUTDUPL_DESC desc;
         duplication->GetDesc(&desc);
         width = desc.ModeDesc.Width;
         height = desc.ModeDesc.Height;
+        pixels.Configure(width, height, width, height);
 
         // Create staging texture for CPU access
         D3D11_TEXTURE2D_DESC texDesc = {};
@@ -74,24 +185,23 @@ public:
         texDesc.Usage = D3D11_USAGE_STAGING;
         texDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
 
-        hr = device->CreateTexture2D(&texDesc, nullptr, &stagingTexture);
+        HRESULT hr = device->CreateTexture2D(&texDesc, nullptr, &stagingTexture);
+        QueryPerformanceFrequency(&qpcFrequency);
         return SUCCEEDED(hr);
     }
 
     bool hasFrame = false;
 
-    int CaptureFrame(BYTE* buffer, int maxSize) {
-        DXGI_OUTDUPL_FRAME_INFO frameInfo;
-        IDXGIResource* resource = nullptr;
+    // Wait up to timeoutMs (0 when paced) for a desktop update and map it.
+    // Returns 0 with the frame mapped, -2 on timeout, -3 if access was lost,
+    // -1 on error. Recording sees every acquired frame here; CaptureFrame()
+    // (or ReleaseFrame() when no slot is free) unmaps it.
+    int AcquireFrame(UINT timeoutMs) {
+        ReleaseFrame();
 
-        // Release previous frame if we had one
-        if (hasFrame) {
-            duplication->ReleaseFrame();
-            hasFrame = false;
-        }
-
-        // Acquire new frame (500ms timeout)
-        HRESULT hr = duplication->AcquireNextFrame(500, &frameInfo, &resource);
+        IDXGIResource* resource = nullptr;
+        uint64_t startUs = LatencyNowUs();
+        HRESULT hr = duplication->AcquireNextFrame(timeoutMs, &frameInfo, &resource);
         if (hr == DXGI_ERROR_WAIT_TIMEOUT) {
             return -2;  // Timeout - screen didn't change
         }
@@ -106,6 +216,16 @@ public:
             return -1;
         }
         hasFrame = true;
+        uint64_t acquiredUs = LatencyNowUs();
+        latency.Record(STAGE_ACQUIRE, acquiredUs - startUs);
+        captureUs = acquiredUs;
+        if (frameInfo.LastPresentTime.QuadPart != 0) {
+            uint64_t presentUs = LatencyQpcToUs(frameInfo.LastPresentTime.QuadPart, qpcFrequency.QuadPart);
+            if (presentUs <= acquiredUs) {
+                captureUs = presentUs;
+                latency.Record(STAGE_PRESENT, acquiredUs - presentUs);
+            }
+        }
 
         // Get texture
         ID3D11Texture2D* texture;
@@ -122,42 +242,144 @@ public:
         texture->Release();
 
         // Map staging texture
-        D3D11_MAPPED_SUBRESOURCE mapped;
-        hr = context->Map(stagingTexture, 0, D3D11_MAP_READ, 0, &mapped);
+        hr = context->Map(stagingTexture, 0, D3D11_MAP_READ, 0, &mapping);
         if (FAILED(hr)) {
             printf("Map staging texture failed: 0x%08X\n", hr);
             fflush(stdout);
             return -1;
         }
+        mapped = true;
+        mappedUs = LatencyNowUs();
+        latency.Record(STAGE_COPY, mappedUs - acquiredUs);
+
+        if (recorder.IsRecording()) {
+            // Every captured frame, whatever goes out to clients
+            const TileRect* hints = nullptr;
+            int hintCount = GetDirtyHints(&hints);
+            recorder.Submit((const BYTE*)mapping.pData, mapping.RowPitch, captureUs, hints, hintCount);
+        }
+        return 0;
+    }
 
-        // Calculate size (simple BMP-like format: width, height, BGRA data)
-        int headerSize = 8;
+    // Capture the frame AcquireFrame() mapped into slot, then unmap it. With
+    // delta set, a non-keyframe carries only the tiles that changed (-2 if
+    // none did) unless that would be as big as the frame.
+    // With moves set too, it has to see every frame; with moveSearch also
+    // set, tiles that only shifted go out as moves in front of the tiles
+    // (FRAME_FLAG_MOVES).
+    // With lossless set, the frame is a lossless stream instead of raw BGRA.
+    // slot->timestampUs is set to the frame's present (or acquire) time; the
+    // caller fills in the sequence number and timestamp header fields.
+    int CaptureFrame(FrameSlot* slot, TileDelta* delta, MoveDetector* moves, bool moveSearch,
+                     LosslessEncoder* lossless, bool keyframe) {
+        BYTE* buffer = slot->data;
+        int maxSize = (int)slot->capacity;
+        slot->timestampUs = captureUs;
+
+        // Calculate size (header, BGRA data); the header itself is written at publish
+        int headerSize = FRAME_HEADER_SIZE;
         int dataSize = width * height * 4;
         int totalSize = headerSize + dataSize;
 
         if (totalSize > maxSize) {
             printf("Buffer too small: need %d, have %d\n", totalSize, maxSize);
             fflush(stdout);
-            context->Unmap(stagingTexture, 0);
+            Unmap();
             return -1;
         }
 
-        // Write header: width (4 bytes), height (4 bytes)
-        memcpy(buffer, &width, 4);
-        memcpy(buffer + 4, &height, 4);
+        BYTE* src = (BYTE*)mapping.pData;
+        slot->width = width;
+        slot->height = height;
+        slot->stride = width * 4;
+        slot->flags = 0;
+
+        bool copied = false;
+        if (delta) {
+            const TileRect* hints = nullptr;
+            int hintCount = keyframe ? -1 : GetDirtyHints(&hints);
+            int dirty;
+            if (keyframe && !lossless) {
+                // Goes out whole anyway: copy while hashing, one pass over the mapping
+                PixelTargets targets;
+                targets.bgra = buffer + headerSize;
+                targets.bgraStride = width * 4;
+                targets.tiles = delta;
+                dirty = pixels.Run(src, mapping.RowPitch, targets, hints, hintCount, keyframe);
+                copied = dirty >= 0;
+            } else {
+                dirty = delta->Detect(src, mapping.RowPitch, hints, hintCount, keyframe);
+            }
+
+            if (!keyframe && dirty == 0) {
+                Unmap();
+                return -2;  // Nothing visible changed
+            }
 
-        // Copy pixel data (handle pitch)
-        BYTE* dst = buffer + headerSize;
-        BYTE* src = (BYTE*)mapped.pData;
-        for (UINT y = 0; y < height; y++) {
-            memcpy(dst + y * width * 4, src + y * mapped.RowPitch, width * 4);
+            // Moved tiles leave the dirty map (keyframes only refresh the detector)
+            int moved = 0;
+            if (moves && dirty >= 0) {
+                moved = moves->Detect(src, mapping.RowPitch, delta, moveHints.data(), keyframe ? 0 : (int)moveHints.size(),
+                    moveSearch && !keyframe);
+            }
+            size_t movesSize = moved ? moves->GetMovesSize() : 0;
+            size_t deltaSize = headerSize + movesSize + delta->GetRawDeltaSize();
+            if (!keyframe && deltaSize < (size_t)totalSize) {
+                if (moved) moves->WriteMoves(buffer + headerSize);
+                delta->WriteRawDelta(src, mapping.RowPitch, buffer + headerSize + movesSize);
+                Unmap();
+                latency.Record(STAGE_PACK, LatencyNowUs() - mappedUs);
+
+                slot->flags = FRAME_FLAG_DELTA | (moved ? FRAME_FLAG_MOVES : 0);
+                slot->size = deltaSize;
+                return (int)deltaSize;
+            }
         }
 
-        context->Unmap(stagingTexture, 0);
+        if (lossless) {
+            if (!keyframe && frameInfo.LastPresentTime.QuadPart == 0) {
+                // Only the cursor moved; the encoder's reference is still current
+                Unmap();
+                return -2;
+            }
+            bool xorCoded = false;
+            int size = lossless->Encode(src, mapping.RowPitch, !keyframe, buffer + headerSize,
+                maxSize - headerSize, &xorCoded);
+            Unmap();
+            latency.Record(STAGE_PACK, LatencyNowUs() - mappedUs);
+            if (size < 0) {
+                printf("Lossless frame does not fit the slot\n");
+                fflush(stdout);
+                return -1;
+            }
+
+            // XOR frames depend on the previous one, just like tile deltas
+            slot->flags = xorCoded ? FRAME_FLAG_DELTA : 0;
+            slot->size = headerSize + size;
+            return headerSize + size;
+        }
+
+        // Copy pixel data (handle pitch) in row bands across the pool
+        if (!copied) ParallelCopyRows(jobs, buffer + headerSize, width * 4, src, mapping.RowPitch, width * 4, height);
+
+        Unmap();
+        latency.Record(STAGE_PACK, LatencyNowUs() - mappedUs);
+
+        slot->size = totalSize;
         return totalSize;
     }
 
+    // Let go of the acquired frame, mapped or not
+    void ReleaseFrame() {
+        Unmap();
+        if (hasFrame) {
+            duplication->ReleaseFrame();
+            hasFrame = false;
+        }
+    }
+
     void Cleanup() {
+        ReleaseFrame();
         if (stagingTexture) stagingTexture->Release();
         if (duplication) duplication->Release();
         if (context) context->Release();
@@ -166,105 +388,364 @@ public:
 
     UINT GetWidth() { return width; }
     UINT GetHeight() { return height; }
+
+    // Pool for the staging copy; null copies on the capture thread
+    void SetJobSystem(JobSystem* pool) {
+        jobs = pool;
+        pixels.SetJobSystem(pool);
+    }
 };
 
-int main() {
-    printf("SimWidget Capture Service v1.0\n");
-    printf("Port: %d\n", PORT);
+static std::atomic<bool> running(true);
+static std::atomic<bool> clientConnected(false);
+static std::atomic<bool> keyframeRequested(false);
+static std::atomic<bool> deltasAllowed(true);     // False while a client takes keyframes only
+static std::atomic<bool> movesAllowed(true);      // False while a client can't apply moves
+static std::atomic<int> clientFpsLimit(0);        // BroadcastServer::GetClientFpsLimit()
+
+// v2 header at the start of the slot, v1 header beside it for old clients
+static void WriteFrameHeaders(FrameSlot* slot, bool lossless) {
+    bool isDelta = (slot->flags & FRAME_FLAG_DELTA) != 0;
+    WireFrameHeader header;
+    header.codec = lossless ? WIRE_CODEC_LOSSLESS : WIRE_CODEC_BGRA;
+    header.flags = !isDelta ? WIRE_FLAG_KEYFRAME : lossless ? WIRE_FLAG_DELTA : WIRE_FLAG_DELTA | WIRE_FLAG_TILES;
+    if (slot->flags & FRAME_FLAG_MOVES) header.flags |= WIRE_FLAG_MOVES;
+    header.width = (uint16_t)slot->width;
+    header.height = (uint16_t)slot->height;
+    header.seq = slot->seq;
+    header.captureUs = slot->timestampUs;
+    WireWriteHeader(header, slot->data);
+
+    // v1: width (4 bytes), height | flag (4 bytes), sequence number (8 bytes), capture timestamp (8 bytes)
+    uint32_t flaggedHeight = slot->height | (lossless ? LOSSLESS_FRAME_FLAG : isDelta ? DELTA_FRAME_FLAG : 0);
+    memcpy(slot->legacyHeader, &slot->width, 4);
+    memcpy(slot->legacyHeader + 4, &flaggedHeight, 4);
+    memcpy(slot->legacyHeader + 8, &slot->seq, 8);
+    memcpy(slot->legacyHeader + 16, &slot->timestampUs, 8);
+    slot->hasLegacyHeader = true;
+}
+
+// Capture thread: fills slots while at least one client is connected or a
+// recording is running
+static void CaptureThread(ScreenCapture* capture, FrameRing* ring, TileDelta* delta, MoveDetector* moves,
+                          LosslessEncoder* lossless, int fps) {
+    FramePacer pacer;
+    int pacedFps = fps;
+    pacer.Start(pacedFps);
+    uint64_t seq = 0;
+    int timeoutCount = 0;
+    int errorCount = 0;
+    bool needKeyframe = true;
+    auto lastKeyframe = std::chrono::steady_clock::now();
+
+    while (running) {
+        if (!clientConnected && !recorder.IsRecording()) {
+            needKeyframe = true;
+            pacer.Reset();
+            Sleep(10);
+            continue;
+        }
+
+        // No faster than the fastest client wants
+        int wantedFps = WireCappedFps(fps, clientFpsLimit);
+        if (wantedFps != pacedFps) {
+            pacedFps = wantedFps;
+            pacer.Start(pacedFps);
+            printf("Pacing: %d FPS%s\n", pacedFps, pacedFps > 0 ? "" : " (off)");
+            fflush(stdout);
+        }
+
+        // Paced: wait for the deadline, then take whatever is on screen now
+        pacer.Wait();
+        if (pacer.GetStatsAgeMs() >= PACER_REPORT_MS) {
+            PacerStats stats;
+            pacer.TakeStats(&stats);
+            PrintPacerStats("", stats);
+            fflush(stdout);
+        }
+
+        // Client resync requests are rate limited so a struggling client
+        // can't turn the whole stream into keyframes
+        auto now = std::chrono::steady_clock::now();
+        if (keyframeRequested && now - lastKeyframe >= std::chrono::milliseconds(KEYFRAME_MIN_INTERVAL_MS)) {
+            keyframeRequested = false;
+            needKeyframe = true;
+        }
+        if (!deltasAllowed) needKeyframe = true;
+
+        // Acquire first: the slot is only taken (possibly reclaiming the
+        // oldest queued frame) once there is a new frame to put in it
+        int result = capture->AcquireFrame(pacer.IsPaced() ? 0 : 500);
+        if (result == -2) {
+            // Timeout - screen didn't change. Paced, that is just a quiet deadline.
+            timeoutCount++;
+            if (!pacer.IsPaced() && (timeoutCount == 1 || timeoutCount % 50 == 0)) {
+                printf("Timeout (no screen change): %d\n", timeoutCount);
+                fflush(stdout);
+            }
+            if (!pacer.IsPaced()) Sleep(1);
+            continue;
+        }
+        if (result < 0) {
+            needKeyframe = true;  // Dirty rects of the lost frame are gone
+            errorCount++;
+            if (errorCount == 1 || errorCount % 10 == 0) {
+                printf("Capture error (count: %d)\n", errorCount);
+                fflush(stdout);
+            }
+            Sleep(10);
+            continue;
+        }
+
+        uint64_t droppedBefore = ring->GetDropped();
+        FrameSlot* slot = ring->AcquireWrite();
+        if (ring->GetDropped() != droppedBefore) {
+            // Reclaimed a frame nobody sent - the delta chain is broken
+            needKeyframe = true;
+        }
+        if (!slot) {
+            // Every slot is held by a client; this frame and its dirty
+            // rects are skipped
+            capture->ReleaseFrame();
+            needKeyframe = true;
+            Sleep(1);
+            continue;
+        }
+
+        int frameSize = capture->CaptureFrame(slot, delta, moves, movesAllowed, lossless, needKeyframe);
+        if (frameSize == -2) {
+            // Nothing visible changed
+            ring->Release(slot);
+            continue;
+        }
+        if (frameSize <= 0) {
+            ring->Release(slot);
+            needKeyframe = true;  // Dirty rects of the lost frame are gone
+            errorCount++;
+            if (errorCount == 1 || errorCount % 10 == 0) {
+                printf("Capture error (count: %d)\n", errorCount);
+                fflush(stdout);
+            }
+            Sleep(10);
+            continue;
+        }
+        timeoutCount = 0;
+        errorCount = 0;
+
+        if (!(slot->flags & FRAME_FLAG_DELTA)) {
+            needKeyframe = false;
+            lastKeyframe = now;
+        }
+        slot->seq = ++seq;
+        WriteFrameHeaders(slot, lossless != nullptr);
+        slot->handoffUs = LatencyNowUs();
+        ring->Publish(slot);
+    }
+}
+
+static int recordCodec = CAPTURE_CODEC_LOSSLESS;
+
+static void StartRecording(const char* path, UINT width, UINT height) {
+    if (recorder.Start(path, width, height, recordCodec)) {
+        printf("Recording to %s (%ux%u, %s)\n", path, width, height, CaptureCodecName(recordCodec));
+    } else {
+        printf("Can't record to %s%s\n", path, recorder.IsRecording() ? " (already recording)" : "");
+    }
+    fflush(stdout);
+}
+
+static void StopRecording() {
+    if (!recorder.IsRecording()) return;
+    recorder.Stop();
+    printf("Recording stopped: %llu frames, %llu dropped, %.1f MB%s\n",
+        (unsigned long long)recorder.GetFramesWritten(), (unsigned long long)recorder.GetFramesDropped(),
+        recorder.GetBytesWritten() / 1e6, recorder.HasFailed() ? " (write failed)" : "");
+    fflush(stdout);
+}
+
+// Console: each line on stdin (Enter) prints the stage percentiles since
+// the previous report (only reads the histograms); "rec FILE" starts a
+// recording and "stop" ends it.
+static void ReportThread(UINT width, UINT height) {
+    char line[512];
+    while (fgets(line, sizeof(line), stdin)) {
+        line[strcspn(line, "\r\n")] = 0;
+        if (strncmp(line, "rec ", 4) == 0) StartRecording(line + 4, width, height);
+        else if (strcmp(line, "stop") == 0) StopRecording();
+        else latency.Report("");
+        fflush(stdout);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    bool deltaMode = false;
+    bool movesMode = false;
+    bool losslessMode = false;
+    bool xorMode = false;
+    int threadCount = JobSystem::DefaultWorkerCount();
+    int fps = DEFAULT_FPS;
+    int wsPort = 0;
+    const char* recordPath = nullptr;
+    int outputIndex = 0;
+    bool listOutputs = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--delta") == 0) deltaMode = true;
+        else if (strcmp(argv[i], "--moves") == 0) movesMode = true;
+        else if (strcmp(argv[i], "--lossless") == 0) losslessMode = true;
+        else if (strcmp(argv[i], "--xor") == 0) losslessMode = xorMode = true;
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) threadCount = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--fps") == 0 && i + 1 < argc) fps = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--ws") == 0 && i + 1 < argc) wsPort = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) recordPath = argv[++i];
+        else if (strcmp(argv[i], "--record-raw") == 0) recordCodec = CAPTURE_CODEC_RAW;
+        else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) outputIndex = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--list-outputs") == 0) listOutputs = true;
+    }
+    if (threadCount < 0) threadCount = 0;
+    if (fps < 0) fps = 0;
+    if (deltaMode && losslessMode) {
+        printf("--delta and --lossless/--xor can't be combined\n");
+        return 1;
+    }
+    if (movesMode && !deltaMode) {
+        printf("--moves needs --delta\n");
+        return 1;
+    }
+
+    const char* mode = movesMode ? "delta tiles + moves" : deltaMode ? "delta tiles" : xorMode ? "lossless + xor" : losslessMode ? "lossless" : "full frames";
+    DxgiOutputInfo outputs[DXGI_MAX_OUTPUTS];
+    int outputCount = EnumerateOutputs(outputs, DXGI_MAX_OUTPUTS);
+    if (listOutputs || outputIndex < 0 || outputIndex >= outputCount) {
+        if (!listOutputs) printf("No output %d (%d found):\n", outputIndex, std::max(outputCount, 0));
+        else printf("Outputs:\n");
+        PrintOutputs(outputs, outputCount);
+        fflush(stdout);
+        return listOutputs && outputCount > 0 ? 0 : 1;
+    }
+
+    printf("SimWidget Capture Service v1.12\n");
+    printf("Port: %d, Mode: %s, Pool threads: %d, Pacing: %d FPS%s\n", PORT, mode, threadCount, fps,
+        fps > 0 ? "" : " (off)");
     fflush(stdout);
 
     // Initialize capture
+    const DxgiOutputInfo& output = outputs[outputIndex];
     ScreenCapture capture;
-    if (!capture.Initialize()) {
+    if (!capture.Initialize(output)) {
         printf("Failed to initialize capture\n");
         fflush(stdout);
         return 1;
     }
-    printf("Capture initialized: %dx%d\n", capture.GetWidth(), capture.GetHeight());
+    printf("Capture initialized: output %d, %s %dx%d (%s)\n", outputIndex, output.name, capture.GetWidth(),
+        capture.GetHeight(), output.adapterName);
     fflush(stdout);
 
-    // Initialize Winsock
-    WSADATA wsaData;
-    WSAStartup(MAKEWORD(2, 2), &wsaData);
+    JobSystem jobs;
+    jobs.Start(threadCount);
+    capture.SetJobSystem(&jobs);
+    recorder.SetJobSystem(&jobs);
+
+    TileDelta delta;
+    if (deltaMode && !delta.Initialize(capture.GetWidth(), capture.GetHeight())) {
+        printf("Failed to initialize delta tiles\n");
+        fflush(stdout);
+        return 1;
+    }
 
-    // Create socket
-    SOCKET serverSocket = socket(AF_INET, SOCK_STREAM, 0);
-    sockaddr_in serverAddr = {};
-    serverAddr.sin_family = AF_INET;
-    serverAddr.sin_addr.s_addr = INADDR_ANY;
-    serverAddr.sin_port = htons(PORT);
+    MoveDetector moves;
+    if (movesMode && !moves.Initialize(capture.GetWidth(), capture.GetHeight())) {
+        printf("Failed to initialize move detection\n");
+        fflush(stdout);
+        return 1;
+    }
+
+    LosslessEncoder lossless;
+    if (losslessMode && !lossless.Initialize(capture.GetWidth(), capture.GetHeight(), xorMode)) {
+        printf("Failed to initialize lossless codec\n");
+        fflush(stdout);
+        return 1;
+    }
+    lossless.SetJobSystem(&jobs);
+
+    // Slots are sized to the frame (~33 MB raw at 4K), with no fixed cap;
+    // slots no client ever pins are never touched
+    size_t frameSize = FRAME_HEADER_SIZE + (size_t)capture.GetWidth() * capture.GetHeight() * 4;
+    if (losslessMode) frameSize = FRAME_HEADER_SIZE + lossless.MaxEncodedSize();  // Incompressible frames grow ~3%
+    FrameRing ring;
+    if (!ring.Initialize(FRAME_SLOTS + 2 * BROADCAST_MAX_CLIENTS, frameSize)) {
+        printf("Failed to allocate frame slots (%zu bytes each)\n", frameSize);
+        fflush(stdout);
+        return 1;
+    }
+
+    // Initialize Winsock
+    if (!NetStartup()) {
+        printf("Failed to initialize Winsock\n");
+        fflush(stdout);
+        return 1;
+    }
 
-    bind(serverSocket, (sockaddr*)&serverAddr, sizeof(serverAddr));
-    listen(serverSocket, 5);
+    BroadcastServer server;
+    if (!server.Start(PORT)) {
+        printf("Failed to listen on port %d\n", PORT);
+        fflush(stdout);
+        return 1;
+    }
+    if (wsPort > 0 && !server.StartWebSocket(wsPort)) {
+        printf("Failed to listen on WebSocket port %d\n", wsPort);
+        fflush(stdout);
+        return 1;
+    }
+    server.SetLatencyHistograms(&latency[STAGE_SEND], &latency[STAGE_TOTAL]);
+    server.SetStreamInfo(losslessMode ? WIRE_CODEC_LOSSLESS : WIRE_CODEC_BGRA, capture.GetWidth(), capture.GetHeight(), fps);
+    server.SetStreamMoves(movesMode);
 
-    printf("Listening on port %d...\n", PORT);
+    printf("Listening on port %d (up to %d clients)...\n", PORT, BROADCAST_MAX_CLIENTS);
+    if (wsPort > 0) printf("WebSocket endpoint: ws://localhost:%d/\n", wsPort);
+    printf("Press Enter for per-stage latency percentiles, \"rec FILE\" / \"stop\" to record\n");
     fflush(stdout);
+    if (recordPath) StartRecording(recordPath, capture.GetWidth(), capture.GetHeight());
+    std::thread(ReportThread, capture.GetWidth(), capture.GetHeight()).detach();
 
-    // Allocate frame buffer
-    BYTE* frameBuffer = new BYTE[BUFFER_SIZE];
+    std::thread captureThread(CaptureThread, &capture, &ring, deltaMode ? &delta : nullptr,
+        movesMode ? &moves : nullptr, losslessMode ? &lossless : nullptr, fps);
 
+    uint64_t lastReported = 0;
     while (true) {
-        SOCKET clientSocket = accept(serverSocket, nullptr, nullptr);
-        if (clientSocket == INVALID_SOCKET) continue;
+        // Don't wait on the ring while clients still have bytes to write
+        FrameSlot* frame = ring.AcquireRead(server.HasPendingWrites() ? 0 : 2);
+        if (frame) {
+            latency.RecordSince(STAGE_QUEUE, frame->handoffUs, LatencyNowUs());
+            server.Broadcast(&ring, frame);
+            ring.Release(frame);
+        }
 
-        printf("Client connected\n");
-        fflush(stdout);
+        server.Service(frame ? 0 : 1);
+        if (server.TakeKeyframeRequest()) keyframeRequested = true;
+        deltasAllowed = server.AllClientsTakeDeltas();
+        movesAllowed = server.AllClientsTakeMoves();
+        clientFpsLimit = server.GetClientFpsLimit();
 
-        int framesSent = 0;
-        int timeoutCount = 0;
-        int errorCount = 0;
-
-        // Simple protocol: send frames continuously
-        while (true) {
-            int frameSize = capture.CaptureFrame(frameBuffer, BUFFER_SIZE);
-            if (frameSize == -2) {
-                // Timeout - screen didn't change
-                timeoutCount++;
-                if (timeoutCount == 1 || timeoutCount % 50 == 0) {
-                    printf("Timeout (no screen change): %d\n", timeoutCount);
-                    fflush(stdout);
-                }
-                Sleep(1);
-                continue;
-            }
-            if (frameSize <= 0) {
-                errorCount++;
-                if (errorCount == 1 || errorCount % 10 == 0) {
-                    printf("Capture error (count: %d)\n", errorCount);
-                    fflush(stdout);
-                }
-                Sleep(10);
-                continue;
-            }
-            timeoutCount = 0;
-            errorCount = 0;
-
-            // Send frame size first (4 bytes)
-            if (send(clientSocket, (char*)&frameSize, 4, 0) <= 0) break;
-
-            // Send frame data
-            int sent = 0;
-            while (sent < frameSize) {
-                int result = send(clientSocket, (char*)(frameBuffer + sent), frameSize - sent, 0);
-                if (result <= 0) break;
-                sent += result;
-            }
-            if (sent < frameSize) break;
+        // Clients still in the handshake don't get frames yet
+        bool anyClients = server.GetStreamingClientCount() > 0;
+        if (clientConnected && !anyClients) ring.Flush();
+        clientConnected = anyClients;
 
-            framesSent++;
-            if (framesSent % 100 == 0) {
-                printf("Frames sent: %d\n", framesSent);
-                fflush(stdout);
-            }
+        uint64_t framesSent = server.GetFramesSent();
+        if (framesSent / 100 != lastReported / 100) {
+            printf("Frames sent: %llu\n", (unsigned long long)framesSent);
+            fflush(stdout);
         }
-
-        closesocket(clientSocket);
-        printf("Client disconnected (sent %d frames)\n", framesSent);
-        fflush(stdout);
+        lastReported = framesSent;
     }
 
-    delete[] frameBuffer;
+    running = false;
+    ring.Close();
+    captureThread.join();
+    jobs.Stop();
+
+    server.Stop();
     capture.Cleanup();
-    WSACleanup();
+    NetCleanup();
     return 0;
 }
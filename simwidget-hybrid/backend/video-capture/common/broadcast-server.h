@@ -0,0 +1,838 @@
+// Broadcast Server - serves one frame stream to many TCP clients
+// Non-blocking sockets driven by a single poll() loop. Each client has its
+// own send queue of depth one ("latest frame wins"): while a frame is still
+// going out, newer frames replace the pending one instead of piling up, so a
+// slow client only drops its own frames and never stalls the others.
+// Frames are FrameRing slots shared by reference count, never copied.
+//
+// Delta frames (FRAME_FLAG_DELTA) only go to clients that have every frame
+// since the last keyframe. A client that just connected, or whose pending
+// delta had to be dropped, skips deltas until the next keyframe and the
+// server raises a keyframe request (TakeKeyframeRequest()).
+//
+// Wire format per frame: [4 bytes payload size][payload]
+//
+// Clients are greeted with the v2 handshake (common/wire-protocol.h): a
+// client gets no frames until it has sent a hello (answered with a reply)
+// or stayed silent for WIRE_HANDSHAKE_MS, which makes it a v1 client. Frames
+// start with the v2 header; v1 clients get FrameSlot::legacyHeader in its
+// place. The hello's capabilities shape what each client is sent: no deltas
+// for a client that can't apply them (the service should then send
+// keyframes, see AllClientsTakeDeltas()), no deltas with moves
+// (FRAME_FLAG_MOVES) for one that can't apply those (AllClientsTakeMoves()),
+// no deltas with per-tile codecs (FRAME_FLAG_TILE_CODECS) for one that can't
+// decode them (AllClientsTakeTileCodecs()),
+// no faster than its max fps for keyframe-only clients, and a
+// WIRE_MSG_KEYFRAME message resyncs it.
+//
+// Sends are gather writes straight from the frame slot (NetSendv()): the
+// length prefix, the rest of the frame in flight and the whole pending frame
+// go out in one call, so a frame costs one syscall instead of one for the
+// prefix plus one per payload chunk, and TCP_NODELAY no longer pushes a
+// 4-byte segment ahead of every frame. With SetZeroCopy() (Linux only) large
+// writes use MSG_ZEROCOPY; a fully sent frame then keeps its slot reference
+// until the kernel reports that it no longer reads the pages.
+//
+// With StartWebSocket() the same stream is also served to browsers over
+// RFC 6455 (common/websocket.h) on a second port: after the HTTP upgrade,
+// each frame is one binary message (the WebSocket header is kept in the slot
+// in place of the length prefix, so sends stay gathered and zero-copy),
+// hello / reply / messages are binary messages too, and the server pings
+// every SetPingInterval() ms, dropping clients that don't answer in time.
+// A WebSocket client that sends no hello gets JPEG-style defaults: v2
+// headers, keyframes only. Replies, pongs and close frames queue per client
+// and go out between frames.
+//
+// For rate control the server tracks how long frames take from Broadcast()
+// to their last byte (GetSendTimeUs() / GetFramesSent()) and how many bytes
+// are queued but not yet accepted by the sockets (GetQueuedBytes()).
+// With SetLatencyHistograms() every delivered frame also records its
+// Broadcast()-to-last-byte time and, for frames with a capture timestamp,
+// capture-to-last-byte time.
+
+#pragma once
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+#include "frame-ring.h"
+#include "latency-histogram.h"
+#include "net-compat.h"
+#include "websocket.h"
+#include "wire-protocol.h"
+
+#define BROADCAST_MAX_CLIENTS 8
+#define BROADCAST_ZEROCOPY_MIN_BYTES 16384  // Smaller writes copy (pinning costs more)
+
+#define BROADCAST_FPS_SLACK_MS 2             // Frames this early still meet a client's max fps
+#define BROADCAST_PING_MS 5000               // WebSocket keepalive; no pong for this long = gone
+#define BROADCAST_UPGRADE_MS 2000            // WebSocket upgrade request must be complete by then
+
+static_assert(FRAME_LEGACY_HEADER_SIZE == WIRE_HEADER_SIZE, "v1 headers replace v2 headers in place");
+static_assert(FRAME_WS_HEADER_SIZE == WS_SERVER_HEADER_SIZE, "slot holds any server frame header");
+
+class BroadcastServer {
+private:
+    struct Retired {
+        FrameRing* ring;
+        FrameSlot* frame;
+        uint32_t call;                   // Last zero-copy call that read it
+    };
+
+    struct Client {
+        SOCKET socket = INVALID_SOCKET;
+        FrameSlot* inFlight = nullptr;   // Frame currently being written
+        FrameRing* inFlightRing = nullptr;
+        size_t offset = 0;               // Bytes of prefix + payload already sent
+        int64_t inFlightZeroCopy = -1;   // Last zero-copy call that carried its bytes
+        FrameSlot* pending = nullptr;    // Newest frame waiting for inFlight to finish
+        FrameRing* pendingRing = nullptr;
+        std::chrono::steady_clock::time_point inFlightQueued;  // When Broadcast() got the frame
+        std::chrono::steady_clock::time_point pendingQueued;
+        uint64_t framesSent = 0;
+        uint64_t framesDropped = 0;
+        bool synced = false;             // Has the reference for the next delta
+
+        // Handshake and capabilities
+        int protocol = 0;                // 0 = handshake pending, 1 = v1, else WIRE_VERSION
+        std::chrono::steady_clock::time_point connected;
+        uint8_t inbox[WIRE_HELLO_SIZE] = {};
+        size_t inboxSize = 0;
+        bool takesDeltas = true;         // v1 clients always got deltas
+        bool takesMoves = false;         // Applies copy-rect moves (v2 hello only)
+        bool takesTileCodecs = false;    // Decodes per-tile codecs (v2 hello only)
+        int maxFps = 0;                  // 0 = no cap
+        int minScalePercent = 0;
+        std::chrono::steady_clock::time_point nextDue;     // Earliest next frame under maxFps
+        uint64_t framesSkipped = 0;      // Held back by max fps
+
+        // Bytes that go out between frames: handshake reply, WebSocket
+        // upgrade response and control frames
+        std::vector<uint8_t> control;
+        size_t controlSent = 0;
+        bool closing = false;            // Disconnect once control is out
+
+        // WebSocket clients
+        bool webSocket = false;
+        bool upgraded = false;           // HTTP upgrade done
+        std::vector<uint8_t> input;      // Upgrade request, then partial client frames
+        std::chrono::steady_clock::time_point lastPing;
+        bool awaitingPong = false;
+
+        // Zero-copy: sent frames the kernel may still read, oldest first
+        bool zeroCopy = false;
+        uint32_t zeroCopyCalls = 0;      // Id of the next zero-copy call
+        uint32_t zeroCopyDone = 0;       // Every call below this id has completed
+        std::vector<Retired> retired;
+    };
+
+    SOCKET listenSocket = INVALID_SOCKET;
+    SOCKET webSocketListen = INVALID_SOCKET;
+    int pingIntervalMs = BROADCAST_PING_MS;
+    int maxClients = BROADCAST_MAX_CLIENTS;
+    std::vector<Client> clients;
+    std::vector<NetPollFd> pollFds;
+    uint64_t totalSent = 0;
+    uint64_t totalDropped = 0;
+    uint64_t totalSendTimeUs = 0;
+    uint64_t totalSendCalls = 0;
+    uint64_t totalBytesSent = 0;
+    uint64_t totalZeroCopyCalls = 0;
+    bool zeroCopyRequested = false;
+    bool zeroCopyCopied = false;
+    bool keyframeRequested = false;
+    int streamCodec = 0;                 // Announced in v2 replies
+    uint32_t streamWidth = 0, streamHeight = 0;
+    int streamFps = 0;
+    bool streamMoves = false;            // Moves may be sent, announced in v2 replies
+    bool streamTileCodecs = false;       // Per-tile codecs may be sent, announced in v2 replies
+    LatencyHistogram* sendLatency = nullptr;
+    LatencyHistogram* totalLatency = nullptr;
+
+    void StartFrame(Client& c, FrameRing* ring, FrameSlot* frame, std::chrono::steady_clock::time_point queued) {
+        c.inFlight = frame;
+        c.inFlightRing = ring;
+        c.inFlightQueued = queued;
+        c.offset = 0;
+        c.inFlightZeroCopy = -1;
+    }
+
+    // The frame in flight has its last byte in the socket
+    void FinishFrame(Client& c) {
+        uint64_t sendUs = (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - c.inFlightQueued).count();
+        if (sendLatency) sendLatency->Record(sendUs);
+        if (totalLatency) totalLatency->RecordSince(c.inFlight->timestampUs, LatencyNowUs());
+        if (c.inFlightZeroCopy >= 0) {
+            // The kernel may still read the slot - hold it until completion
+            c.retired.push_back({ c.inFlightRing, c.inFlight, (uint32_t)c.inFlightZeroCopy });
+        } else {
+            c.inFlightRing->Release(c.inFlight);
+        }
+        c.inFlight = nullptr;
+        c.framesSent++;
+        totalSent++;
+        totalSendTimeUs += sendUs;
+    }
+
+    // Bytes frame takes on this client's connection
+    static size_t WireSize(const Client& c, const FrameSlot* frame) {
+        return (c.webSocket ? frame->wsHeaderSize : 4) + frame->size;
+    }
+
+    // Wire bytes of frame for this client from offset skip on: length prefix
+    // (WebSocket header), header (the v1 one for v1 clients) and payload.
+    // Returns buffers used (<= 3).
+    int FrameBuffers(const Client& c, const FrameSlot* frame, size_t skip, NetBuffer* out) const {
+        size_t headerSize = 0;
+        const uint8_t* header = frame->data;
+        if (c.protocol == 1 && frame->hasLegacyHeader && frame->size >= FRAME_LEGACY_HEADER_SIZE) {
+            header = frame->legacyHeader;
+            headerSize = FRAME_LEGACY_HEADER_SIZE;
+        }
+        const uint8_t* parts[3] = { c.webSocket ? frame->wsHeader : frame->sizePrefix, header, frame->data + headerSize };
+        size_t sizes[3] = { c.webSocket ? (size_t)frame->wsHeaderSize : 4, headerSize, frame->size - headerSize };
+        int count = 0;
+        for (int p = 0; p < 3; p++) {
+            if (skip >= sizes[p]) {
+                skip -= sizes[p];
+                continue;
+            }
+            NetSetBuffer(&out[count++], parts[p] + skip, sizes[p] - skip);
+            skip = 0;
+        }
+        return count;
+    }
+
+    // Release retired frames whose zero-copy calls have all completed
+    void ReleaseCompleted(Client& c) {
+        size_t done = 0;
+        while (done < c.retired.size() && (int32_t)(c.retired[done].call - c.zeroCopyDone) < 0) {
+            c.retired[done].ring->Release(c.retired[done].frame);
+            done++;
+        }
+        c.retired.erase(c.retired.begin(), c.retired.begin() + done);
+    }
+
+    // Write as much as the socket accepts, the frame in flight and the
+    // pending one gathered into each call. Queued control bytes go first, at
+    // the next frame boundary. Returns false if the client is gone.
+    bool Flush(Client& c) {
+        while (true) {
+            if (c.controlSent < c.control.size() && (!c.inFlight || c.offset == 0)) {
+                int n = send(c.socket, (const char*)c.control.data() + c.controlSent,
+                    (int)(c.control.size() - c.controlSent), NET_SEND_FLAGS);
+                if (n < 0) return NetWouldBlock(NetLastError());
+                if (n == 0) return false;
+                c.controlSent += n;
+                if (c.controlSent < c.control.size()) continue;
+                c.control.clear();
+                c.controlSent = 0;
+            }
+            if (c.closing && c.control.empty()) return false;
+            if (!c.inFlight) return true;
+
+            NetBuffer buffers[6];
+            size_t inFlightLeft = WireSize(c, c.inFlight) - c.offset;
+            int count = FrameBuffers(c, c.inFlight, c.offset, buffers);
+            size_t bytes = inFlightLeft;
+            if (c.pending && c.control.empty()) {
+                // Not while control waits: it would never see a frame boundary
+                count += FrameBuffers(c, c.pending, 0, buffers + count);
+                bytes += WireSize(c, c.pending);
+            }
+
+            bool usedZeroCopy;
+            int result = NetSendv(c.socket, buffers, count, c.zeroCopy && bytes >= BROADCAST_ZEROCOPY_MIN_BYTES,
+                &usedZeroCopy);
+            totalSendCalls++;
+            if (result < 0) {
+                return NetWouldBlock(NetLastError());
+            }
+            if (result == 0) return false;
+            totalBytesSent += result;
+
+            int64_t call = -1;
+            if (usedZeroCopy) {
+                call = c.zeroCopyCalls++;
+                totalZeroCopyCalls++;
+            }
+            size_t written = (size_t)result;
+            if (written < inFlightLeft) {
+                c.offset += written;
+                if (call >= 0) c.inFlightZeroCopy = call;
+                continue;
+            }
+
+            if (call >= 0) c.inFlightZeroCopy = call;
+            FinishFrame(c);
+            written -= inFlightLeft;
+            if (c.pending) {
+                StartFrame(c, c.pendingRing, c.pending, c.pendingQueued);
+                c.pending = nullptr;
+                c.offset = written;
+                if (call >= 0 && written > 0) c.inFlightZeroCopy = call;
+                if (written == WireSize(c, c.inFlight)) FinishFrame(c);
+            }
+        }
+    }
+
+    void Disconnect(size_t index) {
+        Client& c = clients[index];
+        if (c.inFlight) c.inFlightRing->Release(c.inFlight);
+        if (c.pending) c.pendingRing->Release(c.pending);
+        // Closing the socket ends the connection the kernel may still read
+        // retired frames for; nobody receives those bytes any more
+        for (auto& r : c.retired) r.ring->Release(r.frame);
+        closesocket(c.socket);
+        printf("Client disconnected (sent %llu frames, dropped %llu, %d remaining)\n",
+            (unsigned long long)c.framesSent, (unsigned long long)c.framesDropped,
+            (int)clients.size() - 1);
+        fflush(stdout);
+        clients.erase(clients.begin() + index);
+    }
+
+    void AcceptClients(SOCKET listener, bool webSocket) {
+        while (true) {
+            SOCKET s = accept(listener, nullptr, nullptr);
+            if (s == INVALID_SOCKET) return;
+
+            if ((int)clients.size() >= maxClients) {
+                printf("Client rejected (limit %d reached)\n", maxClients);
+                fflush(stdout);
+                closesocket(s);
+                continue;
+            }
+
+            NetSetNonBlocking(s);
+            NetSetNoDelay(s);
+            Client c;
+            c.socket = s;
+            c.zeroCopy = zeroCopyRequested && NetEnableZeroCopy(s);
+            c.connected = std::chrono::steady_clock::now();
+            c.webSocket = webSocket;
+            clients.push_back(c);
+        }
+    }
+
+    // Handshake over: start streaming to the client with its first keyframe
+    void Activate(Client& c, int protocol) {
+        c.protocol = protocol;
+        keyframeRequested = true;
+        const char* transport = c.webSocket ? "WebSocket, " : "";
+        if (protocol == 1) {
+            printf("Client connected (%sprotocol v1, %d total)\n", transport, (int)clients.size());
+        } else {
+            printf("Client connected (%sprotocol v%d, %s, max %d fps, min scale %d%%, %d total)\n", transport, protocol,
+                c.takesDeltas ? "deltas" : "keyframes only", c.maxFps, c.minScalePercent, (int)clients.size());
+        }
+        fflush(stdout);
+    }
+
+    // A client that sent no hello: old TCP clients speak v1, browsers get
+    // v2 headers and keyframes only
+    void ActivateDefault(Client& c) {
+        if (!c.webSocket) {
+            Activate(c, 1);
+            return;
+        }
+        c.takesDeltas = false;
+        Activate(c, WIRE_VERSION);
+    }
+
+    // Bytes that go out at the next frame boundary: a protocol message (a
+    // binary message for WebSocket clients) or a WebSocket control frame
+    void Queue(Client& c, int opcode, const uint8_t* data, size_t size) {
+        if (c.webSocket) {
+            uint8_t header[WS_SERVER_HEADER_SIZE];
+            int headerSize = WsWriteHeader(header, opcode, size);
+            c.control.insert(c.control.end(), header, header + headerSize);
+        }
+        c.control.insert(c.control.end(), data, data + size);
+    }
+
+    // Answer a complete hello. A rejected client is closed once the reply is out.
+    void Handshake(Client& c) {
+        WireHello hello;
+        if (!WireReadHello(c.inbox, &hello)) {
+            // Not a hello: an old client that happens to send something
+            ActivateDefault(c);
+            return;
+        }
+        c.takesDeltas = (hello.flags & WIRE_HELLO_DELTAS) != 0;
+        c.takesMoves = c.takesDeltas && (hello.flags & WIRE_HELLO_MOVES) != 0;
+        c.takesTileCodecs = c.takesDeltas && (hello.flags & WIRE_HELLO_TILE_CODECS) != 0;
+        c.maxFps = hello.maxFps;
+        c.minScalePercent = hello.minScalePercent;
+
+        WireReply reply;
+        reply.codec = (uint8_t)streamCodec;
+        reply.flags = c.takesDeltas ? WIRE_HELLO_DELTAS : 0;
+        if (streamMoves && c.takesMoves) reply.flags |= WIRE_HELLO_MOVES;
+        if (streamTileCodecs && c.takesTileCodecs) reply.flags |= WIRE_HELLO_TILE_CODECS;
+        reply.width = (uint16_t)streamWidth;
+        reply.height = (uint16_t)streamHeight;
+        reply.fps = (uint16_t)WireCappedFps(streamFps, c.maxFps);
+        if (hello.version < WIRE_VERSION) {
+            reply.status = WIRE_STATUS_VERSION;
+        } else if (streamCodec && !(hello.codecs & (1u << streamCodec))) {
+            reply.status = WIRE_STATUS_CODEC;
+        }
+
+        uint8_t bytes[WIRE_REPLY_SIZE];
+        WireWriteReply(reply, bytes);
+        Queue(c, WS_OP_BINARY, bytes, WIRE_REPLY_SIZE);
+        if (reply.status != WIRE_STATUS_OK) {
+            printf("Client rejected (%s)\n", reply.status == WIRE_STATUS_CODEC ? "codec not supported" : "protocol version");
+            fflush(stdout);
+            if (c.webSocket) Queue(c, WS_OP_CLOSE, nullptr, 0);
+            c.closing = true;
+            return;
+        }
+        Activate(c, WIRE_VERSION);
+    }
+
+    void HandleMessage(Client& c) {
+        WireMessage m;
+        WireReadMessage(c.inbox, &m);
+        if (m.type == WIRE_MSG_KEYFRAME) {
+            // Deltas are useless to it until the next keyframe
+            c.synced = false;
+            keyframeRequested = true;
+        } else if (m.type == WIRE_MSG_MAX_FPS) {
+            c.maxFps = m.arg;
+        }
+        // Unknown types are ignored so newer clients can still connect
+    }
+
+    // One complete client frame; the payload is unmasked already
+    void HandleWebSocketFrame(Client& c, const WsFrame& f, const uint8_t* payload) {
+        switch (f.opcode) {
+            case WS_OP_BINARY:
+                if (!f.fin) break;  // Fragmented messages aren't supported
+                if (c.protocol == 0) {
+                    if (f.payloadSize < WIRE_HELLO_SIZE) break;
+                    memcpy(c.inbox, payload, WIRE_HELLO_SIZE);
+                    Handshake(c);
+                } else {
+                    for (size_t i = 0; i + WIRE_MESSAGE_SIZE <= f.payloadSize; i += WIRE_MESSAGE_SIZE) {
+                        memcpy(c.inbox, payload + i, WIRE_MESSAGE_SIZE);
+                        HandleMessage(c);
+                    }
+                }
+                break;
+            case WS_OP_PING:
+                Queue(c, WS_OP_PONG, payload, f.payloadSize);
+                break;
+            case WS_OP_PONG:
+                c.awaitingPong = false;
+                break;
+            case WS_OP_CLOSE:
+                // Echo the status code, then close
+                Queue(c, WS_OP_CLOSE, payload, f.payloadSize < 2 ? 0 : 2);
+                c.closing = true;
+                break;
+            default:
+                break;  // Text and stray continuation frames are ignored
+        }
+    }
+
+    // WebSocket client: the upgrade request, then frames. False if it is gone.
+    bool ReceiveWebSocket(Client& c) {
+        while (!c.closing) {
+            uint8_t buffer[2048];
+            int n = recv(c.socket, (char*)buffer, sizeof(buffer), 0);
+            if (n == 0) return false;
+            if (n < 0) return NetWouldBlock(NetLastError());
+            c.input.insert(c.input.end(), buffer, buffer + n);
+
+            if (!c.upgraded) {
+                char response[WS_RESPONSE_SIZE];
+                size_t responseSize = 0;
+                int result = WsHandshake((const char*)c.input.data(), c.input.size(), response, &responseSize);
+                if (result == 0) continue;
+                c.control.insert(c.control.end(), response, response + responseSize);
+                if (result < 0) {
+                    c.closing = true;
+                    return true;
+                }
+                // Browsers wait for the 101 before sending frames
+                c.input.clear();
+                c.upgraded = true;
+                c.connected = c.lastPing = std::chrono::steady_clock::now();
+                continue;
+            }
+
+            size_t offset = 0;
+            while (!c.closing) {
+                WsFrame f;
+                int size = WsParseFrame(c.input.data() + offset, c.input.size() - offset, &f);
+                if (size < 0) return false;
+                if (size == 0) break;
+                HandleWebSocketFrame(c, f, c.input.data() + offset + f.headerSize);
+                offset += size;
+            }
+            c.input.erase(c.input.begin(), c.input.begin() + offset);
+        }
+        return true;
+    }
+
+    // Read what the client sent: its hello during the handshake, then
+    // messages (v2) or nothing of interest (v1). False if it is gone.
+    bool Receive(Client& c) {
+        if (c.webSocket) return ReceiveWebSocket(c);
+        while (!c.closing) {
+            if (c.protocol == 1) {
+                char scratch[256];
+                int n = recv(c.socket, scratch, sizeof(scratch), 0);
+                if (n == 0) return false;
+                if (n < 0) return NetWouldBlock(NetLastError());
+                continue;
+            }
+            size_t need = c.protocol == 0 ? WIRE_HELLO_SIZE : WIRE_MESSAGE_SIZE;
+            int n = recv(c.socket, (char*)c.inbox + c.inboxSize, (int)(need - c.inboxSize), 0);
+            if (n == 0) return false;
+            if (n < 0) return NetWouldBlock(NetLastError());
+            c.inboxSize += n;
+            if (c.inboxSize < need) continue;
+            c.inboxSize = 0;
+            if (c.protocol == 0) {
+                Handshake(c);
+            } else {
+                HandleMessage(c);
+            }
+        }
+        return true;
+    }
+
+    // Handshake window and WebSocket keepalive
+    void CheckTimers() {
+        auto now = std::chrono::steady_clock::now();
+        for (size_t i = clients.size(); i-- > 0; ) {
+            Client& c = clients[i];
+            if (c.webSocket && !c.upgraded) {
+                // A silent or stalled upgrade would otherwise hold a client slot forever
+                if (now - c.connected >= std::chrono::milliseconds(BROADCAST_UPGRADE_MS)) {
+                    printf("Client timed out (no WebSocket upgrade)\n");
+                    fflush(stdout);
+                    Disconnect(i);
+                }
+                continue;
+            }
+            // Clients that stayed silent through the handshake window get the defaults
+            if (c.protocol == 0 && now - c.connected >= std::chrono::milliseconds(WIRE_HANDSHAKE_MS)) ActivateDefault(c);
+
+            if (!c.webSocket || pingIntervalMs <= 0 || c.closing ||
+                now - c.lastPing < std::chrono::milliseconds(pingIntervalMs)) continue;
+            if (c.awaitingPong) {
+                printf("Client timed out (no pong)\n");
+                fflush(stdout);
+                Disconnect(i);
+                continue;
+            }
+            c.awaitingPong = true;
+            c.lastPing = now;
+            Queue(c, WS_OP_PING, nullptr, 0);
+            if (!Flush(c)) Disconnect(i);
+        }
+    }
+
+public:
+    ~BroadcastServer() { Stop(); }
+
+    bool Start(int port, int clientLimit = BROADCAST_MAX_CLIENTS) {
+        maxClients = clientLimit;
+        listenSocket = NetListen(port, 16);
+        if (listenSocket == INVALID_SOCKET) return false;
+        NetSetNonBlocking(listenSocket);
+        return true;
+    }
+
+    // Also serve the stream to WebSocket clients (browsers) on port
+    bool StartWebSocket(int port) {
+        webSocketListen = NetListen(port, 16);
+        if (webSocketListen == INVALID_SOCKET) return false;
+        NetSetNonBlocking(webSocketListen);
+        return true;
+    }
+
+    // WebSocket ping interval in ms (0 = never ping); a client that hasn't
+    // answered by the next ping is disconnected
+    void SetPingInterval(int ms) { pingIntervalMs = ms; }
+
+    // Codec, size and rate announced in v2 replies. The size is updated from
+    // the frames broadcast since.
+    void SetStreamInfo(int codec, uint32_t width, uint32_t height, int fps) {
+        streamCodec = codec;
+        streamWidth = width;
+        streamHeight = height;
+        streamFps = fps;
+    }
+
+    // Announce in v2 replies that delta frames may carry moves
+    // (common/move-detect.h) for clients whose hello says they apply them
+    void SetStreamMoves(bool enable) { streamMoves = enable; }
+
+    // Announce in v2 replies that delta frames may code tiles per tile
+    // (common/tile-codec.h) for clients whose hello says they decode them
+    void SetStreamTileCodecs(bool enable) { streamTileCodecs = enable; }
+
+    // Send large writes with MSG_ZEROCOPY to clients connecting from now on
+    // (Linux only; ignored elsewhere). Each client falls back to copying once
+    // the kernel reports it had to copy anyway, as it always does on loopback.
+    void SetZeroCopy(bool enable) { zeroCopyRequested = enable; }
+
+    // Record per-frame delivery times into these (either may be null)
+    void SetLatencyHistograms(LatencyHistogram* send, LatencyHistogram* total) {
+        sendLatency = send;
+        totalLatency = total;
+    }
+
+    // Queue frame for every client. Takes its own references; the caller
+    // keeps (and must still release) the reference it passed in.
+    void Broadcast(FrameRing* ring, FrameSlot* frame) {
+        bool isDelta = (frame->flags & FRAME_FLAG_DELTA) != 0;
+        auto now = std::chrono::steady_clock::now();
+        // In the slot rather than per client: zero-copy sends pin it until
+        // the kernel is done, and the slot is held exactly that long
+        uint32_t size = (uint32_t)frame->size;
+        memcpy(frame->sizePrefix, &size, 4);
+        frame->wsHeaderSize = WsWriteHeader(frame->wsHeader, WS_OP_BINARY, frame->size);
+        if (frame->width && frame->height) {
+            streamWidth = frame->width;
+            streamHeight = frame->height;
+        }
+
+        for (size_t i = 0; i < clients.size(); ) {
+            Client& c = clients[i];
+            if (c.protocol == 0 || c.closing) {
+                // Still in the handshake, or on the way out
+                i++;
+                continue;
+            }
+
+            if (!isDelta && !c.takesDeltas && c.maxFps > 0) {
+                // Keyframe-only client with a rate cap. Deadlines advance by
+                // the interval, so a 45 fps cap on a 60 fps stream averages
+                // 45, not 30. Deltas can't be skipped: clients that take them
+                // get every frame.
+                auto interval = std::chrono::microseconds(1000000 / c.maxFps);
+                if (now + std::chrono::milliseconds(BROADCAST_FPS_SLACK_MS) < c.nextDue) {
+                    c.framesSkipped++;
+                    i++;
+                    continue;
+                }
+                c.nextDue = now - c.nextDue > interval ? now + interval : c.nextDue + interval;
+            }
+
+            if (isDelta && (!c.synced || !c.takesDeltas || ((frame->flags & FRAME_FLAG_MOVES) && !c.takesMoves) ||
+                            ((frame->flags & FRAME_FLAG_TILE_CODECS) && !c.takesTileCodecs))) {
+                // Missing the reference frame (or skipping a frame with moves
+                // or tile codecs it can't decode, which breaks its chain too)
+                // - wait for a keyframe
+                c.synced = false;
+                c.framesDropped++;
+                totalDropped++;
+                keyframeRequested = true;
+                i++;
+                continue;
+            }
+
+            if (!c.inFlight) {
+                ring->AddRef(frame);
+                StartFrame(c, ring, frame, now);
+                c.synced = true;
+            } else {
+                // Latest frame wins - replace whatever was waiting
+                if (c.pending) {
+                    // Not started yet: Flush() only gathers it once inFlight is done
+                    c.pendingRing->Release(c.pending);
+                    c.pending = nullptr;
+                    c.framesDropped++;
+                    totalDropped++;
+                    if (isDelta) {
+                        // This delta builds on the frame just dropped
+                        c.synced = false;
+                        c.framesDropped++;
+                        totalDropped++;
+                        keyframeRequested = true;
+                    }
+                }
+                if (!isDelta || c.synced) {
+                    ring->AddRef(frame);
+                    c.pending = frame;
+                    c.pendingRing = ring;
+                    c.pendingQueued = now;
+                    c.synced = true;
+                }
+            }
+
+            if (!Flush(c)) {
+                Disconnect(i);
+                continue;
+            }
+            i++;
+        }
+    }
+
+    // True (once) when a client needs a keyframe to resynchronize
+    bool TakeKeyframeRequest() {
+        bool requested = keyframeRequested;
+        keyframeRequested = false;
+        return requested;
+    }
+
+    // Run one iteration of the event loop: accept, detect disconnects and
+    // continue partial writes. Blocks for at most timeoutMs.
+    void Service(int timeoutMs) {
+        pollFds.clear();
+        NetPollFd listenFd = {};
+        listenFd.fd = listenSocket;
+        listenFd.events = POLLIN;
+        pollFds.push_back(listenFd);
+        if (webSocketListen != INVALID_SOCKET) {
+            listenFd.fd = webSocketListen;
+            pollFds.push_back(listenFd);
+        }
+        size_t first = pollFds.size();
+        for (auto& c : clients) {
+            NetPollFd fd = {};
+            fd.fd = c.socket;
+            fd.events = POLLIN;
+            if (c.inFlight || !c.control.empty()) fd.events |= POLLOUT;
+            pollFds.push_back(fd);
+        }
+
+        int ready = NetPoll(pollFds.data(), (unsigned)pollFds.size(), timeoutMs);
+        if (ready > 0) {
+            // Walk clients backwards so Disconnect() doesn't shift unvisited entries
+            for (size_t i = clients.size(); i-- > 0; ) {
+                short revents = pollFds[first + i].revents;
+                if (!revents) continue;
+
+                Client& c = clients[i];
+                bool alive = !(revents & POLLNVAL);
+                if (alive && (revents & POLLERR)) {
+                    // Zero-copy completions arrive on the error queue; anything
+                    // else there is a real socket error
+                    bool copied = false;
+                    alive = c.zeroCopyDone != c.zeroCopyCalls &&
+                        NetReadZeroCopyCompletions(c.socket, &c.zeroCopyDone, &copied) > 0;
+                    if (copied) {
+                        c.zeroCopy = false;
+                        zeroCopyCopied = true;
+                    }
+                    ReleaseCompleted(c);
+                }
+                if (alive && (revents & (POLLIN | POLLHUP))) alive = Receive(c);
+                if (alive && ((revents & POLLOUT) || !c.control.empty())) alive = Flush(c);
+                if (!alive) Disconnect(i);
+            }
+
+            if (pollFds[0].revents & POLLIN) AcceptClients(listenSocket, false);
+            if (first > 1 && (pollFds[1].revents & POLLIN)) AcceptClients(webSocketListen, true);
+        }
+        CheckTimers();
+    }
+
+    bool HasPendingWrites() const {
+        for (auto& c : clients) {
+            if (c.inFlight) return true;
+        }
+        return false;
+    }
+
+    // Bytes handed to Broadcast() that no socket has accepted yet. Only
+    // grows once a client's socket buffer is full.
+    size_t GetQueuedBytes() const {
+        size_t queued = 0;
+        for (auto& c : clients) {
+            if (c.inFlight) queued += WireSize(c, c.inFlight) - c.offset;
+            if (c.pending) queued += WireSize(c, c.pending);
+        }
+        return queued;
+    }
+
+    int GetClientCount() const { return (int)clients.size(); }  // Including those still in the handshake
+    int GetStreamingClientCount() const {
+        int count = 0;
+        for (auto& c : clients) count += c.protocol != 0;
+        return count;
+    }
+
+    // False while a connected client can't apply deltas: the service should
+    // then send keyframes only
+    bool AllClientsTakeDeltas() const {
+        for (auto& c : clients) {
+            if (c.protocol != 0 && !c.takesDeltas) return false;
+        }
+        return true;
+    }
+
+    // False while a connected client can't apply moves: the service should
+    // then send plain tile deltas
+    bool AllClientsTakeMoves() const {
+        for (auto& c : clients) {
+            if (c.protocol != 0 && !c.takesMoves) return false;
+        }
+        return true;
+    }
+
+    // False while a connected client can't decode per-tile codecs: the
+    // service should then code delta tiles as JPEG only
+    bool AllClientsTakeTileCodecs() const {
+        for (auto& c : clients) {
+            if (c.protocol != 0 && !c.takesTileCodecs) return false;
+        }
+        return true;
+    }
+
+    // Highest frame rate any client wants, 0 if one of them has no cap (or
+    // there are none): capture doesn't need to run faster than this
+    int GetClientFpsLimit() const {
+        int limit = 0;
+        for (auto& c : clients) {
+            if (c.protocol == 0) continue;
+            if (c.maxFps == 0) return 0;
+            if (c.maxFps > limit) limit = c.maxFps;
+        }
+        return limit;
+    }
+
+    // Smallest adaptive scale (percent of full size) every client accepts
+    int GetMinScalePercent() const {
+        int percent = 0;
+        for (auto& c : clients) {
+            if (c.protocol != 0 && c.minScalePercent > percent) percent = c.minScalePercent;
+        }
+        return percent;
+    }
+
+    uint64_t GetFramesSent() const { return totalSent; }
+    uint64_t GetFramesDropped() const { return totalDropped; }
+    uint64_t GetSendTimeUs() const { return totalSendTimeUs; }  // Summed over GetFramesSent() frames
+    uint64_t GetSendCalls() const { return totalSendCalls; }     // Frame send syscalls, including would-block
+    uint64_t GetBytesSent() const { return totalBytesSent; }     // Prefixes + payloads
+    uint64_t GetZeroCopyCalls() const { return totalZeroCopyCalls; }
+    bool GetZeroCopyCopied() const { return zeroCopyCopied; }  // Kernel copied anyway (e.g. loopback)
+
+    // Frames fully sent whose pages the kernel may still read
+    int GetRetiredFrames() const {
+        int retired = 0;
+        for (auto& c : clients) retired += (int)c.retired.size();
+        return retired;
+    }
+
+    void Stop() {
+        while (!clients.empty()) Disconnect(clients.size() - 1);
+        if (listenSocket != INVALID_SOCKET) {
+            closesocket(listenSocket);
+            listenSocket = INVALID_SOCKET;
+        }
+        if (webSocketListen != INVALID_SOCKET) {
+            closesocket(webSocketListen);
+            webSocketListen = INVALID_SOCKET;
+        }
+    }
+};
@@ -0,0 +1,594 @@
+// Capture File - record desktop frames to disk and replay them anywhere
+// A recording keeps what Desktop Duplication delivered: every frame's
+// pixels, its capture timestamp and the DXGI dirty rects, so the encoder,
+// delta and pipeline code can be fed a real flight on a machine without a
+// simulator (or without Windows), at the original timing or flat out.
+//
+// File (little endian, every record and the index 64-byte aligned):
+//   header  [4B magic "SWC1"][2B version][1B codec][1B reserved][4B width]
+//           [4B height][4B frame count][4B keyframe interval][8B index offset]
+//           [32B reserved]
+//   record  [4B magic "SWCF"][2B flags][2B dirty rect count][4B frame number]
+//           [4B payload size][8B timestamp us][8B reserved]
+//           [16B per dirty rect (left, top, right, bottom)][pad][payload][pad]
+//   index   32B per frame: [8B record offset][8B timestamp us][4B payload size]
+//           [2B flags][2B dirty rect count][4B keyframe at or before][4B reserved]
+//
+// Payloads are pitch-stripped BGRA (CAPTURE_CODEC_RAW, read straight out of
+// the mapping) or lossless streams (common/lossless-codec.h), where every
+// CAPTURE_KEYFRAME_INTERVAL-th frame stands alone and the rest are XOR coded
+// against their predecessor. The index and the header's frame count are
+// written by Close(); a file cut short by a crash is still readable, the
+// reader rebuilds the index by walking the records.
+//
+// CaptureFileWriter appends synchronously. CaptureRecorder wraps it for the
+// capture services: Submit() copies a frame into one of a few preallocated
+// buffers and returns, a thread codes and writes it; with every buffer busy
+// the frame is dropped rather than stalling capture. CaptureFileReader maps
+// a file read-only: frame i is an O(1) index lookup (plus decoding from the
+// nearest keyframe for lossless files), and Next() / GetDirtyRects() make it
+// a drop-in for the synthetic bench/frame-source.h.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "frame-pacer.h"
+#include "job-system.h"
+#include "lossless-codec.h"
+#include "shm-compat.h"
+#include "tile-delta.h"
+
+#define CAPTURE_FILE_MAGIC 0x31435753u    // "SWC1"
+#define CAPTURE_RECORD_MAGIC 0x46435753u  // "SWCF"
+#define CAPTURE_FILE_VERSION 1
+#define CAPTURE_ALIGN 64
+#define CAPTURE_CODEC_RAW 1
+#define CAPTURE_CODEC_LOSSLESS 2
+#define CAPTURE_FRAME_KEYFRAME 0x1        // Decodes on its own
+#define CAPTURE_FRAME_NO_HINTS 0x2        // DXGI reported no dirty rects: anything may have changed
+#define CAPTURE_KEYFRAME_INTERVAL 60      // Lossless: longest XOR chain a seek has to decode
+#define CAPTURE_MAX_DIRTY_RECTS 65535
+#define CAPTURE_RECORD_BUFFERS 4          // Frames CaptureRecorder can hold before it drops
+
+struct CaptureFileHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint8_t codec;
+    uint8_t reserved0;
+    uint32_t width, height;
+    uint32_t frameCount;
+    uint32_t keyframeInterval;
+    uint64_t indexOffset;        // 0 until Close()
+    uint8_t reserved[32];
+};
+
+struct CaptureRecordHeader {
+    uint32_t magic;
+    uint16_t flags;
+    uint16_t dirtyCount;
+    uint32_t frame;
+    uint32_t payloadSize;
+    uint64_t timestampUs;
+    uint64_t reserved;
+};
+
+struct CaptureIndexEntry {
+    uint64_t offset;             // Record header
+    uint64_t timestampUs;
+    uint32_t payloadSize;
+    uint16_t flags;
+    uint16_t dirtyCount;
+    uint32_t keyframe;           // Frame to start decoding from
+    uint32_t reserved;
+};
+
+static_assert(sizeof(CaptureFileHeader) == 64, "capture file header layout");
+static_assert(sizeof(CaptureRecordHeader) == 32, "capture record header layout");
+static_assert(sizeof(CaptureIndexEntry) == 32, "capture index entry layout");
+static_assert(sizeof(TileRect) == 16, "dirty rects are stored as four int32");
+
+inline uint64_t CaptureAlign(uint64_t offset) { return (offset + CAPTURE_ALIGN - 1) & ~(uint64_t)(CAPTURE_ALIGN - 1); }
+
+// Payload position relative to its record header
+inline uint64_t CapturePayloadOffset(uint32_t dirtyCount) {
+    return CaptureAlign(sizeof(CaptureRecordHeader) + (uint64_t)dirtyCount * sizeof(TileRect));
+}
+
+inline const char* CaptureCodecName(int codec) {
+    return codec == CAPTURE_CODEC_RAW ? "raw" : codec == CAPTURE_CODEC_LOSSLESS ? "lossless" : "unknown";
+}
+
+class CaptureFileWriter {
+private:
+    FILE* file = nullptr;
+    CaptureFileHeader header = {};
+    uint64_t offset = 0;                     // Next write position
+    std::vector<CaptureIndexEntry> index;
+    LosslessEncoder encoder;
+    std::vector<uint8_t> encoded;
+    JobSystem* jobs = nullptr;
+
+    bool Write(const void* data, size_t size) {
+        if (size && fwrite(data, 1, size, file) != size) return false;
+        offset += size;
+        return true;
+    }
+
+    bool Pad() {
+        static const uint8_t zeros[CAPTURE_ALIGN] = {};
+        return Write(zeros, (size_t)(CaptureAlign(offset) - offset));
+    }
+
+public:
+    ~CaptureFileWriter() { Close(); }
+
+    // Create (truncate) path for width x height frames. codec is
+    // CAPTURE_CODEC_RAW or CAPTURE_CODEC_LOSSLESS.
+    bool Open(const char* path, uint32_t width, uint32_t height, int codec,
+              uint32_t keyframeInterval = CAPTURE_KEYFRAME_INTERVAL) {
+        Close();
+        if (width == 0 || height == 0 || (codec != CAPTURE_CODEC_RAW && codec != CAPTURE_CODEC_LOSSLESS)) return false;
+        if (codec == CAPTURE_CODEC_LOSSLESS) {
+            if (!encoder.Initialize(width, height, true)) return false;
+            encoder.SetJobSystem(jobs);
+            encoded.resize(encoder.MaxEncodedSize());
+        }
+        file = fopen(path, "wb");
+        if (!file) return false;
+
+        memset(&header, 0, sizeof(header));
+        header.magic = CAPTURE_FILE_MAGIC;
+        header.version = CAPTURE_FILE_VERSION;
+        header.codec = (uint8_t)codec;
+        header.width = width;
+        header.height = height;
+        header.keyframeInterval = codec == CAPTURE_CODEC_RAW ? 1 : (keyframeInterval ? keyframeInterval : 1);
+        offset = 0;
+        index.clear();
+        if (!Write(&header, sizeof(header))) {
+            Close();
+            return false;
+        }
+        return true;
+    }
+
+    // Pool for lossless coding; null codes on the calling thread
+    void SetJobSystem(JobSystem* pool) {
+        jobs = pool;
+        encoder.SetJobSystem(pool);
+    }
+
+    // Append one frame (stride bytes per row). hints / hintCount are the
+    // frame's DXGI dirty rects; hintCount -1 means DXGI gave none. Returns 0,
+    // or -1 if the file can't be written (it is closed then).
+    int Append(const uint8_t* bgra, size_t stride, uint64_t timestampUs, const TileRect* hints, int hintCount) {
+        if (!file) return -1;
+        uint32_t frame = (uint32_t)index.size();
+        bool keyframe = frame % header.keyframeInterval == 0;
+        size_t rowBytes = (size_t)header.width * 4;
+
+        CaptureRecordHeader record = {};
+        record.magic = CAPTURE_RECORD_MAGIC;
+        record.frame = frame;
+        record.timestampUs = timestampUs;
+        if (hintCount < 0 || hintCount > CAPTURE_MAX_DIRTY_RECTS) {
+            record.flags |= CAPTURE_FRAME_NO_HINTS;
+        } else {
+            record.dirtyCount = (uint16_t)hintCount;
+        }
+        if (keyframe) record.flags |= CAPTURE_FRAME_KEYFRAME;
+
+        int size = (int)(rowBytes * header.height);
+        if (header.codec == CAPTURE_CODEC_LOSSLESS) {
+            size = encoder.Encode(bgra, stride, !keyframe, encoded.data(), encoded.size());
+            if (size < 0) return -1;
+        }
+        record.payloadSize = (uint32_t)size;
+
+        CaptureIndexEntry entry = {};
+        entry.offset = offset;
+        entry.timestampUs = timestampUs;
+        entry.payloadSize = record.payloadSize;
+        entry.flags = record.flags;
+        entry.dirtyCount = record.dirtyCount;
+        entry.keyframe = keyframe ? frame : index.back().keyframe;
+
+        bool ok = Write(&record, sizeof(record)) && Write(hints, record.dirtyCount * sizeof(TileRect)) && Pad();
+        if (ok && header.codec == CAPTURE_CODEC_LOSSLESS) {
+            ok = Write(encoded.data(), (size_t)size);
+        } else if (ok && stride == rowBytes) {
+            ok = Write(bgra, rowBytes * header.height);
+        } else {
+            for (uint32_t y = 0; ok && y < header.height; y++) ok = Write(bgra + y * stride, rowBytes);
+        }
+        if (!ok || !Pad()) {
+            Close();
+            return -1;
+        }
+        index.push_back(entry);
+        return 0;
+    }
+
+    // Write the index and the final header. Returns false if that failed
+    // (the records are still readable).
+    bool Close() {
+        if (!file) return true;
+        header.frameCount = (uint32_t)index.size();
+        header.indexOffset = offset;
+        bool ok = Write(index.data(), index.size() * sizeof(CaptureIndexEntry));
+        ok = ok && fseek(file, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, file) == 1;
+        ok = fclose(file) == 0 && ok;
+        file = nullptr;
+        return ok;
+    }
+
+    bool IsOpen() const { return file != nullptr; }
+    uint32_t GetFrameCount() const { return (uint32_t)index.size(); }
+    uint64_t GetBytesWritten() const { return offset; }
+};
+
+// Background recording for the capture services
+class CaptureRecorder {
+private:
+    struct Buffer {
+        std::vector<uint8_t> pixels;
+        std::vector<TileRect> hints;
+        int hintCount = -1;
+        uint64_t timestampUs = 0;
+        bool free = true;
+    };
+
+    CaptureFileWriter writer;
+    Buffer buffers[CAPTURE_RECORD_BUFFERS];
+    std::deque<int> ready;                   // Filled buffers, oldest first
+    int filling = 0;                         // Buffers being copied into by Submit()
+    bool recording = false;
+    bool failed = false;
+    uint32_t width = 0, height = 0;
+    JobSystem* jobs = nullptr;
+    std::mutex lock;
+    std::condition_variable wake;
+    std::thread thread;
+    std::atomic<uint64_t> written{0};
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<uint64_t> bytes{0};
+
+    void WriterThread() {
+        std::unique_lock<std::mutex> guard(lock);
+        while (true) {
+            wake.wait(guard, [&] { return !ready.empty() || (!recording && filling == 0); });
+            if (ready.empty()) break;
+            Buffer& b = buffers[ready.front()];
+            ready.pop_front();
+            guard.unlock();
+            bool ok = failed || writer.Append(b.pixels.data(), (size_t)width * 4, b.timestampUs,
+                b.hints.data(), b.hintCount) == 0;
+            guard.lock();
+            if (!ok) failed = true;
+            else if (!failed) written++;
+            bytes = writer.GetBytesWritten();
+            b.free = true;
+        }
+        writer.Close();
+    }
+
+public:
+    ~CaptureRecorder() { Stop(); }
+
+    // Pool for the frame copy and lossless coding (set before Start())
+    void SetJobSystem(JobSystem* pool) {
+        jobs = pool;
+        writer.SetJobSystem(pool);
+    }
+
+    // Open path and start the writer thread. False if already recording or
+    // the file can't be created.
+    bool Start(const char* path, uint32_t w, uint32_t h, int codec) {
+        std::lock_guard<std::mutex> guard(lock);
+        if (recording || thread.joinable()) return false;
+        if (!writer.Open(path, w, h, codec)) return false;
+        width = w;
+        height = h;
+        for (auto& b : buffers) {
+            b.pixels.resize((size_t)w * h * 4);
+            b.free = true;
+        }
+        ready.clear();
+        failed = false;
+        written = 0;
+        dropped = 0;
+        bytes = writer.GetBytesWritten();
+        recording = true;
+        thread = std::thread(&CaptureRecorder::WriterThread, this);
+        return true;
+    }
+
+    // Queue one frame (capture thread). Copies the pixels, so they only have
+    // to stay valid for the call. False if not recording or the frame was
+    // dropped because the writer is behind.
+    bool Submit(const uint8_t* bgra, size_t stride, uint64_t timestampUs, const TileRect* hints, int hintCount) {
+        int slot = -1;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            if (!recording) return false;
+            for (int i = 0; i < CAPTURE_RECORD_BUFFERS && slot < 0; i++) {
+                if (buffers[i].free) slot = i;
+            }
+            if (slot < 0) {
+                dropped++;
+                return false;
+            }
+            buffers[slot].free = false;
+            filling++;
+        }
+        Buffer& b = buffers[slot];
+        ParallelCopyRows(jobs, b.pixels.data(), (size_t)width * 4, bgra, stride, (size_t)width * 4, height);
+        b.hintCount = hintCount;
+        b.hints.assign(hints, hints + (hintCount > 0 ? hintCount : 0));
+        b.timestampUs = timestampUs;
+
+        std::lock_guard<std::mutex> guard(lock);
+        filling--;
+        ready.push_back(slot);
+        wake.notify_one();
+        return true;
+    }
+
+    // Write what is queued, then the index, and close the file
+    void Stop() {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            recording = false;
+            wake.notify_one();
+        }
+        if (thread.joinable()) thread.join();
+    }
+
+    bool IsRecording() {
+        std::lock_guard<std::mutex> guard(lock);
+        return recording;
+    }
+
+    // True once a write failed; later frames are discarded until Stop()
+    bool HasFailed() {
+        std::lock_guard<std::mutex> guard(lock);
+        return failed;
+    }
+
+    uint64_t GetFramesWritten() const { return written; }
+    uint64_t GetFramesDropped() const { return dropped; }
+    uint64_t GetBytesWritten() const { return bytes; }
+};
+
+class CaptureFileReader {
+private:
+    MappedFile file;
+    CaptureFileHeader header = {};
+    const CaptureIndexEntry* index = nullptr;   // Into the mapping, or into rebuilt
+    std::vector<CaptureIndexEntry> rebuilt;
+    uint32_t frameCount = 0;
+    bool complete = false;
+
+    LosslessDecoder decoder;
+    int64_t decoded = -1;                        // Frame in the decoder
+
+    // Frame source state
+    uint32_t position = 0;                       // Next() returns this frame
+    int hintCount = -1;
+    const TileRect* hints = &noHints;
+    TileRect noHints = {};
+    bool jumped = true;                          // Next() frame doesn't follow the last one
+    bool realtime = false;
+    bool anchored = false;
+    std::chrono::steady_clock::time_point anchor;
+    uint64_t anchorUs = 0;
+    FramePacer pacer;
+
+    bool ValidEntry(const CaptureIndexEntry& e) const {
+        uint64_t end = e.offset + CapturePayloadOffset(e.dirtyCount) + e.payloadSize;
+        return e.offset >= sizeof(CaptureFileHeader) && end <= file.GetSize() && end > e.offset;
+    }
+
+    // Walk the records of a file without an index (writer never closed it)
+    void RebuildIndex() {
+        rebuilt.clear();
+        uint64_t offset = sizeof(CaptureFileHeader);
+        uint32_t keyframe = 0;
+        while (offset + sizeof(CaptureRecordHeader) <= file.GetSize()) {
+            CaptureRecordHeader record;
+            memcpy(&record, file.GetData() + offset, sizeof(record));
+            if (record.magic != CAPTURE_RECORD_MAGIC || record.frame != rebuilt.size()) break;
+            CaptureIndexEntry e = {};
+            e.offset = offset;
+            e.timestampUs = record.timestampUs;
+            e.payloadSize = record.payloadSize;
+            e.flags = record.flags;
+            e.dirtyCount = record.dirtyCount;
+            if (record.flags & CAPTURE_FRAME_KEYFRAME) keyframe = record.frame;
+            else if (rebuilt.empty()) break;  // Nothing to decode it against
+            e.keyframe = keyframe;
+            if (!ValidEntry(e)) break;        // Cut off mid-record
+            rebuilt.push_back(e);
+            offset = CaptureAlign(offset + CapturePayloadOffset(e.dirtyCount) + e.payloadSize);
+        }
+        index = rebuilt.data();
+        frameCount = (uint32_t)rebuilt.size();
+    }
+
+public:
+    // Map a recording. Returns false if it isn't one (or is empty of frames
+    // and has no index to say so).
+    bool Open(const char* path) {
+        Close();
+        if (!file.Open(path) || file.GetSize() < sizeof(header)) return false;
+        memcpy(&header, file.GetData(), sizeof(header));
+        if (header.magic != CAPTURE_FILE_MAGIC || header.version != CAPTURE_FILE_VERSION ||
+            header.width == 0 || header.height == 0 || header.width > 65535 || header.height > 65535 ||
+            (header.codec != CAPTURE_CODEC_RAW && header.codec != CAPTURE_CODEC_LOSSLESS)) {
+            Close();
+            return false;
+        }
+
+        // An index past the end (file cut after Close(), or a bad header) is
+        // ignored; checked without adding, so a huge offset can't wrap around
+        uint64_t size = file.GetSize();
+        complete = header.indexOffset != 0 && header.indexOffset % CAPTURE_ALIGN == 0 &&
+            header.indexOffset <= size &&
+            header.frameCount <= (size - header.indexOffset) / sizeof(CaptureIndexEntry);
+        if (complete) {
+            index = (const CaptureIndexEntry*)(file.GetData() + header.indexOffset);
+            frameCount = header.frameCount;
+            for (uint32_t i = 0; i < frameCount && complete; i++) {
+                complete = ValidEntry(index[i]) && index[i].keyframe <= i;
+            }
+        }
+        if (!complete) RebuildIndex();
+        pacer.Start(0);
+        Seek(0);
+        return true;
+    }
+
+    void Close() {
+        file.Close();
+        index = nullptr;
+        rebuilt.clear();
+        frameCount = 0;
+        decoded = -1;
+        position = 0;
+    }
+
+    void SetJobSystem(JobSystem* pool) { decoder.SetJobSystem(pool); }
+
+    // Deliver frames from Next() at their recorded spacing (true) or as fast
+    // as they are asked for (false, the default)
+    void SetRealtime(bool enabled) {
+        realtime = enabled;
+        anchored = false;
+    }
+
+    uint32_t GetWidth() const { return header.width; }
+    uint32_t GetHeight() const { return header.height; }
+    uint32_t GetStride() const { return header.width * 4; }
+    int GetCodec() const { return header.codec; }
+    uint32_t GetFrameCount() const { return frameCount; }
+    // False if the index was rebuilt (recording not closed cleanly)
+    bool IsComplete() const { return complete; }
+
+    uint64_t GetTimestampUs(uint32_t frame) const { return frame < frameCount ? index[frame].timestampUs : 0; }
+    uint64_t GetDurationUs() const {
+        return frameCount > 1 ? index[frameCount - 1].timestampUs - index[0].timestampUs : 0;
+    }
+
+    // Stored payload of a frame, straight out of the mapping (raw BGRA or a
+    // lossless stream). nullptr past the end.
+    const uint8_t* GetPayload(uint32_t frame, uint32_t* size, uint16_t* flags = nullptr) const {
+        if (frame >= frameCount) return nullptr;
+        const CaptureIndexEntry& e = index[frame];
+        *size = e.payloadSize;
+        if (flags) *flags = e.flags;
+        return file.GetData() + e.offset + CapturePayloadOffset(e.dirtyCount);
+    }
+
+    // Dirty rects recorded with a frame, relative to the frame before it.
+    // Returns the count, or -1 (rects = nullptr) if DXGI gave none.
+    int GetFrameDirtyRects(uint32_t frame, const TileRect** rects) const {
+        *rects = nullptr;
+        if (frame >= frameCount || (index[frame].flags & CAPTURE_FRAME_NO_HINTS)) return -1;
+        *rects = index[frame].dirtyCount ? (const TileRect*)(file.GetData() + index[frame].offset +
+            sizeof(CaptureRecordHeader)) : &noHints;
+        return index[frame].dirtyCount;
+    }
+
+    // Pixels of a frame (GetStride() bytes per row), valid until the next
+    // decode. Raw files return the mapping itself; lossless files decode
+    // forward from the nearest keyframe, or from the last decoded frame when
+    // reading in order. nullptr past the end or on a corrupt payload.
+    const uint8_t* Decode(uint32_t frame) {
+        uint32_t size;
+        const uint8_t* payload = GetPayload(frame, &size);
+        if (!payload) return nullptr;
+        if (header.codec == CAPTURE_CODEC_RAW) return size == (uint64_t)GetStride() * header.height ? payload : nullptr;
+
+        if (decoded == (int64_t)frame) return decoder.GetFrame();
+        uint32_t from = index[frame].keyframe;
+        if (decoded >= (int64_t)from && decoded < (int64_t)frame) from = (uint32_t)decoded + 1;
+        for (uint32_t f = from; f <= frame; f++) {
+            payload = GetPayload(f, &size);
+            if (decoder.Decode(payload, size) != 0 || decoder.GetWidth() != header.width ||
+                decoder.GetHeight() != header.height) {
+                decoded = -1;
+                return nullptr;
+            }
+            decoded = f;
+        }
+        return decoder.GetFrame();
+    }
+
+    // Next() continues at frame. Its first frame reports no dirty rects
+    // (hint count -1), since they describe a jump the caller didn't see.
+    bool Seek(uint32_t frame) {
+        if (frame > frameCount) return false;
+        position = frame;
+        jumped = true;
+        anchored = false;
+        return true;
+    }
+
+    // Frame by capture time: the last frame at or before timestampUs
+    uint32_t FindFrame(uint64_t timestampUs) const {
+        uint32_t lo = 0, hi = frameCount;
+        while (hi - lo > 1) {
+            uint32_t mid = lo + (hi - lo) / 2;
+            if (index[mid].timestampUs <= timestampUs) lo = mid;
+            else hi = mid;
+        }
+        return lo;
+    }
+
+    // Frame source: the next frame's pixels (GetStride() bytes per row),
+    // valid until the next call; nullptr at the end or on a corrupt frame.
+    // In realtime mode it returns no earlier than the frame's recorded
+    // offset from the first frame delivered since Seek() / SetRealtime().
+    const uint8_t* Next() {
+        if (position >= frameCount) return nullptr;
+        uint32_t frame = position++;
+        const uint8_t* pixels = Decode(frame);
+        if (!pixels) return nullptr;
+
+        const TileRect* rects;
+        int count = GetFrameDirtyRects(frame, &rects);
+        hintCount = jumped ? -1 : count;
+        hints = !jumped && rects ? rects : &noHints;
+        jumped = false;
+
+        if (realtime) {
+            uint64_t us = index[frame].timestampUs;
+            if (!anchored || us < anchorUs) {
+                anchored = true;
+                anchor = std::chrono::steady_clock::now();
+                anchorUs = us;
+            }
+            pacer.WaitUntil(anchor + std::chrono::microseconds(us - anchorUs));
+        }
+        return pixels;
+    }
+
+    // Dirty rects of the last Next(), as bench/frame-source.h: never null,
+    // count -1 when unknown (pass straight to TileDelta::Detect() as hints)
+    const TileRect* GetDirtyRects(int* count) const {
+        *count = hintCount;
+        return hints;
+    }
+
+    // Frames delivered by Next() so far since the start (1 = the first)
+    uint64_t GetFrameNumber() const { return position; }
+};
@@ -0,0 +1,358 @@
+// Color Convert - BGRA to planar YCbCr (JFIF, full-range BT.601)
+// Converts pitched BGRA rows into separate Y, Cb and Cr planes in one pass,
+// with 4:4:4, 4:2:2 or 4:2:0 chroma. Scalar reference plus SSE2 and AVX2
+// kernels; all three use the same 15-bit fixed point math and produce
+// identical output, so the SIMD paths are tested for exact equality.
+//
+// Chroma is computed from the summed B, G, R of each 2x1 (4:2:2) or 2x2
+// (4:2:0) block, i.e. the block is averaged before conversion. Odd widths and
+// heights repeat the last column / row.
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include "cpu-features.h"
+
+enum ChromaSubsampling {
+    CHROMA_444 = 0,
+    CHROMA_422 = 1,  // Half width
+    CHROMA_420 = 2   // Half width, half height
+};
+
+struct YCbCrPlanes {
+    uint8_t* y;
+    uint8_t* cb;
+    uint8_t* cr;
+    uint32_t yStride;
+    uint32_t cStride;  // Shared by Cb and Cr
+};
+
+inline const char* ChromaSubsamplingName(ChromaSubsampling s) {
+    switch (s) {
+        case CHROMA_420: return "4:2:0";
+        case CHROMA_422: return "4:2:2";
+        default: return "4:4:4";
+    }
+}
+
+inline uint32_t ChromaWidth(uint32_t width, ChromaSubsampling s) {
+    return s == CHROMA_444 ? width : (width + 1) / 2;
+}
+
+inline uint32_t ChromaHeight(uint32_t height, ChromaSubsampling s) {
+    return s == CHROMA_420 ? (height + 1) / 2 : height;
+}
+
+namespace colorconv {
+
+// Q15 coefficients. Y sums to 32768 so white stays 255; Cb and Cr sum to 0.
+const int SHIFT = 15;
+const int Y_B = 3735, Y_G = 19235, Y_R = 9798;
+const int CB_B = 16384, CB_G = -10855, CB_R = -5529;
+const int CR_B = -2664, CR_G = -13720, CR_R = 16384;
+
+// Results are never negative; only Cb/Cr of saturated blue/red can hit 256
+inline uint8_t Clamp255(int v) { return (uint8_t)(v > 255 ? 255 : v); }
+
+inline uint8_t Luma(int b, int g, int r) {
+    return (uint8_t)((Y_B * b + Y_G * g + Y_R * r + (1 << (SHIFT - 1))) >> SHIFT);
+}
+
+// b, g, r are sums over (1 << log2Count) pixels
+inline void Chroma(int b, int g, int r, int log2Count, uint8_t* cb, uint8_t* cr) {
+    int shift = SHIFT + log2Count;
+    int bias = (128 << shift) + (1 << (shift - 1));
+    *cb = Clamp255((CB_B * b + CB_G * g + CB_R * r + bias) >> shift);
+    *cr = Clamp255((CR_B * b + CR_G * g + CR_R * r + bias) >> shift);
+}
+
+// Convert pixels [x0, width) of one output row. row1/y1 are only used for
+// 4:2:0 (row1 == row0 on the last row of an odd height, y1 == nullptr then).
+// cb/cr point at the start of the chroma row; x0 must be even.
+inline void ConvertRowScalar(const uint8_t* row0, const uint8_t* row1, uint32_t x0, uint32_t width,
+                             ChromaSubsampling s, uint8_t* y0, uint8_t* y1, uint8_t* cb, uint8_t* cr) {
+    for (uint32_t x = x0; x < width; x++) {
+        const uint8_t* p = row0 + x * 4;
+        y0[x] = Luma(p[0], p[1], p[2]);
+        if (y1) {
+            const uint8_t* q = row1 + x * 4;
+            y1[x] = Luma(q[0], q[1], q[2]);
+        }
+    }
+
+    if (s == CHROMA_444) {
+        for (uint32_t x = x0; x < width; x++) {
+            const uint8_t* p = row0 + x * 4;
+            Chroma(p[0], p[1], p[2], 0, &cb[x], &cr[x]);
+        }
+        return;
+    }
+
+    for (uint32_t x = x0; x < width; x += 2) {
+        const uint8_t* a = row0 + x * 4;
+        const uint8_t* b = row0 + (x + 1 < width ? x + 1 : x) * 4;
+        int sb = a[0] + b[0], sg = a[1] + b[1], sr = a[2] + b[2];
+        int log2Count = 1;
+        if (s == CHROMA_420) {
+            const uint8_t* c = row1 + x * 4;
+            const uint8_t* d = row1 + (x + 1 < width ? x + 1 : x) * 4;
+            sb += c[0] + d[0];
+            sg += c[1] + d[1];
+            sr += c[2] + d[2];
+            log2Count = 2;
+        }
+        Chroma(sb, sg, sr, log2Count, &cb[x / 2], &cr[x / 2]);
+    }
+}
+
+// SIMD layout: a BGRA pixel is one 32-bit lane. Masking with 0x00FF00FF gives
+// 16-bit (B, R) pairs and shifting by 8 first gives (G, A) pairs, so one
+// madd per pair and an add yield the exact 32-bit dot product per pixel -
+// the same integer sum the scalar path computes. A gets a zero coefficient.
+// Sums of up to four pixels still fit the 16-bit halves, so 2x1 / 2x2 blocks
+// are summed before the madd.
+
+inline int32_t PairCoef(int low, int high) { return (int32_t)(((uint32_t)high << 16) | ((uint32_t)low & 0xFFFF)); }
+
+#ifdef SIMD_X86
+
+struct CoefsSSE2 {
+    __m128i mask, yBR, yG, cbBR, cbG, crBR, crG, yRound;
+    CoefsSSE2() {
+        mask = _mm_set1_epi32(0x00FF00FF);
+        yBR = _mm_set1_epi32(PairCoef(Y_B, Y_R));
+        yG = _mm_set1_epi32(PairCoef(Y_G, 0));
+        cbBR = _mm_set1_epi32(PairCoef(CB_B, CB_R));
+        cbG = _mm_set1_epi32(PairCoef(CB_G, 0));
+        crBR = _mm_set1_epi32(PairCoef(CR_B, CR_R));
+        crG = _mm_set1_epi32(PairCoef(CR_G, 0));
+        yRound = _mm_set1_epi32(1 << (SHIFT - 1));
+    }
+};
+
+inline __m128i DotSSE2(__m128i br, __m128i ga, __m128i coefBR, __m128i coefG) {
+    return _mm_add_epi32(_mm_madd_epi16(br, coefBR), _mm_madd_epi16(ga, coefG));
+}
+
+// Sum horizontally adjacent pixels: 8 pixels in (a, b) -> 4 pair sums
+inline __m128i PairSumSSE2(__m128i a, __m128i b) {
+    __m128i even = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(a), _mm_castsi128_ps(b), _MM_SHUFFLE(2, 0, 2, 0)));
+    __m128i odd = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(a), _mm_castsi128_ps(b), _MM_SHUFFLE(3, 1, 3, 1)));
+    return _mm_add_epi16(even, odd);
+}
+
+inline void StoreLuma16SSE2(const __m128i px[4], const CoefsSSE2& k, uint8_t* out) {
+    __m128i l[4];
+    for (int i = 0; i < 4; i++) {
+        __m128i br = _mm_and_si128(px[i], k.mask);
+        __m128i ga = _mm_and_si128(_mm_srli_epi32(px[i], 8), k.mask);
+        l[i] = _mm_srai_epi32(_mm_add_epi32(DotSSE2(br, ga, k.yBR, k.yG), k.yRound), SHIFT);
+    }
+    __m128i packed = _mm_packus_epi16(_mm_packs_epi32(l[0], l[1]), _mm_packs_epi32(l[2], l[3]));
+    _mm_storeu_si128((__m128i*)out, packed);
+}
+
+// 16 pixels per step; the tail (width % 16) goes through the scalar path
+inline void ConvertRowSSE2(const uint8_t* row0, const uint8_t* row1, uint32_t width, ChromaSubsampling s,
+                           uint8_t* y0, uint8_t* y1, uint8_t* cb, uint8_t* cr) {
+    const CoefsSSE2 k;
+    int log2Count = s == CHROMA_420 ? 2 : (s == CHROMA_422 ? 1 : 0);
+    int shift = SHIFT + log2Count;
+    __m128i bias = _mm_set1_epi32((128 << shift) + (1 << (shift - 1)));
+    __m128i shiftCount = _mm_cvtsi32_si128(shift);
+
+    uint32_t x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m128i p[4], q[4];
+        for (int i = 0; i < 4; i++) p[i] = _mm_loadu_si128((const __m128i*)(row0 + (x + i * 4) * 4));
+        StoreLuma16SSE2(p, k, y0 + x);
+        if (s == CHROMA_420) {
+            for (int i = 0; i < 4; i++) q[i] = _mm_loadu_si128((const __m128i*)(row1 + (x + i * 4) * 4));
+            if (y1) StoreLuma16SSE2(q, k, y1 + x);
+        }
+
+        __m128i br[4], ga[4];
+        for (int i = 0; i < 4; i++) {
+            br[i] = _mm_and_si128(p[i], k.mask);
+            ga[i] = _mm_and_si128(_mm_srli_epi32(p[i], 8), k.mask);
+            if (s == CHROMA_420) {
+                br[i] = _mm_add_epi16(br[i], _mm_and_si128(q[i], k.mask));
+                ga[i] = _mm_add_epi16(ga[i], _mm_and_si128(_mm_srli_epi32(q[i], 8), k.mask));
+            }
+        }
+
+        if (s == CHROMA_444) {
+            __m128i vb[4], vr[4];
+            for (int i = 0; i < 4; i++) {
+                vb[i] = _mm_sra_epi32(_mm_add_epi32(DotSSE2(br[i], ga[i], k.cbBR, k.cbG), bias), shiftCount);
+                vr[i] = _mm_sra_epi32(_mm_add_epi32(DotSSE2(br[i], ga[i], k.crBR, k.crG), bias), shiftCount);
+            }
+            _mm_storeu_si128((__m128i*)(cb + x), _mm_packus_epi16(_mm_packs_epi32(vb[0], vb[1]), _mm_packs_epi32(vb[2], vb[3])));
+            _mm_storeu_si128((__m128i*)(cr + x), _mm_packus_epi16(_mm_packs_epi32(vr[0], vr[1]), _mm_packs_epi32(vr[2], vr[3])));
+        } else {
+            __m128i vb[2], vr[2];
+            for (int i = 0; i < 2; i++) {
+                __m128i sbr = PairSumSSE2(br[i * 2], br[i * 2 + 1]);
+                __m128i sga = PairSumSSE2(ga[i * 2], ga[i * 2 + 1]);
+                vb[i] = _mm_sra_epi32(_mm_add_epi32(DotSSE2(sbr, sga, k.cbBR, k.cbG), bias), shiftCount);
+                vr[i] = _mm_sra_epi32(_mm_add_epi32(DotSSE2(sbr, sga, k.crBR, k.crG), bias), shiftCount);
+            }
+            // Low 8 bytes Cb, high 8 bytes Cr
+            __m128i packed = _mm_packus_epi16(_mm_packs_epi32(vb[0], vb[1]), _mm_packs_epi32(vr[0], vr[1]));
+            _mm_storel_epi64((__m128i*)(cb + x / 2), packed);
+            _mm_storel_epi64((__m128i*)(cr + x / 2), _mm_srli_si128(packed, 8));
+        }
+    }
+
+    ConvertRowScalar(row0, row1, x, width, s, y0, y1, cb, cr);
+}
+
+struct CoefsAVX2 {
+    __m256i mask, yBR, yG, cbBR, cbG, crBR, crG, yRound, order;
+    SIMD_TARGET_AVX2 CoefsAVX2() {
+        mask = _mm256_set1_epi32(0x00FF00FF);
+        yBR = _mm256_set1_epi32(PairCoef(Y_B, Y_R));
+        yG = _mm256_set1_epi32(PairCoef(Y_G, 0));
+        cbBR = _mm256_set1_epi32(PairCoef(CB_B, CB_R));
+        cbG = _mm256_set1_epi32(PairCoef(CB_G, 0));
+        crBR = _mm256_set1_epi32(PairCoef(CR_B, CR_R));
+        crG = _mm256_set1_epi32(PairCoef(CR_G, 0));
+        yRound = _mm256_set1_epi32(1 << (SHIFT - 1));
+        // packs/packus work per 128-bit lane; this puts 4-byte groups back in order
+        order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    }
+};
+
+SIMD_TARGET_AVX2
+inline __m256i DotAVX2(__m256i br, __m256i ga, __m256i coefBR, __m256i coefG) {
+    return _mm256_add_epi32(_mm256_madd_epi16(br, coefBR), _mm256_madd_epi16(ga, coefG));
+}
+
+// 4 x 8 int32 values (0..256) -> 32 bytes in order
+SIMD_TARGET_AVX2
+inline __m256i Pack32AVX2(const __m256i v[4], __m256i order) {
+    __m256i packed = _mm256_packus_epi16(_mm256_packs_epi32(v[0], v[1]), _mm256_packs_epi32(v[2], v[3]));
+    return _mm256_permutevar8x32_epi32(packed, order);
+}
+
+// Sum horizontally adjacent pixels: 16 pixels in (a, b) -> 8 pair sums in order
+SIMD_TARGET_AVX2
+inline __m256i PairSumAVX2(__m256i a, __m256i b) {
+    __m256i even = _mm256_castps_si256(_mm256_shuffle_ps(_mm256_castsi256_ps(a), _mm256_castsi256_ps(b), _MM_SHUFFLE(2, 0, 2, 0)));
+    __m256i odd = _mm256_castps_si256(_mm256_shuffle_ps(_mm256_castsi256_ps(a), _mm256_castsi256_ps(b), _MM_SHUFFLE(3, 1, 3, 1)));
+    // The shuffle works per lane: pairs come out as 0,1,4,5 | 2,3,6,7
+    return _mm256_permute4x64_epi64(_mm256_add_epi16(even, odd), _MM_SHUFFLE(3, 1, 2, 0));
+}
+
+SIMD_TARGET_AVX2
+inline void StoreLuma32AVX2(const __m256i px[4], const CoefsAVX2& k, uint8_t* out) {
+    __m256i l[4];
+    for (int i = 0; i < 4; i++) {
+        __m256i br = _mm256_and_si256(px[i], k.mask);
+        __m256i ga = _mm256_and_si256(_mm256_srli_epi32(px[i], 8), k.mask);
+        l[i] = _mm256_srai_epi32(_mm256_add_epi32(DotAVX2(br, ga, k.yBR, k.yG), k.yRound), SHIFT);
+    }
+    _mm256_storeu_si256((__m256i*)out, Pack32AVX2(l, k.order));
+}
+
+SIMD_TARGET_AVX2
+inline void ConvertRowAVX2(const uint8_t* row0, const uint8_t* row1, uint32_t width, ChromaSubsampling s,
+                           uint8_t* y0, uint8_t* y1, uint8_t* cb, uint8_t* cr) {
+    const CoefsAVX2 k;
+    int log2Count = s == CHROMA_420 ? 2 : (s == CHROMA_422 ? 1 : 0);
+    int shift = SHIFT + log2Count;
+    __m256i bias = _mm256_set1_epi32((128 << shift) + (1 << (shift - 1)));
+    __m128i shiftCount = _mm_cvtsi32_si128(shift);
+
+    uint32_t x = 0;
+    for (; x + 32 <= width; x += 32) {
+        __m256i p[4], q[4];
+        for (int i = 0; i < 4; i++) p[i] = _mm256_loadu_si256((const __m256i*)(row0 + (x + i * 8) * 4));
+        StoreLuma32AVX2(p, k, y0 + x);
+        if (s == CHROMA_420) {
+            for (int i = 0; i < 4; i++) q[i] = _mm256_loadu_si256((const __m256i*)(row1 + (x + i * 8) * 4));
+            if (y1) StoreLuma32AVX2(q, k, y1 + x);
+        }
+
+        __m256i br[4], ga[4];
+        for (int i = 0; i < 4; i++) {
+            br[i] = _mm256_and_si256(p[i], k.mask);
+            ga[i] = _mm256_and_si256(_mm256_srli_epi32(p[i], 8), k.mask);
+            if (s == CHROMA_420) {
+                br[i] = _mm256_add_epi16(br[i], _mm256_and_si256(q[i], k.mask));
+                ga[i] = _mm256_add_epi16(ga[i], _mm256_and_si256(_mm256_srli_epi32(q[i], 8), k.mask));
+            }
+        }
+
+        if (s == CHROMA_444) {
+            __m256i vb[4], vr[4];
+            for (int i = 0; i < 4; i++) {
+                vb[i] = _mm256_sra_epi32(_mm256_add_epi32(DotAVX2(br[i], ga[i], k.cbBR, k.cbG), bias), shiftCount);
+                vr[i] = _mm256_sra_epi32(_mm256_add_epi32(DotAVX2(br[i], ga[i], k.crBR, k.crG), bias), shiftCount);
+            }
+            _mm256_storeu_si256((__m256i*)(cb + x), Pack32AVX2(vb, k.order));
+            _mm256_storeu_si256((__m256i*)(cr + x), Pack32AVX2(vr, k.order));
+        } else {
+            // Cb in the first two vectors, Cr in the last two: low 16 bytes Cb, high 16 Cr
+            __m256i v[4];
+            for (int i = 0; i < 2; i++) {
+                __m256i sbr = PairSumAVX2(br[i * 2], br[i * 2 + 1]);
+                __m256i sga = PairSumAVX2(ga[i * 2], ga[i * 2 + 1]);
+                v[i] = _mm256_sra_epi32(_mm256_add_epi32(DotAVX2(sbr, sga, k.cbBR, k.cbG), bias), shiftCount);
+                v[i + 2] = _mm256_sra_epi32(_mm256_add_epi32(DotAVX2(sbr, sga, k.crBR, k.crG), bias), shiftCount);
+            }
+            __m256i packed = Pack32AVX2(v, k.order);
+            _mm_storeu_si128((__m128i*)(cb + x / 2), _mm256_castsi256_si128(packed));
+            _mm_storeu_si128((__m128i*)(cr + x / 2), _mm256_extracti128_si256(packed, 1));
+        }
+    }
+
+    // Remaining 16-pixel block (if any) and tail
+    if (x < width) {
+        uint32_t cx = s == CHROMA_444 ? x : x / 2;
+        ConvertRowSSE2(row0 + x * 4, row1 ? row1 + x * 4 : nullptr, width - x, s,
+            y0 + x, y1 ? y1 + x : nullptr, cb + cx, cr + cx);
+    }
+}
+
+#endif  // SIMD_X86
+
+}  // namespace colorconv
+
+// Convert a w x h BGRA image (any pitch) into out. For 4:2:0 the planes need
+// ChromaHeight() rows. Converting a horizontal strip (e.g. one MCU row) is
+// done by offsetting the pointers; strips must start on an even row for 4:2:0.
+inline void ConvertBgraToYCbCr(const uint8_t* bgra, uint32_t stride, uint32_t width, uint32_t height,
+                               ChromaSubsampling subsampling, const YCbCrPlanes& out,
+                               SimdLevel level = GetSimdLevel()) {
+    using namespace colorconv;
+    uint32_t rowStep = subsampling == CHROMA_420 ? 2 : 1;
+
+    for (uint32_t y = 0; y < height; y += rowStep) {
+        const uint8_t* row0 = bgra + (size_t)y * stride;
+        uint8_t* y0 = out.y + (size_t)y * out.yStride;
+        const uint8_t* row1 = nullptr;
+        uint8_t* y1 = nullptr;
+        if (subsampling == CHROMA_420) {
+            bool hasNext = y + 1 < height;
+            row1 = hasNext ? row0 + stride : row0;
+            y1 = hasNext ? y0 + out.yStride : nullptr;
+        }
+        size_t chromaOffset = (size_t)(y / rowStep) * out.cStride;
+        uint8_t* cb = out.cb + chromaOffset;
+        uint8_t* cr = out.cr + chromaOffset;
+
+#ifdef SIMD_X86
+        if (level == SIMD_AVX2) {
+            ConvertRowAVX2(row0, row1, width, subsampling, y0, y1, cb, cr);
+            continue;
+        }
+        if (level == SIMD_SSE2) {
+            ConvertRowSSE2(row0, row1, width, subsampling, y0, y1, cb, cr);
+            continue;
+        }
+#endif
+        ConvertRowScalar(row0, row1, 0, width, subsampling, y0, y1, cb, cr);
+    }
+}
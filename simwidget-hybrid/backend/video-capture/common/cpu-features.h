@@ -0,0 +1,78 @@
+// CPU feature detection for the SIMD kernels
+// x86/x64 gets SSE2 (baseline on x64) and AVX2 (checked at runtime).
+// Other architectures fall back to the scalar paths.
+
+#pragma once
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define SIMD_X86 1
+#include <emmintrin.h>
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+// MSVC compiles any intrinsic without flags; GCC/Clang need a per-function target
+#if defined(SIMD_X86) && !defined(_MSC_VER)
+#define SIMD_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define SIMD_TARGET_AVX2
+#endif
+
+enum SimdLevel {
+    SIMD_SCALAR = 0,
+    SIMD_SSE2 = 1,
+    SIMD_AVX2 = 2
+};
+
+inline const char* SimdLevelName(SimdLevel level) {
+    switch (level) {
+        case SIMD_AVX2: return "avx2";
+        case SIMD_SSE2: return "sse2";
+        default: return "scalar";
+    }
+}
+
+inline SimdLevel DetectSimdLevel() {
+#ifdef SIMD_X86
+    unsigned int regs[4] = {};
+#ifdef _MSC_VER
+    __cpuidex((int*)regs, 1, 0);
+#else
+    __cpuid_count(1, 0, regs[0], regs[1], regs[2], regs[3]);
+#endif
+    bool sse2 = (regs[3] & (1u << 26)) != 0;
+    bool osxsave = (regs[2] & (1u << 27)) != 0;
+    bool avx = (regs[2] & (1u << 28)) != 0;
+    if (!sse2) return SIMD_SCALAR;
+    if (!osxsave || !avx) return SIMD_SSE2;
+
+    // OS must save YMM state (XCR0 bits 1 and 2)
+#ifdef _MSC_VER
+    unsigned long long xcr0 = _xgetbv(0);
+#else
+    unsigned int xlo, xhi;
+    __asm__("xgetbv" : "=a"(xlo), "=d"(xhi) : "c"(0));
+    unsigned long long xcr0 = ((unsigned long long)xhi << 32) | xlo;
+#endif
+    if ((xcr0 & 6) != 6) return SIMD_SSE2;
+
+#ifdef _MSC_VER
+    __cpuidex((int*)regs, 7, 0);
+#else
+    __cpuid_count(7, 0, regs[0], regs[1], regs[2], regs[3]);
+#endif
+    return (regs[1] & (1u << 5)) ? SIMD_AVX2 : SIMD_SSE2;
+#else
+    return SIMD_SCALAR;
+#endif
+}
+
+// Detected once; kernels call this to pick their implementation
+inline SimdLevel GetSimdLevel() {
+    static SimdLevel level = DetectSimdLevel();
+    return level;
+}
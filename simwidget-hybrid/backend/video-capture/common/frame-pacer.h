@@ -0,0 +1,240 @@
+// Frame Pacer - deadline-based frame scheduling
+// Frame n is due at start + n * interval on the steady (QPC-backed)
+// clock. Deadlines are absolute, so time spent capturing never shifts the
+// schedule, and running a little late doesn't add up into drift. A loop that
+// overruns by whole intervals skips those deadlines (counted as missed) and
+// continues one interval after the late frame, instead of bursting frames to
+// catch up.
+//
+// Waiting is hybrid: sleep until shortly before the deadline, then spin
+// (yielding) for the rest. The spin margin follows how late the OS actually
+// wakes us (twice the running average oversleep, clamped), so it is a few
+// hundred microseconds where sleeps are precise and a couple of milliseconds
+// where they are not. On Windows the sleep uses a high-resolution waitable
+// timer (Windows 10 1803+), falling back to Sleep() at 1 ms timer resolution.
+//
+// Statistics per reporting window: achieved FPS, interval min / max / stddev
+// (jitter as the viewer sees it), wake-up lateness against the deadline and
+// missed deadlines.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <math.h>
+#include <chrono>
+#include <thread>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#include <mmsystem.h>
+#pragma comment(lib, "winmm.lib")
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x2
+#endif
+#endif
+
+#define PACER_SPIN_MIN_US 100      // Spin margin bounds
+#define PACER_SPIN_MAX_US 4000
+#define PACER_SPIN_INITIAL_US 1000
+#define PACER_REPORT_MS 5000       // Suggested reporting window for services
+
+struct PacerStats {
+    uint64_t frames = 0;
+    uint64_t missed = 0;           // Deadlines skipped because the loop overran
+    double seconds = 0;            // Window length
+    double fps = 0;
+    double meanIntervalMs = 0;     // Between consecutive Wait() returns
+    double minIntervalMs = 0;
+    double maxIntervalMs = 0;
+    double jitterMs = 0;           // Standard deviation of the interval
+    double meanLateUs = 0;         // Wake-up time after the deadline
+    double maxLateUs = 0;
+    double spinUs = 0;             // Current spin margin
+};
+
+inline void PrintPacerStats(const char* prefix, const PacerStats& s) {
+    printf("%sPacing: %.1f FPS, interval %.2f ms (min %.2f, max %.2f, jitter %.2f), late avg %.0f us max %.0f us, "
+        "missed %llu, spin %.0f us\n", prefix, s.fps, s.meanIntervalMs, s.minIntervalMs, s.maxIntervalMs, s.jitterMs,
+        s.meanLateUs, s.maxLateUs, (unsigned long long)s.missed, s.spinUs);
+}
+
+class FramePacer {
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    Clock::duration interval = Clock::duration::zero();   // Zero = unpaced
+    Clock::time_point deadline;
+    Clock::time_point lastFrame;
+    bool haveLastFrame = false;
+    double spinUs = PACER_SPIN_INITIAL_US;
+    double oversleepUs = PACER_SPIN_INITIAL_US / 2;        // Running average
+
+    // Current window
+    Clock::time_point windowStart;
+    uint64_t frames = 0, intervals = 0, missed = 0;
+    double intervalSum = 0, intervalSqSum = 0, minInterval = 0, maxInterval = 0;
+    double lateSum = 0, maxLate = 0;
+
+#ifdef _WIN32
+    HANDLE timer = nullptr;
+    bool highResolution = false;
+    bool periodSet = false;
+#endif
+
+    static double Us(Clock::duration d) { return std::chrono::duration<double, std::micro>(d).count(); }
+
+    // Coarse sleep until about `until`
+    void SleepUntil(Clock::time_point until) {
+        Clock::duration left = until - Clock::now();
+        if (left <= Clock::duration::zero()) return;
+#ifdef _WIN32
+        if (highResolution) {
+            LARGE_INTEGER due;
+            due.QuadPart = -(LONGLONG)(Us(left) * 10);  // Relative, 100 ns units
+            if (SetWaitableTimer(timer, &due, 0, nullptr, nullptr, FALSE)) {
+                WaitForSingleObject(timer, INFINITE);
+                return;
+            }
+        }
+        DWORD ms = (DWORD)(Us(left) / 1000);
+        if (ms > 0) Sleep(ms);
+#else
+        std::this_thread::sleep_for(left);
+#endif
+    }
+
+    // Sleep until just before `until`, then spin; returns the wake-up time.
+    // The spin margin follows how far sleeps have been overshooting.
+    Clock::time_point SleepThenSpin(Clock::time_point now, Clock::time_point until) {
+        Clock::time_point wake = until - std::chrono::microseconds((int64_t)spinUs);
+        if (wake > now) {
+            SleepUntil(wake);
+            double over = Us(Clock::now() - wake);
+            if (over < 0) over = 0;
+            oversleepUs += (over - oversleepUs) / 16;
+            spinUs = 2 * oversleepUs;
+            if (spinUs < PACER_SPIN_MIN_US) spinUs = PACER_SPIN_MIN_US;
+            if (spinUs > PACER_SPIN_MAX_US) spinUs = PACER_SPIN_MAX_US;
+        }
+        while ((now = Clock::now()) < until) std::this_thread::yield();
+        return now;
+    }
+
+    void ResetWindow(Clock::time_point now) {
+        windowStart = now;
+        frames = intervals = missed = 0;
+        intervalSum = intervalSqSum = minInterval = maxInterval = 0;
+        lateSum = maxLate = 0;
+    }
+
+    void RecordFrame(Clock::time_point now, double lateUs) {
+        if (haveLastFrame) {
+            double ms = Us(now - lastFrame) / 1000;
+            if (intervals == 0 || ms < minInterval) minInterval = ms;
+            if (intervals == 0 || ms > maxInterval) maxInterval = ms;
+            intervalSum += ms;
+            intervalSqSum += ms * ms;
+            intervals++;
+        }
+        lastFrame = now;
+        haveLastFrame = true;
+        frames++;
+        lateSum += lateUs;
+        if (lateUs > maxLate) maxLate = lateUs;
+    }
+
+public:
+    ~FramePacer() {
+#ifdef _WIN32
+        if (timer) CloseHandle(timer);
+        if (periodSet) timeEndPeriod(1);
+#endif
+    }
+
+    // Pace at fps frames per second (0 = unpaced: Wait() returns at once but
+    // intervals are still measured). The first deadline is now.
+    void Start(double fps) {
+#ifdef _WIN32
+        if (!timer) {
+            timer = CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+            highResolution = timer != nullptr;
+        }
+        if (!highResolution && !periodSet && fps > 0) {
+            // Older Windows: make Sleep() 1 ms granular instead of ~15.6 ms
+            periodSet = timeBeginPeriod(1) == TIMERR_NOERROR;
+        }
+#endif
+        interval = fps > 0 ? std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / fps))
+                           : Clock::duration::zero();
+        Reset();
+        ResetWindow(Clock::now());
+    }
+
+    // Re-anchor the schedule at now, e.g. after an idle stretch, so the gap
+    // isn't counted as missed deadlines or one long interval
+    void Reset() {
+        deadline = Clock::now();
+        haveLastFrame = false;
+    }
+
+    // Block until the next deadline. Returns false if it had already passed
+    // by a whole interval or more (those deadlines are counted as missed and
+    // skipped), true otherwise.
+    bool Wait() {
+        Clock::time_point now = Clock::now();
+        if (interval == Clock::duration::zero()) {
+            RecordFrame(now, 0);
+            return true;
+        }
+
+        bool onTime = true;
+        if (now >= deadline + interval) {
+            // Overran: skip the passed deadlines and re-anchor on this frame
+            missed += (uint64_t)((now - deadline) / interval);
+            deadline = now;
+            onTime = false;
+        } else if (now < deadline) {
+            now = SleepThenSpin(now, deadline);
+        }
+
+        RecordFrame(now, Us(now - deadline));
+        deadline += interval;
+        return onTime;
+    }
+
+    // Block until an arbitrary time point (e.g. a recorded frame's original
+    // time) with the same sleep-then-spin precision. Not part of the stats.
+    void WaitUntil(std::chrono::steady_clock::time_point when) {
+        Clock::time_point now = Clock::now();
+        if (now < when) SleepThenSpin(now, when);
+    }
+
+    bool IsPaced() const { return interval != Clock::duration::zero(); }
+    double GetStatsAgeMs() const { return Us(Clock::now() - windowStart) / 1000; }
+
+    // Statistics since the last call (or Start()); starts a new window
+    void TakeStats(PacerStats* stats) {
+        Clock::time_point now = Clock::now();
+        PacerStats s;
+        s.frames = frames;
+        s.missed = missed;
+        s.seconds = Us(now - windowStart) / 1e6;
+        s.fps = s.seconds > 0 ? frames / s.seconds : 0;
+        if (intervals > 0) {
+            s.meanIntervalMs = intervalSum / intervals;
+            s.minIntervalMs = minInterval;
+            s.maxIntervalMs = maxInterval;
+            double variance = intervalSqSum / intervals - s.meanIntervalMs * s.meanIntervalMs;
+            s.jitterMs = variance > 0 ? sqrt(variance) : 0;
+        }
+        s.meanLateUs = frames ? lateSum / frames : 0;
+        s.maxLateUs = maxLate;
+        s.spinUs = IsPaced() ? spinUs : 0;
+        *stats = s;
+        ResetWindow(now);
+    }
+};
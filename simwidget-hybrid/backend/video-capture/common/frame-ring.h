@@ -0,0 +1,183 @@
+// Frame Ring - bounded hand-off between capture pipeline stages
+// Fixed set of preallocated slots; when the consumer falls behind the
+// oldest queued frame is dropped so the producer never waits.
+// Slots are reference counted so one encoded frame can be shared by
+// several consumers (e.g. every connected client) without copying.
+// Portable (standard library only) so it can be exercised off Windows.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+// FrameSlot::flags
+#define FRAME_FLAG_DELTA 0x1    // Payload only makes sense on top of the previous frame
+#define FRAME_FLAG_YCBCR 0x2    // Raw slot holds YCbCr planes (JpegFramePlanes() layout), not BGRA
+#define FRAME_FLAG_MOVES 0x4    // Delta slot carries a move payload (common/move-detect.h) too
+#define FRAME_FLAG_TILE_CODECS 0x8  // Delta tiles are coded per tile (common/tile-codec.h), not all JPEG
+
+#define FRAME_LEGACY_HEADER_SIZE 24  // Protocol v1 and v2 frame headers are both this long
+#define FRAME_WS_HEADER_SIZE 10      // Largest server WebSocket frame header
+
+struct FrameSlot {
+    uint8_t* data = nullptr;
+    size_t capacity = 0;
+    size_t size = 0;        // Bytes used in data
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t stride = 0;    // Bytes per row (0 for encoded payloads)
+    uint64_t seq = 0;       // Capture sequence number
+    uint32_t flags = 0;     // FRAME_FLAG_*
+    uint32_t channel = 0;   // Stream the frame belongs to (multi-region services)
+    uint64_t timestampUs = 0; // Capture time (LatencyNowUs() clock, 0 = unknown)
+    uint64_t handoffUs = 0;   // When the last stage published it (queue wait)
+    uint8_t sizePrefix[4] = {}; // Wire length prefix, sent from here with the payload
+    uint8_t wsHeader[FRAME_WS_HEADER_SIZE] = {}; // WebSocket clients get this in place of sizePrefix
+    int wsHeaderSize = 0;
+    uint8_t legacyHeader[FRAME_LEGACY_HEADER_SIZE] = {}; // v1 header for old clients (if hasLegacyHeader)
+    bool hasLegacyHeader = false; // Replaces the first FRAME_LEGACY_HEADER_SIZE bytes of data for v1 clients
+    int refs = 0;           // Owned by FrameRing - use AddRef()/Release()
+};
+
+class FrameRing {
+private:
+    FrameSlot* slots = nullptr;
+    int slotCount = 0;
+
+    // Free slots (stack) and queued slots (FIFO), both as slot indices
+    int* freeList = nullptr;
+    int freeCount = 0;
+    int* queue = nullptr;
+    int queueHead = 0;
+    int queueCount = 0;
+
+    uint64_t dropped = 0;
+    bool closed = false;
+
+    std::mutex lock;
+    std::condition_variable available;
+
+    int IndexOf(FrameSlot* slot) const { return (int)(slot - slots); }
+
+public:
+    ~FrameRing() { Cleanup(); }
+
+    bool Initialize(int count, size_t slotSize) {
+        Cleanup();
+        slots = new FrameSlot[count];
+        freeList = new int[count];
+        queue = new int[count];
+        slotCount = count;  // Set first: Cleanup() frees what a failed loop allocated
+        for (int i = 0; i < count; i++) {
+            slots[i].data = (uint8_t*)malloc(slotSize);
+            if (!slots[i].data) return false;
+            slots[i].capacity = slotSize;
+            freeList[i] = i;
+        }
+        freeCount = count;
+        queueHead = 0;
+        queueCount = 0;
+        dropped = 0;
+        closed = false;
+        return true;
+    }
+
+    // Get a slot to fill. Reclaims the oldest queued frame if no slot is
+    // free; returns nullptr only when every slot is held by a stage.
+    FrameSlot* AcquireWrite() {
+        std::lock_guard<std::mutex> guard(lock);
+        FrameSlot* slot = nullptr;
+        if (freeCount > 0) {
+            slot = &slots[freeList[--freeCount]];
+        } else if (queueCount > 0) {
+            slot = &slots[queue[queueHead]];
+            queueHead = (queueHead + 1) % slotCount;
+            queueCount--;
+            dropped++;
+        }
+        if (slot) slot->refs = 1;
+        return slot;
+    }
+
+    // Hand a filled slot to the next stage
+    void Publish(FrameSlot* slot) {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            queue[(queueHead + queueCount) % slotCount] = IndexOf(slot);
+            queueCount++;
+        }
+        available.notify_one();
+    }
+
+    // Take the oldest queued slot (caller holds one reference).
+    // Returns nullptr on timeout or after Close().
+    FrameSlot* AcquireRead(int timeoutMs) {
+        std::unique_lock<std::mutex> guard(lock);
+        if (!available.wait_for(guard, std::chrono::milliseconds(timeoutMs),
+                [this] { return queueCount > 0 || closed; })) {
+            return nullptr;
+        }
+        if (queueCount == 0) return nullptr;
+        int index = queue[queueHead];
+        queueHead = (queueHead + 1) % slotCount;
+        queueCount--;
+        return &slots[index];
+    }
+
+    // Share a slot the caller already holds with another consumer
+    void AddRef(FrameSlot* slot) {
+        std::lock_guard<std::mutex> guard(lock);
+        slot->refs++;
+    }
+
+    // Drop one reference; the last one returns the slot to the free list
+    void Release(FrameSlot* slot) {
+        std::lock_guard<std::mutex> guard(lock);
+        if (--slot->refs > 0) return;
+        slot->size = 0;
+        freeList[freeCount++] = IndexOf(slot);
+    }
+
+    // Drop everything queued (e.g. when the last client disconnects)
+    void Flush() {
+        std::lock_guard<std::mutex> guard(lock);
+        while (queueCount > 0) {
+            slots[queue[queueHead]].refs = 0;
+            freeList[freeCount++] = queue[queueHead];
+            queueHead = (queueHead + 1) % slotCount;
+            queueCount--;
+        }
+    }
+
+    // Wake all blocked readers; subsequent reads return nullptr once drained
+    void Close() {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            closed = true;
+        }
+        available.notify_all();
+    }
+
+    uint64_t GetDropped() {
+        std::lock_guard<std::mutex> guard(lock);
+        return dropped;
+    }
+
+    void Cleanup() {
+        if (slots) {
+            for (int i = 0; i < slotCount; i++) free(slots[i].data);
+            delete[] slots;
+            slots = nullptr;
+        }
+        delete[] freeList;
+        freeList = nullptr;
+        delete[] queue;
+        queue = nullptr;
+        slotCount = 0;
+        freeCount = 0;
+        queueCount = 0;
+    }
+};
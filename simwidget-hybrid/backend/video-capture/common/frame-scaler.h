@@ -0,0 +1,403 @@
+// Frame Scaler - BGRA downscale / resample ahead of encoding
+// Exact 2:1 and 4:1 reductions use a box filter (average of each 2x2 / 4x4
+// block, rounded); any other size uses bilinear interpolation with 7-bit
+// weights. Scalar reference plus SSE2 kernels (AVX2 for the box filters);
+// all paths use the same integer math and produce identical output.
+//
+// Bilinear samples pixel centers, (x + 0.5) * src / dst - 0.5, clamped at the
+// edges. Output rows are split into bands across an optional JobSystem; every
+// band has its own scratch, so Scale() does not allocate.
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include "color-convert.h"
+#include "cpu-features.h"
+#include "job-system.h"
+
+#define SCALE_BAND_ROWS 16      // Output rows per job
+#define SCALE_WEIGHT_BITS 7     // Bilinear weights are 0..128
+
+enum ScaleFilter {
+    SCALE_COPY = 0,      // Same size, rows copied
+    SCALE_BOX2 = 1,      // Exactly half: dst = src / 2 (integer division)
+    SCALE_BOX4 = 2,      // Exactly a quarter: dst = src / 4
+    SCALE_BILINEAR = 3   // Anything else
+};
+
+inline const char* ScaleFilterName(ScaleFilter filter) {
+    switch (filter) {
+        case SCALE_BOX2: return "box 2:1";
+        case SCALE_BOX4: return "box 4:1";
+        case SCALE_BILINEAR: return "bilinear";
+        default: return "copy";
+    }
+}
+
+// Output size for a scale factor. Rounds down, so 0.5 of an odd width still
+// takes the 2:1 box path (the last column is dropped).
+inline uint32_t ScaledSize(uint32_t size, double scale) {
+    uint32_t scaled = (uint32_t)(size * scale + 1e-6);
+    return scaled > 0 ? scaled : 1;
+}
+
+namespace scaler {
+
+const int WEIGHT_ONE = 1 << SCALE_WEIGHT_BITS;
+const int VERTICAL_SHIFT = 2 * SCALE_WEIGHT_BITS;
+
+// Source taps for one output coordinate
+struct Tap {
+    uint32_t i0, i1;  // Neighboring source indices (equal at the edge)
+    int16_t f;        // Weight of i1, 0..WEIGHT_ONE
+};
+
+inline void BuildTaps(std::vector<Tap>& taps, uint32_t srcSize, uint32_t dstSize) {
+    taps.resize(dstSize);
+    for (uint32_t i = 0; i < dstSize; i++) {
+        // 16.16 fixed point position of the output pixel center in the source
+        int64_t pos = ((int64_t)(2 * i + 1) * srcSize << 16) / (2 * (int64_t)dstSize) - 32768;
+        if (pos < 0) pos = 0;
+        Tap& t = taps[i];
+        t.i0 = (uint32_t)(pos >> 16);
+        if (t.i0 >= srcSize - 1) {
+            t.i0 = t.i1 = srcSize - 1;
+            t.f = 0;
+        } else {
+            t.i1 = t.i0 + 1;
+            t.f = (int16_t)((pos >> (16 - SCALE_WEIGHT_BITS)) & (WEIGHT_ONE - 1));
+        }
+    }
+}
+
+// --- Box 2:1 ---------------------------------------------------------------
+
+inline void Box2RowScalar(const uint8_t* row0, const uint8_t* row1, uint32_t x0, uint32_t width, uint8_t* dst) {
+    for (uint32_t x = x0; x < width; x++) {
+        const uint8_t* a = row0 + x * 8;
+        const uint8_t* b = row1 + x * 8;
+        for (int c = 0; c < 4; c++) dst[x * 4 + c] = (uint8_t)((a[c] + a[c + 4] + b[c] + b[c + 4] + 2) >> 2);
+    }
+}
+
+// --- Box 4:1 ---------------------------------------------------------------
+
+inline void Box4RowScalar(const uint8_t* const rows[4], uint32_t x0, uint32_t width, uint8_t* dst) {
+    for (uint32_t x = x0; x < width; x++) {
+        for (int c = 0; c < 4; c++) {
+            int sum = 8;
+            for (int r = 0; r < 4; r++) {
+                const uint8_t* p = rows[r] + x * 16 + c;
+                sum += p[0] + p[4] + p[8] + p[12];
+            }
+            dst[x * 4 + c] = (uint8_t)(sum >> 4);
+        }
+    }
+}
+
+// --- Bilinear --------------------------------------------------------------
+// Horizontal pass into 16-bit rows (value * 128 at most 32640), then a
+// vertical blend: (h0 * (128 - fy) + h1 * fy + 8192) >> 14.
+
+inline void HorizontalScalar(const uint8_t* row, const Tap* taps, uint32_t x0, uint32_t width, int16_t* out) {
+    for (uint32_t x = x0; x < width; x++) {
+        const uint8_t* a = row + taps[x].i0 * 4;
+        const uint8_t* b = row + taps[x].i1 * 4;
+        int f = taps[x].f;
+        for (int c = 0; c < 4; c++) out[x * 4 + c] = (int16_t)(a[c] * (WEIGHT_ONE - f) + b[c] * f);
+    }
+}
+
+inline void VerticalScalar(const int16_t* h0, const int16_t* h1, int fy, uint32_t x0, uint32_t width, uint8_t* dst) {
+    for (uint32_t i = x0 * 4; i < width * 4; i++) {
+        dst[i] = (uint8_t)((h0[i] * (WEIGHT_ONE - fy) + h1[i] * fy + (1 << (VERTICAL_SHIFT - 1))) >> VERTICAL_SHIFT);
+    }
+}
+
+#ifdef SIMD_X86
+
+// A pixel's (B, R) and (G, A) as 16-bit pairs - see color-convert.h
+inline __m128i AverageSSE2(__m128i br, __m128i ga, __m128i round, int shift, __m128i mask) {
+    br = _mm_and_si128(_mm_srli_epi16(_mm_add_epi16(br, round), shift), mask);
+    ga = _mm_and_si128(_mm_srli_epi16(_mm_add_epi16(ga, round), shift), mask);
+    return _mm_or_si128(br, _mm_slli_epi32(ga, 8));
+}
+
+// 4 output pixels (8 source pixels per row) per step
+inline void Box2RowSSE2(const uint8_t* row0, const uint8_t* row1, uint32_t width, uint8_t* dst) {
+    const __m128i mask = _mm_set1_epi32(0x00FF00FF);
+    const __m128i round = _mm_set1_epi16(2);
+    uint32_t x = 0;
+    for (; x + 4 <= width; x += 4) {
+        __m128i br[2], ga[2];
+        for (int i = 0; i < 2; i++) {
+            __m128i p = _mm_loadu_si128((const __m128i*)(row0 + x * 8 + i * 16));
+            __m128i q = _mm_loadu_si128((const __m128i*)(row1 + x * 8 + i * 16));
+            br[i] = _mm_add_epi16(_mm_and_si128(p, mask), _mm_and_si128(q, mask));
+            ga[i] = _mm_add_epi16(_mm_and_si128(_mm_srli_epi32(p, 8), mask), _mm_and_si128(_mm_srli_epi32(q, 8), mask));
+        }
+        __m128i sbr = colorconv::PairSumSSE2(br[0], br[1]);
+        __m128i sga = colorconv::PairSumSSE2(ga[0], ga[1]);
+        _mm_storeu_si128((__m128i*)(dst + x * 4), AverageSSE2(sbr, sga, round, 2, mask));
+    }
+    Box2RowScalar(row0, row1, x, width, dst);
+}
+
+// 4 output pixels (16 source pixels per row) per step
+inline void Box4RowSSE2(const uint8_t* const rows[4], uint32_t width, uint8_t* dst) {
+    const __m128i mask = _mm_set1_epi32(0x00FF00FF);
+    const __m128i round = _mm_set1_epi16(8);
+    uint32_t x = 0;
+    for (; x + 4 <= width; x += 4) {
+        __m128i br[4], ga[4];
+        for (int i = 0; i < 4; i++) {
+            br[i] = ga[i] = _mm_setzero_si128();
+            for (int r = 0; r < 4; r++) {
+                __m128i p = _mm_loadu_si128((const __m128i*)(rows[r] + x * 16 + i * 16));
+                br[i] = _mm_add_epi16(br[i], _mm_and_si128(p, mask));
+                ga[i] = _mm_add_epi16(ga[i], _mm_and_si128(_mm_srli_epi32(p, 8), mask));
+            }
+        }
+        __m128i sbr = colorconv::PairSumSSE2(colorconv::PairSumSSE2(br[0], br[1]), colorconv::PairSumSSE2(br[2], br[3]));
+        __m128i sga = colorconv::PairSumSSE2(colorconv::PairSumSSE2(ga[0], ga[1]), colorconv::PairSumSSE2(ga[2], ga[3]));
+        _mm_storeu_si128((__m128i*)(dst + x * 4), AverageSSE2(sbr, sga, round, 4, mask));
+    }
+    Box4RowScalar(rows, x, width, dst);
+}
+
+// Two output pixels per step: interleave each tap pair's bytes so one madd
+// per pixel computes a * (128 - f) + b * f for all four channels
+inline void HorizontalSSE2(const uint8_t* row, const Tap* taps, uint32_t width, int16_t* out) {
+    const __m128i zero = _mm_setzero_si128();
+    uint32_t x = 0;
+    for (; x + 2 <= width; x += 2) {
+        __m128i v[2];
+        for (int i = 0; i < 2; i++) {
+            const Tap& t = taps[x + i];
+            __m128i a = _mm_cvtsi32_si128(*(const int32_t*)(row + t.i0 * 4));
+            __m128i b = _mm_cvtsi32_si128(*(const int32_t*)(row + t.i1 * 4));
+            __m128i ab = _mm_unpacklo_epi8(_mm_unpacklo_epi8(a, b), zero);
+            __m128i w = _mm_set1_epi32((int32_t)(((uint32_t)t.f << 16) | (uint32_t)(WEIGHT_ONE - t.f)));
+            v[i] = _mm_madd_epi16(ab, w);
+        }
+        _mm_storeu_si128((__m128i*)(out + x * 4), _mm_packs_epi32(v[0], v[1]));
+    }
+    HorizontalScalar(row, taps, x, width, out);
+}
+
+// 4 output pixels per step
+inline void VerticalSSE2(const int16_t* h0, const int16_t* h1, int fy, uint32_t width, uint8_t* dst) {
+    const __m128i w = _mm_set1_epi32((int32_t)(((uint32_t)fy << 16) | (uint32_t)(WEIGHT_ONE - fy)));
+    const __m128i round = _mm_set1_epi32(1 << (VERTICAL_SHIFT - 1));
+    uint32_t x = 0;
+    for (; x + 4 <= width; x += 4) {
+        __m128i v[4];
+        for (int i = 0; i < 2; i++) {
+            __m128i a = _mm_loadu_si128((const __m128i*)(h0 + x * 4 + i * 8));
+            __m128i b = _mm_loadu_si128((const __m128i*)(h1 + x * 4 + i * 8));
+            v[i * 2] = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(a, b), w), round), VERTICAL_SHIFT);
+            v[i * 2 + 1] = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(a, b), w), round), VERTICAL_SHIFT);
+        }
+        __m128i packed = _mm_packus_epi16(_mm_packs_epi32(v[0], v[1]), _mm_packs_epi32(v[2], v[3]));
+        _mm_storeu_si128((__m128i*)(dst + x * 4), packed);
+    }
+    VerticalScalar(h0, h1, fy, x, width, dst);
+}
+
+SIMD_TARGET_AVX2
+inline __m256i AverageAVX2(__m256i br, __m256i ga, __m256i round, int shift, __m256i mask) {
+    br = _mm256_and_si256(_mm256_srli_epi16(_mm256_add_epi16(br, round), shift), mask);
+    ga = _mm256_and_si256(_mm256_srli_epi16(_mm256_add_epi16(ga, round), shift), mask);
+    return _mm256_or_si256(br, _mm256_slli_epi32(ga, 8));
+}
+
+// 8 output pixels per step; the rest goes through the SSE2 kernel
+SIMD_TARGET_AVX2
+inline void Box2RowAVX2(const uint8_t* row0, const uint8_t* row1, uint32_t width, uint8_t* dst) {
+    const __m256i mask = _mm256_set1_epi32(0x00FF00FF);
+    const __m256i round = _mm256_set1_epi16(2);
+    uint32_t x = 0;
+    for (; x + 8 <= width; x += 8) {
+        __m256i br[2], ga[2];
+        for (int i = 0; i < 2; i++) {
+            __m256i p = _mm256_loadu_si256((const __m256i*)(row0 + x * 8 + i * 32));
+            __m256i q = _mm256_loadu_si256((const __m256i*)(row1 + x * 8 + i * 32));
+            br[i] = _mm256_add_epi16(_mm256_and_si256(p, mask), _mm256_and_si256(q, mask));
+            ga[i] = _mm256_add_epi16(_mm256_and_si256(_mm256_srli_epi32(p, 8), mask),
+                _mm256_and_si256(_mm256_srli_epi32(q, 8), mask));
+        }
+        __m256i sbr = colorconv::PairSumAVX2(br[0], br[1]);
+        __m256i sga = colorconv::PairSumAVX2(ga[0], ga[1]);
+        _mm256_storeu_si256((__m256i*)(dst + x * 4), AverageAVX2(sbr, sga, round, 2, mask));
+    }
+    if (x < width) Box2RowSSE2(row0 + x * 8, row1 + x * 8, width - x, dst + x * 4);
+}
+
+SIMD_TARGET_AVX2
+inline void Box4RowAVX2(const uint8_t* const rows[4], uint32_t width, uint8_t* dst) {
+    const __m256i mask = _mm256_set1_epi32(0x00FF00FF);
+    const __m256i round = _mm256_set1_epi16(8);
+    uint32_t x = 0;
+    for (; x + 8 <= width; x += 8) {
+        __m256i br[4], ga[4];
+        for (int i = 0; i < 4; i++) {
+            br[i] = ga[i] = _mm256_setzero_si256();
+            for (int r = 0; r < 4; r++) {
+                __m256i p = _mm256_loadu_si256((const __m256i*)(rows[r] + x * 16 + i * 32));
+                br[i] = _mm256_add_epi16(br[i], _mm256_and_si256(p, mask));
+                ga[i] = _mm256_add_epi16(ga[i], _mm256_and_si256(_mm256_srli_epi32(p, 8), mask));
+            }
+        }
+        __m256i sbr = colorconv::PairSumAVX2(colorconv::PairSumAVX2(br[0], br[1]), colorconv::PairSumAVX2(br[2], br[3]));
+        __m256i sga = colorconv::PairSumAVX2(colorconv::PairSumAVX2(ga[0], ga[1]), colorconv::PairSumAVX2(ga[2], ga[3]));
+        _mm256_storeu_si256((__m256i*)(dst + x * 4), AverageAVX2(sbr, sga, round, 4, mask));
+    }
+    if (x < width) {
+        const uint8_t* rest[4];
+        for (int r = 0; r < 4; r++) rest[r] = rows[r] + x * 16;
+        Box4RowSSE2(rest, width - x, dst + x * 4);
+    }
+}
+
+#endif  // SIMD_X86
+
+}  // namespace scaler
+
+// Scales BGRA frames of one fixed size to another. Configure once, then
+// Scale() every frame; not safe to call Scale() from two threads at once.
+class FrameScaler {
+private:
+    uint32_t srcWidth = 0, srcHeight = 0;
+    uint32_t dstWidth = 0, dstHeight = 0;
+    ScaleFilter filter = SCALE_COPY;
+    SimdLevel simd = GetSimdLevel();
+    JobSystem* jobs = nullptr;
+    std::vector<scaler::Tap> xTaps, yTaps;
+    std::vector<int16_t> scratch;  // Two horizontal rows per band (bilinear)
+
+    void ScaleRows(const uint8_t* src, size_t srcStride, uint8_t* dst, size_t dstStride,
+                   uint32_t rowBegin, uint32_t rowEnd, int16_t* h0, int16_t* h1) const {
+        using namespace scaler;
+        for (uint32_t y = rowBegin; y < rowEnd; y++) {
+            uint8_t* out = dst + y * dstStride;
+            switch (filter) {
+                case SCALE_COPY:
+                    memcpy(out, src + y * srcStride, (size_t)dstWidth * 4);
+                    break;
+
+                case SCALE_BOX2: {
+                    const uint8_t* row0 = src + (size_t)y * 2 * srcStride;
+#ifdef SIMD_X86
+                    if (simd == SIMD_AVX2) { Box2RowAVX2(row0, row0 + srcStride, dstWidth, out); break; }
+                    if (simd == SIMD_SSE2) { Box2RowSSE2(row0, row0 + srcStride, dstWidth, out); break; }
+#endif
+                    Box2RowScalar(row0, row0 + srcStride, 0, dstWidth, out);
+                    break;
+                }
+
+                case SCALE_BOX4: {
+                    const uint8_t* rows[4];
+                    for (int r = 0; r < 4; r++) rows[r] = src + ((size_t)y * 4 + r) * srcStride;
+#ifdef SIMD_X86
+                    if (simd == SIMD_AVX2) { Box4RowAVX2(rows, dstWidth, out); break; }
+                    if (simd == SIMD_SSE2) { Box4RowSSE2(rows, dstWidth, out); break; }
+#endif
+                    Box4RowScalar(rows, 0, dstWidth, out);
+                    break;
+                }
+
+                case SCALE_BILINEAR: {
+                    const Tap& t = yTaps[y];
+                    const uint8_t* row0 = src + (size_t)t.i0 * srcStride;
+                    const uint8_t* row1 = src + (size_t)t.i1 * srcStride;
+#ifdef SIMD_X86
+                    if (simd != SIMD_SCALAR) {
+                        HorizontalSSE2(row0, xTaps.data(), dstWidth, h0);
+                        HorizontalSSE2(row1, xTaps.data(), dstWidth, h1);
+                        VerticalSSE2(h0, h1, t.f, dstWidth, out);
+                        break;
+                    }
+#endif
+                    HorizontalScalar(row0, xTaps.data(), 0, dstWidth, h0);
+                    HorizontalScalar(row1, xTaps.data(), 0, dstWidth, h1);
+                    VerticalScalar(h0, h1, t.f, 0, dstWidth, out);
+                    break;
+                }
+            }
+        }
+    }
+
+public:
+    // Picks the filter from the sizes. Returns false for empty sizes or
+    // upscaling (the capture path only ever shrinks).
+    bool Configure(uint32_t srcW, uint32_t srcH, uint32_t dstW, uint32_t dstH) {
+        if (srcW == 0 || srcH == 0 || dstW == 0 || dstH == 0 || dstW > srcW || dstH > srcH) return false;
+        srcWidth = srcW;
+        srcHeight = srcH;
+        dstWidth = dstW;
+        dstHeight = dstH;
+
+        if (dstW == srcW && dstH == srcH) filter = SCALE_COPY;
+        else if (dstW == srcW / 2 && dstH == srcH / 2) filter = SCALE_BOX2;
+        else if (dstW == srcW / 4 && dstH == srcH / 4) filter = SCALE_BOX4;
+        else filter = SCALE_BILINEAR;
+
+        xTaps.clear();
+        yTaps.clear();
+        scratch.clear();
+        if (filter == SCALE_BILINEAR) {
+            scaler::BuildTaps(xTaps, srcW, dstW);
+            scaler::BuildTaps(yTaps, srcH, dstH);
+            uint32_t bands = (dstH + SCALE_BAND_ROWS - 1) / SCALE_BAND_ROWS;
+            scratch.resize((size_t)bands * 2 * dstW * 4);
+        }
+        return true;
+    }
+
+    void SetJobSystem(JobSystem* pool) { jobs = pool; }
+    void SetSimdLevel(SimdLevel level) { simd = level; }
+
+    ScaleFilter GetFilter() const { return filter; }
+    uint32_t GetWidth() const { return dstWidth; }
+    uint32_t GetHeight() const { return dstHeight; }
+    uint32_t GetSourceWidth() const { return srcWidth; }
+    uint32_t GetSourceHeight() const { return srcHeight; }
+    SimdLevel GetSimd() const { return simd; }
+
+    // Bilinear taps per output column / row (empty for the other filters)
+    const scaler::Tap* GetXTaps() const { return xTaps.data(); }
+    const scaler::Tap* GetYTaps() const { return yTaps.data(); }
+
+    // src is srcW x srcH BGRA, dst receives dstW x dstH BGRA (any pitches)
+    void Scale(const uint8_t* src, size_t srcStride, uint8_t* dst, size_t dstStride) {
+        if (filter == SCALE_COPY) {
+            ParallelCopyRows(jobs, dst, dstStride, src, srcStride, (size_t)dstWidth * 4, dstHeight);
+            return;
+        }
+        int16_t* rows = scratch.data();
+        size_t rowSize = (size_t)dstWidth * 4;
+        auto band = [&](uint32_t begin, uint32_t end) {
+            int16_t* h0 = rows ? rows + (begin / SCALE_BAND_ROWS) * 2 * rowSize : nullptr;
+            ScaleRows(src, srcStride, dst, dstStride, begin, end, h0, h0 ? h0 + rowSize : nullptr);
+        };
+        if (jobs) jobs->ParallelFor(dstHeight, SCALE_BAND_ROWS, band);
+        else band(0, dstHeight);
+    }
+
+    // Destination rectangle (exclusive right/bottom) that can change when
+    // the given source rectangle changes. Used to carry DXGI dirty rects
+    // over to the scaled frame.
+    void MapRect(int32_t* left, int32_t* top, int32_t* right, int32_t* bottom) const {
+        // Floor the start, ceil the end, plus one pixel for the bilinear taps
+        *left = (int32_t)((int64_t)*left * dstWidth / srcWidth) - 1;
+        *top = (int32_t)((int64_t)*top * dstHeight / srcHeight) - 1;
+        *right = (int32_t)(((int64_t)*right * dstWidth + srcWidth - 1) / srcWidth) + 1;
+        *bottom = (int32_t)(((int64_t)*bottom * dstHeight + srcHeight - 1) / srcHeight) + 1;
+        if (*left < 0) *left = 0;
+        if (*top < 0) *top = 0;
+        if (*right > (int32_t)dstWidth) *right = (int32_t)dstWidth;
+        if (*bottom > (int32_t)dstHeight) *bottom = (int32_t)dstHeight;
+    }
+};
@@ -0,0 +1,223 @@
+// Job System - small work-stealing thread pool for per-frame pixel work
+// Each worker owns a fixed-size deque: it pushes and pops its own jobs at the
+// back (LIFO, cache friendly) and idle workers steal from the front of the
+// others. ParallelFor() splits [0, count) into fixed chunks of `grain`, so
+// the split - and with it any output that depends on it - is the same for any
+// thread count; only the order in which chunks run changes.
+//
+// The thread calling ParallelFor() runs chunks too, so a JobSystem with zero
+// workers simply runs everything inline. Several threads may call
+// ParallelFor() at once (e.g. the JPEG service's encode workers).
+// No allocations after Start().
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define JOB_QUEUE_CAPACITY 256  // Per worker; a full queue runs the job inline
+
+class JobSystem {
+private:
+    struct Job {
+        void (*run)(const void* context, uint32_t begin, uint32_t end);
+        const void* context;
+        uint32_t begin, end;
+        std::atomic<uint32_t>* remaining;
+    };
+
+    struct WorkQueue {
+        std::mutex lock;
+        Job jobs[JOB_QUEUE_CAPACITY];
+        uint32_t head = 0;  // Front: thieves take from here
+        uint32_t tail = 0;  // Back: the owner pushes and pops here
+
+        bool Push(const Job& job) {
+            std::lock_guard<std::mutex> guard(lock);
+            if (tail - head == JOB_QUEUE_CAPACITY) return false;
+            jobs[tail % JOB_QUEUE_CAPACITY] = job;
+            tail++;
+            return true;
+        }
+
+        bool Pop(Job* job) {
+            std::lock_guard<std::mutex> guard(lock);
+            if (tail == head) return false;
+            tail--;
+            *job = jobs[tail % JOB_QUEUE_CAPACITY];
+            return true;
+        }
+
+        bool Steal(Job* job) {
+            std::lock_guard<std::mutex> guard(lock);
+            if (tail == head) return false;
+            *job = jobs[head % JOB_QUEUE_CAPACITY];
+            head++;
+            return true;
+        }
+    };
+
+    std::vector<WorkQueue*> queues;
+    std::vector<std::thread> threads;
+    std::atomic<bool> running{false};
+    std::atomic<int> queued{0};          // Jobs sitting in any queue
+    std::atomic<uint32_t> nextQueue{0};  // Round-robin target for outside callers
+    std::mutex sleepLock;
+    std::condition_variable wake;
+
+    // Which worker of which pool the current thread is (-1 = not a worker)
+    struct ThreadSlot {
+        const JobSystem* owner = nullptr;
+        int index = -1;
+    };
+    static ThreadSlot& CurrentThread() {
+        static thread_local ThreadSlot slot;
+        return slot;
+    }
+
+    int WorkerIndex() const {
+        const ThreadSlot& slot = CurrentThread();
+        return slot.owner == this ? slot.index : -1;
+    }
+
+    template <class Fn>
+    static void Invoke(const void* context, uint32_t begin, uint32_t end) {
+        (*(const Fn*)context)(begin, end);
+    }
+
+    static void Execute(const Job& job) {
+        job.run(job.context, job.begin, job.end);
+        job.remaining->fetch_sub(1, std::memory_order_acq_rel);
+    }
+
+    // Own queue first (newest job), then steal the oldest job of another worker
+    bool TakeJob(int self, Job* job) {
+        int count = (int)queues.size();
+        if (self >= 0 && queues[self]->Pop(job)) {
+            queued--;
+            return true;
+        }
+        int start = self >= 0 ? self + 1 : (int)(nextQueue.load(std::memory_order_relaxed) % count);
+        for (int i = 0; i < count; i++) {
+            int victim = (start + i) % count;
+            if (victim != self && queues[victim]->Steal(job)) {
+                queued--;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void WorkerLoop(int index) {
+        CurrentThread().owner = this;
+        CurrentThread().index = index;
+
+        Job job;
+        while (running) {
+            if (TakeJob(index, &job)) {
+                Execute(job);
+                continue;
+            }
+            std::unique_lock<std::mutex> guard(sleepLock);
+            wake.wait(guard, [this] { return queued > 0 || !running; });
+        }
+    }
+
+public:
+    ~JobSystem() { Stop(); }
+
+    // Start workerCount threads. The calling thread of ParallelFor() works
+    // too, so N-way parallelism needs N - 1 workers.
+    void Start(int workerCount) {
+        Stop();
+        if (workerCount < 0) workerCount = 0;
+        running = true;
+        for (int i = 0; i < workerCount; i++) queues.push_back(new WorkQueue());
+        for (int i = 0; i < workerCount; i++) threads.emplace_back(&JobSystem::WorkerLoop, this, i);
+    }
+
+    void Stop() {
+        {
+            std::lock_guard<std::mutex> guard(sleepLock);
+            running = false;
+        }
+        wake.notify_all();
+        for (auto& t : threads) t.join();
+        threads.clear();
+        for (auto* q : queues) delete q;
+        queues.clear();
+    }
+
+    int GetWorkerCount() const { return (int)threads.size(); }
+
+    // Suggested worker count: one per core, minus the calling thread
+    static int DefaultWorkerCount() {
+        int cores = (int)std::thread::hardware_concurrency();
+        return cores > 1 ? cores - 1 : 0;
+    }
+
+    // Call fn(begin, end) for consecutive chunks of [0, count), grain items
+    // each (the last may be shorter). Returns when every chunk has run.
+    template <class Fn>
+    void ParallelFor(uint32_t count, uint32_t grain, const Fn& fn) {
+        if (count == 0) return;
+        if (grain == 0) grain = 1;
+        uint32_t chunks = (count + grain - 1) / grain;
+        if (queues.empty() || chunks == 1) {
+            for (uint32_t begin = 0; begin < count; begin += grain) fn(begin, std::min(begin + grain, count));
+            return;
+        }
+
+        std::atomic<uint32_t> remaining(chunks);
+        Job job = { &Invoke<Fn>, &fn, 0, 0, &remaining };
+        int self = WorkerIndex();
+
+        // Keep chunk 0 for this thread; hand out the rest
+        for (uint32_t c = 1; c < chunks; c++) {
+            job.begin = c * grain;
+            job.end = std::min(job.begin + grain, count);
+            int target = self >= 0 ? self : (int)(nextQueue.fetch_add(1, std::memory_order_relaxed) % queues.size());
+            if (queues[target]->Push(job)) {
+                queued++;
+            } else {
+                Execute(job);
+            }
+        }
+        {
+            std::lock_guard<std::mutex> guard(sleepLock);
+        }
+        wake.notify_all();
+
+        job.begin = 0;
+        job.end = std::min(grain, count);
+        Execute(job);
+
+        // Help with whatever is queued (ours or anyone's) until our chunks are done
+        Job other;
+        while (remaining.load(std::memory_order_acquire) > 0) {
+            if (TakeJob(self, &other)) Execute(other);
+            else std::this_thread::yield();
+        }
+    }
+};
+
+// Pitch-stripping copy of `rows` rows, split into row bands across the pool.
+// jobs may be null (plain sequential copy).
+inline void ParallelCopyRows(JobSystem* jobs, uint8_t* dst, size_t dstPitch, const uint8_t* src,
+                             size_t srcPitch, size_t rowBytes, uint32_t rows) {
+    auto copy = [=](uint32_t begin, uint32_t end) {
+        if (dstPitch == rowBytes && srcPitch == rowBytes) {
+            memcpy(dst + begin * rowBytes, src + begin * rowBytes, (end - begin) * rowBytes);
+            return;
+        }
+        for (uint32_t y = begin; y < end; y++) memcpy(dst + y * dstPitch, src + y * srcPitch, rowBytes);
+    };
+    if (jobs) jobs->ParallelFor(rows, 64, copy);
+    else copy(0, rows);
+}
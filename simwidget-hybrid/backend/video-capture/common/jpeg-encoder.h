@@ -0,0 +1,824 @@
+// JPEG Encoder - self-contained baseline JPEG for BGRA frames
+// Replaces the per-frame WIC object churn with an encoder that is set up once:
+// quantization, reciprocal and Huffman tables plus the file header are built
+// in Configure() (only when quality / subsampling / restart interval change),
+// scratch for one MCU row is reserved up front, and Encode() writes straight
+// into the caller's buffer without touching the heap.
+//
+// Per MCU row: BGRA -> YCbCr (common/color-convert.h), then per 8x8 block a
+// float AAN forward DCT + quantizer (scalar, SSE2 or AVX2 - identical output)
+// and Huffman coding with the standard Annex K tables. Supports 4:4:4, 4:2:2
+// and 4:2:0 chroma and optional restart markers (DRI / RSTn).
+//
+// With a JobSystem attached (SetJobSystem) the frame is cut into bands of
+// MCU rows separated by restart markers. Bands share no state, so they are
+// converted and encoded in parallel and then concatenated; the file is
+// byte-identical for any number of threads.
+//
+// EncodePlanes() takes a frame that is already YCbCr, laid out by
+// JpegFramePlanes() (whole MCUs, edges replicated), e.g. straight out of the
+// fused capture pass (pixel-pipeline.h); it skips the conversion and writes
+// the same bytes Encode() would for the BGRA source.
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include "color-convert.h"
+#include "cpu-features.h"
+#include "job-system.h"
+
+#define JPEG_BLOCK_WORST_CASE 512  // Bytes one block can take, incl. 0xFF stuffing
+#define JPEG_DEFAULT_BAND_ROWS 4    // MCU rows per parallel band
+#define JPEG_BAND_INITIAL_SIZE (64 * 1024)
+
+// MCU size in luma pixels for a chroma layout
+inline uint32_t JpegMcuWidth(ChromaSubsampling s) { return s == CHROMA_444 ? 8 : 16; }
+inline uint32_t JpegMcuHeight(ChromaSubsampling s) { return s == CHROMA_420 ? 16 : 8; }
+
+// Layout of a whole w x h frame as Y, Cb, Cr planes padded to whole MCUs.
+// Returns the bytes it needs; with base set, points planes into it.
+// paddedWidth / paddedHeight (optional) receive the padded luma size.
+inline size_t JpegFramePlanes(uint32_t width, uint32_t height, ChromaSubsampling s, uint8_t* base,
+                              YCbCrPlanes* planes, uint32_t* paddedWidth = nullptr, uint32_t* paddedHeight = nullptr) {
+    uint32_t mcuWidth = JpegMcuWidth(s), mcuHeight = JpegMcuHeight(s);
+    uint32_t w = (width + mcuWidth - 1) / mcuWidth * mcuWidth;
+    uint32_t h = (height + mcuHeight - 1) / mcuHeight * mcuHeight;
+    uint32_t chromaWidth = s == CHROMA_444 ? w : w / 2;
+    uint32_t chromaHeight = s == CHROMA_420 ? h / 2 : h;
+    size_t lumaSize = (size_t)w * h;
+    size_t chromaSize = (size_t)chromaWidth * chromaHeight;
+    if (paddedWidth) *paddedWidth = w;
+    if (paddedHeight) *paddedHeight = h;
+    if (base && planes) {
+        planes->y = base;
+        planes->cb = base + lumaSize;
+        planes->cr = base + lumaSize + chromaSize;
+        planes->yStride = w;
+        planes->cStride = chromaWidth;
+    }
+    return lumaSize + 2 * chromaSize;
+}
+
+namespace jpegenc {
+
+// Zigzag position -> natural (row * 8 + col) index
+const uint8_t NATURAL_ORDER[64] = {
+     0,  1,  8, 16,  9,  2,  3, 10, 17, 24, 32, 25, 18, 11,  4,  5,
+    12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13,  6,  7, 14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63
+};
+
+// Annex K.1 base quantization tables, natural order
+const uint8_t LUMA_QUANT[64] = {
+    16, 11, 10, 16,  24,  40,  51,  61,  12, 12, 14, 19,  26,  58,  60,  55,
+    14, 13, 16, 24,  40,  57,  69,  56,  14, 17, 22, 29,  51,  87,  80,  62,
+    18, 22, 37, 56,  68, 109, 103,  77,  24, 35, 55, 64,  81, 104, 113,  92,
+    49, 64, 78, 87, 103, 121, 120, 101,  72, 92, 95, 98, 112, 100, 103,  99
+};
+const uint8_t CHROMA_QUANT[64] = {
+    17, 18, 24, 47, 99, 99, 99, 99,  18, 21, 26, 66, 99, 99, 99, 99,
+    24, 26, 56, 99, 99, 99, 99, 99,  47, 66, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99,  99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99,  99, 99, 99, 99, 99, 99, 99, 99
+};
+
+// Annex K.3 Huffman tables: code counts per length 1..16, then symbols
+const uint8_t DC_LUMA_BITS[16] = { 0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0 };
+const uint8_t DC_CHROMA_BITS[16] = { 0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0 };
+const uint8_t DC_VALUES[12] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+
+const uint8_t AC_LUMA_BITS[16] = { 0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d };
+const uint8_t AC_LUMA_VALUES[162] = {
+    0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+    0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+    0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+    0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+    0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+    0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+    0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+    0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+    0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa
+};
+
+const uint8_t AC_CHROMA_BITS[16] = { 0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77 };
+const uint8_t AC_CHROMA_VALUES[162] = {
+    0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+    0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0,
+    0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+    0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+    0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+    0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+    0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5,
+    0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+    0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+    0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa
+};
+
+// AAN scale factors: cos(k * pi / 16) * sqrt(2), k > 0
+const float AAN_SCALE[8] = {
+    1.0f, 1.387039845f, 1.306562965f, 1.175875602f, 1.0f, 0.785694958f, 0.541196100f, 0.275899379f
+};
+
+struct HuffCode {
+    uint16_t code[256];
+    uint8_t size[256];
+};
+
+inline void BuildHuffCode(const uint8_t bits[16], const uint8_t* values, HuffCode* out) {
+    memset(out, 0, sizeof(*out));
+    uint16_t code = 0;
+    int k = 0;
+    for (int length = 1; length <= 16; length++) {
+        for (int i = 0; i < bits[length - 1]; i++, k++) {
+            out->code[values[k]] = code++;
+            out->size[values[k]] = (uint8_t)length;
+        }
+        code <<= 1;
+    }
+}
+
+// Number of bits needed for |v| (JPEG magnitude category)
+inline int BitLength(uint32_t v) {
+    if (!v) return 0;
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanReverse(&index, v);
+    return (int)index + 1;
+#else
+    return 32 - __builtin_clz(v);
+#endif
+}
+
+inline int LowestBit64(uint64_t v) {
+#ifdef _MSC_VER
+    unsigned long index;
+    if (_BitScanForward(&index, (unsigned long)(uint32_t)v)) return (int)index;
+    _BitScanForward(&index, (unsigned long)(uint32_t)(v >> 32));
+    return (int)index + 32;
+#else
+    return __builtin_ctzll(v);
+#endif
+}
+
+// Entropy-coded segment writer with 0xFF byte stuffing. The caller checks
+// space per MCU, so Put() itself never bounds-checks.
+struct BitWriter {
+    uint64_t acc = 0;
+    int bits = 0;
+    uint8_t* p = nullptr;
+
+    void EmitByte(uint8_t b) {
+        *p++ = b;
+        if (b == 0xFF) *p++ = 0;
+    }
+
+    void Put(uint32_t value, int size) {
+        acc = (acc << size) | value;
+        bits += size;
+        if (bits >= 32) {
+            bits -= 32;
+            uint32_t word = (uint32_t)(acc >> bits);
+            // Fast path when no byte is 0xFF (i.e. ~word has no zero byte)
+            uint32_t inv = ~word;
+            if (((inv - 0x01010101u) & ~inv & 0x80808080u) == 0) {
+                p[0] = (uint8_t)(word >> 24);
+                p[1] = (uint8_t)(word >> 16);
+                p[2] = (uint8_t)(word >> 8);
+                p[3] = (uint8_t)word;
+                p += 4;
+            } else {
+                EmitByte((uint8_t)(word >> 24));
+                EmitByte((uint8_t)(word >> 16));
+                EmitByte((uint8_t)(word >> 8));
+                EmitByte((uint8_t)word);
+            }
+        }
+    }
+
+    // Pad the last byte with 1 bits
+    void Flush() {
+        while (bits >= 8) {
+            bits -= 8;
+            EmitByte((uint8_t)(acc >> bits));
+        }
+        if (bits > 0) {
+            EmitByte((uint8_t)(((acc << (8 - bits)) | (0xFFu >> bits)) & 0xFF));
+            bits = 0;
+        }
+        acc = 0;
+    }
+};
+
+// --- Forward DCT + quantization --------------------------------------------
+// Float AAN DCT (as in IJG jfdctflt.c). Written once as a macro so the scalar,
+// SSE2 and AVX2 paths run the identical operation sequence on their own
+// vector type - the quantized output is bit-exact across all three.
+// Pass 1 runs down the columns, pass 2 along the rows; results are stored
+// transposed (index u * 8 + v for horizontal frequency u, vertical v), which
+// the reciprocal and zigzag tables account for.
+
+#define JPEG_FDCT_1D(V, d) do { \
+    V t0 = d[0] + d[7], t7 = d[0] - d[7]; \
+    V t1 = d[1] + d[6], t6 = d[1] - d[6]; \
+    V t2 = d[2] + d[5], t5 = d[2] - d[5]; \
+    V t3 = d[3] + d[4], t4 = d[3] - d[4]; \
+    V t10 = t0 + t3, t13 = t0 - t3; \
+    V t11 = t1 + t2, t12 = t1 - t2; \
+    d[0] = t10 + t11; \
+    d[4] = t10 - t11; \
+    V z1 = (t12 + t13) * 0.707106781f; \
+    d[2] = t13 + z1; \
+    d[6] = t13 - z1; \
+    t10 = t4 + t5; \
+    t11 = t5 + t6; \
+    t12 = t6 + t7; \
+    V z5 = (t10 - t12) * 0.382683433f; \
+    V z2 = t10 * 0.541196100f + z5; \
+    V z4 = t12 * 1.306562965f + z5; \
+    V z3 = t11 * 0.707106781f; \
+    V z11 = t7 + z3, z13 = t7 - z3; \
+    d[5] = z13 + z2; \
+    d[3] = z13 - z2; \
+    d[1] = z11 + z4; \
+    d[7] = z11 - z4; \
+} while (0)
+
+inline void FdctQuantScalar(const uint8_t* src, uint32_t stride, const float* recip, int16_t* out) {
+    float data[8][8];
+    for (int y = 0; y < 8; y++) {
+        for (int x = 0; x < 8; x++) data[y][x] = (float)src[y * stride + x] - 128.0f;
+    }
+    float d[8];
+    for (int x = 0; x < 8; x++) {
+        for (int k = 0; k < 8; k++) d[k] = data[k][x];
+        JPEG_FDCT_1D(float, d);
+        for (int k = 0; k < 8; k++) data[k][x] = d[k];
+    }
+    for (int v = 0; v < 8; v++) {
+        for (int k = 0; k < 8; k++) d[k] = data[v][k];
+        JPEG_FDCT_1D(float, d);
+        for (int u = 0; u < 8; u++) out[u * 8 + v] = (int16_t)lrintf(d[u] * recip[u * 8 + v]);
+    }
+}
+
+#ifdef SIMD_X86
+
+struct F4 { __m128 v; };
+inline F4 operator+(F4 a, F4 b) { return { _mm_add_ps(a.v, b.v) }; }
+inline F4 operator-(F4 a, F4 b) { return { _mm_sub_ps(a.v, b.v) }; }
+inline F4 operator*(F4 a, float c) { return { _mm_mul_ps(a.v, _mm_set1_ps(c)) }; }
+
+inline F4 LoadRow4SSE2(const uint8_t* p) {
+    __m128i bytes = _mm_cvtsi32_si128(*(const int*)p);
+    __m128i words = _mm_unpacklo_epi8(bytes, _mm_setzero_si128());
+    __m128i dwords = _mm_unpacklo_epi16(words, _mm_setzero_si128());
+    return { _mm_sub_ps(_mm_cvtepi32_ps(dwords), _mm_set1_ps(128.0f)) };
+}
+
+inline void FdctQuantSSE2(const uint8_t* src, uint32_t stride, const float* recip, int16_t* out) {
+    // Left and right halves of each row
+    F4 left[8], right[8];
+    for (int y = 0; y < 8; y++) {
+        left[y] = LoadRow4SSE2(src + y * stride);
+        right[y] = LoadRow4SSE2(src + y * stride + 4);
+    }
+    JPEG_FDCT_1D(F4, left);
+    JPEG_FDCT_1D(F4, right);
+
+    // Transpose: t[x] holds column x, vertical frequencies 0-3 in lo, 4-7 in hi
+    F4 lo[8], hi[8];
+    _MM_TRANSPOSE4_PS(left[0].v, left[1].v, left[2].v, left[3].v);
+    _MM_TRANSPOSE4_PS(left[4].v, left[5].v, left[6].v, left[7].v);
+    _MM_TRANSPOSE4_PS(right[0].v, right[1].v, right[2].v, right[3].v);
+    _MM_TRANSPOSE4_PS(right[4].v, right[5].v, right[6].v, right[7].v);
+    for (int x = 0; x < 4; x++) {
+        lo[x] = left[x];
+        hi[x] = left[x + 4];
+        lo[x + 4] = right[x];
+        hi[x + 4] = right[x + 4];
+    }
+    JPEG_FDCT_1D(F4, lo);
+    JPEG_FDCT_1D(F4, hi);
+
+    for (int u = 0; u < 8; u++) {
+        __m128i a = _mm_cvtps_epi32(_mm_mul_ps(lo[u].v, _mm_loadu_ps(recip + u * 8)));
+        __m128i b = _mm_cvtps_epi32(_mm_mul_ps(hi[u].v, _mm_loadu_ps(recip + u * 8 + 4)));
+        _mm_storeu_si128((__m128i*)(out + u * 8), _mm_packs_epi32(a, b));
+    }
+}
+
+struct F8 { __m256 v; };
+SIMD_TARGET_AVX2 inline F8 operator+(F8 a, F8 b) { return { _mm256_add_ps(a.v, b.v) }; }
+SIMD_TARGET_AVX2 inline F8 operator-(F8 a, F8 b) { return { _mm256_sub_ps(a.v, b.v) }; }
+SIMD_TARGET_AVX2 inline F8 operator*(F8 a, float c) { return { _mm256_mul_ps(a.v, _mm256_set1_ps(c)) }; }
+
+SIMD_TARGET_AVX2
+inline void Transpose8x8AVX2(F8 r[8]) {
+    __m256 t0 = _mm256_unpacklo_ps(r[0].v, r[1].v), t1 = _mm256_unpackhi_ps(r[0].v, r[1].v);
+    __m256 t2 = _mm256_unpacklo_ps(r[2].v, r[3].v), t3 = _mm256_unpackhi_ps(r[2].v, r[3].v);
+    __m256 t4 = _mm256_unpacklo_ps(r[4].v, r[5].v), t5 = _mm256_unpackhi_ps(r[4].v, r[5].v);
+    __m256 t6 = _mm256_unpacklo_ps(r[6].v, r[7].v), t7 = _mm256_unpackhi_ps(r[6].v, r[7].v);
+    __m256 s0 = _mm256_shuffle_ps(t0, t2, 0x44), s1 = _mm256_shuffle_ps(t0, t2, 0xEE);
+    __m256 s2 = _mm256_shuffle_ps(t1, t3, 0x44), s3 = _mm256_shuffle_ps(t1, t3, 0xEE);
+    __m256 s4 = _mm256_shuffle_ps(t4, t6, 0x44), s5 = _mm256_shuffle_ps(t4, t6, 0xEE);
+    __m256 s6 = _mm256_shuffle_ps(t5, t7, 0x44), s7 = _mm256_shuffle_ps(t5, t7, 0xEE);
+    r[0].v = _mm256_permute2f128_ps(s0, s4, 0x20);
+    r[1].v = _mm256_permute2f128_ps(s1, s5, 0x20);
+    r[2].v = _mm256_permute2f128_ps(s2, s6, 0x20);
+    r[3].v = _mm256_permute2f128_ps(s3, s7, 0x20);
+    r[4].v = _mm256_permute2f128_ps(s0, s4, 0x31);
+    r[5].v = _mm256_permute2f128_ps(s1, s5, 0x31);
+    r[6].v = _mm256_permute2f128_ps(s2, s6, 0x31);
+    r[7].v = _mm256_permute2f128_ps(s3, s7, 0x31);
+}
+
+SIMD_TARGET_AVX2
+inline void FdctQuantAVX2(const uint8_t* src, uint32_t stride, const float* recip, int16_t* out) {
+    F8 r[8];
+    const __m256 bias = _mm256_set1_ps(128.0f);
+    for (int y = 0; y < 8; y++) {
+        __m256i px = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(src + y * stride)));
+        r[y].v = _mm256_sub_ps(_mm256_cvtepi32_ps(px), bias);
+    }
+    JPEG_FDCT_1D(F8, r);
+    Transpose8x8AVX2(r);
+    JPEG_FDCT_1D(F8, r);
+
+    for (int u = 0; u < 8; u += 2) {
+        __m256i a = _mm256_cvtps_epi32(_mm256_mul_ps(r[u].v, _mm256_loadu_ps(recip + u * 8)));
+        __m256i b = _mm256_cvtps_epi32(_mm256_mul_ps(r[u + 1].v, _mm256_loadu_ps(recip + u * 8 + 8)));
+        // packs works per 128-bit lane: a0-3 b0-3 a4-7 b4-7 -> a0-7 b0-7
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), _MM_SHUFFLE(3, 1, 2, 0));
+        _mm256_storeu_si256((__m256i*)(out + u * 8), packed);
+    }
+}
+
+// Bit i set when zigzag coefficient i is non-zero
+inline uint64_t NonZeroMaskSSE2(const int16_t* zz) {
+    const __m128i zero = _mm_setzero_si128();
+    uint64_t mask = 0;
+    for (int i = 0; i < 64; i += 16) {
+        __m128i a = _mm_cmpeq_epi16(_mm_loadu_si128((const __m128i*)(zz + i)), zero);
+        __m128i b = _mm_cmpeq_epi16(_mm_loadu_si128((const __m128i*)(zz + i + 8)), zero);
+        uint32_t zeros = (uint32_t)_mm_movemask_epi8(_mm_packs_epi16(a, b));
+        mask |= (uint64_t)(~zeros & 0xFFFF) << i;
+    }
+    return mask;
+}
+
+#endif  // SIMD_X86
+
+inline uint64_t NonZeroMaskScalar(const int16_t* zz) {
+    uint64_t mask = 0;
+    for (int i = 0; i < 64; i++) {
+        if (zz[i]) mask |= 1ull << i;
+    }
+    return mask;
+}
+
+}  // namespace jpegenc
+
+class BaselineJpegEncoder {
+private:
+    // Component tables: 0 = luma, 1 = chroma
+    int quality = 0;
+    ChromaSubsampling subsampling = CHROMA_420;
+    int restartInterval = 0;
+    SimdLevel level = GetSimdLevel();
+
+    uint8_t quant[2][64];        // Natural order, as written to DQT
+    float recip[2][64];          // Transposed order, AAN scaling folded in
+    uint8_t zigzag[64];          // Zigzag position -> transposed index
+    jpegenc::HuffCode dcCodes[2], acCodes[2];
+    std::vector<uint8_t> header; // SOI ... SOS, patched with the frame size
+    size_t sizeOffset = 0;       // Offset of the SOF0 height field
+    size_t restartOffset = 0;    // Offset of the DRI interval (0 = no DRI)
+
+    // One MCU row of Y / Cb / Cr, padded to whole MCUs
+    struct Strip {
+        std::vector<uint8_t> buffer;
+        uint32_t width = 0;  // Padded luma width the buffer was sized for
+        YCbCrPlanes planes = {};
+    };
+
+    // A band of MCU rows encoded on its own, then copied into the output
+    struct Band {
+        Strip strip;
+        std::vector<uint8_t> data;
+        int size = 0;
+    };
+
+    Strip strip;
+    uint32_t reservedWidth = 0;
+    JobSystem* jobs = nullptr;
+    int bandRows = 0;
+    std::vector<Band> bands;
+
+    int McuWidth() const { return (int)JpegMcuWidth(subsampling); }
+    int McuHeight() const { return (int)JpegMcuHeight(subsampling); }
+
+    static void BuildQuant(const uint8_t* base, int quality, uint8_t* out) {
+        int scale = quality < 50 ? 5000 / quality : 200 - quality * 2;
+        for (int i = 0; i < 64; i++) {
+            int q = (base[i] * scale + 50) / 100;
+            out[i] = (uint8_t)(q < 1 ? 1 : (q > 255 ? 255 : q));
+        }
+    }
+
+    static void PutMarker(std::vector<uint8_t>& h, uint8_t marker, size_t length) {
+        h.push_back(0xFF);
+        h.push_back(marker);
+        h.push_back((uint8_t)(length >> 8));
+        h.push_back((uint8_t)length);
+    }
+
+    static void PutHuffTable(std::vector<uint8_t>& h, uint8_t tableClassId, const uint8_t bits[16],
+                             const uint8_t* values) {
+        h.push_back(tableClassId);
+        int count = 0;
+        for (int i = 0; i < 16; i++) {
+            h.push_back(bits[i]);
+            count += bits[i];
+        }
+        h.insert(h.end(), values, values + count);
+    }
+
+    void BuildHeader() {
+        using namespace jpegenc;
+        header.clear();
+        header.push_back(0xFF);
+        header.push_back(0xD8);  // SOI
+
+        // APP0 JFIF 1.01, no thumbnail
+        const uint8_t jfif[] = { 'J', 'F', 'I', 'F', 0, 1, 1, 0, 0, 1, 0, 1, 0, 0 };
+        PutMarker(header, 0xE0, 2 + sizeof(jfif));
+        header.insert(header.end(), jfif, jfif + sizeof(jfif));
+
+        // DQT: both tables, zigzag order
+        PutMarker(header, 0xDB, 2 + 2 * 65);
+        for (int t = 0; t < 2; t++) {
+            header.push_back((uint8_t)t);
+            for (int k = 0; k < 64; k++) header.push_back(quant[t][NATURAL_ORDER[k]]);
+        }
+
+        // SOF0: 8-bit, three components
+        PutMarker(header, 0xC0, 2 + 6 + 3 * 3);
+        header.push_back(8);
+        sizeOffset = header.size();
+        for (int i = 0; i < 4; i++) header.push_back(0);  // Height, width - patched per frame
+        header.push_back(3);
+        uint8_t lumaSampling = subsampling == CHROMA_420 ? 0x22 : (subsampling == CHROMA_422 ? 0x21 : 0x11);
+        const uint8_t components[9] = { 1, lumaSampling, 0, 2, 0x11, 1, 3, 0x11, 1 };
+        header.insert(header.end(), components, components + 9);
+
+        // DHT: all four standard tables in one segment
+        PutMarker(header, 0xC4, 2 + 4 * 17 + 12 + 12 + 162 + 162);
+        PutHuffTable(header, 0x00, DC_LUMA_BITS, DC_VALUES);
+        PutHuffTable(header, 0x10, AC_LUMA_BITS, AC_LUMA_VALUES);
+        PutHuffTable(header, 0x01, DC_CHROMA_BITS, DC_VALUES);
+        PutHuffTable(header, 0x11, AC_CHROMA_BITS, AC_CHROMA_VALUES);
+
+        // Bands need a DRI too; the interval is patched per frame
+        restartOffset = 0;
+        if (restartInterval > 0 || bandRows > 0) {
+            PutMarker(header, 0xDD, 4);
+            restartOffset = header.size();
+            header.push_back((uint8_t)(restartInterval >> 8));
+            header.push_back((uint8_t)restartInterval);
+        }
+
+        // SOS: all three components, full spectral range
+        PutMarker(header, 0xDA, 2 + 1 + 3 * 2 + 3);
+        const uint8_t scan[10] = { 3, 1, 0x00, 2, 0x11, 3, 0x11, 0, 63, 0 };
+        header.insert(header.end(), scan, scan + 10);
+    }
+
+    void EncodeBlock(const uint8_t* src, uint32_t stride, int table, int* dcPred, jpegenc::BitWriter& bw) const {
+        using namespace jpegenc;
+        alignas(32) int16_t coef[64];
+        alignas(16) int16_t zz[64];
+
+#ifdef SIMD_X86
+        if (level == SIMD_AVX2) FdctQuantAVX2(src, stride, recip[table], coef);
+        else if (level == SIMD_SSE2) FdctQuantSSE2(src, stride, recip[table], coef);
+        else FdctQuantScalar(src, stride, recip[table], coef);
+#else
+        FdctQuantScalar(src, stride, recip[table], coef);
+#endif
+        for (int k = 0; k < 64; k++) zz[k] = coef[zigzag[k]];
+
+        // DC: difference to the previous block of the same component
+        const HuffCode& dc = dcCodes[table];
+        int diff = zz[0] - *dcPred;
+        *dcPred = zz[0];
+        int magnitude = diff < 0 ? -diff : diff;
+        int nbits = BitLength((uint32_t)magnitude);
+        bw.Put(dc.code[nbits], dc.size[nbits]);
+        if (nbits) bw.Put((uint32_t)(diff < 0 ? diff - 1 : diff) & ((1u << nbits) - 1), nbits);
+
+        // AC: walk only the non-zero coefficients
+        const HuffCode& ac = acCodes[table];
+#ifdef SIMD_X86
+        uint64_t nonZero = (level >= SIMD_SSE2 ? NonZeroMaskSSE2(zz) : NonZeroMaskScalar(zz)) & ~1ull;
+#else
+        uint64_t nonZero = NonZeroMaskScalar(zz) & ~1ull;
+#endif
+        int last = 0;
+        while (nonZero) {
+            int k = LowestBit64(nonZero);
+            nonZero &= nonZero - 1;
+            int run = k - last - 1;
+            while (run > 15) {
+                bw.Put(ac.code[0xF0], ac.size[0xF0]);  // ZRL
+                run -= 16;
+            }
+            int v = zz[k];
+            magnitude = v < 0 ? -v : v;
+            nbits = BitLength((uint32_t)magnitude);
+            int symbol = (run << 4) | nbits;
+            bw.Put(ac.code[symbol], ac.size[symbol]);
+            bw.Put((uint32_t)(v < 0 ? v - 1 : v) & ((1u << nbits) - 1), nbits);
+            last = k;
+        }
+        if (last != 63) bw.Put(ac.code[0x00], ac.size[0x00]);  // EOB
+    }
+
+    void ReserveStrip(Strip& s, uint32_t paddedWidth) {
+        if (paddedWidth <= s.width) return;
+        uint32_t chromaPadded = subsampling == CHROMA_444 ? paddedWidth : paddedWidth / 2;
+        uint32_t chromaRows = subsampling == CHROMA_420 ? 8 : McuHeight();
+        size_t lumaSize = (size_t)paddedWidth * McuHeight();
+        size_t chromaSize = (size_t)chromaPadded * chromaRows;
+        s.buffer.assign(lumaSize + 2 * chromaSize + 32, 0);  // Slack for SIMD stores
+        s.width = paddedWidth;
+        s.planes.y = s.buffer.data();
+        s.planes.cb = s.planes.y + lumaSize;
+        s.planes.cr = s.planes.cb + chromaSize;
+    }
+
+    // Convert rows [y, y + rows) into the strip and pad to whole MCUs
+    void FillStrip(YCbCrPlanes& planes, const uint8_t* bgra, uint32_t stride, uint32_t width,
+                   uint32_t y, uint32_t rows) const {
+        ConvertBgraToYCbCr(bgra + (size_t)y * stride, stride, width, rows, subsampling, planes, level);
+
+        uint32_t paddedWidth = planes.yStride;
+        uint32_t chromaWidth = ChromaWidth(width, subsampling);
+        uint32_t chromaPadded = planes.cStride;
+        uint32_t chromaRows = ChromaHeight(rows, subsampling);
+        uint32_t mcuHeight = McuHeight();
+        uint32_t chromaMcuHeight = subsampling == CHROMA_420 ? 8 : mcuHeight;
+
+        // Repeat the last column, then the last row
+        for (uint32_t r = 0; r < rows; r++) {
+            uint8_t* row = planes.y + (size_t)r * paddedWidth;
+            memset(row + width, row[width - 1], paddedWidth - width);
+        }
+        for (uint32_t r = 0; r < chromaRows; r++) {
+            uint8_t* cb = planes.cb + (size_t)r * chromaPadded;
+            uint8_t* cr = planes.cr + (size_t)r * chromaPadded;
+            memset(cb + chromaWidth, cb[chromaWidth - 1], chromaPadded - chromaWidth);
+            memset(cr + chromaWidth, cr[chromaWidth - 1], chromaPadded - chromaWidth);
+        }
+        for (uint32_t r = rows; r < mcuHeight; r++) {
+            memcpy(planes.y + (size_t)r * paddedWidth, planes.y + (size_t)(rows - 1) * paddedWidth, paddedWidth);
+        }
+        for (uint32_t r = chromaRows; r < chromaMcuHeight; r++) {
+            memcpy(planes.cb + (size_t)r * chromaPadded, planes.cb + (size_t)(chromaRows - 1) * chromaPadded, chromaPadded);
+            memcpy(planes.cr + (size_t)r * chromaPadded, planes.cr + (size_t)(chromaRows - 1) * chromaPadded, chromaPadded);
+        }
+    }
+
+    // Entropy-code MCU rows [rowBegin, rowEnd) into [out, end). Restart
+    // markers go before every restartEvery-th MCU of the frame (0 = none).
+    // The rows come from frame if set (JpegFramePlanes() layout), otherwise
+    // they are converted from bgra into the strip one at a time.
+    // Returns the bytes written or -1 when out of space.
+    int EncodeRows(Strip& s, const uint8_t* bgra, uint32_t stride, const YCbCrPlanes* frame, uint32_t width,
+                   uint32_t height, uint32_t rowBegin, uint32_t rowEnd, uint32_t restartEvery, uint8_t* out,
+                   uint8_t* end) const {
+        uint32_t mcuWidth = McuWidth(), mcuHeight = McuHeight();
+        uint32_t mcusX = (width + mcuWidth - 1) / mcuWidth;
+        uint32_t lumaBlocksX = mcuWidth / 8, lumaBlocksY = mcuHeight / 8;
+        size_t mcuBound = (size_t)(lumaBlocksX * lumaBlocksY + 2) * JPEG_BLOCK_WORST_CASE + 2;
+
+        YCbCrPlanes planes = frame ? *frame : s.planes;
+        if (!frame) {
+            planes.yStride = mcusX * mcuWidth;
+            planes.cStride = subsampling == CHROMA_444 ? planes.yStride : planes.yStride / 2;
+        }
+        uint32_t chromaMcuHeight = subsampling == CHROMA_420 ? mcuHeight / 2 : mcuHeight;
+
+        jpegenc::BitWriter bw;
+        bw.p = out;
+        int dcPred[3] = { 0, 0, 0 };
+
+        for (uint32_t my = rowBegin; my < rowEnd; my++) {
+            uint32_t y = my * mcuHeight;
+            if (frame) {
+                planes.y = frame->y + (size_t)y * frame->yStride;
+                planes.cb = frame->cb + (size_t)my * chromaMcuHeight * frame->cStride;
+                planes.cr = frame->cr + (size_t)my * chromaMcuHeight * frame->cStride;
+            } else {
+                FillStrip(planes, bgra, stride, width, y, height - y < mcuHeight ? height - y : mcuHeight);
+            }
+
+            for (uint32_t mx = 0; mx < mcusX; mx++) {
+                if ((size_t)(end - bw.p) < mcuBound) return -1;
+
+                uint32_t mcuIndex = my * mcusX + mx;
+                if (restartEvery && mcuIndex > rowBegin * mcusX && mcuIndex % restartEvery == 0) {
+                    bw.Flush();
+                    *bw.p++ = 0xFF;
+                    *bw.p++ = (uint8_t)(0xD0 + ((mcuIndex / restartEvery - 1) & 7));
+                    dcPred[0] = dcPred[1] = dcPred[2] = 0;
+                }
+
+                for (uint32_t by = 0; by < lumaBlocksY; by++) {
+                    for (uint32_t bx = 0; bx < lumaBlocksX; bx++) {
+                        const uint8_t* block = planes.y + (size_t)by * 8 * planes.yStride + mx * mcuWidth + bx * 8;
+                        EncodeBlock(block, planes.yStride, 0, &dcPred[0], bw);
+                    }
+                }
+                EncodeBlock(planes.cb + mx * 8, planes.cStride, 1, &dcPred[1], bw);
+                EncodeBlock(planes.cr + mx * 8, planes.cStride, 1, &dcPred[2], bw);
+            }
+        }
+
+        bw.Flush();
+        return (int)(bw.p - out);
+    }
+
+    // Encode one band into its own buffer, growing it (rarely) if needed
+    void EncodeBand(uint32_t index, const uint8_t* bgra, uint32_t stride, const YCbCrPlanes* frame,
+                    uint32_t width, uint32_t height, uint32_t mcusY, size_t maxSize) {
+        Band& band = bands[index];
+        uint32_t rowBegin = index * bandRows;
+        uint32_t rowEnd = rowBegin + bandRows < mcusY ? rowBegin + bandRows : mcusY;
+        while (true) {
+            band.size = EncodeRows(band.strip, bgra, stride, frame, width, height, rowBegin, rowEnd, 0,
+                band.data.data(), band.data.data() + band.data.size());
+            if (band.size >= 0 || band.data.size() >= maxSize) return;
+            band.data.resize(band.data.size() * 2 < maxSize ? band.data.size() * 2 : maxSize);
+        }
+    }
+
+    // Encode() / EncodePlanes(): pixels come from bgra, or from frame if set
+    int EncodeFrame(const uint8_t* bgra, uint32_t stride, const YCbCrPlanes* frame, uint32_t width,
+                    uint32_t height, uint8_t* out, size_t maxSize) {
+        if (header.empty() || width == 0 || height == 0 || width > 65535 || height > 65535) return -1;
+        if (maxSize < header.size() + 2) return -1;
+        Reserve(width, height);
+
+        uint32_t mcuWidth = McuWidth(), mcuHeight = McuHeight();
+        uint32_t mcusX = (width + mcuWidth - 1) / mcuWidth;
+        uint32_t mcusY = (height + mcuHeight - 1) / mcuHeight;
+        bool banded = bandRows > 0 && mcusY > (uint32_t)bandRows && mcusX * bandRows <= 65535;
+        uint32_t restartEvery = banded ? mcusX * bandRows : (uint32_t)restartInterval;
+
+        memcpy(out, header.data(), header.size());
+        out[sizeOffset] = (uint8_t)(height >> 8);
+        out[sizeOffset + 1] = (uint8_t)height;
+        out[sizeOffset + 2] = (uint8_t)(width >> 8);
+        out[sizeOffset + 3] = (uint8_t)width;
+        if (restartOffset) {
+            out[restartOffset] = (uint8_t)(restartEvery >> 8);
+            out[restartOffset + 1] = (uint8_t)restartEvery;
+        }
+
+        uint8_t* p = out + header.size();
+        uint8_t* end = out + maxSize;
+
+        if (!banded) {
+            int size = EncodeRows(strip, bgra, stride, frame, width, height, 0, mcusY, restartEvery, p, end);
+            if (size < 0) return -1;
+            p += size;
+        } else {
+            uint32_t bandCount = (mcusY + bandRows - 1) / bandRows;
+            jobs->ParallelFor(bandCount, 1, [&](uint32_t begin, uint32_t endBand) {
+                for (uint32_t b = begin; b < endBand; b++) {
+                    EncodeBand(b, bgra, stride, frame, width, height, mcusY, maxSize);
+                }
+            });
+
+            // Stitch the bands together with RSTn markers in between
+            for (uint32_t b = 0; b < bandCount; b++) {
+                const Band& band = bands[b];
+                if (band.size < 0 || (size_t)(end - p) < (size_t)band.size + 2) return -1;
+                memcpy(p, band.data.data(), band.size);
+                p += band.size;
+                if (b + 1 < bandCount) {
+                    *p++ = 0xFF;
+                    *p++ = (uint8_t)(0xD0 + (b & 7));
+                }
+            }
+        }
+
+        if (end - p < 2) return -1;
+        *p++ = 0xFF;
+        *p++ = 0xD9;  // EOI
+        return (int)(p - out);
+    }
+
+public:
+    // Build tables for a setting. Cheap to call every frame - it only does
+    // work when something changed. restartInterval is in MCUs (0 = none).
+    bool Configure(int q, ChromaSubsampling s, int restart = 0) {
+        if (q < 1 || q > 100 || restart < 0 || restart > 65535) return false;
+        if (q == quality && s == subsampling && restart == restartInterval && !header.empty()) return true;
+
+        using namespace jpegenc;
+        bool geometryChanged = s != subsampling;
+        quality = q;
+        subsampling = s;
+        restartInterval = restart;
+
+        BuildQuant(LUMA_QUANT, q, quant[0]);
+        BuildQuant(CHROMA_QUANT, q, quant[1]);
+        for (int t = 0; t < 2; t++) {
+            for (int u = 0; u < 8; u++) {
+                for (int v = 0; v < 8; v++) {
+                    recip[t][u * 8 + v] = 1.0f / ((float)quant[t][v * 8 + u] * AAN_SCALE[u] * AAN_SCALE[v] * 8.0f);
+                }
+            }
+        }
+        for (int k = 0; k < 64; k++) {
+            int n = NATURAL_ORDER[k];
+            zigzag[k] = (uint8_t)((n % 8) * 8 + n / 8);
+        }
+        BuildHuffCode(DC_LUMA_BITS, DC_VALUES, &dcCodes[0]);
+        BuildHuffCode(AC_LUMA_BITS, AC_LUMA_VALUES, &acCodes[0]);
+        BuildHuffCode(DC_CHROMA_BITS, DC_VALUES, &dcCodes[1]);
+        BuildHuffCode(AC_CHROMA_BITS, AC_CHROMA_VALUES, &acCodes[1]);
+        BuildHeader();
+
+        if (geometryChanged) {
+            // Strip layout depends on the subsampling - size them again
+            strip.width = 0;
+            for (auto& band : bands) band.strip.width = 0;
+            if (reservedWidth) Reserve(reservedWidth);
+        }
+        return true;
+    }
+
+    // Encode in parallel bands of bandRowCount MCU rows on jobs (null = off).
+    // Output is identical for any worker count, including zero.
+    void SetJobSystem(JobSystem* jobSystem, int bandRowCount = JPEG_DEFAULT_BAND_ROWS) {
+        jobs = jobSystem;
+        bandRows = jobSystem ? (bandRowCount > 0 ? bandRowCount : JPEG_DEFAULT_BAND_ROWS) : 0;
+        if (!header.empty()) BuildHeader();
+    }
+
+    // Allocate scratch for frames up to maxWidth wide (and, in band mode, up
+    // to maxHeight tall), so Encode() doesn't have to
+    void Reserve(uint32_t maxWidth, uint32_t maxHeight = 0) {
+        uint32_t mcuWidth = McuWidth();
+        uint32_t paddedWidth = (maxWidth + mcuWidth - 1) / mcuWidth * mcuWidth;
+        if (maxWidth > reservedWidth) reservedWidth = maxWidth;
+        ReserveStrip(strip, paddedWidth);
+
+        if (bandRows > 0) {
+            uint32_t mcusY = (maxHeight + McuHeight() - 1) / McuHeight();
+            size_t bandCount = (mcusY + bandRows - 1) / bandRows;
+            if (bands.size() < bandCount) bands.resize(bandCount);
+            for (auto& band : bands) {
+                ReserveStrip(band.strip, paddedWidth);
+                if (band.data.empty()) band.data.resize(JPEG_BAND_INITIAL_SIZE);
+            }
+        }
+    }
+
+    void SetSimdLevel(SimdLevel l) { level = l < GetSimdLevel() ? l : GetSimdLevel(); }
+    int GetQuality() const { return quality; }
+    ChromaSubsampling GetSubsampling() const { return subsampling; }
+    int GetRestartInterval() const { return restartInterval; }
+    size_t GetHeaderSize() const { return header.size(); }
+
+    // Upper bound on the encoded size, for sizing output buffers
+    size_t MaxEncodedSize(uint32_t width, uint32_t height) const {
+        uint32_t mcuWidth = McuWidth(), mcuHeight = McuHeight();
+        size_t mcus = (size_t)((width + mcuWidth - 1) / mcuWidth) * ((height + mcuHeight - 1) / mcuHeight);
+        size_t blocksPerMcu = (size_t)(mcuWidth / 8) * (mcuHeight / 8) + 2;
+        return header.size() + mcus * (blocksPerMcu * JPEG_BLOCK_WORST_CASE + 2) + 2;
+    }
+
+    // Encode a BGRA image (any pitch) into out. Returns the JPEG size, or -1
+    // if not configured, the size is invalid or out is too small.
+    int Encode(const uint8_t* bgra, uint32_t stride, uint32_t width, uint32_t height,
+               uint8_t* out, size_t maxSize) {
+        return EncodeFrame(bgra, stride, nullptr, width, height, out, maxSize);
+    }
+
+    // Encode a w x h image already converted to YCbCr in the configured
+    // subsampling, laid out as JpegFramePlanes() describes (padding filled).
+    // Same return values as Encode().
+    int EncodePlanes(const YCbCrPlanes& planes, uint32_t width, uint32_t height, uint8_t* out, size_t maxSize) {
+        return EncodeFrame(nullptr, 0, &planes, width, height, out, maxSize);
+    }
+};
@@ -0,0 +1,209 @@
+// Latency Histogram - lock-free per-stage latency percentiles
+// Log-linear ("HDR-style") buckets over microseconds: values below 32 get a
+// bucket each, above that every power of two is split into 16 equal
+// sub-buckets, so any recorded value is known to within 1/16 (6.25%) from
+// 1 us up to ~38 hours in 544 buckets. Record() is one relaxed atomic add
+// per bucket plus the sum and max, so capture, encode and send threads can
+// all record into the same histogram without a lock and without allocating.
+//
+// Percentiles come from snapshots, which only read the counters: a
+// reporting thread can ask for p50 / p99 / p99.9 at any time without
+// touching the hot path. Subtracting an older snapshot gives the
+// percentiles of the window in between.
+//
+// LatencyNowUs() is the steady clock in microseconds - QueryPerformanceCounter
+// on Windows (MSVC), so DXGI present times converted with LatencyQpcToUs()
+// and Node's process.hrtime() on the same machine read the same clock.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <math.h>
+#include <atomic>
+#include <chrono>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#define LATENCY_SUB_BITS 4                         // 16 sub-buckets per power of two
+#define LATENCY_SUB_BUCKETS (1 << LATENCY_SUB_BITS)
+#define LATENCY_MAX_BITS 37                        // Values are clamped below 2^37 us
+#define LATENCY_BUCKETS ((LATENCY_MAX_BITS - LATENCY_SUB_BITS + 1) * LATENCY_SUB_BUCKETS)
+
+inline uint64_t LatencyNowUs() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// QueryPerformanceCounter ticks -> LatencyNowUs() microseconds (split so
+// the multiplication can't overflow)
+inline uint64_t LatencyQpcToUs(int64_t ticks, int64_t frequency) {
+    return (uint64_t)((ticks / frequency) * 1000000 + (ticks % frequency) * 1000000 / frequency);
+}
+
+inline int LatencyHighestBit(uint64_t v) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanReverse64(&index, v);
+    return (int)index;
+#else
+    return 63 - __builtin_clzll(v);
+#endif
+}
+
+// Bucket holding us. Values below 2 * LATENCY_SUB_BUCKETS map to themselves;
+// above, the top LATENCY_SUB_BITS + 1 bits select the bucket.
+inline int LatencyBucket(uint64_t us) {
+    if (us < 2 * LATENCY_SUB_BUCKETS) return (int)us;
+    if (us >> LATENCY_MAX_BITS) us = ((uint64_t)1 << LATENCY_MAX_BITS) - 1;
+    int shift = LatencyHighestBit(us) - LATENCY_SUB_BITS;
+    return shift * LATENCY_SUB_BUCKETS + (int)(us >> shift);
+}
+
+// Smallest and largest value that land in bucket
+inline uint64_t LatencyBucketLow(int bucket) {
+    if (bucket < 2 * LATENCY_SUB_BUCKETS) return (uint64_t)bucket;
+    int shift = bucket / LATENCY_SUB_BUCKETS - 1;
+    return (uint64_t)(bucket - shift * LATENCY_SUB_BUCKETS) << shift;
+}
+
+inline uint64_t LatencyBucketHigh(int bucket) {
+    if (bucket < 2 * LATENCY_SUB_BUCKETS) return (uint64_t)bucket;
+    int shift = bucket / LATENCY_SUB_BUCKETS - 1;
+    return LatencyBucketLow(bucket) + ((uint64_t)1 << shift) - 1;
+}
+
+// Plain copy of a histogram's counters
+struct LatencySnapshot {
+    uint64_t counts[LATENCY_BUCKETS] = {};
+    uint64_t count = 0;
+    uint64_t sumUs = 0;
+    uint64_t maxUs = 0;
+
+    // Value below which p percent (0-100) of the samples fall: the top of
+    // the bucket holding that rank, never above the largest sample.
+    // 0 when empty.
+    uint64_t Percentile(double p) const {
+        if (count == 0) return 0;
+        uint64_t rank = (uint64_t)ceil(p / 100 * count);
+        if (rank < 1) rank = 1;
+        if (rank > count) rank = count;
+        uint64_t seen = 0;
+        for (int b = 0; b < LATENCY_BUCKETS; b++) {
+            seen += counts[b];
+            if (seen >= rank) {
+                uint64_t high = LatencyBucketHigh(b);
+                return high < maxUs ? high : maxUs;
+            }
+        }
+        return maxUs;
+    }
+
+    double MeanUs() const { return count ? (double)sumUs / count : 0; }
+
+    // Keep only what was recorded after earlier (a snapshot of the same
+    // histogram). The window's max is bounded by its highest bucket.
+    void Subtract(const LatencySnapshot& earlier) {
+        uint64_t top = 0;
+        count = 0;
+        for (int b = 0; b < LATENCY_BUCKETS; b++) {
+            counts[b] -= earlier.counts[b];
+            count += counts[b];
+            if (counts[b]) top = LatencyBucketHigh(b);
+        }
+        sumUs -= earlier.sumUs;
+        if (top < maxUs) maxUs = top;
+    }
+};
+
+class LatencyHistogram {
+private:
+    std::atomic<uint64_t> counts[LATENCY_BUCKETS];
+    std::atomic<uint64_t> sumUs{0};
+    std::atomic<uint64_t> maxUs{0};
+
+public:
+    LatencyHistogram() {
+        for (int b = 0; b < LATENCY_BUCKETS; b++) counts[b].store(0, std::memory_order_relaxed);
+    }
+
+    // Any thread, lock-free
+    void Record(uint64_t us) {
+        counts[LatencyBucket(us)].fetch_add(1, std::memory_order_relaxed);
+        sumUs.fetch_add(us, std::memory_order_relaxed);
+        uint64_t max = maxUs.load(std::memory_order_relaxed);
+        while (us > max && !maxUs.compare_exchange_weak(max, us, std::memory_order_relaxed)) {}
+    }
+
+    // Interval between two LatencyNowUs() readings; ignores end < start
+    // (stamps taken on different threads can be a tick apart)
+    void RecordSince(uint64_t startUs, uint64_t endUs) {
+        if (startUs && endUs >= startUs) Record(endUs - startUs);
+    }
+
+    // Copy the counters while writers keep recording. Each counter is read
+    // once, so a snapshot may split a concurrent Record() but never loses it.
+    void Snapshot(LatencySnapshot* s) const {
+        s->count = 0;
+        for (int b = 0; b < LATENCY_BUCKETS; b++) {
+            s->counts[b] = counts[b].load(std::memory_order_relaxed);
+            s->count += s->counts[b];
+        }
+        s->sumUs = sumUs.load(std::memory_order_relaxed);
+        s->maxUs = maxUs.load(std::memory_order_relaxed);
+    }
+};
+
+// A fixed list of pipeline stages, each with its own histogram.
+// Any thread records; one thread at a time calls Report().
+class LatencyStages {
+private:
+    const char* const* names = nullptr;
+    int stageCount = 0;
+    LatencyHistogram* histograms = nullptr;
+    LatencySnapshot* previous = nullptr;   // As of the last report
+    LatencySnapshot current;
+    uint64_t windowStartUs = 0;
+
+public:
+    LatencyStages(const char* const* stageNames, int count)
+        : names(stageNames), stageCount(count), windowStartUs(LatencyNowUs()) {
+        histograms = new LatencyHistogram[count];
+        previous = new LatencySnapshot[count];
+    }
+    ~LatencyStages() {
+        delete[] histograms;
+        delete[] previous;
+    }
+    LatencyStages(const LatencyStages&) = delete;
+    LatencyStages& operator=(const LatencyStages&) = delete;
+
+    LatencyHistogram& operator[](int stage) { return histograms[stage]; }
+    void Record(int stage, uint64_t us) { histograms[stage].Record(us); }
+    void RecordSince(int stage, uint64_t startUs, uint64_t endUs) { histograms[stage].RecordSince(startUs, endUs); }
+
+    // Print count / mean / p50 / p99 / p99.9 / max per stage for everything
+    // recorded since the last report (or since startup), then start a new
+    // window
+    void Report(const char* prefix) {
+        uint64_t now = LatencyNowUs();
+        printf("%sLatency over %.1f s (ms):\n", prefix, (now - windowStartUs) / 1e6);
+        printf("%s  %-8s %8s %8s %8s %8s %8s %8s\n", prefix, "stage", "frames", "mean", "p50", "p99", "p99.9", "max");
+        for (int i = 0; i < stageCount; i++) {
+            histograms[i].Snapshot(&current);
+            LatencySnapshot window = current;
+            window.Subtract(previous[i]);
+            previous[i] = current;
+            if (window.count == 0) {
+                printf("%s  %-8s %8s\n", prefix, names[i], "-");
+                continue;
+            }
+            printf("%s  %-8s %8llu %8.2f %8.2f %8.2f %8.2f %8.2f\n", prefix, names[i],
+                (unsigned long long)window.count, window.MeanUs() / 1000, window.Percentile(50) / 1000.0,
+                window.Percentile(99) / 1000.0, window.Percentile(99.9) / 1000.0, window.maxUs / 1000.0);
+        }
+        windowStartUs = now;
+    }
+};
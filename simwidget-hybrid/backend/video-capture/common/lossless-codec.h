@@ -0,0 +1,496 @@
+// Lossless Codec - fast pixel-exact BGRA compression for the raw frame service
+// Each row is turned into residuals by a left-neighbour predictor (per byte,
+// mod 256; the first pixel predicts from the one above it), optionally after XOR against the previous frame so unchanged
+// pixels become zero. Residuals are coded in groups of 8 pixels, each group
+// in the smallest of four forms:
+//
+//   ZERO    all residuals 0                     0 bytes
+//   NIBBLE  B, G, R in -8..7, alpha residual 0  12 bytes (4 bits per channel)
+//   BYTE    alpha residual 0                    24 bytes (B, G, R)
+//   RAW     anything else                       32 bytes
+//
+// Runs of groups with the same form share one token byte: (form << 6) |
+// (count - 1), up to 64 groups. Flat UI, panels and unchanged areas collapse
+// to a token per 512 pixels; photographic content costs at most ~3% over raw.
+// Residuals and group classification use SSE2/AVX2, so the codec runs at
+// memory speed on mostly static frames. The row tail is padded to a whole
+// group with zero residuals.
+//
+// The image is cut into bands of LOSSLESS_BAND_ROWS rows that are coded
+// independently (no state crosses a band), so bands encode and decode in
+// parallel on a JobSystem and the output is identical for any thread count.
+//
+// Stream: [4B magic "SWL1"][2B width][2B height][1B flags][1B reserved]
+//         [2B band rows][4B size of each band][band data...]  (little endian)
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <vector>
+#include "cpu-features.h"
+#include "job-system.h"
+
+#define LOSSLESS_MAGIC 0x314C5753u  // "SWL1"
+#define LOSSLESS_FLAG_XOR 0x1       // Residuals are against the previous frame
+#define LOSSLESS_BAND_ROWS 32
+#define LOSSLESS_HEADER_SIZE 12
+
+namespace lossless {
+
+enum GroupForm { FORM_ZERO = 0, FORM_NIBBLE = 1, FORM_BYTE = 2, FORM_RAW = 3 };
+
+const int GROUP_PIXELS = 8;
+const int GROUP_BYTES = 32;
+const int FORM_BYTES[4] = { 0, 12, 24, 32 };
+const int MAX_RUN = 64;
+
+inline uint32_t GroupsPerRow(uint32_t width) { return (width + GROUP_PIXELS - 1) / GROUP_PIXELS; }
+
+// --- Residuals -------------------------------------------------------------
+// out[x] = p[x] - p[x - 1] per byte (p[-1] = 0), where p = cur ^ ref when ref
+// is set. out is padded with zeros up to a whole group.
+
+inline void ResidualsScalar(const uint8_t* cur, const uint8_t* ref, uint32_t x0, uint32_t width, uint8_t* out) {
+    for (uint32_t x = x0; x < width; x++) {
+        for (int c = 0; c < 4; c++) {
+            uint8_t p = cur[x * 4 + c], left = x ? cur[x * 4 - 4 + c] : 0;
+            if (ref) {
+                p ^= ref[x * 4 + c];
+                if (x) left ^= ref[x * 4 - 4 + c];
+            }
+            out[x * 4 + c] = (uint8_t)(p - left);
+        }
+    }
+}
+
+// Classify one group of residuals
+inline GroupForm ClassifyScalar(const uint8_t* r) {
+    bool zero = true, alphaZero = true, small = true;
+    for (int i = 0; i < GROUP_BYTES; i++) {
+        if (r[i]) zero = false;
+        if ((i & 3) == 3) {
+            if (r[i]) alphaZero = false;
+        } else if ((uint8_t)(r[i] + 8) >= 16) {
+            small = false;
+        }
+    }
+    if (zero) return FORM_ZERO;
+    if (!alphaZero) return FORM_RAW;
+    return small ? FORM_NIBBLE : FORM_BYTE;
+}
+
+#ifdef SIMD_X86
+
+inline void ResidualsSSE2(const uint8_t* cur, const uint8_t* ref, uint32_t width, uint8_t* out) {
+    ResidualsScalar(cur, ref, 0, width < 1 ? width : 1, out);
+    uint32_t x = 1;
+    for (; x + 4 <= width; x += 4) {
+        __m128i p = _mm_loadu_si128((const __m128i*)(cur + x * 4));
+        __m128i left = _mm_loadu_si128((const __m128i*)(cur + x * 4 - 4));
+        if (ref) {
+            p = _mm_xor_si128(p, _mm_loadu_si128((const __m128i*)(ref + x * 4)));
+            left = _mm_xor_si128(left, _mm_loadu_si128((const __m128i*)(ref + x * 4 - 4)));
+        }
+        _mm_storeu_si128((__m128i*)(out + x * 4), _mm_sub_epi8(p, left));
+    }
+    ResidualsScalar(cur, ref, x, width, out);
+}
+
+inline GroupForm ClassifySSE2(const uint8_t* r) {
+    const __m128i alpha = _mm_set1_epi32((int)0xFF000000);
+    const __m128i bias = _mm_set1_epi8(8);
+    const __m128i high = _mm_set1_epi8((char)0xF0);
+    __m128i a = _mm_loadu_si128((const __m128i*)r);
+    __m128i b = _mm_loadu_si128((const __m128i*)(r + 16));
+    __m128i any = _mm_or_si128(a, b);
+    __m128i zero = _mm_setzero_si128();
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(any, zero)) == 0xFFFF) return FORM_ZERO;
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(any, alpha), zero)) != 0xFFFF) return FORM_RAW;
+    // Alpha residuals are 0 here, so +8 keeps them in range
+    __m128i big = _mm_or_si128(_mm_and_si128(_mm_add_epi8(a, bias), high), _mm_and_si128(_mm_add_epi8(b, bias), high));
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(big, zero)) == 0xFFFF ? FORM_NIBBLE : FORM_BYTE;
+}
+
+SIMD_TARGET_AVX2
+inline void ResidualsAVX2(const uint8_t* cur, const uint8_t* ref, uint32_t width, uint8_t* out) {
+    ResidualsScalar(cur, ref, 0, width < 1 ? width : 1, out);
+    uint32_t x = 1;
+    for (; x + 8 <= width; x += 8) {
+        __m256i p = _mm256_loadu_si256((const __m256i*)(cur + x * 4));
+        __m256i left = _mm256_loadu_si256((const __m256i*)(cur + x * 4 - 4));
+        if (ref) {
+            p = _mm256_xor_si256(p, _mm256_loadu_si256((const __m256i*)(ref + x * 4)));
+            left = _mm256_xor_si256(left, _mm256_loadu_si256((const __m256i*)(ref + x * 4 - 4)));
+        }
+        _mm256_storeu_si256((__m256i*)(out + x * 4), _mm256_sub_epi8(p, left));
+    }
+    ResidualsScalar(cur, ref, x, width, out);
+}
+
+SIMD_TARGET_AVX2
+inline GroupForm ClassifyAVX2(const uint8_t* r) {
+    __m256i v = _mm256_loadu_si256((const __m256i*)r);
+    if (_mm256_testz_si256(v, v)) return FORM_ZERO;
+    if (!_mm256_testz_si256(v, _mm256_set1_epi32((int)0xFF000000))) return FORM_RAW;
+    __m256i biased = _mm256_add_epi8(v, _mm256_set1_epi8(8));
+    return _mm256_testz_si256(biased, _mm256_set1_epi8((char)0xF0)) ? FORM_NIBBLE : FORM_BYTE;
+}
+
+// Inverse predictor for 4 pixels: running per-byte sum seeded with the
+// previous pixel (in the top lane of carry)
+inline __m128i PrefixSumSSE2(__m128i r, __m128i carry) {
+    r = _mm_add_epi8(r, _mm_slli_si128(r, 4));
+    r = _mm_add_epi8(r, _mm_slli_si128(r, 8));
+    return _mm_add_epi8(r, _mm_shuffle_epi32(carry, _MM_SHUFFLE(3, 3, 3, 3)));
+}
+
+#endif  // SIMD_X86
+
+// --- Group packing ---------------------------------------------------------
+
+inline uint8_t* PackGroup(const uint8_t* r, GroupForm form, uint8_t* out) {
+    switch (form) {
+        case FORM_NIBBLE:
+            // B, G, R of 8 pixels = 24 nibbles, two per byte in that order
+            for (int p = 0; p < GROUP_PIXELS; p += 2) {
+                const uint8_t* a = r + p * 4;
+                const uint8_t* b = a + 4;
+                *out++ = (uint8_t)(((a[0] + 8) & 15) | ((a[1] + 8) & 15) << 4);
+                *out++ = (uint8_t)(((a[2] + 8) & 15) | ((b[0] + 8) & 15) << 4);
+                *out++ = (uint8_t)(((b[1] + 8) & 15) | ((b[2] + 8) & 15) << 4);
+            }
+            return out;
+        case FORM_BYTE:
+            for (int p = 0; p < GROUP_PIXELS; p++) {
+                out[0] = r[p * 4];
+                out[1] = r[p * 4 + 1];
+                out[2] = r[p * 4 + 2];
+                out += 3;
+            }
+            return out;
+        case FORM_RAW:
+            memcpy(out, r, GROUP_BYTES);
+            return out + GROUP_BYTES;
+        default:
+            return out;
+    }
+}
+
+inline void UnpackGroup(const uint8_t* in, GroupForm form, uint8_t* r) {
+    switch (form) {
+        case FORM_NIBBLE:
+            for (int p = 0; p < GROUP_PIXELS; p += 2) {
+                uint8_t* a = r + p * 4;
+                uint8_t* b = a + 4;
+                a[0] = (uint8_t)((in[0] & 15) - 8);
+                a[1] = (uint8_t)((in[0] >> 4) - 8);
+                a[2] = (uint8_t)((in[1] & 15) - 8);
+                b[0] = (uint8_t)((in[1] >> 4) - 8);
+                b[1] = (uint8_t)((in[2] & 15) - 8);
+                b[2] = (uint8_t)((in[2] >> 4) - 8);
+                a[3] = b[3] = 0;
+                in += 3;
+            }
+            return;
+        case FORM_BYTE:
+            for (int p = 0; p < GROUP_PIXELS; p++) {
+                r[p * 4] = in[0];
+                r[p * 4 + 1] = in[1];
+                r[p * 4 + 2] = in[2];
+                r[p * 4 + 3] = 0;
+                in += 3;
+            }
+            return;
+        case FORM_RAW:
+            memcpy(r, in, GROUP_BYTES);
+            return;
+        default:
+            memset(r, 0, GROUP_BYTES);
+            return;
+    }
+}
+
+}  // namespace lossless
+
+// Worst case: every group RAW with its own token, plus headers
+inline size_t LosslessMaxEncodedSize(uint32_t width, uint32_t height) {
+    size_t bands = (height + LOSSLESS_BAND_ROWS - 1) / LOSSLESS_BAND_ROWS;
+    size_t groups = (size_t)lossless::GroupsPerRow(width) * height;
+    return LOSSLESS_HEADER_SIZE + bands * 4 + groups * (lossless::GROUP_BYTES + 1);
+}
+
+// Encoder for frames of one fixed size. Keeps a copy of the last frame it
+// encoded as the reference for XOR frames. Not thread safe; Encode() splits
+// its own work across the JobSystem.
+class LosslessEncoder {
+private:
+    uint32_t width = 0, height = 0;
+    SimdLevel simd = GetSimdLevel();
+    JobSystem* jobs = nullptr;
+    bool keepReference = false;
+    bool hasReference = false;
+    std::vector<uint8_t> reference;        // Last frame, pitch stripped
+    std::vector<std::vector<uint8_t>> bands;
+    std::vector<uint32_t> bandSizes;
+    std::vector<uint8_t> residualRows;     // One padded residual row per band
+
+    void Residuals(const uint8_t* cur, const uint8_t* ref, uint8_t* out) const {
+#ifdef SIMD_X86
+        if (simd == SIMD_AVX2) { lossless::ResidualsAVX2(cur, ref, width, out); return; }
+        if (simd == SIMD_SSE2) { lossless::ResidualsSSE2(cur, ref, width, out); return; }
+#endif
+        lossless::ResidualsScalar(cur, ref, 0, width, out);
+    }
+
+    lossless::GroupForm Classify(const uint8_t* r) const {
+#ifdef SIMD_X86
+        if (simd == SIMD_AVX2) return lossless::ClassifyAVX2(r);
+        if (simd == SIMD_SSE2) return lossless::ClassifySSE2(r);
+#endif
+        return lossless::ClassifyScalar(r);
+    }
+
+    void EncodeBand(uint32_t band, const uint8_t* bgra, size_t stride, bool useXor) {
+        using namespace lossless;
+        uint32_t groupsPerRow = GroupsPerRow(width);
+        uint8_t* residual = residualRows.data() + (size_t)band * groupsPerRow * GROUP_BYTES;
+        uint8_t* out = bands[band].data();
+        uint8_t* token = nullptr;
+        int runForm = -1, runLength = 0;
+        uint8_t above[4];
+
+        uint32_t rowEnd = std::min(height, (band + 1) * LOSSLESS_BAND_ROWS);
+        for (uint32_t y = band * LOSSLESS_BAND_ROWS; y < rowEnd; y++) {
+            const uint8_t* cur = bgra + y * stride;
+            uint8_t* ref = keepReference ? reference.data() + (size_t)y * width * 4 : nullptr;
+            Residuals(cur, useXor ? ref : nullptr, residual);
+            // The row's first pixel predicts from the first pixel of the row above
+            for (int c = 0; c < 4; c++) {
+                uint8_t first = useXor ? (uint8_t)(cur[c] ^ ref[c]) : cur[c];
+                if (y % LOSSLESS_BAND_ROWS) residual[c] = (uint8_t)(residual[c] - above[c]);
+                above[c] = first;
+            }
+            if (ref) memcpy(ref, cur, (size_t)width * 4);  // Next frame's reference, while it's in cache
+
+            for (uint32_t g = 0; g < groupsPerRow; g++) {
+                const uint8_t* r = residual + g * GROUP_BYTES;
+                GroupForm form = Classify(r);
+                if ((int)form == runForm && runLength < MAX_RUN) {
+                    runLength++;
+                    *token = (uint8_t)((form << 6) | (runLength - 1));
+                } else {
+                    token = out++;
+                    *token = (uint8_t)(form << 6);
+                    runForm = form;
+                    runLength = 1;
+                }
+                out = PackGroup(r, form, out);
+            }
+        }
+        bandSizes[band] = (uint32_t)(out - bands[band].data());
+    }
+
+public:
+    // keepXorReference: remember each frame so the next can be XOR coded
+    bool Initialize(uint32_t w, uint32_t h, bool keepXorReference) {
+        if (w == 0 || h == 0 || w > 65535 || h > 65535) return false;
+        width = w;
+        height = h;
+        keepReference = keepXorReference;
+        hasReference = false;
+        reference.assign(keepReference ? (size_t)w * h * 4 : 0, 0);
+
+        uint32_t bandCount = (h + LOSSLESS_BAND_ROWS - 1) / LOSSLESS_BAND_ROWS;
+        size_t groupsPerRow = lossless::GroupsPerRow(w);
+        // Zero padding past the row end stays zero: residuals only write [0, width)
+        residualRows.assign((size_t)bandCount * groupsPerRow * lossless::GROUP_BYTES, 0);
+        bands.resize(bandCount);
+        for (auto& band : bands) band.resize(groupsPerRow * LOSSLESS_BAND_ROWS * (lossless::GROUP_BYTES + 1));
+        bandSizes.assign(bandCount, 0);
+        return true;
+    }
+
+    void SetJobSystem(JobSystem* pool) { jobs = pool; }
+    void SetSimdLevel(SimdLevel level) { simd = level; }
+
+    // Forget the reference; the next frame is coded on its own
+    void ResetReference() { hasReference = false; }
+
+    size_t MaxEncodedSize() const { return LosslessMaxEncodedSize(width, height); }
+
+    // Encode one frame. With useXor (and a reference from the previous
+    // Encode) the frame is coded against that reference; *xorCoded tells
+    // which one happened. Returns the stream size or -1 if it won't fit.
+    int Encode(const uint8_t* bgra, size_t stride, bool useXor, uint8_t* out, size_t maxSize, bool* xorCoded = nullptr) {
+        bool xorFrame = useXor && keepReference && hasReference;
+        uint32_t bandCount = (uint32_t)bands.size();
+
+        auto encode = [&](uint32_t begin, uint32_t end) {
+            for (uint32_t b = begin; b < end; b++) EncodeBand(b, bgra, stride, xorFrame);
+        };
+        if (jobs) jobs->ParallelFor(bandCount, 1, encode);
+        else encode(0, bandCount);
+        hasReference = keepReference;
+        if (xorCoded) *xorCoded = xorFrame;
+
+        size_t total = LOSSLESS_HEADER_SIZE + (size_t)bandCount * 4;
+        for (uint32_t size : bandSizes) total += size;
+        if (total > maxSize) return -1;
+
+        uint32_t magic = LOSSLESS_MAGIC;
+        uint16_t w = (uint16_t)width, h = (uint16_t)height, bandRows = LOSSLESS_BAND_ROWS;
+        memcpy(out, &magic, 4);
+        memcpy(out + 4, &w, 2);
+        memcpy(out + 6, &h, 2);
+        out[8] = xorFrame ? LOSSLESS_FLAG_XOR : 0;
+        out[9] = 0;
+        memcpy(out + 10, &bandRows, 2);
+        memcpy(out + LOSSLESS_HEADER_SIZE, bandSizes.data(), (size_t)bandCount * 4);
+        uint8_t* data = out + LOSSLESS_HEADER_SIZE + (size_t)bandCount * 4;
+        for (uint32_t b = 0; b < bandCount; b++) {
+            memcpy(data, bands[b].data(), bandSizes[b]);
+            data += bandSizes[b];
+        }
+        return (int)total;
+    }
+};
+
+// Decoder. Keeps the last decoded frame, which XOR frames need.
+class LosslessDecoder {
+private:
+    uint32_t width = 0, height = 0;
+    SimdLevel simd = GetSimdLevel();
+    JobSystem* jobs = nullptr;
+    bool hasFrame = false;
+    std::vector<uint8_t> frame;          // Pitch stripped BGRA
+    std::vector<uint8_t> residualRows;   // One padded row per band
+    std::vector<size_t> bandOffsets;
+
+    // Returns false on a corrupt band
+    bool DecodeBand(uint32_t band, const uint8_t* in, size_t size, bool useXor) {
+        using namespace lossless;
+        uint32_t groupsPerRow = GroupsPerRow(width);
+        uint8_t* residual = residualRows.data() + (size_t)band * groupsPerRow * GROUP_BYTES;
+        const uint8_t* end = in + size;
+        GroupForm form = FORM_ZERO;
+        int remaining = 0;
+        uint8_t above[4];
+
+        uint32_t rowEnd = std::min(height, (band + 1) * LOSSLESS_BAND_ROWS);
+        for (uint32_t y = band * LOSSLESS_BAND_ROWS; y < rowEnd; y++) {
+            for (uint32_t g = 0; g < groupsPerRow; g++) {
+                if (remaining == 0) {
+                    if (in >= end) return false;
+                    form = (GroupForm)(*in >> 6);
+                    remaining = (*in & 63) + 1;
+                    in++;
+                }
+                if (end - in < FORM_BYTES[form]) return false;
+                UnpackGroup(in, form, residual + g * GROUP_BYTES);
+                in += FORM_BYTES[form];
+                remaining--;
+            }
+
+            // Undo the predictor, then the XOR
+            for (int c = 0; c < 4; c++) {
+                if (y % LOSSLESS_BAND_ROWS) residual[c] = (uint8_t)(residual[c] + above[c]);
+                above[c] = residual[c];
+            }
+            uint8_t* row = frame.data() + (size_t)y * width * 4;
+            uint32_t x = 0;
+#ifdef SIMD_X86
+            if (simd != SIMD_SCALAR) {
+                __m128i carry = _mm_setzero_si128();
+                for (; x + 4 <= width; x += 4) {
+                    __m128i p = PrefixSumSSE2(_mm_loadu_si128((const __m128i*)(residual + x * 4)), carry);
+                    carry = p;
+                    if (useXor) p = _mm_xor_si128(p, _mm_loadu_si128((const __m128i*)(row + x * 4)));
+                    _mm_storeu_si128((__m128i*)(row + x * 4), p);
+                }
+                if (x > 0 && x < width) {
+                    // Scalar tail continues from the last predicted (pre-XOR) pixel
+                    uint8_t last[16];
+                    _mm_storeu_si128((__m128i*)last, carry);
+                    for (; x < width; x++) {
+                        for (int c = 0; c < 4; c++) {
+                            last[12 + c] = (uint8_t)(last[12 + c] + residual[x * 4 + c]);
+                            row[x * 4 + c] = useXor ? (uint8_t)(row[x * 4 + c] ^ last[12 + c]) : last[12 + c];
+                        }
+                    }
+                }
+            }
+#endif
+            if (x < width) {
+                uint8_t p[4] = { 0, 0, 0, 0 };
+                for (; x < width; x++) {
+                    for (int c = 0; c < 4; c++) {
+                        p[c] = (uint8_t)(p[c] + residual[x * 4 + c]);
+                        row[x * 4 + c] = useXor ? (uint8_t)(row[x * 4 + c] ^ p[c]) : p[c];
+                    }
+                }
+            }
+        }
+        return in == end;
+    }
+
+public:
+    void SetJobSystem(JobSystem* pool) { jobs = pool; }
+    void SetSimdLevel(SimdLevel level) { simd = level; }
+
+    // Decode a stream into the internal frame (GetFrame()). Returns 0, or -1
+    // for a corrupt stream or an XOR frame without a matching previous frame.
+    int Decode(const uint8_t* in, size_t size) {
+        if (size < LOSSLESS_HEADER_SIZE) return -1;
+        uint32_t magic;
+        uint16_t w, h, bandRows;
+        memcpy(&magic, in, 4);
+        memcpy(&w, in + 4, 2);
+        memcpy(&h, in + 6, 2);
+        memcpy(&bandRows, in + 10, 2);
+        bool useXor = (in[8] & LOSSLESS_FLAG_XOR) != 0;
+        if (magic != LOSSLESS_MAGIC || bandRows != LOSSLESS_BAND_ROWS || w == 0 || h == 0) return -1;
+
+        if (w != width || h != height) {
+            if (useXor) return -1;
+            width = w;
+            height = h;
+            frame.assign((size_t)w * h * 4, 0);
+            hasFrame = false;
+        }
+        if (useXor && !hasFrame) return -1;
+
+        uint32_t bandCount = (height + LOSSLESS_BAND_ROWS - 1) / LOSSLESS_BAND_ROWS;
+        size_t offset = LOSSLESS_HEADER_SIZE + (size_t)bandCount * 4;
+        if (size < offset) return -1;
+        bandOffsets.resize(bandCount + 1);
+        for (uint32_t b = 0; b < bandCount; b++) {
+            uint32_t bandSize;
+            memcpy(&bandSize, in + LOSSLESS_HEADER_SIZE + b * 4, 4);
+            bandOffsets[b] = offset;
+            offset += bandSize;
+            if (offset > size) return -1;
+        }
+        bandOffsets[bandCount] = offset;
+        residualRows.resize((size_t)bandCount * lossless::GroupsPerRow(width) * lossless::GROUP_BYTES);
+
+        std::atomic<bool> ok(true);
+        auto decode = [&](uint32_t begin, uint32_t end) {
+            for (uint32_t b = begin; b < end; b++) {
+                if (!DecodeBand(b, in + bandOffsets[b], bandOffsets[b + 1] - bandOffsets[b], useXor)) ok = false;
+            }
+        };
+        if (jobs) jobs->ParallelFor(bandCount, 1, decode);
+        else decode(0, bandCount);
+
+        // A half-decoded frame is no reference for the next XOR frame
+        hasFrame = ok;
+        return ok ? 0 : -1;
+    }
+
+    const uint8_t* GetFrame() const { return frame.data(); }
+    uint32_t GetWidth() const { return width; }
+    uint32_t GetHeight() const { return height; }
+};
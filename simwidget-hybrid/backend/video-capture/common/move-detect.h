@@ -0,0 +1,437 @@
+// Move Detect - scroll and pan detection for tile deltas
+// Panning the moving map or scrolling a checklist dirties every tile it
+// touches, although the pixels only shifted. MoveDetector finds the dirty
+// tiles (common/tile-delta.h) that are an exact copy of the previous frame
+// at some offset and turns them into "copy rect from (x,y)" commands, so only
+// the tiles left over are encoded.
+//
+// Candidate offsets, tried in this order:
+//   - Desktop Duplication move rects, when DXGI reports them (passed in)
+//   - the offsets that moved tiles in the previous frame (scrolls continue)
+//   - a block-matching search: textured 16x16 probe blocks from dirty tiles
+//     are looked up in the previous frame within +-range pixels, nearest
+//     offset first, by sum of absolute differences (SSE2/AVX2 psadbw)
+// Only exact matches (SAD 0) are kept, and every tile is compared pixel for
+// pixel before it is sent as a move: applying the moves and then the residual
+// tiles rebuilds the frame exactly. Lossy clients copy their own decoded
+// pixels, which is what they would have shown anyway.
+//
+// The detector keeps a packed copy of the previous frame, refreshed from the
+// dirty tiles of each frame, so it has to see every frame its TileDelta
+// sees. Portable: SSE2/AVX2 kernels on x86, identical scalar path elsewhere.
+//
+// Move payload (in front of the tile delta when WIRE_FLAG_MOVES is set):
+//   [2 bytes move count][2 bytes reserved]
+//   per move: [2 bytes source x][2 bytes source y][2 bytes x][2 bytes y]
+//             [2 bytes width][2 bytes height]
+// Every source rect refers to the previous frame as it was before this
+// frame's moves; ApplyMoves() takes care of overlapping rects.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include "cpu-features.h"
+#include "tile-delta.h"
+
+#define MOVE_HEADER_SIZE 4
+#define MOVE_RECT_SIZE 12
+#define MOVE_SEARCH_RANGE 64  // Default search window, pixels each way
+#define MOVE_BLOCK 16         // Probe block size, pixels
+#define MOVE_PROBES 8         // Probe blocks per frame at most
+#define MOVE_PROBE_MISSES 2   // Stop probing after this many probes find nothing
+#define MOVE_MAX_VECTORS 4    // Distinct offsets tried per frame
+#define MOVE_MIN_TILES 2      // Fewer unexplained dirty tiles than this: don't search
+
+// Content moved right / down by dx / dy pixels: pixel (x, y) of the new
+// frame is pixel (x - dx, y - dy) of the previous one
+struct MoveVector {
+    int32_t dx, dy;
+};
+
+// Copy the dst-sized rect at (srcX, srcY) of the previous frame to dst
+struct MoveRect {
+    int32_t srcX, srcY;
+    TileRect dst;
+};
+
+namespace movesad {
+
+inline uint32_t SadRowScalar(const uint8_t* a, const uint8_t* b, uint32_t bytes) {
+    uint32_t sum = 0;
+    for (uint32_t i = 0; i < bytes; i++) sum += (uint32_t)abs((int)a[i] - (int)b[i]);
+    return sum;
+}
+
+#ifdef SIMD_X86
+// bytes must be a multiple of 16
+inline uint32_t SadRowSSE2(const uint8_t* a, const uint8_t* b, uint32_t bytes) {
+    __m128i sum = _mm_setzero_si128();
+    for (uint32_t i = 0; i < bytes; i += 16) {
+        __m128i va = _mm_loadu_si128((const __m128i*)(a + i));
+        __m128i vb = _mm_loadu_si128((const __m128i*)(b + i));
+        sum = _mm_add_epi64(sum, _mm_sad_epu8(va, vb));
+    }
+    return (uint32_t)(_mm_cvtsi128_si32(sum) + _mm_cvtsi128_si32(_mm_srli_si128(sum, 8)));
+}
+
+// bytes must be a multiple of 32
+SIMD_TARGET_AVX2
+inline uint32_t SadRowAVX2(const uint8_t* a, const uint8_t* b, uint32_t bytes) {
+    __m256i sum = _mm256_setzero_si256();
+    for (uint32_t i = 0; i < bytes; i += 32) {
+        __m256i va = _mm256_loadu_si256((const __m256i*)(a + i));
+        __m256i vb = _mm256_loadu_si256((const __m256i*)(b + i));
+        sum = _mm256_add_epi64(sum, _mm256_sad_epu8(va, vb));
+    }
+    __m128i half = _mm_add_epi64(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+    return (uint32_t)(_mm_cvtsi128_si32(half) + _mm_cvtsi128_si32(_mm_srli_si128(half, 8)));
+}
+#endif
+
+inline uint32_t SadRow(const uint8_t* a, const uint8_t* b, uint32_t bytes, SimdLevel level) {
+#ifdef SIMD_X86
+    if (level == SIMD_AVX2 && bytes % 32 == 0) return SadRowAVX2(a, b, bytes);
+    if (level != SIMD_SCALAR && bytes % 16 == 0) return SadRowSSE2(a, b, bytes);
+#endif
+    (void)level;
+    return SadRowScalar(a, b, bytes);
+}
+
+// SAD of a MOVE_BLOCK x MOVE_BLOCK BGRA block against another, giving up
+// once the sum passes limit (returns something above limit then)
+inline uint32_t BlockSad(const uint8_t* a, size_t strideA, const uint8_t* b, size_t strideB, uint32_t limit,
+                         SimdLevel level) {
+    uint32_t sum = 0;
+    for (int y = 0; y < MOVE_BLOCK; y++) {
+        sum += SadRow(a + (size_t)y * strideA, b + (size_t)y * strideB, MOVE_BLOCK * 4, level);
+        if (sum > limit) break;
+    }
+    return sum;
+}
+
+}  // namespace movesad
+
+// Write moves as the move payload. Returns bytes written
+// (MOVE_HEADER_SIZE + count * MOVE_RECT_SIZE).
+inline size_t WriteMoves(const MoveRect* moves, int count, uint8_t* out) {
+    uint16_t header[2] = { (uint16_t)count, 0 };
+    memcpy(out, header, MOVE_HEADER_SIZE);
+    uint8_t* p = out + MOVE_HEADER_SIZE;
+    for (int i = 0; i < count; i++) {
+        const MoveRect& m = moves[i];
+        uint16_t fields[6] = {
+            (uint16_t)m.srcX, (uint16_t)m.srcY, (uint16_t)m.dst.left, (uint16_t)m.dst.top,
+            (uint16_t)(m.dst.right - m.dst.left), (uint16_t)(m.dst.bottom - m.dst.top)
+        };
+        memcpy(p, fields, MOVE_RECT_SIZE);
+        p += MOVE_RECT_SIZE;
+    }
+    return p - out;
+}
+
+// Bytes of the move payload at the start of payload, or 0 if it is truncated
+inline size_t ReadMovesSize(const uint8_t* payload, size_t size) {
+    if (size < MOVE_HEADER_SIZE) return 0;
+    uint16_t count;
+    memcpy(&count, payload, 2);
+    size_t needed = MOVE_HEADER_SIZE + (size_t)count * MOVE_RECT_SIZE;
+    return needed <= size ? needed : 0;
+}
+
+// Apply a move payload (as written by WriteMoves) to the previous frame in
+// place. *used receives its size, so the tile delta follows at payload +
+// *used. Returns false if it is malformed or a rect leaves the frame.
+inline bool ApplyMoves(const uint8_t* payload, size_t size, uint8_t* frame, uint32_t width, uint32_t height,
+                       uint32_t stride, size_t* used) {
+    size_t movesSize = ReadMovesSize(payload, size);
+    if (movesSize == 0) return false;
+    int count = (int)((movesSize - MOVE_HEADER_SIZE) / MOVE_RECT_SIZE);
+
+    // Every source is read before any destination is written
+    std::vector<uint8_t> sources;
+    for (int pass = 0; pass < 2; pass++) {
+        size_t offset = 0;
+        for (int i = 0; i < count; i++) {
+            uint16_t f[6];
+            memcpy(f, payload + MOVE_HEADER_SIZE + (size_t)i * MOVE_RECT_SIZE, MOVE_RECT_SIZE);
+            uint32_t sx = f[0], sy = f[1], dx = f[2], dy = f[3], w = f[4], h = f[5];
+            if (sx + w > width || sy + h > height || dx + w > width || dy + h > height) return false;
+            size_t rowBytes = (size_t)w * 4;
+            if (pass == 0) sources.resize(sources.size() + rowBytes * h);
+            for (uint32_t row = 0; row < h; row++) {
+                uint8_t* src = frame + (size_t)(sy + row) * stride + (size_t)sx * 4;
+                uint8_t* dst = frame + (size_t)(dy + row) * stride + (size_t)dx * 4;
+                if (pass == 0) memcpy(&sources[offset], src, rowBytes);
+                else memcpy(dst, &sources[offset], rowBytes);
+                offset += rowBytes;
+            }
+        }
+    }
+    *used = movesSize;
+    return true;
+}
+
+// Finds moved tiles in one stream of frames. Initialize for the frame size,
+// then Detect() after every TileDelta::Detect() on the same frames.
+class MoveDetector {
+private:
+    uint32_t width = 0, height = 0;
+    std::vector<uint8_t> reference;     // Previous frame, packed BGRA
+    bool haveReference = false;
+    int range = MOVE_SEARCH_RANGE;
+    SimdLevel simd = GetSimdLevel();
+    std::vector<MoveVector> offsets;    // Every offset within range, nearest first
+    std::vector<MoveVector> vectors;    // This frame's candidates
+    std::vector<MoveVector> lastVectors; // Offsets that moved tiles last frame
+    std::vector<int> tileVector;        // Per tile: index into vectors, -1 = not moved
+    std::vector<uint8_t> wasDirty;      // Dirty map before moved tiles were taken out
+    std::vector<int> open;              // Dirty tiles no move explains yet
+    std::vector<int> probeTiles;
+    std::vector<MoveRect> moves;
+    int movedTiles = 0;
+
+    void BuildOffsets() {
+        offsets.clear();
+        for (int dy = -range; dy <= range; dy++) {
+            for (int dx = -range; dx <= range; dx++) {
+                if (dx || dy) offsets.push_back({ dx, dy });
+            }
+        }
+        // Nearest first (Chebyshev rings), straight scrolls first within a ring
+        std::stable_sort(offsets.begin(), offsets.end(), [](const MoveVector& a, const MoveVector& b) {
+            int ra = std::max(abs(a.dx), abs(a.dy)), rb = std::max(abs(b.dx), abs(b.dy));
+            if (ra != rb) return ra < rb;
+            return abs(a.dx) + abs(a.dy) < abs(b.dx) + abs(b.dy);
+        });
+    }
+
+    // Index of v among this frame's candidates, adding it if there is room;
+    // -1 for no move or a full list
+    int AddVector(MoveVector v) {
+        if (v.dx == 0 && v.dy == 0) return -1;
+        for (size_t i = 0; i < vectors.size(); i++) {
+            if (vectors[i].dx == v.dx && vectors[i].dy == v.dy) return (int)i;
+        }
+        if ((int)vectors.size() >= MOVE_MAX_VECTORS) return -1;
+        vectors.push_back(v);
+        return (int)vectors.size() - 1;
+    }
+
+    // Is tile t of the new frame the previous frame shifted by v?
+    bool TileMatches(const TileDelta& tiles, int t, const uint8_t* pixels, uint32_t stride, MoveVector v) const {
+        uint32_t x, y, w, h;
+        tiles.GetTileRect(t, &x, &y, &w, &h);
+        int64_t sx = (int64_t)x - v.dx, sy = (int64_t)y - v.dy;
+        if (sx < 0 || sy < 0 || sx + w > width || sy + h > height) return false;
+        size_t refStride = (size_t)width * 4;
+        for (uint32_t row = 0; row < h; row++) {
+            const uint8_t* cur = pixels + (size_t)(y + row) * stride + (size_t)x * 4;
+            const uint8_t* ref = &reference[(size_t)(sy + row) * refStride + (size_t)sx * 4];
+            if (memcmp(cur, ref, (size_t)w * 4) != 0) return false;
+        }
+        return true;
+    }
+
+    // Try vectors [first, end) on the open tiles; matched tiles leave open
+    void MatchOpenTiles(const TileDelta& tiles, const uint8_t* pixels, uint32_t stride, int first) {
+        size_t kept = 0;
+        for (size_t i = 0; i < open.size(); i++) {
+            int t = open[i];
+            for (int v = first; v < (int)vectors.size(); v++) {
+                if (TileMatches(tiles, t, pixels, stride, vectors[v])) {
+                    tileVector[t] = v;
+                    break;
+                }
+            }
+            if (tileVector[t] < 0) open[kept++] = t;
+        }
+        open.resize(kept);
+    }
+
+    // A block with no detail matches anywhere - useless as a probe
+    bool HasTexture(const uint8_t* block, uint32_t stride) const {
+        uint32_t across = 0, down = 0;
+        for (int y = 0; y < MOVE_BLOCK && (!across || !down); y++) {
+            const uint8_t* row = block + (size_t)y * stride;
+            across += movesad::SadRowScalar(row, row + 4, (MOVE_BLOCK - 1) * 4);
+            if (y + 1 < MOVE_BLOCK) down += movesad::SadRowScalar(row, row + stride, MOVE_BLOCK * 4);
+        }
+        return across && down;
+    }
+
+    // Search the previous frame for the probe block in the middle of tile t.
+    // Returns false if it is untextured or found nowhere within range.
+    bool Probe(const TileDelta& tiles, int t, const uint8_t* pixels, uint32_t stride, MoveVector* found) const {
+        uint32_t x, y, w, h;
+        tiles.GetTileRect(t, &x, &y, &w, &h);
+        if (w < MOVE_BLOCK + 1 || h < MOVE_BLOCK + 1) return false;
+        int32_t bx = (int32_t)(x + (w - MOVE_BLOCK) / 2), by = (int32_t)(y + (h - MOVE_BLOCK) / 2);
+        const uint8_t* block = pixels + (size_t)by * stride + (size_t)bx * 4;
+        if (!HasTexture(block, stride)) return false;
+
+        size_t refStride = (size_t)width * 4;
+        for (const MoveVector& o : offsets) {
+            int32_t sx = bx - o.dx, sy = by - o.dy;
+            if (sx < 0 || sy < 0 || sx + MOVE_BLOCK > (int32_t)width || sy + MOVE_BLOCK > (int32_t)height) continue;
+            const uint8_t* ref = &reference[(size_t)sy * refStride + (size_t)sx * 4];
+            if (movesad::BlockSad(block, stride, ref, refStride, 0, simd) == 0) {
+                *found = o;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Moved tiles to rects: runs of tiles with one vector along each tile
+    // row, stacked with an identical run right above
+    void BuildRects(const TileDelta& tiles) {
+        moves.clear();
+        int tilesX = tiles.GetTilesX(), tilesY = tiles.GetTilesY();
+        for (int ty = 0; ty < tilesY; ty++) {
+            for (int tx = 0; tx < tilesX; ) {
+                int v = tileVector[ty * tilesX + tx];
+                if (v < 0) {
+                    tx++;
+                    continue;
+                }
+                int end = tx + 1;
+                while (end < tilesX && tileVector[ty * tilesX + end] == v) end++;
+
+                uint32_t x0, y0, x1, y1, w, h;
+                tiles.GetTileRect(ty * tilesX + tx, &x0, &y0, &w, &h);
+                tiles.GetTileRect(ty * tilesX + end - 1, &x1, &y1, &w, &h);
+                TileRect dst = { (int32_t)x0, (int32_t)y0, (int32_t)(x1 + w), (int32_t)(y0 + h) };
+                MoveRect* above = nullptr;
+                for (MoveRect& m : moves) {
+                    if (m.dst.bottom == dst.top && m.dst.left == dst.left && m.dst.right == dst.right &&
+                        m.dst.left - m.srcX == vectors[v].dx && m.dst.top - m.srcY == vectors[v].dy) {
+                        above = &m;
+                        break;
+                    }
+                }
+                if (above) {
+                    above->dst.bottom = dst.bottom;
+                } else {
+                    moves.push_back({ dst.left - vectors[v].dx, dst.top - vectors[v].dy, dst });
+                }
+                tx = end;
+            }
+        }
+    }
+
+public:
+    bool Initialize(uint32_t frameWidth, uint32_t frameHeight) {
+        if (frameWidth == 0 || frameHeight == 0 || frameWidth > 0xFFFF || frameHeight > 0xFFFF) return false;
+        width = frameWidth;
+        height = frameHeight;
+        reference.assign((size_t)width * height * 4, 0);
+        haveReference = false;
+        lastVectors.clear();
+        moves.clear();
+        movedTiles = 0;
+        if (offsets.empty()) BuildOffsets();
+        return true;
+    }
+
+    // Largest shift the block search looks for, pixels each way (DXGI move
+    // rects and last frame's offsets are tried whatever their size)
+    void SetSearchRange(int pixels) {
+        range = pixels < 1 ? 1 : pixels;
+        BuildOffsets();
+    }
+
+    void SetSimdLevel(SimdLevel level) { simd = level; }
+
+    // Forget the previous frame; no moves until every tile was dirty once
+    void Reset() { haveReference = false; }
+
+    // Take the tiles of pixels (the frame tiles->Detect() just ran on) that
+    // are the previous frame shifted out of the dirty map, and describe them
+    // as moves (GetMoves()). hints are DXGI's move offsets, if any. With
+    // search false it only keeps the previous frame up to date (e.g. while a
+    // client can't apply moves). Returns the number of tiles moved.
+    int Detect(const uint8_t* pixels, uint32_t stride, TileDelta* tiles, const MoveVector* hints, int hintCount,
+               bool search) {
+        int tileCount = tiles->GetTileCount();
+        moves.clear();
+        vectors.clear();
+        movedTiles = 0;
+        uint32_t tileSize = tiles->GetTileSize();
+        if (width == 0 || (uint32_t)tiles->GetTilesX() != (width + tileSize - 1) / tileSize ||
+            (uint32_t)tiles->GetTilesY() != (height + tileSize - 1) / tileSize) return 0;
+
+        wasDirty.assign(tiles->GetDirtyMap(), tiles->GetDirtyMap() + tileCount);
+        bool full = tiles->GetDirtyCount() == tileCount;
+        if (search && haveReference) {
+            tileVector.assign(tileCount, -1);
+            open.clear();
+            for (int t = 0; t < tileCount; t++) {
+                if (wasDirty[t]) open.push_back(t);
+            }
+
+            if ((int)open.size() >= MOVE_MIN_TILES) {
+                for (int i = 0; i < hintCount; i++) AddVector(hints[i]);
+                for (const MoveVector& v : lastVectors) AddVector(v);
+                MatchOpenTiles(*tiles, pixels, stride, 0);
+
+                // Nothing known explains the rest: look for new offsets
+                int misses = 0;
+                int probes = std::min((int)open.size(), MOVE_PROBES);
+                probeTiles.clear();
+                for (int i = 0; i < probes; i++) probeTiles.push_back(open[(size_t)i * open.size() / probes]);
+                for (int i = 0; i < probes && (int)open.size() >= MOVE_MIN_TILES && misses < MOVE_PROBE_MISSES; i++) {
+                    int t = probeTiles[i];
+                    if (tileVector[t] >= 0) continue;  // Explained by an earlier probe's offset
+                    MoveVector v;
+                    int first = (int)vectors.size();
+                    if (!Probe(*tiles, t, pixels, stride, &v) || AddVector(v) < first) {
+                        misses++;
+                        continue;
+                    }
+                    MatchOpenTiles(*tiles, pixels, stride, first);
+                }
+            }
+
+            lastVectors.clear();
+            std::vector<uint8_t> used(vectors.size(), 0);
+            for (int t = 0; t < tileCount; t++) {
+                if (tileVector[t] < 0) continue;
+                tiles->ClearDirty(t);
+                used[tileVector[t]] = 1;
+                movedTiles++;
+            }
+            for (size_t v = 0; v < vectors.size(); v++) {
+                if (used[v]) lastVectors.push_back(vectors[v]);
+            }
+            if (movedTiles) BuildRects(*tiles);
+        }
+
+        // The new frame becomes the reference: only its dirty tiles differ
+        size_t refStride = (size_t)width * 4;
+        for (int t = 0; t < tileCount; t++) {
+            if (!wasDirty[t]) continue;
+            uint32_t x, y, w, h;
+            tiles->GetTileRect(t, &x, &y, &w, &h);
+            for (uint32_t row = 0; row < h; row++) {
+                memcpy(&reference[(size_t)(y + row) * refStride + (size_t)x * 4],
+                    pixels + (size_t)(y + row) * stride + (size_t)x * 4, (size_t)w * 4);
+            }
+        }
+        if (full) haveReference = true;
+        return movedTiles;
+    }
+
+    const MoveRect* GetMoves() const { return moves.data(); }
+    int GetMoveCount() const { return (int)moves.size(); }
+    int GetMovedTiles() const { return movedTiles; }
+
+    size_t GetMovesSize() const { return MOVE_HEADER_SIZE + moves.size() * MOVE_RECT_SIZE; }
+    size_t WriteMoves(uint8_t* out) const { return ::WriteMoves(moves.data(), (int)moves.size(), out); }
+
+    // Largest move payload for a tile grid (every tile its own move)
+    static size_t MaxMovesSize(int tileCount) { return MOVE_HEADER_SIZE + (size_t)tileCount * MOVE_RECT_SIZE; }
+};
@@ -0,0 +1,200 @@
+// Socket compatibility layer - Winsock on Windows, BSD sockets elsewhere
+// Lets the portable server code (and its tests) build on Linux.
+//
+// NetSendv() is a gather write (WSASend / sendmsg): a frame's length prefix
+// and payload, or several frames, leave in one call. On Linux it can also
+// send with MSG_ZEROCOPY, where the kernel reads the pages in place instead
+// of copying them into the socket buffer; the caller must then keep the
+// buffers untouched until NetReadZeroCopyCompletions() reports the call done.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "ws2_32.lib")
+
+typedef WSAPOLLFD NetPollFd;
+typedef WSABUF NetBuffer;
+#define NET_SEND_FLAGS 0
+#define NET_HAS_ZEROCOPY 0
+
+inline int NetPoll(NetPollFd* fds, unsigned count, int timeoutMs) {
+    return WSAPoll(fds, count, timeoutMs);
+}
+inline int NetLastError() { return WSAGetLastError(); }
+inline bool NetWouldBlock(int err) { return err == WSAEWOULDBLOCK; }
+
+inline bool NetStartup() {
+    WSADATA wsaData;
+    return WSAStartup(MAKEWORD(2, 2), &wsaData) == 0;
+}
+inline void NetCleanup() { WSACleanup(); }
+
+inline bool NetSetNonBlocking(SOCKET s) {
+    u_long mode = 1;
+    return ioctlsocket(s, FIONBIO, &mode) == 0;
+}
+
+inline void NetSetBuffer(NetBuffer* b, const void* data, size_t len) {
+    b->buf = (char*)data;
+    b->len = (ULONG)len;
+}
+
+// Bytes written, or -1 (see NetLastError()). Zero-copy is not available
+// through non-overlapped WSASend, so *usedZeroCopy is always false.
+inline int NetSendv(SOCKET s, NetBuffer* buffers, int count, bool zeroCopy, bool* usedZeroCopy) {
+    (void)zeroCopy;
+    *usedZeroCopy = false;
+    DWORD sent = 0;
+    if (WSASend(s, buffers, (DWORD)count, &sent, 0, nullptr, nullptr) == SOCKET_ERROR) return -1;
+    return (int)sent;
+}
+
+inline bool NetEnableZeroCopy(SOCKET s) { (void)s; return false; }
+inline int NetReadZeroCopyCompletions(SOCKET s, uint32_t* doneThrough, bool* copied) {
+    (void)s; (void)doneThrough; (void)copied;
+    return 0;
+}
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/errqueue.h>
+#endif
+
+#if defined(__linux__) && defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY) && defined(SO_EE_ORIGIN_ZEROCOPY)
+#define NET_HAS_ZEROCOPY 1
+#else
+#define NET_HAS_ZEROCOPY 0
+#endif
+
+typedef int SOCKET;
+#define INVALID_SOCKET (-1)
+#define SOCKET_ERROR (-1)
+
+typedef struct pollfd NetPollFd;
+typedef struct iovec NetBuffer;
+#define NET_SEND_FLAGS MSG_NOSIGNAL  // Report EPIPE instead of raising SIGPIPE
+
+inline int closesocket(SOCKET s) { return close(s); }
+inline int NetPoll(NetPollFd* fds, unsigned count, int timeoutMs) {
+    return poll(fds, count, timeoutMs);
+}
+inline int NetLastError() { return errno; }
+inline bool NetWouldBlock(int err) { return err == EAGAIN || err == EWOULDBLOCK; }
+
+inline bool NetStartup() { return true; }
+inline void NetCleanup() {}
+
+inline bool NetSetNonBlocking(SOCKET s) {
+    int flags = fcntl(s, F_GETFL, 0);
+    return flags >= 0 && fcntl(s, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+inline void NetSetBuffer(NetBuffer* b, const void* data, size_t len) {
+    b->iov_base = (void*)data;
+    b->iov_len = len;
+}
+
+// Bytes written, or -1 (see NetLastError()). With zeroCopy the call uses
+// MSG_ZEROCOPY when the socket allows it; *usedZeroCopy says whether it did
+// (every such call gets the next completion id, counting from 0).
+inline int NetSendv(SOCKET s, NetBuffer* buffers, int count, bool zeroCopy, bool* usedZeroCopy) {
+    msghdr msg = {};
+    msg.msg_iov = buffers;
+    msg.msg_iovlen = count;
+    *usedZeroCopy = false;
+#if NET_HAS_ZEROCOPY
+    if (zeroCopy) {
+        ssize_t sent = sendmsg(s, &msg, NET_SEND_FLAGS | MSG_ZEROCOPY);
+        if (sent >= 0) {
+            *usedZeroCopy = true;
+            return (int)sent;
+        }
+        if (errno != ENOBUFS) return -1;
+        // Out of pinned-page budget: this call copies
+    }
+#else
+    (void)zeroCopy;
+#endif
+    return (int)sendmsg(s, &msg, NET_SEND_FLAGS);
+}
+
+inline bool NetEnableZeroCopy(SOCKET s) {
+#if NET_HAS_ZEROCOPY
+    int one = 1;
+    return setsockopt(s, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) == 0;
+#else
+    (void)s;
+    return false;
+#endif
+}
+
+// Drain the socket's error queue. Each zero-copy completion raises
+// *doneThrough to one past the highest finished call id; *copied is set if
+// the kernel fell back to copying (loopback always does). Returns the
+// number of completions read - 0 means the error queue held none, so a
+// POLLERR was a real socket error.
+inline int NetReadZeroCopyCompletions(SOCKET s, uint32_t* doneThrough, bool* copied) {
+    int completions = 0;
+#if NET_HAS_ZEROCOPY
+    while (true) {
+        char control[128];
+        msghdr msg = {};
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if (recvmsg(s, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) break;
+        for (cmsghdr* cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+            sock_extended_err* err = (sock_extended_err*)CMSG_DATA(cm);
+            if (err->ee_errno != 0 || err->ee_origin != SO_EE_ORIGIN_ZEROCOPY) continue;
+            // [ee_info, ee_data] finished; ids wrap at 2^32
+            if ((int32_t)(err->ee_data + 1 - *doneThrough) > 0) *doneThrough = err->ee_data + 1;
+            if (err->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) *copied = true;
+            completions++;
+        }
+    }
+#else
+    (void)s; (void)doneThrough; (void)copied;
+#endif
+    return completions;
+}
+#endif
+
+inline void NetSetNoDelay(SOCKET s) {
+    int flag = 1;
+    setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (const char*)&flag, sizeof(flag));
+}
+
+// Create a listening TCP socket on all interfaces. Returns INVALID_SOCKET on failure.
+inline SOCKET NetListen(int port, int backlog) {
+    SOCKET s = socket(AF_INET, SOCK_STREAM, 0);
+    if (s == INVALID_SOCKET) return INVALID_SOCKET;
+
+    int reuse = 1;
+    setsockopt(s, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons((unsigned short)port);
+
+    if (bind(s, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(s, backlog) != 0) {
+        closesocket(s);
+        return INVALID_SOCKET;
+    }
+    return s;
+}
@@ -0,0 +1,412 @@
+// Pixel Pipeline - one fused pass from a mapped frame to encoder input
+// The capture path used to walk every frame once per transform: strip the
+// row pitch (or scale), hash the delta tiles, then convert to YCbCr inside
+// the encoder - three or four trips over 8-33 MB. PixelPipeline does all of
+// it in a single pass over bands of output rows: each source row is read
+// once, and the output row is hashed and converted while it is still in L1.
+// Only what the caller asks for is written (scaled BGRA, YCbCr planes or
+// both); without BGRA the scaled row never leaves a two-row scratch buffer.
+// Cropping is the caller's: pass the pointer to the region's first pixel
+// and the source pitch.
+//
+// Every combination of stages - filter x keep BGRA x tile hash x chroma
+// layout x SIMD level - is its own template instance, picked once per
+// frame, so the row loop has no stage checks left in it. Output is
+// identical to the separate passes (FrameScaler::Scale, TileDelta::Detect,
+// ConvertBgraToYCbCr plus JPEG MCU padding); tests/test-pixel-pipeline.cpp
+// checks every combination against them.
+//
+// Bands are one tile row tall while hashing (a tile never spans two bands)
+// and PIPELINE_BAND_ROWS otherwise, spread over an optional JobSystem. Each
+// band has its own scratch, so Run() does not allocate once the sizes
+// settle.
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include "color-convert.h"
+#include "cpu-features.h"
+#include "frame-scaler.h"
+#include "job-system.h"
+#include "tile-delta.h"
+
+#define PIPELINE_BAND_ROWS 16  // Output rows per job when not hashing tiles
+#define PIPELINE_NO_CHROMA -1  // Template argument: no YCbCr output
+
+// What one pass produces. Leave a part unset to skip its stage.
+struct PixelTargets {
+    uint8_t* bgra = nullptr;        // Scaled BGRA, pitch stripped (nullptr: not kept)
+    size_t bgraStride = 0;
+    TileDelta* tiles = nullptr;     // Hash tiles into this dirty map; grid sized for the output
+    YCbCrPlanes planes = {};        // YCbCr output (planes.y == nullptr: not converted)
+    ChromaSubsampling subsampling = CHROMA_420;
+    uint32_t paddedWidth = 0;       // Replicate the planes' last column / row out to this
+    uint32_t paddedHeight = 0;      // size, e.g. whole JPEG MCUs (0 = no padding)
+};
+
+namespace pixelpass {
+
+// Row kernels of one SIMD level behind a common interface
+template <int Simd>
+struct Kernels {
+    static void Box2(const uint8_t* row0, const uint8_t* row1, uint32_t width, uint8_t* dst) {
+        scaler::Box2RowScalar(row0, row1, 0, width, dst);
+    }
+    static void Box4(const uint8_t* const rows[4], uint32_t width, uint8_t* dst) {
+        scaler::Box4RowScalar(rows, 0, width, dst);
+    }
+    static void Bilinear(const uint8_t* row0, const uint8_t* row1, const scaler::Tap* taps, int fy,
+                         uint32_t width, int16_t* h0, int16_t* h1, uint8_t* dst) {
+        scaler::HorizontalScalar(row0, taps, 0, width, h0);
+        scaler::HorizontalScalar(row1, taps, 0, width, h1);
+        scaler::VerticalScalar(h0, h1, fy, 0, width, dst);
+    }
+    static void Hash(TileHashState& state, const uint8_t* row) {
+        tilehash::AccumulateRowScalar(state.acc, row, state.stripes, tilehash::Keys());
+        state.RowTail(row);
+    }
+    static void Convert(const uint8_t* row0, const uint8_t* row1, uint32_t width, ChromaSubsampling s,
+                        uint8_t* y0, uint8_t* y1, uint8_t* cb, uint8_t* cr) {
+        colorconv::ConvertRowScalar(row0, row1, 0, width, s, y0, y1, cb, cr);
+    }
+};
+
+#ifdef SIMD_X86
+template <>
+struct Kernels<SIMD_SSE2> {
+    static void Box2(const uint8_t* row0, const uint8_t* row1, uint32_t width, uint8_t* dst) {
+        scaler::Box2RowSSE2(row0, row1, width, dst);
+    }
+    static void Box4(const uint8_t* const rows[4], uint32_t width, uint8_t* dst) {
+        scaler::Box4RowSSE2(rows, width, dst);
+    }
+    static void Bilinear(const uint8_t* row0, const uint8_t* row1, const scaler::Tap* taps, int fy,
+                         uint32_t width, int16_t* h0, int16_t* h1, uint8_t* dst) {
+        scaler::HorizontalSSE2(row0, taps, width, h0);
+        scaler::HorizontalSSE2(row1, taps, width, h1);
+        scaler::VerticalSSE2(h0, h1, fy, width, dst);
+    }
+    static void Hash(TileHashState& state, const uint8_t* row) {
+        tilehash::AccumulateRowSSE2(state.acc, row, state.stripes, tilehash::Keys());
+        state.RowTail(row);
+    }
+    static void Convert(const uint8_t* row0, const uint8_t* row1, uint32_t width, ChromaSubsampling s,
+                        uint8_t* y0, uint8_t* y1, uint8_t* cb, uint8_t* cr) {
+        colorconv::ConvertRowSSE2(row0, row1, width, s, y0, y1, cb, cr);
+    }
+};
+
+// No AVX2 bilinear kernel - the scaler uses SSE2 there too
+template <>
+struct Kernels<SIMD_AVX2> {
+    static void Box2(const uint8_t* row0, const uint8_t* row1, uint32_t width, uint8_t* dst) {
+        scaler::Box2RowAVX2(row0, row1, width, dst);
+    }
+    static void Box4(const uint8_t* const rows[4], uint32_t width, uint8_t* dst) {
+        scaler::Box4RowAVX2(rows, width, dst);
+    }
+    static void Bilinear(const uint8_t* row0, const uint8_t* row1, const scaler::Tap* taps, int fy,
+                         uint32_t width, int16_t* h0, int16_t* h1, uint8_t* dst) {
+        Kernels<SIMD_SSE2>::Bilinear(row0, row1, taps, fy, width, h0, h1, dst);
+    }
+    static void Hash(TileHashState& state, const uint8_t* row) {
+        tilehash::AccumulateRowAVX2(state.acc, row, state.stripes, tilehash::Keys());
+        state.RowTail(row);
+    }
+    static void Convert(const uint8_t* row0, const uint8_t* row1, uint32_t width, ChromaSubsampling s,
+                        uint8_t* y0, uint8_t* y1, uint8_t* cb, uint8_t* cr) {
+        colorconv::ConvertRowAVX2(row0, row1, width, s, y0, y1, cb, cr);
+    }
+};
+#endif  // SIMD_X86
+
+// Everything a band needs for one Run(), shared read-only by all bands
+struct Pass {
+    const uint8_t* src;
+    size_t srcStride;
+    PixelTargets targets;
+    uint32_t width, height;         // Output size
+    const scaler::Tap* xTaps;
+    const scaler::Tap* yTaps;
+    uint32_t tileSize;
+    int tilesX;
+    const uint8_t* needed;          // TileDelta::PrepareDetect() (nullptr = every tile)
+    uint64_t* hashes;               // One per tile, written for the tiles hashed
+    uint32_t chromaWidth;           // Converted chroma columns, then padding out to
+    uint32_t paddedChromaWidth;
+};
+
+// Per-band scratch, disjoint between bands
+struct BandScratch {
+    uint8_t* rows;                  // Two output rows when BGRA is not kept
+    int16_t* h0;                    // Bilinear horizontal passes
+    int16_t* h1;
+    TileHashState* states;          // One per tile column
+    int* columns;                   // Tile columns hashed in this band
+};
+
+template <int Simd, ScaleFilter Filter>
+inline void ScaleRow(const Pass& p, uint32_t y, uint8_t* out, const BandScratch& s) {
+    typedef Kernels<Simd> K;
+    if (Filter == SCALE_COPY) {
+        memcpy(out, p.src + (size_t)y * p.srcStride, (size_t)p.width * 4);
+    } else if (Filter == SCALE_BOX2) {
+        const uint8_t* row0 = p.src + (size_t)y * 2 * p.srcStride;
+        K::Box2(row0, row0 + p.srcStride, p.width, out);
+    } else if (Filter == SCALE_BOX4) {
+        const uint8_t* rows[4];
+        for (int r = 0; r < 4; r++) rows[r] = p.src + ((size_t)y * 4 + r) * p.srcStride;
+        K::Box4(rows, p.width, out);
+    } else {
+        const scaler::Tap& t = p.yTaps[y];
+        K::Bilinear(p.src + (size_t)t.i0 * p.srcStride, p.src + (size_t)t.i1 * p.srcStride, p.xTaps, t.f,
+            p.width, s.h0, s.h1, out);
+    }
+}
+
+// Replicate the last converted column of a plane row out to the padding
+inline void PadRow(uint8_t* row, uint32_t width, uint32_t padded) {
+    if (padded > width) memset(row + width, row[width - 1], padded - width);
+}
+
+// Output rows [begin, end) - a whole tile row when Hash is set; begin is
+// even for 4:2:0, so row pairs never straddle two bands
+template <int Simd, ScaleFilter Filter, bool KeepBgra, bool Hash, int Chroma>
+void RunBand(const Pass& p, uint32_t begin, uint32_t end, const BandScratch& s) {
+    typedef Kernels<Simd> K;
+    const PixelTargets& t = p.targets;
+    const ChromaSubsampling subsampling = (ChromaSubsampling)(Chroma < 0 ? 0 : Chroma);
+
+    int tileRow = 0, columnCount = 0;
+    if (Hash) {
+        tileRow = (int)(begin / p.tileSize);
+        uint32_t tileHeight = p.height - begin < p.tileSize ? p.height - begin : p.tileSize;
+        for (int tx = 0; tx < p.tilesX; tx++) {
+            int index = tileRow * p.tilesX + tx;
+            if (p.needed && !p.needed[index]) continue;
+            uint32_t x = (uint32_t)tx * p.tileSize;
+            s.states[tx].Begin(p.width - x < p.tileSize ? p.width - x : p.tileSize, tileHeight);
+            s.columns[columnCount++] = tx;
+        }
+    }
+
+    const uint8_t* pending = nullptr;   // 4:2:0: even row waiting for its pair
+    for (uint32_t y = begin; y < end; y++) {
+        const uint8_t* row;
+        if (Filter == SCALE_COPY && !KeepBgra) {
+            row = p.src + (size_t)y * p.srcStride;  // Straight from the mapped frame
+        } else {
+            uint8_t* out = KeepBgra ? t.bgra + (size_t)y * t.bgraStride : s.rows + (size_t)(y & 1) * p.width * 4;
+            ScaleRow<Simd, Filter>(p, y, out, s);
+            row = out;
+        }
+
+        if (Hash) {
+            for (int c = 0; c < columnCount; c++) {
+                int tx = s.columns[c];
+                K::Hash(s.states[tx], row + (size_t)tx * p.tileSize * 4);
+            }
+        }
+
+        if (Chroma == CHROMA_420) {
+            bool last = y + 1 == p.height;
+            if (!(y & 1) && !last) {
+                pending = row;
+                continue;
+            }
+            // Odd row, or the unpaired last row of an odd height
+            uint32_t top = y & ~1u;
+            uint8_t* y0 = t.planes.y + (size_t)top * t.planes.yStride;
+            uint8_t* y1 = (y & 1) ? y0 + t.planes.yStride : nullptr;
+            uint8_t* cb = t.planes.cb + (size_t)(top / 2) * t.planes.cStride;
+            uint8_t* cr = t.planes.cr + (size_t)(top / 2) * t.planes.cStride;
+            K::Convert((y & 1) ? pending : row, row, p.width, subsampling, y0, y1, cb, cr);
+            PadRow(y0, p.width, t.paddedWidth);
+            if (y1) PadRow(y1, p.width, t.paddedWidth);
+            PadRow(cb, p.chromaWidth, p.paddedChromaWidth);
+            PadRow(cr, p.chromaWidth, p.paddedChromaWidth);
+        } else if (Chroma >= 0) {
+            uint8_t* y0 = t.planes.y + (size_t)y * t.planes.yStride;
+            uint8_t* cb = t.planes.cb + (size_t)y * t.planes.cStride;
+            uint8_t* cr = t.planes.cr + (size_t)y * t.planes.cStride;
+            K::Convert(row, nullptr, p.width, subsampling, y0, nullptr, cb, cr);
+            PadRow(y0, p.width, t.paddedWidth);
+            PadRow(cb, p.chromaWidth, p.paddedChromaWidth);
+            PadRow(cr, p.chromaWidth, p.paddedChromaWidth);
+        }
+    }
+
+    if (Hash) {
+        for (int c = 0; c < columnCount; c++) {
+            int tx = s.columns[c];
+            p.hashes[tileRow * p.tilesX + tx] = s.states[tx].Finish();
+        }
+    }
+}
+
+typedef void (*BandFn)(const Pass&, uint32_t, uint32_t, const BandScratch&);
+
+// Instance for a stage combination, one template level per stage
+template <int Simd, ScaleFilter Filter, bool KeepBgra, bool Hash>
+inline BandFn PickChroma(int chroma) {
+    switch (chroma) {
+        case CHROMA_444: return &RunBand<Simd, Filter, KeepBgra, Hash, CHROMA_444>;
+        case CHROMA_422: return &RunBand<Simd, Filter, KeepBgra, Hash, CHROMA_422>;
+        case CHROMA_420: return &RunBand<Simd, Filter, KeepBgra, Hash, CHROMA_420>;
+        default: return &RunBand<Simd, Filter, KeepBgra, Hash, PIPELINE_NO_CHROMA>;
+    }
+}
+
+template <int Simd, ScaleFilter Filter>
+inline BandFn PickStages(bool keepBgra, bool hash, int chroma) {
+    if (keepBgra) return hash ? PickChroma<Simd, Filter, true, true>(chroma) : PickChroma<Simd, Filter, true, false>(chroma);
+    return hash ? PickChroma<Simd, Filter, false, true>(chroma) : PickChroma<Simd, Filter, false, false>(chroma);
+}
+
+template <int Simd>
+inline BandFn PickFilter(ScaleFilter filter, bool keepBgra, bool hash, int chroma) {
+    switch (filter) {
+        case SCALE_BOX2: return PickStages<Simd, SCALE_BOX2>(keepBgra, hash, chroma);
+        case SCALE_BOX4: return PickStages<Simd, SCALE_BOX4>(keepBgra, hash, chroma);
+        case SCALE_BILINEAR: return PickStages<Simd, SCALE_BILINEAR>(keepBgra, hash, chroma);
+        default: return PickStages<Simd, SCALE_COPY>(keepBgra, hash, chroma);
+    }
+}
+
+inline BandFn PickBand(SimdLevel simd, ScaleFilter filter, bool keepBgra, bool hash, int chroma) {
+#ifdef SIMD_X86
+    if (simd == SIMD_AVX2) return PickFilter<SIMD_AVX2>(filter, keepBgra, hash, chroma);
+    if (simd == SIMD_SSE2) return PickFilter<SIMD_SSE2>(filter, keepBgra, hash, chroma);
+#endif
+    (void)simd;
+    return PickFilter<SIMD_SCALAR>(filter, keepBgra, hash, chroma);
+}
+
+}  // namespace pixelpass
+
+// Configure once per source / output size, then Run() every frame with the
+// targets wanted. Not safe to call Run() from two threads at once.
+class PixelPipeline {
+private:
+    FrameScaler scaler;     // Filter choice, bilinear taps, MapRect()
+    JobSystem* jobs = nullptr;
+    std::vector<uint8_t> rowScratch;
+    std::vector<int16_t> horizontalScratch;
+    std::vector<TileHashState> states;
+    std::vector<int> columns;
+    std::vector<uint64_t> hashes;
+
+public:
+    // Same rules as FrameScaler::Configure(): no upscaling, no empty sizes
+    bool Configure(uint32_t srcW, uint32_t srcH, uint32_t dstW, uint32_t dstH) {
+        return scaler.Configure(srcW, srcH, dstW, dstH);
+    }
+
+    void SetJobSystem(JobSystem* pool) { jobs = pool; }
+    void SetSimdLevel(SimdLevel level) { scaler.SetSimdLevel(level); }
+
+    ScaleFilter GetFilter() const { return scaler.GetFilter(); }
+    uint32_t GetWidth() const { return scaler.GetWidth(); }
+    uint32_t GetHeight() const { return scaler.GetHeight(); }
+
+    // See FrameScaler::MapRect()
+    void MapRect(int32_t* left, int32_t* top, int32_t* right, int32_t* bottom) const {
+        scaler.MapRect(left, top, right, bottom);
+    }
+
+    // One pass over src (srcW x srcH BGRA, any pitch) into targets. With
+    // targets.tiles set, hints / hintCount / keyframe mean what they do for
+    // TileDelta::Detect() and the dirty tile count is returned; otherwise 0.
+    // Returns -1 if nothing is configured or the targets don't fit the
+    // output size (tile grid, plane padding, 4:2:0 with odd tiles).
+    int Run(const uint8_t* src, size_t srcStride, const PixelTargets& targets,
+            const TileRect* hints = nullptr, int hintCount = -1, bool keyframe = false) {
+        uint32_t width = scaler.GetWidth(), height = scaler.GetHeight();
+        if (width == 0) return -1;
+        bool keepBgra = targets.bgra != nullptr;
+        bool hash = targets.tiles != nullptr;
+        bool convert = targets.planes.y != nullptr;
+        ChromaSubsampling subsampling = targets.subsampling;
+
+        pixelpass::Pass p;
+        p.src = src;
+        p.srcStride = srcStride;
+        p.targets = targets;
+        p.width = width;
+        p.height = height;
+        p.xTaps = scaler.GetXTaps();
+        p.yTaps = scaler.GetYTaps();
+        p.tileSize = hash ? targets.tiles->GetTileSize() : 0;
+        p.tilesX = hash ? targets.tiles->GetTilesX() : 0;
+        p.needed = nullptr;
+        p.hashes = nullptr;
+        p.chromaWidth = ChromaWidth(width, subsampling);
+        p.paddedChromaWidth = subsampling == CHROMA_444 ? targets.paddedWidth : targets.paddedWidth / 2;
+
+        if (hash) {
+            TileDelta* tiles = targets.tiles;
+            if ((uint32_t)tiles->GetTilesX() != (width + p.tileSize - 1) / p.tileSize ||
+                (uint32_t)tiles->GetTilesY() != (height + p.tileSize - 1) / p.tileSize) return -1;
+            if (convert && subsampling == CHROMA_420 && (p.tileSize & 1)) return -1;
+        }
+        if (convert && ((targets.paddedWidth && targets.paddedWidth < width) ||
+                        (targets.paddedHeight && targets.paddedHeight < height))) return -1;
+
+        uint32_t bandRows = hash ? p.tileSize : PIPELINE_BAND_ROWS;
+        uint32_t bandCount = (height + bandRows - 1) / bandRows;
+        size_t rowBytes = (size_t)width * 4;
+        bool needRows = !keepBgra && GetFilter() != SCALE_COPY;
+        bool needHorizontal = GetFilter() == SCALE_BILINEAR;
+
+        // Per-band scratch; resize() is free once the sizes stop changing
+        rowScratch.resize(needRows ? bandCount * 2 * rowBytes : 0);
+        horizontalScratch.resize(needHorizontal ? bandCount * 2 * rowBytes : 0);
+        states.resize(hash ? (size_t)bandCount * p.tilesX : 0);
+        columns.resize(hash ? (size_t)bandCount * p.tilesX : 0);
+        if (hash) {
+            hashes.resize(targets.tiles->GetTileCount());
+            p.hashes = hashes.data();
+            p.needed = targets.tiles->PrepareDetect(hints, hintCount, keyframe);
+        }
+
+        pixelpass::BandFn runBand = pixelpass::PickBand(scaler.GetSimd(), GetFilter(), keepBgra, hash,
+            convert ? (int)subsampling : PIPELINE_NO_CHROMA);
+        auto bands = [&](uint32_t first, uint32_t last) {
+            for (uint32_t b = first; b < last; b++) {
+                pixelpass::BandScratch s;
+                s.rows = needRows ? rowScratch.data() + b * 2 * rowBytes : nullptr;
+                s.h0 = needHorizontal ? horizontalScratch.data() + b * 2 * rowBytes : nullptr;
+                s.h1 = needHorizontal ? s.h0 + rowBytes : nullptr;
+                s.states = hash ? states.data() + (size_t)b * p.tilesX : nullptr;
+                s.columns = hash ? columns.data() + (size_t)b * p.tilesX : nullptr;
+                uint32_t begin = b * bandRows;
+                runBand(p, begin, begin + bandRows < height ? begin + bandRows : height, s);
+            }
+        };
+        if (jobs) jobs->ParallelFor(bandCount, 1, bands);
+        else bands(0, bandCount);
+
+        if (convert && targets.paddedHeight > height) PadBottom(targets, width, height);
+        return hash ? targets.tiles->FinishDetect(p.hashes) : 0;
+    }
+
+private:
+    // Repeat the last plane rows down to the padded height
+    static void PadBottom(const PixelTargets& t, uint32_t width, uint32_t height) {
+        const YCbCrPlanes& planes = t.planes;
+        uint32_t lumaBytes = t.paddedWidth ? t.paddedWidth : width;
+        for (uint32_t y = height; y < t.paddedHeight; y++) {
+            memcpy(planes.y + (size_t)y * planes.yStride, planes.y + (size_t)(height - 1) * planes.yStride, lumaBytes);
+        }
+        uint32_t chromaRows = ChromaHeight(height, t.subsampling);
+        uint32_t paddedRows = ChromaHeight(t.paddedHeight, t.subsampling);
+        uint32_t chromaBytes = t.subsampling == CHROMA_444 ? lumaBytes :
+            (t.paddedWidth ? t.paddedWidth / 2 : ChromaWidth(width, t.subsampling));
+        for (uint32_t y = chromaRows; y < paddedRows; y++) {
+            memcpy(planes.cb + (size_t)y * planes.cStride, planes.cb + (size_t)(chromaRows - 1) * planes.cStride, chromaBytes);
+            memcpy(planes.cr + (size_t)y * planes.cStride, planes.cr + (size_t)(chromaRows - 1) * planes.cStride, chromaBytes);
+        }
+    }
+};
@@ -0,0 +1,296 @@
+// Rate Controller - closed-loop JPEG quality / scale adaptation
+// Fed with what the pipeline measures: encode time and bytes per frame from
+// the encoders, queue-to-last-byte send time, frames replaced before they
+// went out, and the bytes still waiting to be written (which only build up
+// once the socket buffers are full). Every RATE_WINDOW_MS it judges the
+// window against a target frame rate and an optional bandwidth ceiling and
+// nudges the JPEG quality, and optionally a scale step, to fit.
+//
+// Hysteresis keeps it from oscillating:
+//   - over budget -> step down at once, harder the further over it is
+//   - comfortably under (RATE_UP_MARGIN) for upDwell windows -> step up
+//   - anything in between holds and restarts the count
+//   - the window after a change is not judged (queued frames still drain)
+//   - an up step that is undone within RATE_PROBE_WINDOWS doubles upDwell,
+//     so a quality the link can't sustain is retried less and less often;
+//     one that holds halves it again, so a faster link is found quickly
+// Scale only moves when quality is pinned: down once quality is at its
+// minimum, back up once quality has recovered to RATE_UPSCALE_QUALITY.
+// SetMinScale() keeps it from going below what the clients accept.
+//
+// Time is passed in by the caller (milliseconds, any origin), so the
+// controller can be driven from a simulated clock. Not thread safe: one
+// owner (the sender) adds samples and calls Update().
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <math.h>
+
+#define RATE_WINDOW_MS 500         // Measurement window
+#define RATE_QUALITY_STEP 5        // Smallest quality change
+#define RATE_MAX_DOWN_STEP 20      // Largest single quality drop
+#define RATE_UP_MARGIN 0.7         // Step up only below this share of every budget
+#define RATE_ENCODE_SHARE 0.9      // Encoders may use this share of their time
+#define RATE_SEND_LIMIT 1.5        // Send time over this many frame intervals = congested
+#define RATE_BASE_DWELL 4          // Good windows before the first step up
+#define RATE_MAX_DWELL 32          // Longest backoff between up steps
+#define RATE_PROBE_WINDOWS 3       // A drop this soon after an up step undoes it
+#define RATE_SCALE_STEPS 3         // Scale step 0 = configured scale
+#define RATE_UPSCALE_QUALITY 70    // Quality needed before trying a larger scale
+#define RATE_UPSCALE_QUALITY_DROP 15  // Quality given back when the scale grows
+
+// Scale step -> factor of the configured output size
+inline double RateScaleFactor(int step) {
+    static const double factors[RATE_SCALE_STEPS] = { 1.0, 0.75, 0.5 };
+    return factors[step < 0 ? 0 : (step >= RATE_SCALE_STEPS ? RATE_SCALE_STEPS - 1 : step)];
+}
+
+// Which limit the last judged window ran into
+enum RateLimit {
+    RATE_LIMIT_NONE = 0,
+    RATE_LIMIT_BANDWIDTH = 1,   // Bytes per frame over the ceiling
+    RATE_LIMIT_ENCODE = 2,      // Encoders can't sustain the target rate
+    RATE_LIMIT_LINK = 3         // Sends fall behind: slow client or network
+};
+
+inline const char* RateLimitName(RateLimit limit) {
+    switch (limit) {
+        case RATE_LIMIT_BANDWIDTH: return "bandwidth";
+        case RATE_LIMIT_ENCODE: return "encode";
+        case RATE_LIMIT_LINK: return "link";
+        default: return "none";
+    }
+}
+
+// What the controller saw in the last judged window
+struct RateStats {
+    double fps = 0;             // Frames encoded per second
+    double kbps = 0;            // Encoded kilobits per second
+    double encodeMs = 0;        // Average per frame
+    double bytesPerFrame = 0;
+    double sendMs = 0;          // Average queue-to-last-byte time per delivered frame
+    uint64_t dropped = 0;       // Frames replaced before they were sent
+    size_t backlogBytes = 0;    // Peak bytes waiting for the socket
+    RateLimit limit = RATE_LIMIT_NONE;
+};
+
+class RateController {
+private:
+    // Configuration
+    double targetFps = 30;
+    int maxKbps = 0;            // 0 = no ceiling
+    int encoderCount = 1;
+    int minQuality = 20;
+    int maxQuality = 85;
+    bool adaptiveScale = false;
+    int maxScaleStep = RATE_SCALE_STEPS - 1;
+
+    // Output
+    int quality = 60;
+    int scaleStep = 0;
+
+    // Window being measured
+    double windowStart = -1;
+    uint64_t frames = 0;
+    double encodeMs = 0;
+    uint64_t bytes = 0;
+    uint64_t sent = 0;
+    double sendMs = 0;
+    uint64_t dropped = 0;
+    size_t backlogPeak = 0;
+
+    // Hysteresis
+    int goodWindows = 0;
+    int upDwell = RATE_BASE_DWELL;
+    int settleWindows = 0;
+    int windowsSinceUp = RATE_PROBE_WINDOWS + 1;
+    uint64_t changes = 0;
+    RateStats last;
+
+    void ResetWindow(double nowMs) {
+        windowStart = nowMs;
+        frames = 0;
+        encodeMs = 0;
+        bytes = 0;
+        sent = 0;
+        sendMs = 0;
+        dropped = 0;
+        backlogPeak = 0;
+    }
+
+    int Clamp(int q) const { return q < minQuality ? minQuality : (q > maxQuality ? maxQuality : q); }
+
+    // Over budget by `over` (1.0 = exactly at the limit)
+    bool StepDown(double over) {
+        int oldQuality = quality, oldStep = scaleStep;
+        if (windowsSinceUp <= RATE_PROBE_WINDOWS) {
+            // The last up step didn't hold - wait longer before the next one
+            upDwell = upDwell * 2 > RATE_MAX_DWELL ? RATE_MAX_DWELL : upDwell * 2;
+            windowsSinceUp = RATE_PROBE_WINDOWS + 1;
+        }
+        if (quality > minQuality) {
+            int step = RATE_QUALITY_STEP + (int)ceil((over - 1.0) * 4 * RATE_QUALITY_STEP);
+            if (step > RATE_MAX_DOWN_STEP) step = RATE_MAX_DOWN_STEP;
+            quality = Clamp(quality - step);
+        } else if (adaptiveScale && scaleStep < maxScaleStep) {
+            scaleStep++;
+        }
+        return quality != oldQuality || scaleStep != oldStep;
+    }
+
+    bool StepUp() {
+        int oldQuality = quality, oldStep = scaleStep;
+        if (adaptiveScale && scaleStep > 0 && quality >= (RATE_UPSCALE_QUALITY < maxQuality ? RATE_UPSCALE_QUALITY : maxQuality)) {
+            scaleStep--;
+            quality = Clamp(quality - RATE_UPSCALE_QUALITY_DROP);
+        } else if (quality < maxQuality) {
+            quality = Clamp(quality + RATE_QUALITY_STEP);
+        }
+        return quality != oldQuality || scaleStep != oldStep;
+    }
+
+public:
+    // encoders: workers sharing the encode load (the time budget per frame
+    // is encoders / fps). The controller starts at initialQuality, scale step 0.
+    void Configure(double fps, int kbpsCeiling, int encoders, int initialQuality) {
+        targetFps = fps > 0 ? fps : 30;
+        maxKbps = kbpsCeiling > 0 ? kbpsCeiling : 0;
+        encoderCount = encoders > 0 ? encoders : 1;
+        quality = Clamp(initialQuality);
+        scaleStep = 0;
+        goodWindows = 0;
+        upDwell = RATE_BASE_DWELL;
+        settleWindows = 0;
+        windowsSinceUp = RATE_PROBE_WINDOWS + 1;
+        changes = 0;
+        last = RateStats();
+        windowStart = -1;
+    }
+
+    // Range the quality stays in; call before Configure()
+    void SetQualityRange(int minQ, int maxQ) {
+        minQuality = minQ < 1 ? 1 : (minQ > 100 ? 100 : minQ);
+        maxQuality = maxQ < minQuality ? minQuality : (maxQ > 100 ? 100 : maxQ);
+    }
+
+    void SetAdaptiveScale(bool enabled) { adaptiveScale = enabled; }
+
+    // Smallest scale allowed, in percent of the configured size (0 = any).
+    // Returns true if the current scale step had to grow to respect it.
+    bool SetMinScale(int percent) {
+        maxScaleStep = RATE_SCALE_STEPS - 1;
+        while (maxScaleStep > 0 && RateScaleFactor(maxScaleStep) * 100 < percent) maxScaleStep--;
+        if (scaleStep <= maxScaleStep) return false;
+        scaleStep = maxScaleStep;
+        changes++;
+        return true;
+    }
+
+    // count frames encoded, totalling encodeMs of encoder time and byteCount bytes
+    void AddEncoded(uint64_t count, double totalEncodeMs, uint64_t byteCount) {
+        frames += count;
+        encodeMs += totalEncodeMs;
+        bytes += byteCount;
+    }
+
+    // count frames fully written (per client), totalling totalSendMs from
+    // being queued to the last byte; droppedCount frames were replaced unsent
+    void AddSent(uint64_t count, double totalSendMs, uint64_t droppedCount) {
+        sent += count;
+        sendMs += totalSendMs;
+        dropped += droppedCount;
+    }
+
+    // Bytes queued for sending but not yet accepted by the sockets
+    void AddBacklog(size_t queuedBytes) {
+        if (queuedBytes > backlogPeak) backlogPeak = queuedBytes;
+    }
+
+    // Judge the window once it is RATE_WINDOW_MS old. Returns true if the
+    // quality or scale step changed.
+    bool Update(double nowMs) {
+        if (windowStart < 0) ResetWindow(nowMs);
+        double elapsed = nowMs - windowStart;
+        if (elapsed < RATE_WINDOW_MS) return false;
+
+        if (frames == 0) {
+            // Idle (nothing changed on screen or no clients): nothing to judge
+            ResetWindow(nowMs);
+            return false;
+        }
+
+        double interval = 1000.0 / targetFps;
+        RateStats s;
+        s.fps = frames * 1000.0 / elapsed;
+        s.kbps = bytes * 8.0 / elapsed;
+        s.encodeMs = encodeMs / frames;
+        s.bytesPerFrame = (double)bytes / frames;
+        s.sendMs = sent ? sendMs / sent : 0;
+        s.dropped = dropped;
+        s.backlogBytes = backlogPeak;
+
+        // Load relative to each budget, 1.0 = at the limit. Bandwidth is
+        // judged per frame at the target rate so a quiet screen (few delta
+        // frames) can't hide frames that would be too big at full rate.
+        double bandwidthLoad = maxKbps ? s.bytesPerFrame * 8 * targetFps / 1000.0 / maxKbps : 0;
+        double encodeLoad = s.encodeMs / (interval * encoderCount * RATE_ENCODE_SHARE);
+        double linkLoad = s.sendMs / (interval * RATE_SEND_LIMIT);
+        if (s.backlogBytes > 2 * s.bytesPerFrame || dropped * 10 > frames) {
+            // Frames pile up or get replaced: congested whatever the times say
+            linkLoad = linkLoad > 1.1 ? linkLoad : 1.1;
+        }
+
+        double worst = bandwidthLoad;
+        s.limit = bandwidthLoad > 1 ? RATE_LIMIT_BANDWIDTH : RATE_LIMIT_NONE;
+        if (encodeLoad > worst) {
+            worst = encodeLoad;
+            if (encodeLoad > 1) s.limit = RATE_LIMIT_ENCODE;
+        }
+        if (linkLoad > worst) {
+            worst = linkLoad;
+            if (linkLoad > 1) s.limit = RATE_LIMIT_LINK;
+        }
+        last = s;
+        ResetWindow(nowMs);
+
+        if (++windowsSinceUp == RATE_PROBE_WINDOWS + 1) {
+            // The last up step held - probe sooner next time
+            upDwell = upDwell / 2 < RATE_BASE_DWELL ? RATE_BASE_DWELL : upDwell / 2;
+        }
+        if (settleWindows > 0) {
+            settleWindows--;
+            return false;
+        }
+
+        bool changed = false;
+        if (worst > 1) {
+            goodWindows = 0;
+            changed = StepDown(worst);
+        } else if (worst < RATE_UP_MARGIN && s.backlogBytes <= s.bytesPerFrame && dropped == 0 &&
+                   s.sendMs < interval * 0.5) {
+            // Nothing queued behind the frame in flight: room to spend
+            if (++goodWindows >= upDwell) {
+                goodWindows = 0;
+                changed = StepUp();
+                if (changed) windowsSinceUp = 0;
+            }
+        } else {
+            goodWindows = 0;
+        }
+
+        if (changed) {
+            settleWindows = 1;
+            changes++;
+        }
+        return changed;
+    }
+
+    int GetQuality() const { return quality; }
+    int GetScaleStep() const { return scaleStep; }
+    double GetScaleFactor() const { return RateScaleFactor(scaleStep); }
+    int GetUpDwell() const { return upDwell; }
+    uint64_t GetChanges() const { return changes; }
+    const RateStats& GetLastStats() const { return last; }
+};
@@ -0,0 +1,291 @@
+// Shared memory compatibility layer - named file mappings on Windows,
+// shm_open() + mmap() elsewhere. Lets the shared-memory frame ring (and its
+// stress test) build and run on Linux.
+//
+// SharedSignal wakes every process waiting for a counter in shared memory to
+// change: a futex on that counter on Linux, a small set of named
+// manual-reset events on Windows. Signalling never blocks the writer.
+//
+// MappedFile maps an ordinary file read-only (capture recordings).
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <limits.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#endif
+#endif
+
+#define SHM_SIGNAL_EVENTS 4  // Windows: events cycled by counter value
+
+class SharedMemory {
+private:
+    uint8_t* data = nullptr;
+    size_t size = 0;
+#ifdef _WIN32
+    HANDLE mapping = nullptr;
+#else
+    std::string path;
+    bool owner = false;   // Creator unlinks the name on Close()
+#endif
+
+public:
+    ~SharedMemory() { Close(); }
+
+    // Create (or reuse) a named region of the given size, mapped read/write
+    bool Create(const char* name, size_t bytes) {
+        Close();
+#ifdef _WIN32
+        mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+            (DWORD)((uint64_t)bytes >> 32), (DWORD)bytes, name);
+        if (!mapping) return false;
+        data = (uint8_t*)MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, bytes);
+#else
+        path = std::string("/") + name;
+        int fd = shm_open(path.c_str(), O_CREAT | O_RDWR, 0600);
+        if (fd < 0) return false;
+        owner = true;
+        if (ftruncate(fd, (off_t)bytes) != 0) {
+            close(fd);
+            Close();
+            return false;
+        }
+        void* p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        data = p == MAP_FAILED ? nullptr : (uint8_t*)p;
+#endif
+        if (!data) {
+            Close();
+            return false;
+        }
+        size = bytes;
+        return true;
+    }
+
+    // Map an existing region, read-only, at whatever size it was created with
+    bool Open(const char* name) {
+        Close();
+#ifdef _WIN32
+        mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, name);
+        if (!mapping) return false;
+        data = (uint8_t*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        MEMORY_BASIC_INFORMATION info;
+        if (data && VirtualQuery(data, &info, sizeof(info))) size = info.RegionSize;
+#else
+        path = std::string("/") + name;
+        int fd = shm_open(path.c_str(), O_RDONLY, 0);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            void* p = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+            if (p != MAP_FAILED) {
+                data = (uint8_t*)p;
+                size = (size_t)st.st_size;
+            }
+        }
+        close(fd);
+#endif
+        if (!data || size == 0) {
+            Close();
+            return false;
+        }
+        return true;
+    }
+
+    void Close() {
+#ifdef _WIN32
+        if (data) UnmapViewOfFile(data);
+        if (mapping) CloseHandle(mapping);
+        mapping = nullptr;
+#else
+        if (data) munmap(data, size);
+        if (owner) shm_unlink(path.c_str());
+        owner = false;
+#endif
+        data = nullptr;
+        size = 0;
+    }
+
+    uint8_t* GetData() const { return data; }
+    size_t GetSize() const { return size; }
+};
+
+// Whole file mapped read-only; pages load on first touch
+class MappedFile {
+private:
+    uint8_t* data = nullptr;
+    size_t size = 0;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#endif
+
+public:
+    ~MappedFile() { Close(); }
+
+    bool Open(const char* path) {
+        Close();
+#ifdef _WIN32
+        file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+            FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) return false;
+        LARGE_INTEGER length;
+        if (GetFileSizeEx(file, &length) && length.QuadPart > 0) {
+            mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (mapping) data = (uint8_t*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            size = (size_t)length.QuadPart;
+        }
+#else
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            void* p = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED) {
+                data = (uint8_t*)p;
+                size = (size_t)st.st_size;
+            }
+        }
+        close(fd);
+#endif
+        if (!data) {
+            Close();
+            return false;
+        }
+        return true;
+    }
+
+    void Close() {
+#ifdef _WIN32
+        if (data) UnmapViewOfFile(data);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+        mapping = nullptr;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (data) munmap(data, size);
+#endif
+        data = nullptr;
+        size = 0;
+    }
+
+    const uint8_t* GetData() const { return data; }
+    size_t GetSize() const { return size; }
+};
+
+class SharedSignal {
+private:
+#ifdef _WIN32
+    // Event i is set while the counter's latest value is i mod SHM_SIGNAL_EVENTS.
+    // A waiter that has seen value v waits on event (v + 1); that event is
+    // only reset again SHM_SIGNAL_EVENTS changes later, so a waiter can't
+    // miss a wake-up unless it stalls for that many changes between checking
+    // the counter and waiting (and then its timeout still bounds the wait).
+    HANDLE events[SHM_SIGNAL_EVENTS] = {};
+
+    bool OpenEvents(const char* name, bool create) {
+        for (int i = 0; i < SHM_SIGNAL_EVENTS; i++) {
+            std::string eventName = std::string(name) + ".frame" + std::to_string(i);
+            events[i] = create ? CreateEventA(nullptr, TRUE, FALSE, eventName.c_str())
+                               : OpenEventA(SYNCHRONIZE, FALSE, eventName.c_str());
+            if (!events[i]) {
+                Close();
+                return false;
+            }
+        }
+        return true;
+    }
+#endif
+
+public:
+    ~SharedSignal() { Close(); }
+
+    // Writer side
+    bool Create(const char* name) {
+#ifdef _WIN32
+        if (!OpenEvents(name, true)) return false;
+        for (HANDLE e : events) ResetEvent(e);
+#endif
+        (void)name;
+        return true;
+    }
+
+    // Reader side
+    bool Open(const char* name) {
+#ifdef _WIN32
+        return OpenEvents(name, false);
+#else
+        (void)name;
+        return true;
+#endif
+    }
+
+    // Writer: call before storing value into the counter...
+    void Prepare(uint32_t value) {
+#ifdef _WIN32
+        ResetEvent(events[(value + 1) % SHM_SIGNAL_EVENTS]);
+#endif
+        (void)value;
+    }
+
+    // ...and after, to wake every waiter
+    void Wake(const std::atomic<uint32_t>* counter, uint32_t value) {
+#ifdef _WIN32
+        SetEvent(events[value % SHM_SIGNAL_EVENTS]);
+        (void)counter;
+#elif defined(__linux__)
+        syscall(SYS_futex, (const void*)counter, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+        (void)value;
+#else
+        (void)counter;
+        (void)value;
+#endif
+    }
+
+    // Reader: block until the counter differs from seen. Returns false on timeout.
+    bool Wait(const std::atomic<uint32_t>* counter, uint32_t seen, int timeoutMs) {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+        while (counter->load(std::memory_order_acquire) == seen) {
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+            if (left.count() <= 0) return false;
+#ifdef _WIN32
+            WaitForSingleObject(events[(seen + 1) % SHM_SIGNAL_EVENTS], (DWORD)left.count());
+#elif defined(__linux__)
+            // The futex is shared (not FUTEX_PRIVATE) so other processes' wakes reach us
+            struct timespec ts = { (time_t)(left.count() / 1000), (long)(left.count() % 1000) * 1000000 };
+            syscall(SYS_futex, (const void*)counter, FUTEX_WAIT, seen, &ts, nullptr, 0);
+#else
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+#endif
+        }
+        return true;
+    }
+
+    void Close() {
+#ifdef _WIN32
+        for (HANDLE& e : events) {
+            if (e) CloseHandle(e);
+            e = nullptr;
+        }
+#endif
+    }
+};
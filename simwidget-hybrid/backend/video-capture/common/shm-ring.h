@@ -0,0 +1,242 @@
+// Shared-memory Frame Ring - lock-free frame hand-off to other processes
+// One writer publishes frames into N slots of a named shared-memory region
+// (common/shm-compat.h); any number of readers copy out the newest complete
+// frame. Nobody takes a lock and the writer never waits for a reader.
+//
+// Each slot carries a generation counter used as a seqlock: the writer makes
+// it odd before touching the slot and sets it to 2 * frameNum once the frame
+// is complete. A reader checks the generation before and after its copy and
+// retries with the then-newest frame if they differ, so a frame overwritten
+// mid-copy is never returned. With SHM_RING_SLOTS slots a reader has
+// SHM_RING_SLOTS - 1 frame intervals to finish a copy before it can collide
+// with the writer at all.
+//
+// Readers that would rather sleep than poll call WaitForFrame(): every
+// publish bumps a 32-bit counter in the ring header and wakes all waiters
+// through a SharedSignal (futex on Linux, named events on Windows).
+//
+// Layout (little endian, 64-byte aligned):
+//   ShmRingHeader                          64 bytes
+//   slot i at slotOffset + i * slotStride: ShmSlotHeader (64 bytes) + pixels
+// Readers take slot count, sizes and frame dimensions from the headers; only
+// the version has to match.
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include "shm-compat.h"
+
+#define SHM_RING_MAGIC 0x31525753u  // "SWR1"
+#define SHM_RING_VERSION 2          // v1 was the single-buffer ShmHeader + ready flag
+#define SHM_RING_SLOTS 3
+#define SHM_READ_RETRIES 8          // Attempts before a reader gives up on this call
+
+static_assert(sizeof(std::atomic<uint64_t>) == 8, "64-bit atomics must be plain words in shared memory");
+
+struct ShmRingHeader {
+    uint32_t magic;                 // SHM_RING_MAGIC, written last by the creator
+    uint32_t version;               // SHM_RING_VERSION
+    uint32_t slotCount;
+    uint32_t slotOffset;            // Byte offset of slot 0
+    uint64_t slotStride;            // Bytes from one slot to the next
+    uint64_t maxFrameSize;          // Pixel bytes a slot can hold
+    uint32_t width;                 // Dimensions of the latest frame (informational,
+    uint32_t height;                // the slot header has the authoritative copy)
+    std::atomic<uint64_t> latest;   // Frame number of the newest complete frame (0 = none)
+    std::atomic<uint32_t> notify;   // Low 32 bits of latest; what readers wait on
+    uint8_t reserved[12];
+};
+
+struct ShmSlotHeader {
+    std::atomic<uint64_t> generation;  // 2 * frameNum when complete, odd while written
+    uint64_t frameNum;
+    uint64_t timestampUs;           // steady_clock at publish
+    uint32_t width;
+    uint32_t height;
+    uint32_t stride;                // Bytes per row
+    uint32_t size;                  // Pixel bytes
+    uint8_t reserved[24];
+};
+
+static_assert(sizeof(ShmRingHeader) == 64, "ShmRingHeader is part of the shared layout");
+static_assert(sizeof(ShmSlotHeader) == 64, "ShmSlotHeader is part of the shared layout");
+
+struct ShmFrameInfo {
+    uint64_t frameNum;
+    uint64_t timestampUs;
+    uint32_t width;
+    uint32_t height;
+    uint32_t stride;
+    uint32_t size;
+};
+
+inline uint64_t ShmTimestampUs() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+class ShmRingWriter {
+private:
+    SharedMemory memory;
+    SharedSignal signal;
+    ShmRingHeader* header = nullptr;
+    ShmSlotHeader* writing = nullptr;
+    uint64_t frameNum = 0;
+
+    ShmSlotHeader* Slot(uint64_t n) const {
+        return (ShmSlotHeader*)(memory.GetData() + header->slotOffset + (n % header->slotCount) * header->slotStride);
+    }
+
+public:
+    bool Create(const char* name, uint32_t slotCount, size_t maxFrameSize) {
+        if (slotCount < 2) return false;
+        uint64_t stride = (sizeof(ShmSlotHeader) + maxFrameSize + 63) & ~(uint64_t)63;
+        if (!memory.Create(name, sizeof(ShmRingHeader) + stride * slotCount)) return false;
+        if (!signal.Create(name)) {
+            memory.Close();
+            return false;
+        }
+
+        // A reused region may still have an old layout; readers see no magic until it is valid
+        header = (ShmRingHeader*)memory.GetData();
+        header->magic = 0;
+        std::atomic_thread_fence(std::memory_order_release);
+        memset(memory.GetData() + sizeof(uint32_t), 0, memory.GetSize() - sizeof(uint32_t));
+        header->version = SHM_RING_VERSION;
+        header->slotCount = slotCount;
+        header->slotOffset = sizeof(ShmRingHeader);
+        header->slotStride = stride;
+        header->maxFrameSize = maxFrameSize;
+        header->latest.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        header->magic = SHM_RING_MAGIC;
+        frameNum = 0;
+        return true;
+    }
+
+    // Start the next frame. Returns where its pixels go (stride * height
+    // bytes), or nullptr if it doesn't fit a slot. Readers skip the slot
+    // until Publish().
+    uint8_t* BeginWrite(uint32_t width, uint32_t height, uint32_t stride) {
+        if (!header || (uint64_t)stride * height > header->maxFrameSize) return nullptr;
+        uint64_t n = frameNum + 1;
+        writing = Slot(n);
+        writing->generation.store(2 * n - 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        writing->frameNum = n;
+        writing->width = width;
+        writing->height = height;
+        writing->stride = stride;
+        writing->size = stride * height;
+        return (uint8_t*)(writing + 1);
+    }
+
+    // Make the frame started by BeginWrite() visible. Returns its frame number.
+    uint64_t Publish() {
+        if (!writing) return 0;
+        uint64_t n = ++frameNum;
+        writing->timestampUs = ShmTimestampUs();
+        header->width = writing->width;
+        header->height = writing->height;
+        writing->generation.store(2 * n, std::memory_order_release);
+        signal.Prepare((uint32_t)n);
+        header->latest.store(n, std::memory_order_release);
+        header->notify.store((uint32_t)n, std::memory_order_release);
+        signal.Wake(&header->notify, (uint32_t)n);
+        writing = nullptr;
+        return n;
+    }
+
+    uint64_t GetFrameNum() const { return frameNum; }
+    void Close() {
+        signal.Close();
+        memory.Close();
+        header = nullptr;
+        writing = nullptr;
+    }
+};
+
+class ShmRingReader {
+private:
+    SharedMemory memory;
+    SharedSignal signal;
+    const ShmRingHeader* header = nullptr;
+    uint64_t lastFrameNum = 0;
+    uint64_t retries = 0;       // Copies discarded because the writer got there first
+
+    const ShmSlotHeader* Slot(uint64_t n) const {
+        return (const ShmSlotHeader*)(memory.GetData() + header->slotOffset + (n % header->slotCount) * header->slotStride);
+    }
+
+public:
+    // Returns false if the region doesn't exist or isn't a compatible ring
+    bool Open(const char* name) {
+        header = nullptr;
+        if (!memory.Open(name) || memory.GetSize() < sizeof(ShmRingHeader)) return false;
+        const ShmRingHeader* h = (const ShmRingHeader*)memory.GetData();
+        if (h->magic != SHM_RING_MAGIC || h->version != SHM_RING_VERSION) return false;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (h->slotCount == 0 || h->slotStride < sizeof(ShmSlotHeader) + h->maxFrameSize ||
+            h->slotOffset + h->slotStride * h->slotCount > memory.GetSize()) return false;
+        if (!signal.Open(name)) return false;
+        header = h;
+        lastFrameNum = 0;
+        return true;
+    }
+
+    // Copy the newest complete frame newer than the last one returned.
+    // Returns its size, -2 if there is no new frame (or the writer kept
+    // overwriting it), or -1 if dst is too small / the ring isn't open.
+    int ReadLatest(uint8_t* dst, size_t capacity, ShmFrameInfo* info) {
+        if (!header) return -1;
+        for (int attempt = 0; attempt < SHM_READ_RETRIES; attempt++) {
+            uint64_t n = header->latest.load(std::memory_order_acquire);
+            if (n == 0 || n == lastFrameNum) return -2;
+
+            const ShmSlotHeader* slot = Slot(n);
+            uint64_t before = slot->generation.load(std::memory_order_acquire);
+            if (before != 2 * n) {
+                retries++;   // Already being overwritten; a newer frame is on its way
+                continue;
+            }
+            ShmFrameInfo frame = { slot->frameNum, slot->timestampUs, slot->width, slot->height, slot->stride, slot->size };
+            bool fits = frame.size <= capacity && frame.size <= header->maxFrameSize;
+            if (fits) memcpy(dst, slot + 1, frame.size);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot->generation.load(std::memory_order_relaxed) != before) {
+                retries++;   // Torn - the writer lapped us during the copy
+                continue;
+            }
+            if (!fits) return -1;
+
+            lastFrameNum = n;
+            if (info) *info = frame;
+            return (int)frame.size;
+        }
+        return -2;
+    }
+
+    // Block until there is a frame newer than the last one ReadLatest()
+    // returned. Returns 0, -2 on timeout, or -1 if the ring isn't open.
+    int WaitForFrame(int timeoutMs) {
+        if (!header) return -1;
+        uint64_t n = header->latest.load(std::memory_order_acquire);
+        if (n != 0 && n != lastFrameNum) return 0;
+        return signal.Wait(&header->notify, (uint32_t)n, timeoutMs) ? 0 : -2;
+    }
+
+    bool IsOpen() const { return header != nullptr; }
+    uint32_t GetWidth() const { return header ? header->width : 0; }
+    uint32_t GetHeight() const { return header ? header->height : 0; }
+    size_t GetMaxFrameSize() const { return header ? (size_t)header->maxFrameSize : 0; }
+    uint64_t GetRetries() const { return retries; }
+
+    void Close() {
+        signal.Close();
+        memory.Close();
+        header = nullptr;
+    }
+};
@@ -0,0 +1,358 @@
+// Tile Codec - per-tile codec choice for delta tiles
+// Glass-cockpit panels are flat fills, text and vector symbology, which JPEG
+// both smears and codes poorly; terrain and outside views are photographic.
+// MeasureTile() takes a tile's statistics in one SIMD pass - its distinct
+// colors (up to TILE_PALETTE_MAX + 1), how many pixels repeat their left
+// neighbour and how big the steps between the others are - and
+// ClassifyTile() picks a codec from them:
+//
+//   SOLID     one color                           4 bytes
+//   PALETTE   up to 16 colors: palette + runs     tens to hundreds of bytes
+//   LOSSLESS  flat areas with sharp detail        common/lossless-codec.h stream
+//   JPEG      everything else (photographic)      the service's JPEG encoder
+//
+// Solid, palette and lossless tiles decode pixel exact, so text and symbols
+// stay sharp, and JPEG effort only goes to the tiles that need it. A palette
+// or lossless tile that codes to more than TILE_EXACT_MAX_PCT of its raw
+// size falls back to the next codec down the list.
+//
+// Tile data, behind the tile's [4 bytes: size | codec << 24] prefix:
+//   SOLID     [4B BGRA]
+//   PALETTE   [1B color count n][n x 4B BGRA][runs]: run byte = index << 4 | k,
+//             k < 15: k + 1 pixels, k = 15: 16 + next byte pixels. Runs
+//             cover the tile in raster order.
+//   LOSSLESS  LosslessEncoder stream of the tile
+//   JPEG      baseline JPEG of the tile
+
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include "cpu-features.h"
+#include "lossless-codec.h"
+
+#define TILE_CODEC_SOLID 0
+#define TILE_CODEC_PALETTE 1
+#define TILE_CODEC_LOSSLESS 2
+#define TILE_CODEC_JPEG 3
+#define TILE_CODEC_COUNT 4
+
+#define TILE_CODEC_SHIFT 24           // Codec id in the top byte of the tile size prefix
+#define TILE_CODEC_SIZE_MASK 0xFFFFFFu
+
+#define TILE_PALETTE_MAX 16           // Colors a palette tile can have
+#define TILE_FLAT_PCT 50              // Pixels equal to their left neighbour: this many -> lossless
+#define TILE_EDGE_FLAT_PCT 20         // ...or this many, with hard edges
+#define TILE_SHARP_STEP 64            // Mean byte difference summed over BGRA between differing neighbours = hard edges
+#define TILE_EXACT_MAX_PCT 33         // Exact codecs bigger than this share of raw go to the next codec
+
+inline const char* TileCodecName(int codec) {
+    switch (codec) {
+        case TILE_CODEC_SOLID: return "solid";
+        case TILE_CODEC_PALETTE: return "palette";
+        case TILE_CODEC_LOSSLESS: return "lossless";
+        case TILE_CODEC_JPEG: return "jpeg";
+        default: return "unknown";
+    }
+}
+
+// Statistics of one tile
+struct TileStats {
+    int colors = 0;                         // Distinct colors, capped at TILE_PALETTE_MAX + 1
+    uint32_t palette[TILE_PALETTE_MAX] = {};  // In order of first appearance (valid if colors <= max)
+    uint32_t pixels = 0;
+    uint32_t flat = 0;                      // Pixels equal to their left neighbour
+    uint64_t steps = 0;                     // Sum of |dB|+|dG|+|dR|+|dA| over horizontal neighbours
+};
+
+namespace tilecodec {
+
+static const uint8_t bitCount4[16] = { 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4 };
+
+inline void AddColor(TileStats* s, uint32_t c) {
+    if (s->colors > TILE_PALETTE_MAX) return;
+    for (int i = 0; i < s->colors; i++) {
+        if (s->palette[i] == c) return;
+    }
+    if (s->colors < TILE_PALETTE_MAX) s->palette[s->colors] = c;
+    s->colors++;
+}
+
+inline uint32_t Step(const uint8_t* a, const uint8_t* b) {
+    uint32_t sum = 0;
+    for (int c = 0; c < 4; c++) sum += (uint32_t)abs((int)a[c] - (int)b[c]);
+    return sum;
+}
+
+// Pixels [x0, w) of a row, x0 >= 1: neighbour statistics and new colors
+inline void MeasureRowScalar(const uint8_t* row, uint32_t x0, uint32_t w, TileStats* s) {
+    for (uint32_t x = x0; x < w; x++) {
+        uint32_t cur, left;
+        memcpy(&cur, row + x * 4, 4);
+        memcpy(&left, row + x * 4 - 4, 4);
+        if (cur == left) {
+            s->flat++;
+            continue;
+        }
+        s->steps += Step(row + x * 4, row + x * 4 - 4);
+        AddColor(s, cur);
+    }
+}
+
+#ifdef SIMD_X86
+inline void MeasureRowSSE2(const uint8_t* row, uint32_t w, TileStats* s) {
+    uint32_t x = 1;
+    __m128i steps = _mm_setzero_si128();
+    for (; x + 4 <= w; x += 4) {
+        __m128i cur = _mm_loadu_si128((const __m128i*)(row + x * 4));
+        __m128i left = _mm_loadu_si128((const __m128i*)(row + x * 4 - 4));
+        int same = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(cur, left)));
+        s->flat += bitCount4[same];
+        if (same == 15) continue;
+        steps = _mm_add_epi64(steps, _mm_sad_epu8(cur, left));
+        for (int i = 0; i < 4; i++) {
+            if (same & (1 << i)) continue;
+            uint32_t c;
+            memcpy(&c, row + (x + i) * 4, 4);
+            AddColor(s, c);
+        }
+    }
+    s->steps += (uint64_t)_mm_cvtsi128_si32(steps) + (uint64_t)_mm_cvtsi128_si32(_mm_srli_si128(steps, 8));
+    MeasureRowScalar(row, x, w, s);
+}
+
+SIMD_TARGET_AVX2
+inline void MeasureRowAVX2(const uint8_t* row, uint32_t w, TileStats* s) {
+    uint32_t x = 1;
+    __m256i steps = _mm256_setzero_si256();
+    for (; x + 8 <= w; x += 8) {
+        __m256i cur = _mm256_loadu_si256((const __m256i*)(row + x * 4));
+        __m256i left = _mm256_loadu_si256((const __m256i*)(row + x * 4 - 4));
+        int same = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(cur, left)));
+        s->flat += bitCount4[same & 15] + bitCount4[same >> 4];
+        if (same == 255) continue;
+        steps = _mm256_add_epi64(steps, _mm256_sad_epu8(cur, left));
+        for (int i = 0; i < 8; i++) {
+            if (same & (1 << i)) continue;
+            uint32_t c;
+            memcpy(&c, row + (x + i) * 4, 4);
+            AddColor(s, c);
+        }
+    }
+    __m128i half = _mm_add_epi64(_mm256_castsi256_si128(steps), _mm256_extracti128_si256(steps, 1));
+    s->steps += (uint64_t)_mm_cvtsi128_si32(half) + (uint64_t)_mm_cvtsi128_si32(_mm_srli_si128(half, 8));
+    MeasureRowScalar(row, x, w, s);
+}
+#endif
+
+}  // namespace tilecodec
+
+// Statistics of a w x h BGRA tile; identical at every SIMD level
+inline void MeasureTile(const uint8_t* pixels, uint32_t stride, uint32_t w, uint32_t h, SimdLevel level,
+                        TileStats* stats) {
+    *stats = TileStats();
+    stats->pixels = w * h;
+    for (uint32_t y = 0; y < h; y++) {
+        const uint8_t* row = pixels + (size_t)y * stride;
+        uint32_t first;
+        memcpy(&first, row, 4);
+        tilecodec::AddColor(stats, first);
+#ifdef SIMD_X86
+        if (level == SIMD_AVX2) { tilecodec::MeasureRowAVX2(row, w, stats); continue; }
+        if (level == SIMD_SSE2) { tilecodec::MeasureRowSSE2(row, w, stats); continue; }
+#endif
+        (void)level;
+        tilecodec::MeasureRowScalar(row, 1, w, stats);
+    }
+}
+
+// Codec for a tile from its statistics
+inline int ClassifyTile(const TileStats& s) {
+    if (s.colors == 1) return TILE_CODEC_SOLID;
+    if (s.colors <= TILE_PALETTE_MAX) return TILE_CODEC_PALETTE;
+    uint32_t edges = s.pixels - s.flat;
+    if (s.flat * 100 >= s.pixels * TILE_FLAT_PCT) return TILE_CODEC_LOSSLESS;
+    if (s.flat * 100 >= s.pixels * TILE_EDGE_FLAT_PCT && edges && s.steps >= (uint64_t)edges * TILE_SHARP_STEP) {
+        return TILE_CODEC_LOSSLESS;
+    }
+    return TILE_CODEC_JPEG;
+}
+
+// Palette tile data for stats.palette. Returns bytes written, or 0 if it
+// would pass maxSize.
+inline size_t WritePaletteTile(const uint8_t* pixels, uint32_t stride, uint32_t w, uint32_t h, const TileStats& stats,
+                               uint8_t* out, size_t maxSize) {
+    size_t headerSize = 1 + (size_t)stats.colors * 4;
+    if (stats.colors < 1 || stats.colors > TILE_PALETTE_MAX || headerSize > maxSize) return 0;
+    out[0] = (uint8_t)stats.colors;
+    memcpy(out + 1, stats.palette, (size_t)stats.colors * 4);
+    uint8_t* p = out + headerSize;
+    uint8_t* end = out + maxSize;
+
+    int index = -1;
+    uint32_t run = 0;
+    uint32_t last = 0;
+    auto flush = [&]() -> bool {
+        while (run > 0) {
+            uint32_t n = std::min(run, 16u + 255u);
+            if (n < 16) {
+                if (p >= end) return false;
+                *p++ = (uint8_t)((index << 4) | (n - 1));
+            } else {
+                if (end - p < 2) return false;
+                *p++ = (uint8_t)((index << 4) | 15);
+                *p++ = (uint8_t)(n - 16);
+            }
+            run -= n;
+        }
+        return true;
+    };
+    for (uint32_t y = 0; y < h; y++) {
+        const uint8_t* row = pixels + (size_t)y * stride;
+        for (uint32_t x = 0; x < w; x++) {
+            uint32_t c;
+            memcpy(&c, row + x * 4, 4);
+            if (index >= 0 && c == last) {
+                run++;
+                continue;
+            }
+            if (!flush()) return 0;
+            index = 0;
+            while (index < stats.colors && stats.palette[index] != c) index++;
+            if (index == stats.colors) return 0;  // Not the palette of these pixels
+            last = c;
+            run = 1;
+        }
+    }
+    return flush() ? (size_t)(p - out) : 0;
+}
+
+// Decode palette tile data into a w x h BGRA rect. False if it is malformed.
+inline bool ReadPaletteTile(const uint8_t* data, size_t size, uint8_t* dst, uint32_t stride, uint32_t w, uint32_t h) {
+    if (size < 1) return false;
+    int colors = data[0];
+    size_t headerSize = 1 + (size_t)colors * 4;
+    if (colors < 1 || colors > TILE_PALETTE_MAX || size < headerSize) return false;
+    uint32_t palette[TILE_PALETTE_MAX];
+    memcpy(palette, data + 1, (size_t)colors * 4);
+
+    const uint8_t* p = data + headerSize;
+    const uint8_t* end = data + size;
+    uint64_t total = (uint64_t)w * h;
+    uint64_t done = 0;
+    while (done < total) {
+        if (p >= end) return false;
+        int index = *p >> 4;
+        uint32_t n = (*p & 15) + 1;
+        p++;
+        if (n == 16) {
+            if (p >= end) return false;
+            n = 16 + *p++;
+        }
+        if (index >= colors || done + n > total) return false;
+        for (uint32_t i = 0; i < n; i++, done++) {
+            uint32_t x = (uint32_t)(done % w), y = (uint32_t)(done / w);
+            memcpy(dst + (size_t)y * stride + x * 4, &palette[index], 4);
+        }
+    }
+    return p == end;
+}
+
+// Classifies and codes tiles. The caller codes JPEG tiles with its own
+// encoder. Keeps scratch for lossless tiles; one per encode thread.
+class TileCodecEncoder {
+private:
+    SimdLevel simd = GetSimdLevel();
+    LosslessEncoder lossless;
+    uint32_t losslessWidth = 0, losslessHeight = 0;
+    std::vector<uint8_t> scratch;
+    int forced = -1;
+
+public:
+    void SetSimdLevel(SimdLevel level) {
+        simd = level;
+        lossless.SetSimdLevel(level);
+    }
+
+    // Code every tile with one codec (JPEG, or an exact one that then
+    // falls back as usual), -1 = classify; for comparisons
+    void ForceCodec(int codec) { forced = codec; }
+
+    // Pick a codec for the tile and code it into out, falling back when an
+    // exact codec comes out too big. Returns bytes written and sets *codec;
+    // for TILE_CODEC_JPEG nothing is written (returns 0). Returns -1 if the
+    // tile won't fit maxSize.
+    int Encode(const uint8_t* pixels, uint32_t stride, uint32_t w, uint32_t h, uint8_t* out, size_t maxSize,
+               int* codec, TileStats* statsOut = nullptr) {
+        TileStats stats;
+        MeasureTile(pixels, stride, w, h, simd, &stats);
+        if (statsOut) *statsOut = stats;
+        int pick = forced >= 0 ? forced : ClassifyTile(stats);
+        size_t limit = std::min(maxSize, (size_t)w * h * 4 * TILE_EXACT_MAX_PCT / 100);
+
+        if (pick == TILE_CODEC_SOLID && stats.colors != 1) pick = TILE_CODEC_PALETTE;
+        if (pick == TILE_CODEC_SOLID) {
+            if (maxSize < 4) return -1;
+            memcpy(out, &stats.palette[0], 4);
+            *codec = TILE_CODEC_SOLID;
+            return 4;
+        }
+        if (pick == TILE_CODEC_PALETTE) {
+            size_t size = stats.colors <= TILE_PALETTE_MAX ? WritePaletteTile(pixels, stride, w, h, stats, out, limit) : 0;
+            if (size > 0) {
+                *codec = TILE_CODEC_PALETTE;
+                return (int)size;
+            }
+            pick = TILE_CODEC_LOSSLESS;
+        }
+        if (pick == TILE_CODEC_LOSSLESS) {
+            if (w != losslessWidth || h != losslessHeight) {
+                if (!lossless.Initialize(w, h, false)) return -1;
+                losslessWidth = w;
+                losslessHeight = h;
+                scratch.resize(lossless.MaxEncodedSize());
+            }
+            int size = lossless.Encode(pixels, stride, false, scratch.data(), scratch.size());
+            if (size > 0 && (size_t)size <= limit) {
+                memcpy(out, scratch.data(), size);
+                *codec = TILE_CODEC_LOSSLESS;
+                return size;
+            }
+        }
+        *codec = TILE_CODEC_JPEG;
+        return 0;
+    }
+};
+
+// Decodes solid, palette and lossless tiles; JPEG tiles are the caller's
+class TileCodecDecoder {
+private:
+    LosslessDecoder lossless;
+
+public:
+    // Decode tile data of codec into a w x h BGRA rect of dst. False for a
+    // malformed tile or a JPEG one.
+    bool Decode(int codec, const uint8_t* data, size_t size, uint8_t* dst, uint32_t stride, uint32_t w, uint32_t h) {
+        switch (codec) {
+            case TILE_CODEC_SOLID:
+                if (size != 4) return false;
+                for (uint32_t y = 0; y < h; y++) {
+                    for (uint32_t x = 0; x < w; x++) memcpy(dst + (size_t)y * stride + x * 4, data, 4);
+                }
+                return true;
+            case TILE_CODEC_PALETTE:
+                return ReadPaletteTile(data, size, dst, stride, w, h);
+            case TILE_CODEC_LOSSLESS:
+                if (lossless.Decode(data, size) != 0 || lossless.GetWidth() != w || lossless.GetHeight() != h) return false;
+                for (uint32_t y = 0; y < h; y++) {
+                    memcpy(dst + (size_t)y * stride, lossless.GetFrame() + (size_t)y * w * 4, (size_t)w * 4);
+                }
+                return true;
+            default:
+                return false;
+        }
+    }
+};
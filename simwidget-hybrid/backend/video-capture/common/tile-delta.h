@@ -0,0 +1,409 @@
+// Tile Delta - dirty-region detection for BGRA frames
+// Splits the frame into fixed tiles (64x64 by default), fingerprints each
+// tile with a SIMD hash and compares against the previous frame, so only
+// changed tiles need to be encoded and sent. Desktop Duplication dirty
+// rects can be passed as a hint to skip hashing tiles DXGI says are clean.
+// Portable: SSE2/AVX2 kernels on x86, identical scalar path everywhere else.
+//
+// Delta payload (follows the service's frame header):
+//   [2 bytes tile size][2 bytes tiles X][2 bytes tiles Y][2 bytes dirty count]
+//   [tile map: (tilesX * tilesY + 7) / 8 bytes, bit i = tile i, raster order, LSB first]
+//   [dirty tile data in raster order]
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include "cpu-features.h"
+
+#define DELTA_TILE_SIZE 64
+#define DELTA_TILE_HEADER_SIZE 8
+
+// Same layout as the Win32 RECT / DXGI dirty rects (exclusive right/bottom)
+struct TileRect {
+    int32_t left, top, right, bottom;
+};
+
+// --- Tile hash -------------------------------------------------------------
+// XXH3-style accumulate over 64-byte stripes with a distinct key per stripe
+// position and a scramble per row, so moving content between stripes or rows
+// changes the hash. Row tails (< 16 pixels) go through a scalar chain that is
+// shared by every implementation - all paths produce identical hashes.
+
+namespace tilehash {
+
+const int KEY_COUNT = 64;  // 8 stripes x 8 lanes (512-byte rows = 128 px)
+const uint64_t PRIME32 = 0x9E3779B1ull;
+const uint64_t PRIME64 = 0x9E3779B97F4A7C15ull;
+
+struct KeyTable {
+    uint64_t keys[KEY_COUNT];
+    KeyTable() {
+        uint64_t x = 0x5157E1D6A3C0FFEEull;
+        for (int i = 0; i < KEY_COUNT; i++) {
+            // splitmix64
+            x += PRIME64;
+            uint64_t z = x;
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+            keys[i] = z ^ (z >> 31);
+        }
+    }
+};
+
+inline const uint64_t* Keys() {
+    static KeyTable table;
+    return table.keys;
+}
+
+inline uint64_t Load64(const uint8_t* p) { uint64_t v; memcpy(&v, p, 8); return v; }
+inline uint32_t Load32(const uint8_t* p) { uint32_t v; memcpy(&v, p, 4); return v; }
+
+inline void AccumulateRowScalar(uint64_t acc[8], const uint8_t* p, int stripes, const uint64_t* keys) {
+    for (int s = 0; s < stripes; s++) {
+        const uint64_t* key = keys + (s % 8) * 8;
+        for (int i = 0; i < 8; i++) {
+            uint64_t d = Load64(p + s * 64 + i * 8);
+            uint64_t dk = d ^ key[i];
+            acc[i ^ 1] += d;
+            acc[i] += (dk & 0xFFFFFFFFull) * (dk >> 32);
+        }
+    }
+    for (int i = 0; i < 8; i++) {
+        uint64_t a = acc[i];
+        a ^= a >> 47;
+        a ^= keys[i];
+        acc[i] = a * PRIME32;
+    }
+}
+
+#ifdef SIMD_X86
+inline __m128i Mul64By32(__m128i a, __m128i prime) {
+    __m128i lo = _mm_mul_epu32(a, prime);
+    __m128i hi = _mm_mul_epu32(_mm_srli_epi64(a, 32), prime);
+    return _mm_add_epi64(lo, _mm_slli_epi64(hi, 32));
+}
+
+inline void AccumulateRowSSE2(uint64_t acc[8], const uint8_t* p, int stripes, const uint64_t* keys) {
+    __m128i a[4];
+    for (int j = 0; j < 4; j++) a[j] = _mm_loadu_si128((const __m128i*)(acc + j * 2));
+
+    for (int s = 0; s < stripes; s++) {
+        const uint64_t* key = keys + (s % 8) * 8;
+        for (int j = 0; j < 4; j++) {
+            __m128i d = _mm_loadu_si128((const __m128i*)(p + s * 64 + j * 16));
+            __m128i dk = _mm_xor_si128(d, _mm_loadu_si128((const __m128i*)(key + j * 2)));
+            __m128i product = _mm_mul_epu32(dk, _mm_shuffle_epi32(dk, _MM_SHUFFLE(2, 3, 0, 1)));
+            a[j] = _mm_add_epi64(a[j], _mm_shuffle_epi32(d, _MM_SHUFFLE(1, 0, 3, 2)));
+            a[j] = _mm_add_epi64(a[j], product);
+        }
+    }
+
+    __m128i prime = _mm_set1_epi64x((long long)PRIME32);
+    for (int j = 0; j < 4; j++) {
+        __m128i v = _mm_xor_si128(a[j], _mm_srli_epi64(a[j], 47));
+        v = _mm_xor_si128(v, _mm_loadu_si128((const __m128i*)(keys + j * 2)));
+        _mm_storeu_si128((__m128i*)(acc + j * 2), Mul64By32(v, prime));
+    }
+}
+
+SIMD_TARGET_AVX2
+inline void AccumulateRowAVX2(uint64_t acc[8], const uint8_t* p, int stripes, const uint64_t* keys) {
+    __m256i a0 = _mm256_loadu_si256((const __m256i*)acc);
+    __m256i a1 = _mm256_loadu_si256((const __m256i*)(acc + 4));
+
+    for (int s = 0; s < stripes; s++) {
+        const uint64_t* key = keys + (s % 8) * 8;
+        __m256i d0 = _mm256_loadu_si256((const __m256i*)(p + s * 64));
+        __m256i d1 = _mm256_loadu_si256((const __m256i*)(p + s * 64 + 32));
+        __m256i dk0 = _mm256_xor_si256(d0, _mm256_loadu_si256((const __m256i*)key));
+        __m256i dk1 = _mm256_xor_si256(d1, _mm256_loadu_si256((const __m256i*)(key + 4)));
+        a0 = _mm256_add_epi64(a0, _mm256_shuffle_epi32(d0, _MM_SHUFFLE(1, 0, 3, 2)));
+        a1 = _mm256_add_epi64(a1, _mm256_shuffle_epi32(d1, _MM_SHUFFLE(1, 0, 3, 2)));
+        a0 = _mm256_add_epi64(a0, _mm256_mul_epu32(dk0, _mm256_shuffle_epi32(dk0, _MM_SHUFFLE(2, 3, 0, 1))));
+        a1 = _mm256_add_epi64(a1, _mm256_mul_epu32(dk1, _mm256_shuffle_epi32(dk1, _MM_SHUFFLE(2, 3, 0, 1))));
+    }
+
+    __m256i prime = _mm256_set1_epi64x((long long)PRIME32);
+    __m256i v0 = _mm256_xor_si256(a0, _mm256_srli_epi64(a0, 47));
+    __m256i v1 = _mm256_xor_si256(a1, _mm256_srli_epi64(a1, 47));
+    v0 = _mm256_xor_si256(v0, _mm256_loadu_si256((const __m256i*)keys));
+    v1 = _mm256_xor_si256(v1, _mm256_loadu_si256((const __m256i*)(keys + 4)));
+    __m256i lo0 = _mm256_mul_epu32(v0, prime), hi0 = _mm256_mul_epu32(_mm256_srli_epi64(v0, 32), prime);
+    __m256i lo1 = _mm256_mul_epu32(v1, prime), hi1 = _mm256_mul_epu32(_mm256_srli_epi64(v1, 32), prime);
+    _mm256_storeu_si256((__m256i*)acc, _mm256_add_epi64(lo0, _mm256_slli_epi64(hi0, 32)));
+    _mm256_storeu_si256((__m256i*)(acc + 4), _mm256_add_epi64(lo1, _mm256_slli_epi64(hi1, 32)));
+}
+#endif
+
+}  // namespace tilehash
+
+// Running hash of one tile, fed a row at a time. HashTile() is Begin, one
+// Row per pixel row, Finish; the fused pixel pipeline (pixel-pipeline.h)
+// feeds rows while they are still in cache and gets the same hash.
+struct TileHashState {
+    uint64_t acc[8];
+    uint64_t tail;
+    int rowBytes;
+    int stripes;     // Whole 64-byte stripes per row, the rest goes to tail
+
+    void Begin(uint32_t w, uint32_t h) {
+        using namespace tilehash;
+        const uint64_t init[8] = {
+            PRIME32, PRIME64, 0xC2B2AE3D27D4EB4Full, 0x165667B19E3779F9ull,
+            0x85EBCA77C2B2AE63ull, 0x27D4EB2F165667C5ull, 0x61C8864E7A143579ull, PRIME64 ^ PRIME32
+        };
+        memcpy(acc, init, sizeof(acc));
+        tail = (uint64_t)w << 32 | h;
+        rowBytes = (int)w * 4;
+        stripes = rowBytes / 64;
+    }
+
+    // Pixels past the last whole stripe of a row (after the accumulate)
+    void RowTail(const uint8_t* row) {
+        using namespace tilehash;
+        for (int x = stripes * 64; x < rowBytes; x += 4) {
+            tail = (tail ^ Load32(row + x)) * PRIME64;
+            tail ^= tail >> 29;
+        }
+    }
+
+    void Row(const uint8_t* row, SimdLevel level) {
+        using namespace tilehash;
+#ifdef SIMD_X86
+        if (level == SIMD_AVX2) AccumulateRowAVX2(acc, row, stripes, Keys());
+        else if (level == SIMD_SSE2) AccumulateRowSSE2(acc, row, stripes, Keys());
+        else AccumulateRowScalar(acc, row, stripes, Keys());
+#else
+        (void)level;
+        AccumulateRowScalar(acc, row, stripes, Keys());
+#endif
+        RowTail(row);
+    }
+
+    uint64_t Finish() const {
+        using namespace tilehash;
+        uint64_t hash = tail;
+        for (int i = 0; i < 8; i++) {
+            hash = (hash ^ acc[i]) * PRIME64;
+            hash ^= hash >> 32;
+        }
+        return hash;
+    }
+};
+
+// Hash a w x h block of BGRA pixels starting at p
+inline uint64_t HashTile(const uint8_t* p, uint32_t stride, uint32_t w, uint32_t h,
+                         SimdLevel level = GetSimdLevel()) {
+    TileHashState state;
+    state.Begin(w, h);
+    for (uint32_t y = 0; y < h; y++) state.Row(p + (size_t)y * stride, level);
+    return state.Finish();
+}
+
+// --- Dirty tile tracking ---------------------------------------------------
+
+class TileDelta {
+private:
+    uint32_t width = 0, height = 0, tileSize = DELTA_TILE_SIZE;
+    int tilesX = 0, tilesY = 0;
+    std::vector<uint64_t> hashes;   // Hash of each tile in the previous frame
+    std::vector<uint8_t> dirty;     // 1 = changed since previous frame
+    std::vector<uint8_t> candidate; // Scratch: tiles touched by a hint rect
+    std::vector<uint64_t> hashScratch; // Detect(): this frame's hashes
+    bool havePrevious = false;
+    int dirtyCount = 0;
+    bool pendingFull = false;       // Between PrepareDetect() and FinishDetect()
+    bool pendingHinted = false;
+
+public:
+    bool Initialize(uint32_t frameWidth, uint32_t frameHeight, uint32_t tile = DELTA_TILE_SIZE) {
+        if (tile == 0 || tile > 0xFFFF) return false;
+        width = frameWidth;
+        height = frameHeight;
+        tileSize = tile;
+        tilesX = (int)((width + tileSize - 1) / tileSize);
+        tilesY = (int)((height + tileSize - 1) / tileSize);
+        if (tilesX > 0xFFFF || tilesY > 0xFFFF) return false;
+        hashes.assign((size_t)tilesX * tilesY, 0);
+        dirty.assign((size_t)tilesX * tilesY, 0);
+        candidate.assign((size_t)tilesX * tilesY, 0);
+        hashScratch.assign((size_t)tilesX * tilesY, 0);
+        havePrevious = false;
+        dirtyCount = 0;
+        return true;
+    }
+
+    // Forget the previous frame; the next Detect() reports every tile dirty
+    void Reset() { havePrevious = false; }
+
+    // Compare a frame against the previous one and update the dirty map.
+    // hints == nullptr means "no hint information" (hash every tile); otherwise
+    // only tiles intersecting one of the hintCount rects can be dirty. A
+    // keyframe marks every tile dirty. Returns the number of dirty tiles.
+    int Detect(const uint8_t* pixels, uint32_t stride, const TileRect* hints, int hintCount,
+               bool keyframe, SimdLevel level = GetSimdLevel()) {
+        const uint8_t* needed = PrepareDetect(hints, hintCount, keyframe);
+        uint64_t* current = hashScratch.data();
+        for (int t = 0; t < GetTileCount(); t++) {
+            if (needed && !needed[t]) continue;
+            uint32_t x, y, w, h;
+            GetTileRect(t, &x, &y, &w, &h);
+            current[t] = HashTile(pixels + (size_t)y * stride + x * 4, stride, w, h, level);
+        }
+        return FinishDetect(current);
+    }
+
+    // Detect() in two steps, for callers that hash the tiles themselves
+    // while the pixels pass by (pixel-pipeline.h). PrepareDetect() returns
+    // one byte per tile, set for the tiles whose hash FinishDetect() will
+    // read, or nullptr if it reads all of them. The map stays valid until
+    // FinishDetect(), which takes the new hashes and returns the dirty count.
+    const uint8_t* PrepareDetect(const TileRect* hints, int hintCount, bool keyframe) {
+        int tileCount = tilesX * tilesY;
+        pendingFull = keyframe || !havePrevious;
+        pendingHinted = !pendingFull && hints;
+        if (!pendingHinted) return nullptr;
+
+        memset(candidate.data(), 0, tileCount);
+        for (int i = 0; i < hintCount; i++) {
+            int x0 = hints[i].left < 0 ? 0 : hints[i].left / (int)tileSize;
+            int y0 = hints[i].top < 0 ? 0 : hints[i].top / (int)tileSize;
+            int x1 = (hints[i].right - 1) / (int)tileSize;
+            int y1 = (hints[i].bottom - 1) / (int)tileSize;
+            if (x1 >= tilesX) x1 = tilesX - 1;
+            if (y1 >= tilesY) y1 = tilesY - 1;
+            for (int ty = y0; ty <= y1; ty++) {
+                for (int tx = x0; tx <= x1; tx++) candidate[ty * tilesX + tx] = 1;
+            }
+        }
+        return candidate.data();
+    }
+
+    int FinishDetect(const uint64_t* current) {
+        int tileCount = tilesX * tilesY;
+        dirtyCount = 0;
+        for (int t = 0; t < tileCount; t++) {
+            if (pendingHinted && !candidate[t]) {
+                dirty[t] = 0;
+                continue;
+            }
+            dirty[t] = (pendingFull || current[t] != hashes[t]) ? 1 : 0;
+            hashes[t] = current[t];
+            dirtyCount += dirty[t];
+        }
+        havePrevious = true;
+        return dirtyCount;
+    }
+
+    void GetTileRect(int index, uint32_t* x, uint32_t* y, uint32_t* w, uint32_t* h) const {
+        *x = (index % tilesX) * tileSize;
+        *y = (index / tilesX) * tileSize;
+        *w = (*x + tileSize > width) ? width - *x : tileSize;
+        *h = (*y + tileSize > height) ? height - *y : tileSize;
+    }
+
+    // Take a tile out of the dirty map, e.g. because it goes out as a move
+    // (common/move-detect.h). Its hash is already the new frame's.
+    void ClearDirty(int index) {
+        if (!dirty[index]) return;
+        dirty[index] = 0;
+        dirtyCount--;
+    }
+
+    const uint8_t* GetDirtyMap() const { return dirty.data(); }
+    bool IsDirty(int index) const { return dirty[index] != 0; }
+    int GetDirtyCount() const { return dirtyCount; }
+    int GetTileCount() const { return tilesX * tilesY; }
+    int GetTilesX() const { return tilesX; }
+    int GetTilesY() const { return tilesY; }
+    uint32_t GetTileSize() const { return tileSize; }
+
+    size_t GetTileHeaderSize() const {
+        return DELTA_TILE_HEADER_SIZE + (GetTileCount() + 7) / 8;
+    }
+
+    // Bytes needed for the header plus every dirty tile stored raw
+    size_t GetRawDeltaSize() const {
+        size_t size = GetTileHeaderSize();
+        for (int t = 0; t < GetTileCount(); t++) {
+            if (!dirty[t]) continue;
+            uint32_t x, y, w, h;
+            GetTileRect(t, &x, &y, &w, &h);
+            size += (size_t)w * h * 4;
+        }
+        return size;
+    }
+
+    // Write tile size, grid, dirty count and the packed tile map for the given
+    // dirty map (one byte per tile). Only reads immutable geometry, so other
+    // threads may call it with a copy of the map. Returns bytes written.
+    size_t WriteTileHeader(const uint8_t* dirtyMap, uint8_t* out) const {
+        int tileCount = GetTileCount();
+        uint8_t* map = out + DELTA_TILE_HEADER_SIZE;
+        memset(map, 0, (tileCount + 7) / 8);
+        int count = 0;
+        for (int t = 0; t < tileCount; t++) {
+            if (!dirtyMap[t]) continue;
+            map[t >> 3] |= (uint8_t)(1 << (t & 7));
+            count++;
+        }
+        uint16_t fields[4] = {
+            (uint16_t)tileSize, (uint16_t)tilesX, (uint16_t)tilesY, (uint16_t)count
+        };
+        memcpy(out, fields, DELTA_TILE_HEADER_SIZE);
+        return GetTileHeaderSize();
+    }
+
+    size_t WriteTileHeader(uint8_t* out) const { return WriteTileHeader(dirty.data(), out); }
+
+    // Header followed by each dirty tile's rows packed (w * 4 bytes per row).
+    // Returns bytes written.
+    size_t WriteRawDelta(const uint8_t* pixels, uint32_t stride, uint8_t* out) const {
+        uint8_t* dst = out + WriteTileHeader(out);
+        for (int t = 0; t < GetTileCount(); t++) {
+            if (!dirty[t]) continue;
+            uint32_t x, y, w, h;
+            GetTileRect(t, &x, &y, &w, &h);
+            for (uint32_t row = 0; row < h; row++) {
+                memcpy(dst, pixels + (size_t)(y + row) * stride + x * 4, w * 4);
+                dst += w * 4;
+            }
+        }
+        return dst - out;
+    }
+};
+
+// Apply a raw delta payload (as written by WriteRawDelta) onto the previous
+// frame in place. Returns false if the payload is malformed.
+inline bool ApplyRawDelta(const uint8_t* payload, size_t size, uint8_t* frame,
+                          uint32_t width, uint32_t height, uint32_t stride) {
+    if (size < DELTA_TILE_HEADER_SIZE) return false;
+    uint16_t fields[4];
+    memcpy(fields, payload, DELTA_TILE_HEADER_SIZE);
+    uint32_t tile = fields[0];
+    int tilesX = fields[1], tilesY = fields[2];
+    if (tile == 0 || tilesX != (int)((width + tile - 1) / tile) ||
+        tilesY != (int)((height + tile - 1) / tile)) {
+        return false;
+    }
+
+    int tileCount = tilesX * tilesY;
+    size_t offset = DELTA_TILE_HEADER_SIZE + (tileCount + 7) / 8;
+    if (size < offset) return false;
+    const uint8_t* map = payload + DELTA_TILE_HEADER_SIZE;
+
+    for (int t = 0; t < tileCount; t++) {
+        if (!(map[t >> 3] & (1 << (t & 7)))) continue;
+        uint32_t x = (t % tilesX) * tile, y = (t / tilesX) * tile;
+        uint32_t w = (x + tile > width) ? width - x : tile;
+        uint32_t h = (y + tile > height) ? height - y : tile;
+        if (offset + (size_t)w * h * 4 > size) return false;
+        for (uint32_t row = 0; row < h; row++) {
+            memcpy(frame + (size_t)(y + row) * stride + x * 4, payload + offset, w * 4);
+            offset += w * 4;
+        }
+    }
+    return offset == size;
+}
@@ -0,0 +1,265 @@
+// WebSocket - the parts of RFC 6455 the broadcast server needs
+// HTTP upgrade handshake (Sec-WebSocket-Accept = base64(SHA-1(key + GUID))),
+// headers for the unmasked frames a server sends, and a parser for the
+// masked frames clients send. Messages are never fragmented on send;
+// fragmented client messages are not supported (browsers don't fragment the
+// few small binary messages wire protocol v2 clients send). No extensions,
+// no subprotocols. Client-side helpers for tests and tools are at the end.
+// Portable (standard library only).
+
+#pragma once
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define WS_OP_CONTINUATION 0x0
+#define WS_OP_TEXT 0x1
+#define WS_OP_BINARY 0x2
+#define WS_OP_CLOSE 0x8
+#define WS_OP_PING 0x9
+#define WS_OP_PONG 0xA
+
+#define WS_MAX_HEADER_SIZE 14        // Masked client frame with a 64-bit length
+#define WS_SERVER_HEADER_SIZE 10     // Unmasked server frame with a 64-bit length
+#define WS_MAX_CONTROL_PAYLOAD 125
+#define WS_MAX_REQUEST_SIZE 8192     // Upgrade request, headers included
+#define WS_MAX_MESSAGE_SIZE 4096     // Largest client message accepted
+#define WS_RESPONSE_SIZE 160
+
+static const char wsGuid[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+inline void WsSha1(const uint8_t* data, size_t len, uint8_t out[20]) {
+    uint32_t h[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+    uint64_t bits = (uint64_t)len * 8;
+    size_t total = ((len + 8) / 64 + 1) * 64;
+    for (size_t block = 0; block < total; block += 64) {
+        // Message, 0x80, zero padding, 64-bit big-endian length
+        uint8_t chunk[64];
+        for (size_t i = 0; i < 64; i++) {
+            size_t pos = block + i;
+            if (pos < len) chunk[i] = data[pos];
+            else if (pos == len) chunk[i] = 0x80;
+            else if (pos >= total - 8) chunk[i] = (uint8_t)(bits >> (8 * (total - 1 - pos)));
+            else chunk[i] = 0;
+        }
+        uint32_t w[80];
+        for (int i = 0; i < 16; i++) {
+            w[i] = (uint32_t)chunk[i * 4] << 24 | (uint32_t)chunk[i * 4 + 1] << 16 |
+                   (uint32_t)chunk[i * 4 + 2] << 8 | chunk[i * 4 + 3];
+        }
+        for (int i = 16; i < 80; i++) {
+            uint32_t x = w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16];
+            w[i] = x << 1 | x >> 31;
+        }
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+        for (int i = 0; i < 80; i++) {
+            uint32_t f, k;
+            if (i < 20) { f = (b & c) | (~b & d); k = 0x5A827999; }
+            else if (i < 40) { f = b ^ c ^ d; k = 0x6ED9EBA1; }
+            else if (i < 60) { f = (b & c) | (b & d) | (c & d); k = 0x8F1BBCDC; }
+            else { f = b ^ c ^ d; k = 0xCA62C1D6; }
+            uint32_t t = (a << 5 | a >> 27) + f + e + k + w[i];
+            e = d;
+            d = c;
+            c = b << 30 | b >> 2;
+            b = a;
+            a = t;
+        }
+        h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e;
+    }
+    for (int i = 0; i < 20; i++) out[i] = (uint8_t)(h[i / 4] >> (24 - 8 * (i % 4)));
+}
+
+// Standard base64 with padding; out needs 4 * ((len + 2) / 3) + 1 bytes
+inline void WsBase64(const uint8_t* data, size_t len, char* out) {
+    static const char table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    size_t o = 0;
+    for (size_t i = 0; i < len; i += 3) {
+        uint32_t v = (uint32_t)data[i] << 16;
+        if (i + 1 < len) v |= (uint32_t)data[i + 1] << 8;
+        if (i + 2 < len) v |= data[i + 2];
+        out[o++] = table[v >> 18 & 63];
+        out[o++] = table[v >> 12 & 63];
+        out[o++] = i + 1 < len ? table[v >> 6 & 63] : '=';
+        out[o++] = i + 2 < len ? table[v & 63] : '=';
+    }
+    out[o] = 0;
+}
+
+// Sec-WebSocket-Accept for a Sec-WebSocket-Key (28 characters + NUL)
+inline void WsAcceptKey(const char* key, size_t keyLen, char out[29]) {
+    uint8_t joined[128];
+    size_t guidLen = sizeof(wsGuid) - 1;
+    if (keyLen > sizeof(joined) - guidLen) keyLen = sizeof(joined) - guidLen;
+    memcpy(joined, key, keyLen);
+    memcpy(joined + keyLen, wsGuid, guidLen);
+    uint8_t digest[20];
+    WsSha1(joined, keyLen + guidLen, digest);
+    WsBase64(digest, 20, out);
+}
+
+// Value of header name in an HTTP request (case-insensitive name, spaces
+// trimmed). Returns its length, 0 if absent.
+inline size_t WsHeaderValue(const char* request, size_t len, const char* name, const char** value) {
+    size_t nameLen = strlen(name);
+    const char* end = request + len;
+    for (const char* line = request; line < end; ) {
+        const char* eol = line;
+        while (eol < end && *eol != '\r' && *eol != '\n') eol++;
+        if ((size_t)(eol - line) > nameLen && line[nameLen] == ':') {
+            bool match = true;
+            for (size_t i = 0; i < nameLen && match; i++) match = tolower((unsigned char)line[i]) == tolower((unsigned char)name[i]);
+            if (match) {
+                const char* v = line + nameLen + 1;
+                while (v < eol && *v == ' ') v++;
+                const char* vEnd = eol;
+                while (vEnd > v && vEnd[-1] == ' ') vEnd--;
+                *value = v;
+                return (size_t)(vEnd - v);
+            }
+        }
+        line = eol;
+        while (line < end && (*line == '\r' || *line == '\n')) line++;
+    }
+    return 0;
+}
+
+// Case-insensitive search for token in a header value ("keep-alive, Upgrade")
+inline bool WsValueHas(const char* value, size_t len, const char* token) {
+    size_t tokenLen = strlen(token);
+    for (size_t i = 0; i + tokenLen <= len; i++) {
+        size_t j = 0;
+        while (j < tokenLen && tolower((unsigned char)value[i + j]) == tolower((unsigned char)token[j])) j++;
+        if (j == tokenLen) return true;
+    }
+    return false;
+}
+
+// Parse the upgrade request buffered so far and write the response
+// (WS_RESPONSE_SIZE bytes is enough). Returns 0 while the request is
+// incomplete, 1 if it was accepted (101) and -1 if refused (400 / 426).
+inline int WsHandshake(const char* request, size_t len, char* response, size_t* responseLen) {
+    const char* end = nullptr;
+    for (size_t i = 0; i + 4 <= len; i++) {
+        if (memcmp(request + i, "\r\n\r\n", 4) == 0) {
+            end = request + i;
+            break;
+        }
+    }
+    if (!end) {
+        if (len < WS_MAX_REQUEST_SIZE) return 0;
+        end = request + len;  // Too long: refuse
+    }
+    size_t headerLen = (size_t)(end - request);
+
+    const char* upgrade = nullptr;
+    const char* connection = nullptr;
+    const char* key = nullptr;
+    const char* version = nullptr;
+    size_t upgradeLen = WsHeaderValue(request, headerLen, "Upgrade", &upgrade);
+    size_t connectionLen = WsHeaderValue(request, headerLen, "Connection", &connection);
+    size_t keyLen = WsHeaderValue(request, headerLen, "Sec-WebSocket-Key", &key);
+    size_t versionLen = WsHeaderValue(request, headerLen, "Sec-WebSocket-Version", &version);
+
+    if (end == request + len || headerLen < 4 || memcmp(request, "GET ", 4) != 0 ||
+        !WsValueHas(upgrade, upgradeLen, "websocket") || !WsValueHas(connection, connectionLen, "upgrade") ||
+        keyLen == 0 || keyLen > 64) {
+        *responseLen = (size_t)snprintf(response, WS_RESPONSE_SIZE,
+            "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+        return -1;
+    }
+    if (versionLen != 2 || memcmp(version, "13", 2) != 0) {
+        *responseLen = (size_t)snprintf(response, WS_RESPONSE_SIZE,
+            "HTTP/1.1 426 Upgrade Required\r\nSec-WebSocket-Version: 13\r\nContent-Length: 0\r\n\r\n");
+        return -1;
+    }
+
+    char accept[29];
+    WsAcceptKey(key, keyLen, accept);
+    *responseLen = (size_t)snprintf(response, WS_RESPONSE_SIZE,
+        "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+        "Sec-WebSocket-Accept: %s\r\n\r\n", accept);
+    return 1;
+}
+
+// Header of an unmasked, unfragmented server frame (up to
+// WS_SERVER_HEADER_SIZE bytes). Returns its size.
+inline int WsWriteHeader(uint8_t* out, int opcode, uint64_t payloadLen) {
+    out[0] = (uint8_t)(0x80 | opcode);
+    if (payloadLen < 126) {
+        out[1] = (uint8_t)payloadLen;
+        return 2;
+    }
+    if (payloadLen <= 0xFFFF) {
+        out[1] = 126;
+        out[2] = (uint8_t)(payloadLen >> 8);
+        out[3] = (uint8_t)payloadLen;
+        return 4;
+    }
+    out[1] = 127;
+    for (int i = 0; i < 8; i++) out[2 + i] = (uint8_t)(payloadLen >> (56 - 8 * i));
+    return 10;
+}
+
+struct WsFrame {
+    int opcode = 0;
+    bool fin = false;
+    size_t headerSize = 0;
+    size_t payloadSize = 0;     // Payload starts at headerSize, already unmasked
+};
+
+// Parse one client frame at the start of data and unmask its payload in
+// place. Returns the frame's total size, 0 if more bytes are needed, -1 for
+// a protocol error (unmasked, reserved bits, oversized or bad control frame).
+inline int WsParseFrame(uint8_t* data, size_t len, WsFrame* frame) {
+    if (len < 2) return 0;
+    if (data[0] & 0x70) return -1;      // RSV bits without an extension
+    bool masked = (data[1] & 0x80) != 0;
+    if (!masked) return -1;             // Clients must mask (RFC 6455 5.1)
+    frame->fin = (data[0] & 0x80) != 0;
+    frame->opcode = data[0] & 0x0F;
+    uint64_t payload = data[1] & 0x7F;
+    size_t header = 2;
+    if (payload == 126) {
+        if (len < 4) return 0;
+        payload = (uint64_t)data[2] << 8 | data[3];
+        header = 4;
+    } else if (payload == 127) {
+        if (len < 10) return 0;
+        payload = 0;
+        for (int i = 0; i < 8; i++) payload = payload << 8 | data[2 + i];
+        header = 10;
+    }
+    if (payload > WS_MAX_MESSAGE_SIZE) return -1;
+    if ((frame->opcode & 0x8) && (payload > WS_MAX_CONTROL_PAYLOAD || !frame->fin)) return -1;
+    header += 4;
+    if (len < header + payload) return 0;
+
+    const uint8_t* mask = data + header - 4;
+    for (size_t i = 0; i < payload; i++) data[header + i] ^= mask[i & 3];
+    frame->headerSize = header;
+    frame->payloadSize = (size_t)payload;
+    return (int)(header + payload);
+}
+
+// Client side (tests and tools): upgrade request and masked frames
+
+inline size_t WsWriteRequest(char* out, size_t cap, const char* host, const char* key) {
+    return (size_t)snprintf(out, cap,
+        "GET / HTTP/1.1\r\nHost: %s\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+        "Sec-WebSocket-Key: %s\r\nSec-WebSocket-Version: 13\r\n\r\n", host, key);
+}
+
+// Masked frame with payload into out (payloadLen + WS_MAX_HEADER_SIZE bytes).
+// Returns its size.
+inline size_t WsWriteClientFrame(uint8_t* out, int opcode, const uint8_t* payload, size_t payloadLen,
+                                 const uint8_t mask[4]) {
+    size_t header = (size_t)WsWriteHeader(out, opcode, payloadLen);
+    out[1] |= 0x80;
+    memcpy(out + header, mask, 4);
+    header += 4;
+    for (size_t i = 0; i < payloadLen; i++) out[header + i] = payload[i] ^ mask[i & 3];
+    return header + payloadLen;
+}
@@ -0,0 +1,176 @@
+// Wire Protocol v2 - handshake, frame header and client messages
+// Shared by both TCP services (and ws-stream/ws-bridge.js). After connecting,
+// a v2 client sends a hello declaring the codecs it decodes, whether it
+// applies delta frames, the highest frame rate it wants and the smallest
+// scale it accepts. The server answers with a reply (status, codec, frame
+// size and rate), then streams frames, each behind the usual 4-byte length
+// prefix and starting with a v2 frame header:
+//
+//   Hello  (client, 16 bytes): "SWV2", version, flags, max fps (2),
+//                              codec mask (4), min scale %, 3 reserved
+//   Reply  (server, 16 bytes): "SWV2", version, status, codec, flags,
+//                              width (2), height (2), fps (2), 2 reserved
+//   Header (per frame, 24 bytes): version, codec, flags (2), width (2),
+//                              height (2), sequence number (8), capture us (8)
+//   Message (client, 4 bytes): type, reserved, argument (2)
+//
+// A client that sends nothing within WIRE_HANDSHAKE_MS is a v1 client and
+// keeps getting the old per-service header; both headers are 24 bytes, so
+// only the header bytes differ. All fields are little-endian.
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#define WIRE_VERSION 2
+#define WIRE_HELLO_SIZE 16
+#define WIRE_REPLY_SIZE 16
+#define WIRE_HEADER_SIZE 24
+#define WIRE_MESSAGE_SIZE 4
+#define WIRE_HANDSHAKE_MS 250       // Silence this long after connecting = v1 client
+
+static const uint8_t wireMagic[4] = { 'S', 'W', 'V', '2' };
+
+// Codec ids (frame header / reply), and bit (1 << id) in the hello's codec mask
+#define WIRE_CODEC_BGRA 1           // Raw BGRA pixels, rows packed
+#define WIRE_CODEC_JPEG 2           // Baseline JPEG
+#define WIRE_CODEC_LOSSLESS 3       // common/lossless-codec.h stream
+
+// Frame header flags
+#define WIRE_FLAG_KEYFRAME 0x1      // Decodes on its own
+#define WIRE_FLAG_DELTA 0x2         // Applies on top of the previous frame
+#define WIRE_FLAG_TILES 0x4         // Payload is a tile delta (common/tile-delta.h) of codec tiles
+#define WIRE_FLAG_MOVES 0x8         // Payload starts with copy-rect moves (common/move-detect.h)
+#define WIRE_FLAG_TILE_CODECS 0x10  // Tile sizes carry a codec id (common/tile-codec.h)
+
+// Hello / reply flags
+#define WIRE_HELLO_DELTAS 0x1       // Hello: client applies delta frames. Reply: deltas will be sent
+#define WIRE_HELLO_MOVES 0x2        // Hello: client applies moves (needs DELTAS). Reply: moves may be sent
+#define WIRE_HELLO_TILE_CODECS 0x4  // Hello: client decodes per-tile codecs (needs DELTAS). Reply: may be sent
+
+// Reply status; anything but OK is followed by the server closing the connection
+#define WIRE_STATUS_OK 0
+#define WIRE_STATUS_VERSION 1       // Client speaks an older protocol
+#define WIRE_STATUS_CODEC 2         // The stream's codec is not in the client's mask
+
+// Client message types
+#define WIRE_MSG_KEYFRAME 1         // Resend a keyframe (e.g. after a decode error)
+#define WIRE_MSG_MAX_FPS 2          // Argument: new frame rate cap, 0 = none
+
+struct WireHello {
+    uint8_t version = WIRE_VERSION;
+    uint8_t flags = 0;              // WIRE_HELLO_*
+    uint16_t maxFps = 0;            // 0 = as fast as the stream runs
+    uint32_t codecs = 0;            // 1 << WIRE_CODEC_*
+    uint8_t minScalePercent = 0;    // Smallest adaptive scale accepted, 0 = any
+};
+
+struct WireReply {
+    uint8_t version = WIRE_VERSION;
+    uint8_t status = WIRE_STATUS_OK;
+    uint8_t codec = 0;
+    uint8_t flags = 0;              // WIRE_HELLO_DELTAS / _MOVES / _TILE_CODECS if they will be sent
+    uint16_t width = 0;             // Current frame size (0 = not known yet)
+    uint16_t height = 0;
+    uint16_t fps = 0;               // Capture rate cap, 0 = unpaced
+};
+
+struct WireFrameHeader {
+    uint8_t version = WIRE_VERSION;
+    uint8_t codec = 0;
+    uint16_t flags = 0;             // WIRE_FLAG_*
+    uint16_t width = 0;
+    uint16_t height = 0;
+    uint64_t seq = 0;
+    uint64_t captureUs = 0;         // LatencyNowUs() clock
+};
+
+struct WireMessage {
+    uint8_t type = 0;
+    uint16_t arg = 0;
+};
+
+inline void WireWriteHello(const WireHello& h, uint8_t* out) {
+    memset(out, 0, WIRE_HELLO_SIZE);
+    memcpy(out, wireMagic, 4);
+    out[4] = h.version;
+    out[5] = h.flags;
+    memcpy(out + 6, &h.maxFps, 2);
+    memcpy(out + 8, &h.codecs, 4);
+    out[12] = h.minScalePercent;
+}
+
+// False if the bytes are not a hello (e.g. a v1 client sending something else)
+inline bool WireReadHello(const uint8_t* in, WireHello* h) {
+    if (memcmp(in, wireMagic, 4) != 0) return false;
+    h->version = in[4];
+    h->flags = in[5];
+    memcpy(&h->maxFps, in + 6, 2);
+    memcpy(&h->codecs, in + 8, 4);
+    h->minScalePercent = in[12] > 100 ? 100 : in[12];
+    return true;
+}
+
+inline void WireWriteReply(const WireReply& r, uint8_t* out) {
+    memset(out, 0, WIRE_REPLY_SIZE);
+    memcpy(out, wireMagic, 4);
+    out[4] = r.version;
+    out[5] = r.status;
+    out[6] = r.codec;
+    out[7] = r.flags;
+    memcpy(out + 8, &r.width, 2);
+    memcpy(out + 10, &r.height, 2);
+    memcpy(out + 12, &r.fps, 2);
+}
+
+inline bool WireReadReply(const uint8_t* in, WireReply* r) {
+    if (memcmp(in, wireMagic, 4) != 0) return false;
+    r->version = in[4];
+    r->status = in[5];
+    r->codec = in[6];
+    r->flags = in[7];
+    memcpy(&r->width, in + 8, 2);
+    memcpy(&r->height, in + 10, 2);
+    memcpy(&r->fps, in + 12, 2);
+    return true;
+}
+
+inline void WireWriteHeader(const WireFrameHeader& h, uint8_t* out) {
+    out[0] = h.version;
+    out[1] = h.codec;
+    memcpy(out + 2, &h.flags, 2);
+    memcpy(out + 4, &h.width, 2);
+    memcpy(out + 6, &h.height, 2);
+    memcpy(out + 8, &h.seq, 8);
+    memcpy(out + 16, &h.captureUs, 8);
+}
+
+inline void WireReadHeader(const uint8_t* in, WireFrameHeader* h) {
+    h->version = in[0];
+    h->codec = in[1];
+    memcpy(&h->flags, in + 2, 2);
+    memcpy(&h->width, in + 4, 2);
+    memcpy(&h->height, in + 6, 2);
+    memcpy(&h->seq, in + 8, 8);
+    memcpy(&h->captureUs, in + 16, 8);
+}
+
+inline void WireWriteMessage(const WireMessage& m, uint8_t* out) {
+    out[0] = m.type;
+    out[1] = 0;
+    memcpy(out + 2, &m.arg, 2);
+}
+
+inline void WireReadMessage(const uint8_t* in, WireMessage* m) {
+    m->type = in[0];
+    memcpy(&m->arg, in + 2, 2);
+}
+
+// Capture rate for a stream configured at fps (0 = unpaced) whose clients
+// want at most limit (0 = no cap): pacing only ever slows down for clients
+inline int WireCappedFps(int fps, int limit) {
+    if (limit <= 0) return fps;
+    if (fps <= 0 || limit < fps) return limit;
+    return fps;
+}
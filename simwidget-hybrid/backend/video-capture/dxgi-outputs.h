@@ -0,0 +1,125 @@
+// DXGI Outputs - every monitor on every adapter, for Desktop Duplication
+// Windows only (d3d11.lib dxgi.lib), shared by the capture services and
+// test-dxgi.
+//
+// Outputs are numbered across adapters in enumeration order, so output 0 is
+// the first monitor of the first adapter (what the services used to
+// duplicate unconditionally). Duplication needs a D3D11 device created on
+// the adapter that drives the output, so OpenOutput() creates one per output.
+
+#pragma once
+
+#include <d3d11.h>
+#include <dxgi1_2.h>
+#include <stdio.h>
+#include <string.h>
+
+#define DXGI_MAX_OUTPUTS 16
+
+struct DxgiOutputInfo {
+    UINT adapter = 0;          // IDXGIFactory1::EnumAdapters1 index
+    UINT output = 0;           // IDXGIAdapter::EnumOutputs index
+    char name[32] = "";        // \\.\DISPLAY1
+    char adapterName[128] = "";
+    RECT desktop = {};         // Position on the virtual desktop
+    UINT width = 0, height = 0;
+};
+
+// Fill outputs with the monitors attached to the desktop. Returns the
+// count, or -1 if DXGI could not be queried.
+inline int EnumerateOutputs(DxgiOutputInfo* outputs, int maxOutputs) {
+    IDXGIFactory1* factory = nullptr;
+    if (FAILED(CreateDXGIFactory1(__uuidof(IDXGIFactory1), (void**)&factory))) return -1;
+
+    int count = 0;
+    IDXGIAdapter1* adapter = nullptr;
+    for (UINT a = 0; count < maxOutputs && factory->EnumAdapters1(a, &adapter) != DXGI_ERROR_NOT_FOUND; a++) {
+        DXGI_ADAPTER_DESC1 adapterDesc = {};
+        adapter->GetDesc1(&adapterDesc);
+
+        IDXGIOutput* output = nullptr;
+        for (UINT o = 0; count < maxOutputs && adapter->EnumOutputs(o, &output) != DXGI_ERROR_NOT_FOUND; o++) {
+            DXGI_OUTPUT_DESC desc = {};
+            output->GetDesc(&desc);
+            output->Release();
+            if (!desc.AttachedToDesktop) continue;
+
+            DxgiOutputInfo& info = outputs[count++];
+            info.adapter = a;
+            info.output = o;
+            snprintf(info.name, sizeof(info.name), "%ls", desc.DeviceName);
+            snprintf(info.adapterName, sizeof(info.adapterName), "%ls", adapterDesc.Description);
+            info.desktop = desc.DesktopCoordinates;
+            info.width = (UINT)(desc.DesktopCoordinates.right - desc.DesktopCoordinates.left);
+            info.height = (UINT)(desc.DesktopCoordinates.bottom - desc.DesktopCoordinates.top);
+        }
+        adapter->Release();
+    }
+    factory->Release();
+    return count;
+}
+
+// One line per output, numbered as --output expects them
+inline void PrintOutputs(const DxgiOutputInfo* outputs, int count) {
+    for (int i = 0; i < count; i++) {
+        const DxgiOutputInfo& info = outputs[i];
+        printf("  %d: %s %ux%u at %ld,%ld (adapter %u: %s)\n", i, info.name, info.width, info.height,
+            (long)info.desktop.left, (long)info.desktop.top, info.adapter, info.adapterName);
+    }
+}
+
+// Create a device on the output's adapter and start duplicating the output.
+// On failure prints why and returns false with nothing left to release.
+inline bool OpenOutput(const DxgiOutputInfo& info, ID3D11Device** device, ID3D11DeviceContext** context,
+                       IDXGIOutputDuplication** duplication) {
+    *device = nullptr;
+    *context = nullptr;
+    *duplication = nullptr;
+
+    IDXGIFactory1* factory = nullptr;
+    HRESULT hr = CreateDXGIFactory1(__uuidof(IDXGIFactory1), (void**)&factory);
+    if (FAILED(hr)) {
+        printf("Failed to create DXGI factory: 0x%08X\n", (unsigned)hr);
+        return false;
+    }
+    IDXGIAdapter1* adapter = nullptr;
+    hr = factory->EnumAdapters1(info.adapter, &adapter);
+    factory->Release();
+    if (FAILED(hr)) {
+        printf("Adapter %u is gone: 0x%08X\n", info.adapter, (unsigned)hr);
+        return false;
+    }
+
+    // An explicit adapter needs D3D_DRIVER_TYPE_UNKNOWN
+    D3D_FEATURE_LEVEL featureLevel;
+    hr = D3D11CreateDevice(adapter, D3D_DRIVER_TYPE_UNKNOWN, nullptr, 0, nullptr, 0, D3D11_SDK_VERSION,
+        device, &featureLevel, context);
+    if (FAILED(hr)) {
+        adapter->Release();
+        printf("Failed to create D3D device on adapter %u: 0x%08X\n", info.adapter, (unsigned)hr);
+        return false;
+    }
+
+    IDXGIOutput* output = nullptr;
+    hr = adapter->EnumOutputs(info.output, &output);
+    adapter->Release();
+    IDXGIOutput1* output1 = nullptr;
+    if (SUCCEEDED(hr)) {
+        hr = output->QueryInterface(__uuidof(IDXGIOutput1), (void**)&output1);
+        output->Release();
+    }
+    if (SUCCEEDED(hr)) {
+        hr = output1->DuplicateOutput(*device, duplication);
+        output1->Release();
+    }
+    if (FAILED(hr)) {
+        printf("Failed to duplicate %s: 0x%08X\n", info.name, (unsigned)hr);
+        (*context)->Release();
+        (*device)->Release();
+        *context = nullptr;
+        *device = nullptr;
+        *duplication = nullptr;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,82 @@
+// Frame pool benchmark: sustained 60 FPS pull, pooled vs. per-frame V8 buffers
+// Reports RSS and GC pause time for each mode.
+// Usage: node --expose-gc bench-pool.js [seconds] [fps]
+
+const { PerformanceObserver, constants } = require('perf_hooks');
+const capture = require('./index');
+
+const SECONDS = parseFloat(process.argv[2] || '10');
+const FPS = parseInt(process.argv[3] || '60', 10);
+
+function sleep(ms) {
+    return new Promise((resolve) => setTimeout(resolve, ms));
+}
+
+async function run(pooled) {
+    capture.configurePool({ pooled });
+    if (global.gc) global.gc();
+    await sleep(200);
+
+    const pauses = [];
+    const observer = new PerformanceObserver((list) => {
+        for (const entry of list.getEntries()) pauses.push(entry);
+    });
+    observer.observe({ entryTypes: ['gc'] });
+
+    const rssStart = process.memoryUsage().rss;
+    let rssPeak = rssStart;
+    let rssSum = 0;
+    let samples = 0;
+    let frames = 0;
+    let nulls = 0;
+
+    const interval = 1000 / FPS;
+    const end = Date.now() + SECONDS * 1000;
+    let next = Date.now();
+    while (Date.now() < end) {
+        const frame = await capture.captureFrameAsync();
+        if (frame) {
+            frames++;
+            frame[0] ^= 1; // Touch it like a consumer would
+        } else {
+            nulls++;
+        }
+
+        const rss = process.memoryUsage().rss;
+        rssPeak = Math.max(rssPeak, rss);
+        rssSum += rss;
+        samples++;
+
+        next += interval;
+        const wait = next - Date.now();
+        if (wait > 0) await sleep(wait);
+        else next = Date.now();
+    }
+
+    await sleep(100); // Let the last GC entries arrive
+    observer.disconnect();
+
+    const total = pauses.reduce((sum, e) => sum + e.duration, 0);
+    const max = pauses.reduce((m, e) => Math.max(m, e.duration), 0);
+    const major = pauses.filter((e) => (e.detail ? e.detail.kind : e.kind) === constants.NODE_PERFORMANCE_GC_MAJOR).length;
+    const mb = (bytes) => (bytes / 1048576).toFixed(1);
+
+    console.log(`${pooled ? 'pooled  ' : 'unpooled'}  frames ${frames} (${nulls} timeouts)  ` +
+        `RSS avg ${mb(rssSum / samples)} MB peak ${mb(rssPeak)} MB  ` +
+        `GC ${pauses.length} pauses (${major} major) total ${total.toFixed(1)} ms max ${max.toFixed(2)} ms`);
+    if (pooled) console.log('          pool', JSON.stringify(capture.getPoolStats()));
+}
+
+(async () => {
+    if (!capture.initialize()) {
+        console.error('Capture initialization failed');
+        process.exit(1);
+    }
+    const { width, height } = capture.getInfo();
+    console.log(`Frame pool benchmark: ${width}x${height}, ${FPS} FPS pull for ${SECONDS} s per mode` +
+        (global.gc ? '' : ' (run with --expose-gc for a clean start)'));
+
+    await run(false);
+    await run(true);
+    capture.cleanup();
+})();
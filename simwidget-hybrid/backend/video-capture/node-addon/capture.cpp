@@ -1,11 +1,39 @@
 // Node.js Native Addon for Screen Capture
 // Uses N-API wrapper around Desktop Duplication API
 // Build: npm install && node-gyp rebuild
+//
+// startStream() runs capture on a native producer thread and hands frames to
+// JavaScript through a ThreadSafeFunction. Only one delivery is queued at a
+// time: frames captured while JS is busy replace the undelivered one (latest
+// frame wins), so a slow event loop drops frames instead of queueing them.
+// captureFrameAsync() captures on the libuv thread pool. Neither ever waits
+// on the GPU or on AcquireNextFrame's timeout on the main thread.
+//
+// Frames live in a pool of preallocated, page-aligned buffers (FramePool)
+// handed to JS as external buffers, so steady streaming allocates nothing and
+// puts no pixel memory on the V8 heap. A frame goes back to the pool when its
+// Buffer is garbage collected, or right away through releaseFrame().
+//
+// initialize(output) duplicates the monitor listOutputs() numbers that way
+// (dxgi-outputs.h, any adapter); output 0 by default.
 
 #include <napi.h>
 #include <windows.h>
 #include <d3d11.h>
 #include <dxgi1_2.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "../dxgi-outputs.h"
+
+#define FRAME_HEADER_SIZE 8   // width (4 bytes), height (4 bytes)
+#define ACQUIRE_TIMEOUT_MS 100
+#define POOL_MAX_FRAMES 32    // Hard limit on pool slots
+#define POOL_DEFAULT_FRAMES 8 // Default limit (configurePool() changes it)
+#define POOL_PREALLOCATE 3    // Capturing + pending + one held by JS
 
 class ScreenCaptureAddon {
 private:
@@ -14,39 +42,20 @@ private:
     IDXGIOutputDuplication* duplication = nullptr;
     ID3D11Texture2D* stagingTexture = nullptr;
     UINT width = 0, height = 0;
+    int outputIndex = -1;
     bool initialized = false;
 
 public:
-    bool Initialize() {
-        if (initialized) return true;
+    // Duplicate output index (dxgi-outputs.h numbering) on a device of its
+    // own adapter. Switching to another output starts over.
+    bool Initialize(int index) {
+        if (initialized && index == outputIndex) return true;
+        Cleanup();
 
-        D3D_FEATURE_LEVEL featureLevel;
-        HRESULT hr = D3D11CreateDevice(nullptr, D3D_DRIVER_TYPE_HARDWARE, nullptr,
-            0, nullptr, 0, D3D11_SDK_VERSION, &device, &featureLevel, &context);
-        if (FAILED(hr)) return false;
-
-        IDXGIDevice* dxgiDevice;
-        hr = device->QueryInterface(__uuidof(IDXGIDevice), (void**)&dxgiDevice);
-        if (FAILED(hr)) return false;
-
-        IDXGIAdapter* adapter;
-        hr = dxgiDevice->GetAdapter(&adapter);
-        dxgiDevice->Release();
-        if (FAILED(hr)) return false;
-
-        IDXGIOutput* output;
-        hr = adapter->EnumOutputs(0, &output);
-        adapter->Release();
-        if (FAILED(hr)) return false;
-
-        IDXGIOutput1* output1;
-        hr = output->QueryInterface(__uuidof(IDXGIOutput1), (void**)&output1);
-        output->Release();
-        if (FAILED(hr)) return false;
-
-        hr = output1->DuplicateOutput(device, &duplication);
-        output1->Release();
-        if (FAILED(hr)) return false;
+        DxgiOutputInfo outputs[DXGI_MAX_OUTPUTS];
+        int count = EnumerateOutputs(outputs, DXGI_MAX_OUTPUTS);
+        if (index < 0 || index >= count) return false;
+        if (!OpenOutput(outputs[index], &device, &context, &duplication)) return false;
 
         DXGI_OUTDUPL_DESC desc;
         duplication->GetDesc(&desc);
@@ -63,102 +72,554 @@ public:
         texDesc.Usage = D3D11_USAGE_STAGING;
         texDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
 
-        hr = device->CreateTexture2D(&texDesc, nullptr, &stagingTexture);
-        if (FAILED(hr)) return false;
+        HRESULT hr = device->CreateTexture2D(&texDesc, nullptr, &stagingTexture);
+        if (FAILED(hr)) {
+            Cleanup();
+            return false;
+        }
 
+        outputIndex = index;
         initialized = true;
         return true;
     }
 
-    Napi::Buffer<uint8_t> CaptureFrame(Napi::Env env) {
-        if (!initialized) {
-            return Napi::Buffer<uint8_t>::New(env, 0);
-        }
+    // Bytes of one frame: 8 byte header + BGRA data
+    size_t GetFrameSize() { return FRAME_HEADER_SIZE + (size_t)width * height * 4; }
+
+    // Capture into data (GetFrameSize() bytes). Returns the size, -2 if the
+    // screen didn't change within the timeout, or -1 on error. Any thread,
+    // but callers serialize (the D3D11 immediate context isn't thread safe).
+    int CaptureInto(uint8_t* data, size_t capacity, UINT timeoutMs) {
+        if (!initialized || capacity < GetFrameSize()) return -1;
 
         DXGI_OUTDUPL_FRAME_INFO frameInfo;
         IDXGIResource* resource = nullptr;
 
         duplication->ReleaseFrame();
 
-        HRESULT hr = duplication->AcquireNextFrame(100, &frameInfo, &resource);
-        if (FAILED(hr)) {
-            return Napi::Buffer<uint8_t>::New(env, 0);
-        }
+        HRESULT hr = duplication->AcquireNextFrame(timeoutMs, &frameInfo, &resource);
+        if (hr == DXGI_ERROR_WAIT_TIMEOUT) return -2;
+        if (FAILED(hr)) return -1;
 
         ID3D11Texture2D* texture;
         hr = resource->QueryInterface(__uuidof(ID3D11Texture2D), (void**)&texture);
         resource->Release();
-        if (FAILED(hr)) {
-            return Napi::Buffer<uint8_t>::New(env, 0);
-        }
+        if (FAILED(hr)) return -1;
 
         context->CopyResource(stagingTexture, texture);
         texture->Release();
 
         D3D11_MAPPED_SUBRESOURCE mapped;
         hr = context->Map(stagingTexture, 0, D3D11_MAP_READ, 0, &mapped);
-        if (FAILED(hr)) {
-            return Napi::Buffer<uint8_t>::New(env, 0);
-        }
-
-        // Create buffer: 8 byte header + BGRA data
-        size_t headerSize = 8;
-        size_t dataSize = width * height * 4;
-        size_t totalSize = headerSize + dataSize;
-
-        auto buffer = Napi::Buffer<uint8_t>::New(env, totalSize);
-        uint8_t* data = buffer.Data();
+        if (FAILED(hr)) return -1;
 
         // Write header
         memcpy(data, &width, 4);
         memcpy(data + 4, &height, 4);
 
         // Copy pixel data (handle pitch)
-        uint8_t* dst = data + headerSize;
+        uint8_t* dst = data + FRAME_HEADER_SIZE;
         uint8_t* src = (uint8_t*)mapped.pData;
         for (UINT y = 0; y < height; y++) {
             memcpy(dst + y * width * 4, src + y * mapped.RowPitch, width * 4);
         }
 
         context->Unmap(stagingTexture, 0);
-        return buffer;
+        return (int)GetFrameSize();
     }
 
     UINT GetWidth() { return width; }
     UINT GetHeight() { return height; }
+    int GetOutput() { return outputIndex; }
 
     void Cleanup() {
         if (stagingTexture) { stagingTexture->Release(); stagingTexture = nullptr; }
         if (duplication) { duplication->Release(); duplication = nullptr; }
         if (context) { context->Release(); context = nullptr; }
         if (device) { device->Release(); device = nullptr; }
+        outputIndex = -1;
         initialized = false;
     }
 };
 
 // Global instance
 static ScreenCaptureAddon* captureInstance = nullptr;
+static std::mutex captureLock;  // Serializes D3D use: producer thread, async workers, sync calls
+
+// Fixed table of frame-sized buffers shared by the producer thread, async
+// workers and the main thread. A frame handed to JS is identified by a handle
+// (slot index + generation); releasing a slot bumps its generation, so the
+// finalizer of a Buffer that was already released with releaseFrame() finds
+// a stale handle and leaves the slot alone.
+class FramePool {
+private:
+    struct Slot {
+        uint8_t* data = nullptr;
+        size_t capacity = 0;
+        size_t size = 0;          // Bytes captured into data; what JS gets to see
+        uint32_t generation = 0;
+        bool inUse = false;
+    };
+
+    std::mutex lock;
+    Slot slots[POOL_MAX_FRAMES];
+    size_t frameSize = 0;
+    int limit = POOL_DEFAULT_FRAMES;
+    int allocated = 0;
+    int inUse = 0;
+    int highWater = 0;
+    uint64_t exhausted = 0;   // Acquire() calls that found every slot busy
+
+    // Page-aligned and committed up front, so capture never page-faults into it
+    static uint8_t* Allocate(size_t bytes) {
+        uint8_t* p = (uint8_t*)VirtualAlloc(nullptr, bytes, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+        if (p) memset(p, 0, bytes);
+        return p;
+    }
+
+    void FreeSlot(Slot& slot) {
+        if (!slot.data) return;
+        VirtualFree(slot.data, 0, MEM_RELEASE);
+        slot.data = nullptr;
+        slot.capacity = 0;
+        allocated--;
+    }
+
+    void ReleaseLocked(int index) {
+        Slot& slot = slots[index];
+        slot.inUse = false;
+        slot.size = 0;
+        slot.generation++;
+        inUse--;
+        if (slot.capacity != frameSize) FreeSlot(slot);  // Resolution changed while JS held it
+    }
+
+public:
+    bool enabled = true;      // false: copy each frame into a V8 Buffer (old behaviour, for benchmarks)
+
+    // Set the frame size and slot limit; idle slots of another size are freed
+    void Configure(size_t size, int maxFrames, int preallocate) {
+        std::lock_guard<std::mutex> guard(lock);
+        frameSize = size;
+        limit = maxFrames < 1 ? 1 : maxFrames > POOL_MAX_FRAMES ? POOL_MAX_FRAMES : maxFrames;
+        for (Slot& slot : slots) {
+            if (!slot.inUse && slot.data && slot.capacity != size) FreeSlot(slot);
+        }
+        for (int i = 0; i < POOL_MAX_FRAMES && allocated < preallocate && allocated < limit && size > 0; i++) {
+            if (slots[i].data) continue;
+            slots[i].data = Allocate(size);
+            if (!slots[i].data) break;
+            slots[i].capacity = size;
+            allocated++;
+        }
+    }
+
+    // Slot index, or -1 when every slot up to the limit is in use
+    int Acquire() {
+        std::lock_guard<std::mutex> guard(lock);
+        int empty = -1;
+        for (int i = 0; i < POOL_MAX_FRAMES; i++) {
+            Slot& slot = slots[i];
+            if (slot.inUse) continue;
+            if (slot.data && slot.capacity == frameSize) {
+                slot.inUse = true;
+                if (++inUse > highWater) highWater = inUse;
+                return i;
+            }
+            if (!slot.data && empty < 0) empty = i;
+        }
+        if (empty < 0 || allocated >= limit || frameSize == 0) {
+            exhausted++;
+            return -1;
+        }
+        Slot& slot = slots[empty];
+        slot.data = Allocate(frameSize);
+        if (!slot.data) return -1;
+        slot.capacity = frameSize;
+        slot.inUse = true;
+        allocated++;
+        if (++inUse > highWater) highWater = inUse;
+        return empty;
+    }
+
+    void Release(int index) {
+        std::lock_guard<std::mutex> guard(lock);
+        if (index >= 0 && index < POOL_MAX_FRAMES && slots[index].inUse) ReleaseLocked(index);
+    }
+
+    // Handle for a slot about to be handed to JS
+    uintptr_t Handle(int index) {
+        std::lock_guard<std::mutex> guard(lock);
+        return ((uintptr_t)(slots[index].generation & 0xFFFFFF) << 8) | (uintptr_t)index;
+    }
+
+    // Finalizer path: ignored if the slot was released since the handle was made
+    void ReleaseHandle(uintptr_t handle) {
+        std::lock_guard<std::mutex> guard(lock);
+        int index = (int)(handle & 0xFF);
+        uint32_t generation = (uint32_t)(handle >> 8);
+        if (index < POOL_MAX_FRAMES && slots[index].inUse && (slots[index].generation & 0xFFFFFF) == generation) {
+            ReleaseLocked(index);
+        }
+    }
+
+    // releaseFrame() path: the slot whose memory a Buffer points at
+    bool ReleaseData(const uint8_t* data) {
+        std::lock_guard<std::mutex> guard(lock);
+        for (int i = 0; i < POOL_MAX_FRAMES; i++) {
+            if (slots[i].inUse && slots[i].data == data) {
+                ReleaseLocked(i);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Owner-only accessors for an acquired slot. Configure() never resizes
+    // a slot in use, so a slot filled before a resolution change keeps its
+    // old size and is wrapped at that size.
+    uint8_t* Data(int index) { return slots[index].data; }
+    size_t Capacity(int index) { return slots[index].capacity; }
+    size_t Size(int index) { return slots[index].size; }
+
+    // Record a CaptureInto() result as the slot's size; passes it through
+    int Fill(int index, int result) {
+        slots[index].size = result > 0 ? (size_t)result : 0;
+        return result;
+    }
+
+    size_t GetFrameSize() { return frameSize; }
+
+    Napi::Object GetStats(Napi::Env env) {
+        std::lock_guard<std::mutex> guard(lock);
+        Napi::Object result = Napi::Object::New(env);
+        result.Set("enabled", enabled);
+        result.Set("frameSize", (double)frameSize);
+        result.Set("frames", allocated);
+        result.Set("inUse", inUse);
+        result.Set("free", allocated - inUse);
+        result.Set("highWater", highWater);
+        result.Set("maxFrames", limit);
+        result.Set("exhausted", (double)exhausted);
+        return result;
+    }
+};
+
+static FramePool pool;
+
+// Hand a captured slot to JS. Pooled: an external Buffer over the slot that
+// returns it on GC. Unpooled: a fresh V8 Buffer copy, slot returned at once.
+static Napi::Buffer<uint8_t> WrapFrame(Napi::Env env, int slot) {
+    if (!pool.enabled) {
+        auto copy = Napi::Buffer<uint8_t>::Copy(env, pool.Data(slot), pool.Size(slot));
+        pool.Release(slot);
+        return copy;
+    }
+    void* handle = (void*)pool.Handle(slot);
+    return Napi::Buffer<uint8_t>::New(env, pool.Data(slot), pool.Size(slot),
+        [](Napi::Env, uint8_t*, void* hint) { pool.ReleaseHandle((uintptr_t)hint); }, handle);
+}
+
+// Continuous capture on a native thread, delivered through a ThreadSafeFunction
+struct FrameStream {
+    std::thread producer;
+    std::atomic<bool> running{false};
+    std::atomic<int> maxFps{0};                // 0 = as fast as frames arrive
+    std::mutex lock;
+    std::condition_variable wake;              // Cuts the fps-cap sleep short on stop
+    int latest = -1;                           // Pool slot of the newest frame not yet handed to JS (guarded by lock)
+    bool deliveryQueued = false;               // A Deliver() call is pending (guarded by lock)
+    Napi::ThreadSafeFunction tsfn;
+    std::vector<Napi::Promise::Deferred> waiters;  // captureFrameAsync() calls (main thread only)
+
+    std::atomic<uint64_t> framesCaptured{0};
+    std::atomic<uint64_t> framesDelivered{0};
+    std::atomic<uint64_t> framesCoalesced{0};  // Replaced before JS got to them
+    std::atomic<uint64_t> poolStalls{0};       // Captures skipped because JS holds every pool frame
+};
+
+static FrameStream stream;
+
+// Main thread: hand the newest frame to the stream callback and any waiters
+static void Deliver(Napi::Env env, Napi::Function callback, FrameStream* s) {
+    int frame;
+    {
+        std::lock_guard<std::mutex> guard(s->lock);
+        frame = s->latest;
+        s->latest = -1;
+        s->deliveryQueued = false;
+    }
+    if (frame < 0) return;
+    if (env == nullptr) {
+        pool.Release(frame);
+        return;
+    }
+
+    Napi::Buffer<uint8_t> buffer = WrapFrame(env, frame);
+    s->framesDelivered++;
+    for (auto& waiter : s->waiters) waiter.Resolve(buffer);
+    s->waiters.clear();
+    if (!callback.IsEmpty()) callback.Call({ buffer });
+}
+
+static void ProducerThread(FrameStream* s) {
+    auto nextFrame = std::chrono::steady_clock::now();
+    while (s->running) {
+        int fps = s->maxFps;
+        if (fps > 0) {
+            std::unique_lock<std::mutex> guard(s->lock);
+            s->wake.wait_until(guard, nextFrame, [s] { return !s->running; });
+            if (!s->running) break;
+        }
+
+        int frame = pool.Acquire();
+        if (frame < 0) {
+            // JS is holding every pool frame; wait for GC or releaseFrame()
+            s->poolStalls++;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+        int result;
+        {
+            std::lock_guard<std::mutex> guard(captureLock);
+            result = pool.Fill(frame, captureInstance->CaptureInto(pool.Data(frame), pool.Capacity(frame), ACQUIRE_TIMEOUT_MS));
+        }
+        if (result <= 0) {
+            pool.Release(frame);
+            if (result == -1) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            continue;
+        }
+        s->framesCaptured++;
+        if (fps > 0) {
+            auto now = std::chrono::steady_clock::now();
+            nextFrame += std::chrono::microseconds(1000000 / fps);
+            if (nextFrame < now) nextFrame = now;  // Don't burst to catch up
+        }
+
+        // Latest frame wins: only one delivery is ever queued
+        bool queue;
+        {
+            std::lock_guard<std::mutex> guard(s->lock);
+            if (s->latest >= 0) {
+                pool.Release(s->latest);
+                s->framesCoalesced++;
+            }
+            s->latest = frame;
+            queue = !s->deliveryQueued;
+            s->deliveryQueued = true;
+        }
+        if (queue && s->tsfn.NonBlockingCall(s, Deliver) != napi_ok) {
+            std::lock_guard<std::mutex> guard(s->lock);
+            s->deliveryQueued = false;
+        }
+    }
+}
+
+static void StopStream() {
+    if (!stream.running) return;
+    {
+        std::lock_guard<std::mutex> guard(stream.lock);
+        stream.running = false;
+    }
+    stream.wake.notify_all();
+    stream.producer.join();
+    stream.tsfn.Release();  // Already queued Deliver() calls still run
+}
+
+// captureFrameAsync() while not streaming: one capture on the libuv pool
+class CaptureWorker : public Napi::AsyncWorker {
+private:
+    Napi::Promise::Deferred deferred;
+    int frame = -1;
+    int result = -1;
+
+public:
+    CaptureWorker(Napi::Env env) : Napi::AsyncWorker(env), deferred(Napi::Promise::Deferred::New(env)) {}
+    ~CaptureWorker() { pool.Release(frame); }
+
+    Napi::Promise GetPromise() { return deferred.Promise(); }
+
+    void Execute() override {
+        std::lock_guard<std::mutex> guard(captureLock);
+        if (!captureInstance) return;
+        frame = pool.Acquire();
+        if (frame < 0) return;
+        result = pool.Fill(frame, captureInstance->CaptureInto(pool.Data(frame), pool.Capacity(frame), ACQUIRE_TIMEOUT_MS));
+    }
+
+    void OnOK() override {
+        if (result <= 0) {
+            deferred.Resolve(Env().Null());  // Timeout or error: no frame
+            return;
+        }
+        deferred.Resolve(WrapFrame(Env(), frame));
+        frame = -1;
+    }
+};
 
 // N-API wrapper functions
+
+// initialize(output = 0). False if there is no such output, or while a
+// stream runs on another one.
 Napi::Boolean Initialize(const Napi::CallbackInfo& info) {
     Napi::Env env = info.Env();
+    int output = info.Length() > 0 && info[0].IsNumber() ? info[0].As<Napi::Number>().Int32Value() : 0;
 
     if (!captureInstance) {
         captureInstance = new ScreenCaptureAddon();
     }
+    if (stream.running && output != captureInstance->GetOutput()) {
+        return Napi::Boolean::New(env, false);
+    }
 
-    bool result = captureInstance->Initialize();
+    bool result;
+    {
+        std::lock_guard<std::mutex> guard(captureLock);  // Wait out an in-flight async capture
+        result = captureInstance->Initialize(output);
+    }
+    if (result) {
+        pool.Configure(captureInstance->GetFrameSize(), POOL_DEFAULT_FRAMES, POOL_PREALLOCATE);
+    }
     return Napi::Boolean::New(env, result);
 }
 
+// Synchronous capture on the calling thread (blocks up to 100 ms). Returns an
+// empty buffer while a stream is running rather than waiting for the producer.
 Napi::Buffer<uint8_t> CaptureFrame(const Napi::CallbackInfo& info) {
     Napi::Env env = info.Env();
 
-    if (!captureInstance) {
+    if (!captureInstance || stream.running) {
+        return Napi::Buffer<uint8_t>::New(env, 0);
+    }
+
+    int frame = pool.Acquire();
+    if (frame < 0) {
+        return Napi::Buffer<uint8_t>::New(env, 0);
+    }
+    int result;
+    {
+        std::lock_guard<std::mutex> guard(captureLock);
+        result = pool.Fill(frame, captureInstance->CaptureInto(pool.Data(frame), pool.Capacity(frame), ACQUIRE_TIMEOUT_MS));
+    }
+    if (result <= 0) {
+        pool.Release(frame);
         return Napi::Buffer<uint8_t>::New(env, 0);
     }
+    return WrapFrame(env, frame);
+}
+
+// Promise of the next frame (Buffer), or null on timeout/error
+Napi::Value CaptureFrameAsync(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+
+    if (!captureInstance) {
+        auto deferred = Napi::Promise::Deferred::New(env);
+        deferred.Resolve(env.Null());
+        return deferred.Promise();
+    }
+    if (stream.running) {
+        // The producer owns the duplication; take its next delivery
+        stream.waiters.push_back(Napi::Promise::Deferred::New(env));
+        return stream.waiters.back().Promise();
+    }
 
-    return captureInstance->CaptureFrame(env);
+    CaptureWorker* worker = new CaptureWorker(env);
+    Napi::Promise promise = worker->GetPromise();
+    worker->Queue();
+    return promise;
+}
+
+// startStream(callback(frame), maxFps = 0)
+Napi::Boolean StartStream(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+
+    if (!captureInstance || stream.running || info.Length() < 1 || !info[0].IsFunction()) {
+        return Napi::Boolean::New(env, false);
+    }
+    stream.maxFps = info.Length() > 1 && info[1].IsNumber() ? info[1].As<Napi::Number>().Int32Value() : 0;
+    stream.framesCaptured = 0;
+    stream.framesDelivered = 0;
+    stream.framesCoalesced = 0;
+    stream.poolStalls = 0;
+    stream.tsfn = Napi::ThreadSafeFunction::New(env, info[0].As<Napi::Function>(), "ScreenCaptureStream", 0, 1);
+    stream.running = true;
+    stream.producer = std::thread(ProducerThread, &stream);
+    return Napi::Boolean::New(env, true);
+}
+
+void StopStreamWrapper(const Napi::CallbackInfo& info) {
+    StopStream();
+    // Nothing more is coming for pending captureFrameAsync() calls
+    for (auto& waiter : stream.waiters) waiter.Resolve(info.Env().Null());
+    stream.waiters.clear();
+}
+
+// setMaxFps(fps): 0 removes the cap. Applies to the running stream.
+void SetMaxFps(const Napi::CallbackInfo& info) {
+    if (info.Length() > 0 && info[0].IsNumber()) {
+        int fps = info[0].As<Napi::Number>().Int32Value();
+        stream.maxFps = fps > 0 ? fps : 0;
+        stream.wake.notify_all();
+    }
+}
+
+Napi::Object GetStreamStats(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("running", stream.running.load());
+    result.Set("maxFps", stream.maxFps.load());
+    result.Set("framesCaptured", (double)stream.framesCaptured);
+    result.Set("framesDelivered", (double)stream.framesDelivered);
+    result.Set("framesCoalesced", (double)stream.framesCoalesced);
+    result.Set("poolStalls", (double)stream.poolStalls);
+    return result;
+}
+
+// releaseFrame(buffer): give a frame back to the pool before GC would. The
+// Buffer is detached (length 0) so it can't read a slot that is reused.
+Napi::Boolean ReleaseFrame(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    if (info.Length() < 1 || !info[0].IsBuffer()) {
+        return Napi::Boolean::New(env, false);
+    }
+    Napi::Buffer<uint8_t> buffer = info[0].As<Napi::Buffer<uint8_t>>();
+    if (buffer.Length() == 0 || !pool.ReleaseData(buffer.Data())) {
+        return Napi::Boolean::New(env, false);  // Not a pool frame, or already released
+    }
+    buffer.ArrayBuffer().Detach();
+    return Napi::Boolean::New(env, true);
+}
+
+// configurePool(maxFrames, preallocate, enabled)
+void ConfigurePool(const Napi::CallbackInfo& info) {
+    int maxFrames = info.Length() > 0 && info[0].IsNumber() ? info[0].As<Napi::Number>().Int32Value() : POOL_DEFAULT_FRAMES;
+    int preallocate = info.Length() > 1 && info[1].IsNumber() ? info[1].As<Napi::Number>().Int32Value() : POOL_PREALLOCATE;
+    if (info.Length() > 2 && info[2].IsBoolean()) pool.enabled = info[2].As<Napi::Boolean>().Value();
+    pool.Configure(captureInstance ? captureInstance->GetFrameSize() : pool.GetFrameSize(), maxFrames, preallocate);
+}
+
+Napi::Object GetPoolStats(const Napi::CallbackInfo& info) {
+    return pool.GetStats(info.Env());
+}
+
+// Monitors on every adapter, in the numbering initialize() takes
+Napi::Array ListOutputs(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    DxgiOutputInfo outputs[DXGI_MAX_OUTPUTS];
+    int count = EnumerateOutputs(outputs, DXGI_MAX_OUTPUTS);
+    Napi::Array result = Napi::Array::New(env);
+    for (int i = 0; i < count; i++) {
+        Napi::Object output = Napi::Object::New(env);
+        output.Set("index", i);
+        output.Set("name", outputs[i].name);
+        output.Set("adapter", outputs[i].adapterName);
+        output.Set("x", (int)outputs[i].desktop.left);
+        output.Set("y", (int)outputs[i].desktop.top);
+        output.Set("width", outputs[i].width);
+        output.Set("height", outputs[i].height);
+        result.Set((uint32_t)i, output);
+    }
+    return result;
 }
 
 Napi::Object GetInfo(const Napi::CallbackInfo& info) {
@@ -168,10 +629,12 @@ Napi::Object GetInfo(const Napi::CallbackInfo& info) {
     if (captureInstance) {
         result.Set("width", captureInstance->GetWidth());
         result.Set("height", captureInstance->GetHeight());
+        result.Set("output", captureInstance->GetOutput());
         result.Set("initialized", true);
     } else {
         result.Set("width", 0);
         result.Set("height", 0);
+        result.Set("output", -1);
         result.Set("initialized", false);
     }
 
@@ -179,16 +642,28 @@ Napi::Object GetInfo(const Napi::CallbackInfo& info) {
 }
 
 void Cleanup(const Napi::CallbackInfo& info) {
+    StopStreamWrapper(info);
+    std::lock_guard<std::mutex> guard(captureLock);  // Wait out an in-flight async capture
     if (captureInstance) {
         captureInstance->Cleanup();
         delete captureInstance;
         captureInstance = nullptr;
     }
+    pool.Configure(0, POOL_DEFAULT_FRAMES, 0);  // Frees idle frames; JS-held ones go when collected
 }
 
 Napi::Object Init(Napi::Env env, Napi::Object exports) {
     exports.Set("initialize", Napi::Function::New(env, Initialize));
     exports.Set("captureFrame", Napi::Function::New(env, CaptureFrame));
+    exports.Set("captureFrameAsync", Napi::Function::New(env, CaptureFrameAsync));
+    exports.Set("startStream", Napi::Function::New(env, StartStream));
+    exports.Set("stopStream", Napi::Function::New(env, StopStreamWrapper));
+    exports.Set("setMaxFps", Napi::Function::New(env, SetMaxFps));
+    exports.Set("getStreamStats", Napi::Function::New(env, GetStreamStats));
+    exports.Set("releaseFrame", Napi::Function::New(env, ReleaseFrame));
+    exports.Set("configurePool", Napi::Function::New(env, ConfigurePool));
+    exports.Set("getPoolStats", Napi::Function::New(env, GetPoolStats));
+    exports.Set("listOutputs", Napi::Function::New(env, ListOutputs));
     exports.Set("getInfo", Napi::Function::New(env, GetInfo));
     exports.Set("cleanup", Napi::Function::New(env, Cleanup));
     return exports;
@@ -13,22 +13,35 @@ try {
 class ScreenCapture {
     constructor() {
         this.initialized = false;
+        this.output = 0;
     }
 
     /**
      * Initialize the screen capture system
-     * @returns {boolean} Success status
+     * @param {number} [output] - Monitor to capture, numbered as listOutputs() (default: the previous one, 0 at first)
+     * @returns {boolean} Success status (false while streaming another output)
      */
-    initialize() {
+    initialize(output = this.output) {
         if (!addon) {
             throw new Error('Native addon not available');
         }
-        this.initialized = addon.initialize();
+        this.initialized = addon.initialize(output);
+        if (this.initialized) this.output = output;
         return this.initialized;
     }
 
     /**
-     * Capture a single frame
+     * Monitors on every adapter, in the numbering initialize() takes
+     * @returns {Array} [{ index, name, adapter, x, y, width, height }]
+     */
+    listOutputs() {
+        if (!addon) return [];
+        return addon.listOutputs();
+    }
+
+    /**
+     * Capture a single frame on the calling thread (blocks up to 100 ms).
+     * Returns null while a stream is running - use captureFrameAsync().
      * @returns {Buffer|null} Raw frame data (8 byte header + BGRA pixels)
      */
     captureFrame() {
@@ -41,12 +54,103 @@ class ScreenCapture {
         return buffer.length > 0 ? buffer : null;
     }
 
+    /**
+     * Capture a single frame off the main thread. While a stream is running
+     * this resolves with the stream's next frame.
+     * @returns {Promise<Buffer|null>} Raw frame data, or null on timeout/error
+     */
+    captureFrameAsync() {
+        if (!this.initialized) {
+            if (!this.initialize()) {
+                return Promise.resolve(null);
+            }
+        }
+        return addon.captureFrameAsync();
+    }
+
+    /**
+     * Capture continuously on a native thread. onFrame gets each frame
+     * (8 byte header + BGRA pixels); frames captured while the event loop is
+     * busy replace the undelivered one instead of queueing up.
+     * @param {Function} onFrame - Called with a Buffer per frame
+     * @param {Object} [options] - { maxFps: 0 = uncapped }
+     * @returns {boolean} False if already streaming or not initialized
+     */
+    startStream(onFrame, options = {}) {
+        if (!this.initialized) {
+            if (!this.initialize()) {
+                return false;
+            }
+        }
+        return addon.startStream(onFrame, options.maxFps || 0);
+    }
+
+    /**
+     * Stop the stream started by startStream(). Pending captureFrameAsync()
+     * calls resolve with null.
+     */
+    stopStream() {
+        if (addon) {
+            addon.stopStream();
+        }
+    }
+
+    /**
+     * Change the stream's frame rate cap
+     * @param {number} fps - Frames per second, 0 = uncapped
+     */
+    setMaxFps(fps) {
+        if (addon) {
+            addon.setMaxFps(fps);
+        }
+    }
+
+    /**
+     * Stream counters
+     * @returns {Object} { running, maxFps, framesCaptured, framesDelivered, framesCoalesced }
+     */
+    getStreamStats() {
+        if (!addon) return { running: false, maxFps: 0, framesCaptured: 0, framesDelivered: 0, framesCoalesced: 0 };
+        return addon.getStreamStats();
+    }
+
+    /**
+     * Return a frame to the native pool now instead of at GC. The buffer is
+     * detached (length 0) afterwards.
+     * @param {Buffer} buffer - Frame from captureFrame/captureFrameAsync/startStream
+     * @returns {boolean} False if it isn't a pool frame or was already released
+     */
+    releaseFrame(buffer) {
+        if (!addon) return false;
+        return addon.releaseFrame(buffer);
+    }
+
+    /**
+     * Size the native frame pool
+     * @param {Object} options - { maxFrames: 8, preallocate: 3, pooled: true }
+     *   pooled: false copies every frame into a new V8 Buffer (old behaviour)
+     */
+    configurePool(options = {}) {
+        if (!addon) return;
+        addon.configurePool(options.maxFrames || 8, options.preallocate === undefined ? 3 : options.preallocate,
+            options.pooled === undefined ? true : !!options.pooled);
+    }
+
+    /**
+     * Frame pool counters
+     * @returns {Object} { enabled, frameSize, frames, inUse, free, highWater, maxFrames, exhausted }
+     */
+    getPoolStats() {
+        if (!addon) return null;
+        return addon.getPoolStats();
+    }
+
     /**
      * Get capture information
-     * @returns {Object} { width, height, initialized }
+     * @returns {Object} { width, height, output, initialized }
      */
     getInfo() {
-        if (!addon) return { width: 0, height: 0, initialized: false };
+        if (!addon) return { width: 0, height: 0, output: -1, initialized: false };
         return addon.getInfo();
     }
 
@@ -1,24 +1,31 @@
 // Shared Memory Screen Capture
 // Fastest possible transfer - captures to memory-mapped file
-// Compile: cl /EHsc /O2 shm-capture.cpp /link d3d11.lib dxgi.lib
+// Compile: cl /EHsc /O2 shm-capture.cpp /link d3d11.lib dxgi.lib winmm.lib
+// Usage:   shm-capture [fps] [poolThreads] [--output N] [--list-outputs]
+//
+// The loop is paced to absolute fps deadlines (common/frame-pacer.h); at each
+// one it takes whatever the desktop shows, so frames are evenly spaced
+// (fps 0 = every desktop update, as it arrives).
+//
+// Frames go into a multi-slot ring with a per-slot seqlock
+// (common/shm-ring.h), so readers always get a complete frame and never
+// hold up the capture loop. Slots are sized to the desktop at startup.
+//
+// --output N captures another monitor (numbered by --list-outputs, on any
+// adapter; dxgi-outputs.h) instead of the first one.
 
 #include <windows.h>
 #include <d3d11.h>
 #include <dxgi1_2.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../common/frame-pacer.h"
+#include "../common/job-system.h"
+#include "../common/shm-ring.h"
+#include "../dxgi-outputs.h"
 
 #define SHM_NAME "SimWidgetCapture"
-#define SHM_SIZE (8 + 1920 * 1080 * 4)  // Header + BGRA data
-
-// Shared memory header
-struct ShmHeader {
-    UINT32 width;
-    UINT32 height;
-    UINT32 frameNum;
-    UINT32 timestamp;
-    UINT32 ready;      // 1 = new frame available
-    UINT32 reserved[3];
-};
 
 class SharedMemoryCapture {
 private:
@@ -28,44 +35,13 @@ private:
     ID3D11Texture2D* stagingTexture = nullptr;
     UINT width = 0, height = 0;
 
-    HANDLE hMapFile = nullptr;
-    LPVOID pSharedMem = nullptr;
-    UINT32 frameNum = 0;
+    ShmRingWriter ring;
+    JobSystem* jobs = nullptr;  // Splits the staging copy into row bands
 
 public:
-    bool Initialize() {
-        // Create D3D11 device
-        D3D_FEATURE_LEVEL featureLevel;
-        HRESULT hr = D3D11CreateDevice(nullptr, D3D_DRIVER_TYPE_HARDWARE, nullptr,
-            0, nullptr, 0, D3D11_SDK_VERSION, &device, &featureLevel, &context);
-        if (FAILED(hr)) {
-            printf("Failed to create D3D device: 0x%08X\n", hr);
-            return false;
-        }
-
-        // Get DXGI device and output
-        IDXGIDevice* dxgiDevice;
-        device->QueryInterface(__uuidof(IDXGIDevice), (void**)&dxgiDevice);
-
-        IDXGIAdapter* adapter;
-        dxgiDevice->GetAdapter(&adapter);
-        dxgiDevice->Release();
-
-        IDXGIOutput* output;
-        adapter->EnumOutputs(0, &output);
-        adapter->Release();
-
-        IDXGIOutput1* output1;
-        output->QueryInterface(__uuidof(IDXGIOutput1), (void**)&output1);
-        output->Release();
-
-        // Create duplication
-        hr = output1->DuplicateOutput(device, &duplication);
-        output1->Release();
-        if (FAILED(hr)) {
-            printf("Failed to create output duplication: 0x%08X\n", hr);
-            return false;
-        }
+    // Duplicate one monitor (dxgi-outputs.h) on a device of its own adapter
+    bool Initialize(const DxgiOutputInfo& output) {
+        if (!OpenOutput(output, &device, &context, &duplication)) return false;
 
         // Get dimensions
         DXGI_OUTDUPL_DESC desc;
@@ -85,39 +61,23 @@ public:
         texDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
         device->CreateTexture2D(&texDesc, nullptr, &stagingTexture);
 
-        // Create shared memory
-        DWORD shmSize = sizeof(ShmHeader) + width * height * 4;
-        hMapFile = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr,
-            PAGE_READWRITE, 0, shmSize, SHM_NAME);
-        if (!hMapFile) {
+        // Create shared memory ring
+        if (!ring.Create(SHM_NAME, SHM_RING_SLOTS, (size_t)width * height * 4)) {
             printf("Failed to create shared memory\n");
             return false;
         }
 
-        pSharedMem = MapViewOfFile(hMapFile, FILE_MAP_ALL_ACCESS, 0, 0, shmSize);
-        if (!pSharedMem) {
-            printf("Failed to map shared memory\n");
-            return false;
-        }
-
-        // Initialize header
-        ShmHeader* header = (ShmHeader*)pSharedMem;
-        header->width = width;
-        header->height = height;
-        header->frameNum = 0;
-        header->ready = 0;
-
-        printf("Initialized: %dx%d, SHM: %s\n", width, height, SHM_NAME);
+        printf("Initialized: %dx%d, SHM: %s (%d slots)\n", width, height, SHM_NAME, SHM_RING_SLOTS);
         return true;
     }
 
-    bool CaptureFrame() {
+    bool CaptureFrame(UINT timeoutMs) {
         DXGI_OUTDUPL_FRAME_INFO frameInfo;
         IDXGIResource* resource = nullptr;
 
         duplication->ReleaseFrame();
 
-        HRESULT hr = duplication->AcquireNextFrame(100, &frameInfo, &resource);
+        HRESULT hr = duplication->AcquireNextFrame(timeoutMs, &frameInfo, &resource);
         if (FAILED(hr)) return false;
 
         ID3D11Texture2D* texture;
@@ -131,44 +91,41 @@ public:
         hr = context->Map(stagingTexture, 0, D3D11_MAP_READ, 0, &mapped);
         if (FAILED(hr)) return false;
 
-        // Copy to shared memory
-        ShmHeader* header = (ShmHeader*)pSharedMem;
-        BYTE* pixelData = (BYTE*)pSharedMem + sizeof(ShmHeader);
+        // Copy into the next ring slot; readers see it once published
+        BYTE* pixelData = ring.BeginWrite(width, height, width * 4);
         BYTE* src = (BYTE*)mapped.pData;
-
-        for (UINT y = 0; y < height; y++) {
-            memcpy(pixelData + y * width * 4, src + y * mapped.RowPitch, width * 4);
+        if (pixelData) {
+            ParallelCopyRows(jobs, pixelData, width * 4, src, mapped.RowPitch, width * 4, height);
+            ring.Publish();
         }
 
-        header->frameNum = ++frameNum;
-        header->timestamp = GetTickCount();
-        header->ready = 1;  // Signal new frame
-
         context->Unmap(stagingTexture, 0);
-        return true;
+        return pixelData != nullptr;
     }
 
     void Run(int targetFps) {
         printf("Running at %d FPS target\n", targetFps);
-        int frameTime = 1000 / targetFps;
+        FramePacer pacer;
+        pacer.Start(targetFps);
 
         while (true) {
-            DWORD start = GetTickCount();
-
-            if (CaptureFrame()) {
-                // Frame captured
-            }
-
-            DWORD elapsed = GetTickCount() - start;
-            if (elapsed < frameTime) {
-                Sleep(frameTime - elapsed);
+            // No new frame at a deadline just means the screen didn't change
+            pacer.Wait();
+            CaptureFrame(pacer.IsPaced() ? 0 : 100);
+
+            if (pacer.GetStatsAgeMs() >= PACER_REPORT_MS) {
+                PacerStats stats;
+                pacer.TakeStats(&stats);
+                PrintPacerStats("", stats);
+                fflush(stdout);
             }
         }
     }
 
+    void SetJobSystem(JobSystem* pool) { jobs = pool; }
+
     void Cleanup() {
-        if (pSharedMem) UnmapViewOfFile(pSharedMem);
-        if (hMapFile) CloseHandle(hMapFile);
+        ring.Close();
         if (stagingTexture) stagingTexture->Release();
         if (duplication) duplication->Release();
         if (context) context->Release();
@@ -178,15 +135,38 @@ public:
 
 int main(int argc, char* argv[]) {
     int fps = 60;
-    if (argc > 1) fps = atoi(argv[1]);
+    int threads = JobSystem::DefaultWorkerCount();
+    int outputIndex = 0;
+    bool listOutputs = false;
+    int positional = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) outputIndex = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--list-outputs") == 0) listOutputs = true;
+        else if (positional++ == 0) fps = atoi(argv[i]);
+        else threads = atoi(argv[i]);
+    }
+
+    DxgiOutputInfo outputs[DXGI_MAX_OUTPUTS];
+    int outputCount = EnumerateOutputs(outputs, DXGI_MAX_OUTPUTS);
+    if (listOutputs || outputIndex < 0 || outputIndex >= outputCount) {
+        if (!listOutputs) printf("No output %d (%d found):\n", outputIndex, outputCount > 0 ? outputCount : 0);
+        else printf("Outputs:\n");
+        PrintOutputs(outputs, outputCount);
+        return listOutputs && outputCount > 0 ? 0 : 1;
+    }
+
+    printf("SimWidget Shared Memory Capture (pool threads: %d)\n", threads);
 
-    printf("SimWidget Shared Memory Capture\n");
+    JobSystem jobs;
+    jobs.Start(threads);
 
     SharedMemoryCapture capture;
-    if (!capture.Initialize()) {
+    if (!capture.Initialize(outputs[outputIndex])) {
         printf("Initialization failed\n");
         return 1;
     }
+    printf("Output %d: %s (%s)\n", outputIndex, outputs[outputIndex].name, outputs[outputIndex].adapterName);
+    capture.SetJobSystem(&jobs);
 
     capture.Run(fps);
     capture.Cleanup();
@@ -7,9 +7,17 @@ const ref = require('ref-napi');
 const Struct = require('ref-struct-napi');
 
 const SHM_NAME = 'SimWidgetCapture';
-const HEADER_SIZE = 32; // 8 uint32 values
+
+// Layout of common/shm-ring.h (version 2)
+const SHM_RING_MAGIC = 0x31525753; // "SWR1"
+const SHM_RING_VERSION = 2;
+const RING_HEADER_SIZE = 64;
+const SLOT_HEADER_SIZE = 64;
+const READ_RETRIES = 8;
+const SIGNAL_EVENTS = 4; // Named events "<SHM_NAME>.frame0..3", see SharedSignal in common/shm-compat.h
 
 // Windows constants
+const SYNCHRONIZE = 0x00100000;
 const FILE_MAP_READ = 0x0004;
 
 // Define Windows API
@@ -17,16 +25,21 @@ const kernel32 = ffi.Library('kernel32', {
     'OpenFileMappingA': ['pointer', ['uint32', 'bool', 'string']],
     'MapViewOfFile': ['pointer', ['pointer', 'uint32', 'uint32', 'uint32', 'size_t']],
     'UnmapViewOfFile': ['bool', ['pointer']],
-    'CloseHandle': ['bool', ['pointer']]
+    'CloseHandle': ['bool', ['pointer']],
+    'OpenEventA': ['pointer', ['uint32', 'bool', 'string']],
+    'WaitForSingleObject': ['uint32', ['pointer', 'uint32']]
 });
 
 class SharedMemoryReader {
     constructor() {
         this.hMapFile = null;
         this.pSharedMem = null;
+        this.mem = null;
         this.width = 0;
         this.height = 0;
-        this.lastFrameNum = 0;
+        this.lastFrameNum = 0n;
+        this.retries = 0;
+        this.events = [];
     }
 
     connect() {
@@ -36,63 +49,122 @@ class SharedMemoryReader {
             throw new Error('Failed to open shared memory. Is shm-capture.exe running?');
         }
 
-        // Map view
-        const size = HEADER_SIZE + 1920 * 1080 * 4; // Max size
-        this.pSharedMem = kernel32.MapViewOfFile(this.hMapFile, FILE_MAP_READ, 0, 0, size);
+        // Map the whole region, then size the view from the ring header
+        this.pSharedMem = kernel32.MapViewOfFile(this.hMapFile, FILE_MAP_READ, 0, 0, 0);
         if (this.pSharedMem.isNull()) {
             throw new Error('Failed to map shared memory');
         }
+        const header = ref.reinterpret(this.pSharedMem, RING_HEADER_SIZE, 0);
+        if (header.readUInt32LE(0) !== SHM_RING_MAGIC || header.readUInt32LE(4) !== SHM_RING_VERSION) {
+            throw new Error('Shared memory is not a version 2 frame ring - update shm-capture.exe');
+        }
 
-        // Read header
-        const header = Buffer.alloc(HEADER_SIZE);
-        this.pSharedMem.copy(header, 0, 0, HEADER_SIZE);
+        this.slotCount = header.readUInt32LE(8);
+        this.slotOffset = header.readUInt32LE(12);
+        this.slotStride = Number(header.readBigUInt64LE(16));
+        this.maxFrameSize = Number(header.readBigUInt64LE(24));
+        this.mem = ref.reinterpret(this.pSharedMem, this.slotOffset + this.slotStride * this.slotCount, 0);
 
-        this.width = header.readUInt32LE(0);
-        this.height = header.readUInt32LE(4);
+        this.width = header.readUInt32LE(32);
+        this.height = header.readUInt32LE(36);
 
-        console.log(`Connected to shared memory: ${this.width}x${this.height}`);
+        // Publish wake-ups for waitForFrame()
+        for (let i = 0; i < SIGNAL_EVENTS; i++) {
+            const event = kernel32.OpenEventA(SYNCHRONIZE, false, `${SHM_NAME}.frame${i}`);
+            if (event.isNull()) {
+                throw new Error('Failed to open frame events');
+            }
+            this.events.push(event);
+        }
+
+        console.log(`Connected to shared memory: ${this.width}x${this.height}, ${this.slotCount} slots`);
         return true;
     }
 
+    // Newest complete frame, or null if there is none since the last call.
+    // The slot generation is checked around the copy (seqlock); a frame the
+    // writer overwrote meanwhile is discarded and the newer one read instead.
     getFrame() {
-        if (!this.pSharedMem) return null;
+        if (!this.mem) return null;
 
-        // Read header
-        const header = Buffer.alloc(HEADER_SIZE);
-        this.pSharedMem.copy(header, 0, 0, HEADER_SIZE);
+        for (let attempt = 0; attempt < READ_RETRIES; attempt++) {
+            const frameNum = this.mem.readBigUInt64LE(40);
+            if (frameNum === 0n || frameNum === this.lastFrameNum) {
+                return null;
+            }
 
-        const frameNum = header.readUInt32LE(8);
-        const ready = header.readUInt32LE(16);
+            const slot = this.slotOffset + Number(frameNum % BigInt(this.slotCount)) * this.slotStride;
+            const before = this.mem.readBigUInt64LE(slot);
+            if (before !== frameNum * 2n) {
+                this.retries++;
+                continue;
+            }
+            const timestampUs = this.mem.readBigUInt64LE(slot + 16);
+            const width = this.mem.readUInt32LE(slot + 24);
+            const height = this.mem.readUInt32LE(slot + 28);
+            const size = Math.min(this.mem.readUInt32LE(slot + 36), this.maxFrameSize);
+
+            // Read pixel data (BGRA)
+            const pixels = Buffer.alloc(size);
+            this.mem.copy(pixels, 0, slot + SLOT_HEADER_SIZE, slot + SLOT_HEADER_SIZE + size);
+
+            if (this.mem.readBigUInt64LE(slot) !== before) {
+                this.retries++;
+                continue;
+            }
 
-        // Check if new frame available
-        if (!ready || frameNum === this.lastFrameNum) {
-            return null;
+            this.lastFrameNum = frameNum;
+            this.width = width;
+            this.height = height;
+            return {
+                width: width,
+                height: height,
+                frameNum: Number(frameNum),
+                timestampUs: timestampUs,
+                data: pixels
+            };
         }
+        return null;
+    }
 
-        this.lastFrameNum = frameNum;
-
-        // Read pixel data (BGRA)
-        const pixelSize = this.width * this.height * 4;
-        const pixels = Buffer.alloc(pixelSize);
-        this.pSharedMem.copy(pixels, 0, HEADER_SIZE, HEADER_SIZE + pixelSize);
-
-        return {
-            width: this.width,
-            height: this.height,
-            frameNum: frameNum,
-            data: pixels
-        };
+    // Resolves with the next new frame, or null after timeoutMs. The wait
+    // runs on the libuv thread pool, so the event loop keeps going.
+    async waitForFrame(timeoutMs) {
+        const deadline = Date.now() + timeoutMs;
+        for (;;) {
+            const frame = this.getFrame();
+            if (frame) return frame;
+
+            // Notify first, then latest (the writer stores them the other way
+            // round): a frame published in between is caught here rather than
+            // leaving us waiting on the event after it
+            const seen = this.mem.readUInt32LE(48);
+            if (this.mem.readBigUInt64LE(40) !== this.lastFrameNum) continue;
+            const left = deadline - Date.now();
+            if (left <= 0) return null;
+
+            // The writer sets event (n mod 4) when it publishes frame n
+            const event = this.events[(seen + 1) % SIGNAL_EVENTS];
+            await new Promise((resolve) => {
+                kernel32.WaitForSingleObject.async(event, left, () => resolve());
+            });
+        }
     }
 
     disconnect() {
         if (this.pSharedMem) {
             kernel32.UnmapViewOfFile(this.pSharedMem);
             this.pSharedMem = null;
+            this.mem = null;
         }
         if (this.hMapFile) {
             kernel32.CloseHandle(this.hMapFile);
             this.hMapFile = null;
         }
+        for (const event of this.events) {
+            kernel32.CloseHandle(event);
+        }
+        this.events = [];
     }
 }
 
@@ -106,9 +178,11 @@ if (require.main === module) {
         let frameCount = 0;
         const startTime = Date.now();
 
-        setInterval(() => {
-            const frame = reader.getFrame();
-            if (frame) {
+        // Sleeps until the capture publishes instead of polling
+        (async () => {
+            for (;;) {
+                const frame = await reader.waitForFrame(1000);
+                if (!frame) continue;
                 frameCount++;
 
                 // Print stats every second
@@ -118,7 +192,7 @@ if (require.main === module) {
                     console.log(`Frame ${frame.frameNum}: ${fps} FPS`);
                 }
             }
-        }, 1); // Poll every 1ms for max speed
+        })();
 
     } catch (e) {
         console.error(e.message);
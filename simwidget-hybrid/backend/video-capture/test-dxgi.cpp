@@ -4,6 +4,7 @@
 #include <d3d11.h>
 #include <dxgi1_2.h>
 #include <stdio.h>
+#include "dxgi-outputs.h"
 
 int main() {
     printf("Testing Desktop Duplication API...\n");
@@ -110,6 +111,27 @@ int main() {
     context->Release();
     device->Release();
 
+    // Every monitor on every adapter, as the services' --output numbers them
+    DxgiOutputInfo outputs[DXGI_MAX_OUTPUTS];
+    int outputCount = EnumerateOutputs(outputs, DXGI_MAX_OUTPUTS);
+    if (outputCount <= 0) {
+        printf("FAILED: EnumerateOutputs (%d)\n", outputCount);
+        return 1;
+    }
+    printf("\nOutputs:\n");
+    PrintOutputs(outputs, outputCount);
+    for (int i = 0; i < outputCount; i++) {
+        if (!OpenOutput(outputs[i], &device, &context, &duplication)) {
+            printf("FAILED: Duplicate output %d\n", i);
+            return 1;
+        }
+        printf("OK: Output %d duplicated\n", i);
+        duplication->Release();
+        context->Release();
+        device->Release();
+    }
+    fflush(stdout);
+
     printf("\nAll tests passed!\n");
     return 0;
 }
@@ -0,0 +1,410 @@
+// Tests for the broadcast server's gathered send path (common/broadcast-server.h)
+// Streams numbered, patterned frames over localhost and checks that every
+// frame a client receives is intact and in order - with a fast reader, a
+// throttled one that forces partial writes and "latest frame wins" drops,
+// and with MSG_ZEROCOPY where the platform has it. WebSocket connections that
+// never finish the upgrade are closed. Then prints send calls
+// per frame and throughput against the old prefix-then-payload send loop.
+// Compile: g++ -O2 -std=c++17 -pthread tests/test-broadcast-server.cpp -o bin/test-broadcast-server
+//     or:  cl /EHsc /O2 /Fe:bin\test-broadcast-server.exe tests\test-broadcast-server.cpp
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "../common/broadcast-server.h"
+
+static int failures = 0;
+
+#define CHECK(cond, name) do { \
+    if (cond) { printf("OK: %s\n", name); } \
+    else { printf("FAILED: %s (%s:%d)\n", name, __FILE__, __LINE__); failures++; } \
+} while (0)
+
+#define TEST_PORT 19996
+#define SPLIT_PORT 19997
+#define WS_TEST_PORT 19992
+
+// Payload: 8-byte sequence number, then bytes that depend on it
+static void FillFrame(FrameSlot* slot, uint64_t seq, size_t size) {
+    memcpy(slot->data, &seq, 8);
+    for (size_t i = 8; i < size; i++) slot->data[i] = (uint8_t)(seq * 31 + i);
+    slot->size = size;
+    slot->seq = seq;
+    slot->flags = 0;
+}
+
+static bool CheckFrame(const std::vector<uint8_t>& payload, uint64_t* seq) {
+    if (payload.size() < 8) return false;
+    memcpy(seq, payload.data(), 8);
+    for (size_t i = 8; i < payload.size(); i++) {
+        if (payload[i] != (uint8_t)(*seq * 31 + i)) return false;
+    }
+    return true;
+}
+
+// Connects and, for the broadcast server, does the v2 handshake (see
+// tests/test-wire-protocol.cpp for the protocol itself)
+static SOCKET ConnectLoopback(int port, int receiveBuffer, bool handshake) {
+    SOCKET s = socket(AF_INET, SOCK_STREAM, 0);
+    if (receiveBuffer) setsockopt(s, SOL_SOCKET, SO_RCVBUF, (const char*)&receiveBuffer, sizeof(receiveBuffer));
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((unsigned short)port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(s, (sockaddr*)&addr, sizeof(addr)) != 0) {
+        closesocket(s);
+        return INVALID_SOCKET;
+    }
+    if (handshake) {
+        WireHello hello;
+        hello.flags = WIRE_HELLO_DELTAS;
+        uint8_t bytes[WIRE_HELLO_SIZE];
+        WireWriteHello(hello, bytes);
+        send(s, (const char*)bytes, WIRE_HELLO_SIZE, 0);
+        int got = 0;
+        while (got < WIRE_REPLY_SIZE) {
+            int n = recv(s, (char*)bytes + got, WIRE_REPLY_SIZE - got, 0);
+            if (n <= 0) break;
+            got += n;
+        }
+        WireReply reply;
+        if (got < WIRE_REPLY_SIZE || !WireReadReply(bytes, &reply) || reply.status != WIRE_STATUS_OK) {
+            closesocket(s);
+            return INVALID_SOCKET;
+        }
+    }
+    return s;
+}
+
+static bool RecvAll(SOCKET s, uint8_t* data, size_t size, int throttleUs) {
+    size_t got = 0;
+    while (got < size) {
+        size_t chunk = size - got;
+        if (throttleUs && chunk > 16384) chunk = 16384;
+        int n = recv(s, (char*)data + got, (int)chunk, 0);
+        if (n <= 0) return false;
+        got += n;
+        if (throttleUs) std::this_thread::sleep_for(std::chrono::microseconds(throttleUs));
+    }
+    return true;
+}
+
+// Parses [4-byte size][payload] until the server closes the connection
+struct VerifyingReader {
+    int receiveBuffer = 0;
+    int throttleUs = 0;          // Sleep after every 16 KB read
+    uint64_t frames = 0;
+    uint64_t corrupt = 0;
+    uint64_t outOfOrder = 0;
+    uint64_t lastSeq = 0;
+    std::thread thread;
+
+    void Start() {
+        thread = std::thread([this] {
+            SOCKET s = ConnectLoopback(TEST_PORT, receiveBuffer, true);
+            if (s == INVALID_SOCKET) return;
+            std::vector<uint8_t> payload;
+            while (true) {
+                uint32_t size;
+                if (!RecvAll(s, (uint8_t*)&size, 4, 0)) break;
+                payload.resize(size);
+                if (!RecvAll(s, payload.data(), size, throttleUs)) break;
+                uint64_t seq = 0;
+                if (!CheckFrame(payload, &seq)) corrupt++;
+                else if (frames > 0 && seq <= lastSeq) outOfOrder++;
+                lastSeq = seq;
+                frames++;
+            }
+            closesocket(s);
+        });
+    }
+};
+
+// Counts bytes until it has read total
+static void DiscardReader(int port, uint64_t total, bool handshake) {
+    SOCKET s = ConnectLoopback(port, 0, handshake);
+    if (s == INVALID_SOCKET) return;
+    std::vector<char> buffer(256 * 1024);
+    uint64_t got = 0;
+    while (got < total) {
+        int n = recv(s, buffer.data(), (int)buffer.size(), 0);
+        if (n <= 0) break;
+        got += n;
+    }
+    closesocket(s);
+}
+
+static bool WaitForClient(BroadcastServer& server) {
+    for (int i = 0; i < 200 && server.GetStreamingClientCount() == 0; i++) server.Service(10);
+    return server.GetStreamingClientCount() > 0;
+}
+
+static void Drain(BroadcastServer& server) {
+    while (server.HasPendingWrites()) server.Service(1);
+}
+
+// Broadcast count frames of frameSize bytes, one at a time, to a reader
+// that discards them. Returns MB/s; *calls gets send calls per frame and
+// *copied whether the kernel fell back from zero-copy.
+static double MeasureServer(size_t frameSize, int count, bool zeroCopy, double* calls, bool* copied) {
+    BroadcastServer server;
+    server.SetZeroCopy(zeroCopy);
+    if (!server.Start(TEST_PORT)) return 0;
+    std::thread reader(DiscardReader, TEST_PORT, (uint64_t)count * (4 + frameSize), true);
+    if (!WaitForClient(server)) {
+        reader.join();
+        return 0;
+    }
+
+    FrameRing ring;
+    ring.Initialize(4, frameSize);
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < count; i++) {
+        FrameSlot* slot = ring.AcquireWrite();
+        while (!slot) {
+            // Every slot retired behind zero-copy completions
+            server.Service(1);
+            slot = ring.AcquireWrite();
+        }
+        slot->size = frameSize;
+        server.Broadcast(&ring, slot);
+        ring.Release(slot);
+        Drain(server);
+    }
+    reader.join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    *calls = (double)server.GetSendCalls() / count;
+    *copied = server.GetZeroCopyCopied();
+    while (server.GetRetiredFrames() > 0 && server.GetClientCount() > 0) server.Service(1);
+    server.Stop();
+    return (double)count * (4 + frameSize) / seconds / 1e6;
+}
+
+// The previous send loop: one send() for the 4-byte prefix, then send()
+// over the payload until done, polling for POLLOUT on would-block
+static double MeasureSplit(size_t frameSize, int count, double* calls) {
+    SOCKET listenSocket = NetListen(SPLIT_PORT, 1);
+    if (listenSocket == INVALID_SOCKET) return 0;
+    std::thread reader(DiscardReader, SPLIT_PORT, (uint64_t)count * (4 + frameSize), false);
+    SOCKET s = accept(listenSocket, nullptr, nullptr);
+    NetSetNonBlocking(s);
+    NetSetNoDelay(s);
+
+    std::vector<uint8_t> frame(frameSize);
+    uint64_t sendCalls = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < count; i++) {
+        uint32_t size = (uint32_t)frameSize;
+        uint8_t prefix[4];
+        memcpy(prefix, &size, 4);
+        size_t offset = 0, total = 4 + frameSize;
+        while (offset < total) {
+            const char* data = offset < 4 ? (const char*)prefix + offset : (const char*)frame.data() + offset - 4;
+            size_t len = offset < 4 ? 4 - offset : total - offset;
+            int n = send(s, data, (int)len, NET_SEND_FLAGS);
+            sendCalls++;
+            if (n < 0 && NetWouldBlock(NetLastError())) {
+                NetPollFd fd = {};
+                fd.fd = s;
+                fd.events = POLLOUT;
+                NetPoll(&fd, 1, 1);
+                continue;
+            }
+            if (n <= 0) break;
+            offset += n;
+        }
+    }
+    reader.join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    closesocket(s);
+    closesocket(listenSocket);
+    *calls = (double)sendCalls / count;
+    return (double)count * (4 + frameSize) / seconds / 1e6;
+}
+
+// Stream frames of the given sizes to reader; waitForDrain sends one frame
+// at a time, otherwise frames arrive every intervalUs whether or not the
+// client keeps up. Returns the payload bytes broadcast.
+static uint64_t Stream(BroadcastServer& server, FrameRing& ring, int count, size_t minSize, size_t maxSize,
+                   bool waitForDrain, int intervalUs) {
+    auto next = std::chrono::steady_clock::now();
+    uint64_t bytes = 0;
+    for (int i = 1; i <= count; i++) {
+        FrameSlot* slot = ring.AcquireWrite();
+        while (!slot) {
+            server.Service(1);
+            slot = ring.AcquireWrite();
+        }
+        size_t size = minSize + ((uint64_t)i * 7919 * 4099) % (maxSize - minSize + 1);
+        FillFrame(slot, (uint64_t)i, size);
+        bytes += size;
+        server.Broadcast(&ring, slot);
+        ring.Release(slot);
+        if (waitForDrain) {
+            Drain(server);
+            continue;
+        }
+        next += std::chrono::microseconds(intervalUs);
+        while (std::chrono::steady_clock::now() < next) server.Service(1);
+    }
+    Drain(server);
+    return bytes;
+}
+
+// Release every reference and check all slots are free again
+static bool AllSlotsFree(FrameRing& ring, int slots) {
+    uint64_t droppedBefore = ring.GetDropped();
+    std::vector<FrameSlot*> taken;
+    for (int i = 0; i < slots; i++) {
+        FrameSlot* slot = ring.AcquireWrite();
+        if (!slot) break;
+        taken.push_back(slot);
+    }
+    bool free = (int)taken.size() == slots && ring.GetDropped() == droppedBefore;
+    for (auto* slot : taken) ring.Release(slot);
+    return free;
+}
+
+int main() {
+    printf("Testing broadcast server...\n");
+    if (!NetStartup()) {
+        printf("FAILED: Winsock startup\n");
+        return 1;
+    }
+
+    // Fast reader, small frames: one gathered send per frame
+    {
+        BroadcastServer server;
+        CHECK(server.Start(TEST_PORT), "server listens on the test port");
+        VerifyingReader reader;
+        reader.Start();
+        CHECK(WaitForClient(server), "client connects");
+
+        FrameRing ring;
+        ring.Initialize(4, 4096);
+        const int count = 2000;
+        uint64_t payloadBytes = Stream(server, ring, count, 16, 4096, true, 0);
+        uint64_t calls = server.GetSendCalls();
+        server.Stop();
+        reader.thread.join();
+        printf("  %d small frames: %llu send calls\n", count, (unsigned long long)calls);
+        CHECK(reader.frames == (uint64_t)count && reader.corrupt == 0 && reader.outOfOrder == 0,
+            "every frame arrives intact and in order");
+        CHECK(calls == (uint64_t)count, "prefix and payload leave in one call");
+        CHECK(server.GetBytesSent() == payloadBytes + 4 * (uint64_t)count, "byte counter covers prefixes and payloads");
+        CHECK(AllSlotsFree(ring, 4), "every slot is released");
+    }
+
+    // Throttled reader with a small buffer: partial writes, gathered
+    // pending frames and "latest frame wins" drops
+    {
+        BroadcastServer server;
+        server.Start(TEST_PORT);
+        VerifyingReader reader;
+        reader.receiveBuffer = 32 * 1024;
+        reader.throttleUs = 200;
+        reader.Start();
+        CHECK(WaitForClient(server), "throttled client connects");
+
+        FrameRing ring;
+        ring.Initialize(6, 256 * 1024);
+        const int count = 300;
+        Stream(server, ring, count, 1000, 256 * 1024, false, 2000);
+        uint64_t sent = server.GetFramesSent(), dropped = server.GetFramesDropped();
+        server.Stop();
+        reader.thread.join();
+        printf("  throttled: %llu sent, %llu dropped, %llu received, %.1f send calls per frame\n",
+            (unsigned long long)sent, (unsigned long long)dropped, (unsigned long long)reader.frames,
+            (double)server.GetSendCalls() / (sent ? sent : 1));
+        CHECK(dropped > 0 && sent + dropped == (uint64_t)count, "slow client drops frames instead of queueing");
+        CHECK(reader.frames == sent && reader.corrupt == 0 && reader.outOfOrder == 0,
+            "partial writes keep every delivered frame intact");
+        CHECK(AllSlotsFree(ring, 6), "every slot is released after drops");
+    }
+
+    // Zero-copy: frames stay referenced until the kernel is done with them
+    {
+        BroadcastServer server;
+        server.SetZeroCopy(true);
+        server.Start(TEST_PORT);
+        VerifyingReader reader;
+        reader.Start();
+        CHECK(WaitForClient(server), "zero-copy client connects");
+
+        FrameRing ring;
+        ring.Initialize(4, 1024 * 1024);
+        const int count = 200;
+        Stream(server, ring, count, 64 * 1024, 1024 * 1024, true, 0);
+        for (int i = 0; i < 1000 && server.GetRetiredFrames() > 0; i++) server.Service(1);
+        int retired = server.GetRetiredFrames();
+        uint64_t zeroCopyCalls = server.GetZeroCopyCalls();
+        bool copied = server.GetZeroCopyCopied();
+        bool freeBeforeStop = AllSlotsFree(ring, 4);
+        server.Stop();
+        reader.thread.join();
+        printf("  zero-copy: %s, %llu zero-copy calls, kernel %s\n", NET_HAS_ZEROCOPY ? "available" : "not available",
+            (unsigned long long)zeroCopyCalls, copied ? "copied (loopback)" : "sent in place");
+        CHECK(reader.frames == (uint64_t)count && reader.corrupt == 0 && reader.outOfOrder == 0,
+            "zero-copy frames arrive intact and in order");
+        CHECK(retired == 0 && freeBeforeStop, "completions release every retired slot");
+        if (NET_HAS_ZEROCOPY) CHECK(zeroCopyCalls > 0, "large writes use MSG_ZEROCOPY");
+    }
+
+    // WebSocket connections that never complete the upgrade give their slot back
+    {
+        BroadcastServer server;
+        server.Start(TEST_PORT);
+        CHECK(server.StartWebSocket(WS_TEST_PORT), "server listens on the WebSocket test port");
+        SOCKET silent = ConnectLoopback(WS_TEST_PORT, 0, false);
+        SOCKET partial = ConnectLoopback(WS_TEST_PORT, 0, false);
+        const char* request = "GET / HTTP/1.1\r\nHost: localhost\r\nUpgrade: websocket\r\n";
+        send(partial, request, (int)strlen(request), 0);
+        for (int i = 0; i < 20; i++) server.Service(10);
+        CHECK(server.GetClientCount() == 2, "pending upgrades hold a slot for a while");
+
+        auto start = std::chrono::steady_clock::now();
+        while (server.GetClientCount() > 0 &&
+               std::chrono::steady_clock::now() - start < std::chrono::milliseconds(BROADCAST_UPGRADE_MS + 1000)) {
+            server.Service(10);
+        }
+        CHECK(server.GetClientCount() == 0, "silent and partial upgrades are closed after the deadline");
+        char byte;
+        CHECK(recv(silent, &byte, 1, 0) <= 0 && recv(partial, &byte, 1, 0) <= 0, "their sockets see the close");
+        closesocket(silent);
+        closesocket(partial);
+        server.Stop();
+    }
+
+    // Send calls and throughput against the old prefix-then-payload loop
+    {
+        printf("  localhost, one frame at a time:\n");
+        printf("  %10s %22s %22s %22s\n", "frame", "split (calls, MB/s)", "gathered", "zero-copy");
+        static const size_t sizes[] = { 1024, 64 * 1024, 512 * 1024, 4 * 1024 * 1024 };
+        bool fewerCalls = true;
+        for (size_t size : sizes) {
+            int count = (int)(256 * 1024 * 1024 / size);
+            if (count > 20000) count = 20000;
+            double splitCalls = 0, gatheredCalls = 0, zeroCopyCalls = 0;
+            bool unused, copied = false;
+            double split = MeasureSplit(size, count, &splitCalls);
+            double gathered = MeasureServer(size, count, false, &gatheredCalls, &unused);
+            double zeroCopy = MeasureServer(size, count, true, &zeroCopyCalls, &copied);
+            printf("  %8zu K %9.2f %10.0f %11.2f %10.0f %11.2f %10.0f%s\n", size / 1024, splitCalls, split,
+                gatheredCalls, gathered, zeroCopyCalls, zeroCopy, copied ? " (kernel copied)" : "");
+            if (size <= 64 * 1024 && gatheredCalls >= splitCalls) fewerCalls = false;
+        }
+        CHECK(fewerCalls, "gathered sends need fewer calls than prefix + payload");
+    }
+
+    NetCleanup();
+    if (failures) {
+        printf("\n%d test(s) failed\n", failures);
+        return 1;
+    }
+    printf("\nAll tests passed!\n");
+    return 0;
+}
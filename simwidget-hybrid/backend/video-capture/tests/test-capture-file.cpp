@@ -0,0 +1,312 @@
+// Tests for capture recording and replay (common/capture-file.h)
+// Records synthetic scenes (bench/frame-source.h) raw and lossless, then
+// checks every replayed pixel and dirty rect, zero-copy raw access, random
+// access through XOR chains, seeking by time, recovery of a file whose
+// index never got written, headers pointing past the end, realtime pacing
+// and the background recorder.
+// Compile: g++ -O2 -std=c++17 -pthread tests/test-capture-file.cpp -o bin/test-capture-file
+//     or:  cl /EHsc /O2 /Fe:bin\test-capture-file.exe tests\test-capture-file.cpp
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "../common/capture-file.h"
+#include "../bench/frame-source.h"
+
+static int failures = 0;
+
+#define CHECK(cond, name) do { \
+    if (cond) { printf("OK: %s\n", name); } \
+    else { printf("FAILED: %s (%s:%d)\n", name, __FILE__, __LINE__); failures++; } \
+} while (0)
+
+#define RAW_PATH "test-capture-raw.swc"
+#define LOSSLESS_PATH "test-capture-lossless.swc"
+#define CUT_PATH "test-capture-cut.swc"
+#define RECORDER_PATH "test-capture-recorder.swc"
+
+// What a recording should give back for one frame
+struct Expected {
+    std::vector<uint8_t> pixels;   // Pitch stripped
+    std::vector<TileRect> rects;
+    int rectCount;
+    uint64_t timestampUs;
+};
+
+// Render frames of a scene, write them, keep a copy of each
+static bool Record(const char* path, FrameScene scene, uint32_t w, uint32_t h, int frames, int codec,
+                   uint32_t keyframeInterval, std::vector<Expected>* expected) {
+    FrameSource source;
+    CaptureFileWriter writer;
+    if (!source.Initialize(w, h, scene) || !writer.Open(path, w, h, codec, keyframeInterval)) return false;
+    expected->clear();
+    for (int i = 0; i < frames; i++) {
+        const uint8_t* pixels = source.Next();
+        int count;
+        const TileRect* rects = source.GetDirtyRects(&count);
+        if (i % 7 == 3) count = -1;   // Some frames without DXGI metadata
+        Expected e;
+        e.pixels.resize((size_t)w * h * 4);
+        for (uint32_t y = 0; y < h; y++) memcpy(&e.pixels[(size_t)y * w * 4], pixels + y * source.GetStride(), w * 4);
+        e.rects.assign(rects, rects + (count > 0 ? count : 0));
+        e.rectCount = count;
+        e.timestampUs = 1000000 + (uint64_t)i * 16667;
+        if (writer.Append(pixels, source.GetStride(), e.timestampUs, rects, count) != 0) return false;
+        expected->push_back(e);
+    }
+    return writer.Close();
+}
+
+static bool SameRects(const TileRect* rects, int count, const Expected& e) {
+    if (count != e.rectCount) return false;
+    for (int i = 0; i < count; i++) {
+        if (memcmp(&rects[i], &e.rects[i], sizeof(TileRect)) != 0) return false;
+    }
+    return true;
+}
+
+static bool CopyPrefix(const char* from, const char* to, size_t bytes) {
+    FILE* in = fopen(from, "rb");
+    FILE* out = fopen(to, "wb");
+    bool ok = in && out;
+    std::vector<uint8_t> data(bytes);
+    ok = ok && fread(data.data(), 1, bytes, in) == bytes && fwrite(data.data(), 1, bytes, out) == bytes;
+    if (in) fclose(in);
+    if (out) fclose(out);
+    return ok;
+}
+
+// Copy a recording with its header's index offset and frame count replaced
+static bool CopyPatched(const char* from, const char* to, uint64_t indexOffset, uint32_t frameCount) {
+    FILE* in = fopen(from, "rb");
+    if (!in) return false;
+    fseek(in, 0, SEEK_END);
+    size_t size = (size_t)ftell(in);
+    fclose(in);
+    if (!CopyPrefix(from, to, size)) return false;
+    FILE* f = fopen(to, "r+b");
+    CaptureFileHeader header = {};
+    bool ok = f && fread(&header, sizeof(header), 1, f) == 1;
+    header.indexOffset = indexOffset;
+    header.frameCount = frameCount;
+    ok = ok && fseek(f, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, f) == 1;
+    if (f) fclose(f);
+    return ok;
+}
+
+int main() {
+    printf("Testing capture recording and replay...\n");
+    std::vector<Expected> expected;
+
+    // Raw: pixels come straight out of the mapping
+    {
+        bool written = Record(RAW_PATH, SCENE_NEEDLE, 320, 200, 20, CAPTURE_CODEC_RAW, 0, &expected);
+        CHECK(written, "raw recording written");
+        CaptureFileReader reader;
+        CHECK(reader.Open(RAW_PATH) && reader.IsComplete() && reader.GetFrameCount() == 20 &&
+            reader.GetWidth() == 320 && reader.GetHeight() == 200 && reader.GetCodec() == CAPTURE_CODEC_RAW,
+            "raw recording opens with its index");
+
+        bool pixelsOk = true, rectsOk = true, zeroCopy = true;
+        for (uint32_t i = 0; i < 20; i++) {
+            uint32_t size = 0;
+            const uint8_t* payload = reader.GetPayload(i, &size);
+            const uint8_t* pixels = reader.Decode(i);
+            zeroCopy = zeroCopy && pixels == payload && (uintptr_t)pixels % CAPTURE_ALIGN == 0;
+            pixelsOk = pixelsOk && pixels && memcmp(pixels, expected[i].pixels.data(), expected[i].pixels.size()) == 0;
+            const TileRect* rects;
+            int count = reader.GetFrameDirtyRects(i, &rects);
+            rectsOk = rectsOk && SameRects(rects, count, expected[i]) && reader.GetTimestampUs(i) == expected[i].timestampUs;
+        }
+        CHECK(pixelsOk, "raw frames replay pixel-exact");
+        CHECK(zeroCopy, "raw frames are aligned pointers into the mapping");
+        CHECK(rectsOk, "dirty rects and timestamps replay as recorded");
+        CHECK(reader.Decode(20) == nullptr, "no frame past the end");
+    }
+
+    // Lossless with XOR chains: any order decodes the same pixels
+    {
+        const int frames = 50;
+        bool written = Record(LOSSLESS_PATH, SCENE_SCROLL, 640, 360, frames, CAPTURE_CODEC_LOSSLESS, 8, &expected);
+        CHECK(written, "lossless recording written");
+        CaptureFileReader reader;
+        CHECK(reader.Open(LOSSLESS_PATH) && reader.IsComplete() && reader.GetFrameCount() == frames,
+            "lossless recording opens with its index");
+
+        uint64_t payloadBytes = 0;
+        uint16_t flags = 0;
+        int keyframes = 0;
+        for (uint32_t i = 0; i < frames; i++) {
+            uint32_t size = 0;
+            reader.GetPayload(i, &size, &flags);
+            payloadBytes += size;
+            if (flags & CAPTURE_FRAME_KEYFRAME) keyframes++;
+        }
+        CHECK(keyframes == 7, "a keyframe every 8 frames");
+        CHECK(payloadBytes * 4 < (uint64_t)frames * 640 * 360 * 4, "lossless payloads at least 4x smaller than raw");
+
+        const uint32_t order[] = { 0, 1, 2, 17, 9, 31, 30, 49, 8, 7, 48, 3, 16, 15, 40 };
+        bool allOk = true;
+        for (uint32_t i : order) {
+            const uint8_t* pixels = reader.Decode(i);
+            allOk = allOk && pixels && memcmp(pixels, expected[i].pixels.data(), expected[i].pixels.size()) == 0;
+        }
+        CHECK(allOk, "random access through XOR chains is pixel-exact");
+
+        // Sequential frame source after a seek
+        bool sourceOk = reader.Seek(20);
+        int count;
+        for (uint32_t i = 20; i < frames; i++) {
+            const uint8_t* pixels = reader.Next();
+            const TileRect* rects = reader.GetDirtyRects(&count);
+            sourceOk = sourceOk && pixels && rects && memcmp(pixels, expected[i].pixels.data(), expected[i].pixels.size()) == 0;
+            sourceOk = sourceOk && (i == 20 ? count == -1 : SameRects(rects, count, expected[i]));
+        }
+        CHECK(sourceOk, "Next() replays from a seek; first frame after it has no hints");
+        CHECK(reader.Next() == nullptr, "Next() ends with the recording");
+
+        CHECK(reader.FindFrame(expected[33].timestampUs) == 33 && reader.FindFrame(expected[33].timestampUs + 5) == 33 &&
+            reader.FindFrame(0) == 0 && reader.FindFrame(UINT64_MAX) == frames - 1, "frames found by capture time");
+        CHECK(reader.GetDurationUs() == expected[frames - 1].timestampUs - expected[0].timestampUs, "duration");
+
+        // Replay at the recorded spacing (16.7 ms) vs. flat out
+        reader.Seek(0);
+        reader.SetRealtime(true);
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < 10; i++) reader.Next();
+        double realtimeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        reader.Seek(0);
+        reader.SetRealtime(false);
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < 10; i++) reader.Next();
+        double fastMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        printf("  10 frames: %.1f ms realtime (recorded %.1f ms), %.1f ms flat out\n", realtimeMs,
+            (expected[9].timestampUs - expected[0].timestampUs) / 1000.0, fastMs);
+        CHECK(realtimeMs >= 149 && realtimeMs < 400, "realtime replay keeps the recorded spacing");
+        CHECK(fastMs < realtimeMs / 2, "flat-out replay doesn't wait");
+    }
+
+    // A file whose writer never wrote the index: records are walked instead
+    {
+        FILE* f = fopen(LOSSLESS_PATH, "rb");
+        CaptureFileHeader header = {};
+        bool read = f && fread(&header, sizeof(header), 1, f) == 1;
+        if (f) fclose(f);
+        // Cut inside the last record's payload
+        CHECK(read && CopyPrefix(LOSSLESS_PATH, CUT_PATH, (size_t)header.indexOffset - 100), "recording cut short");
+
+        CaptureFileReader reader;
+        bool opened = reader.Open(CUT_PATH);
+        CHECK(opened && !reader.IsComplete() && reader.GetFrameCount() == 49, "index rebuilt up to the cut record");
+        const uint8_t* pixels = reader.Decode(45);
+        CHECK(pixels && memcmp(pixels, expected[45].pixels.data(), expected[45].pixels.size()) == 0,
+            "frames before the cut replay pixel-exact");
+
+        uint8_t junk[128] = { 'n', 'o', 'p', 'e' };
+        f = fopen(CUT_PATH, "wb");
+        if (f) {
+            fwrite(junk, 1, sizeof(junk), f);
+            fclose(f);
+        }
+        CHECK(!reader.Open(CUT_PATH), "other files are refused");
+    }
+
+    // Headers whose index lies past the end of the file: the index is not
+    // used, also when offset + frames * entry size wraps around
+    {
+        std::vector<Expected> expected;
+        bool written = Record(RAW_PATH, SCENE_NEEDLE, 64, 64, 1, CAPTURE_CODEC_RAW, 0, &expected);
+        CaptureFileReader reader;
+        CHECK(written && CopyPatched(RAW_PATH, CUT_PATH, ~0ull - 63, 2) && reader.Open(CUT_PATH) &&
+            !reader.IsComplete() && reader.GetFrameCount() == 1, "index offset that wraps around ignored");
+        CHECK(CopyPatched(RAW_PATH, CUT_PATH, 1ull << 40, 1) && reader.Open(CUT_PATH) && !reader.IsComplete(),
+            "index offset past the end ignored");
+        CHECK(CopyPatched(RAW_PATH, CUT_PATH, CAPTURE_ALIGN, 0x7FFFFFFF) && reader.Open(CUT_PATH) &&
+            !reader.IsComplete() && reader.GetFrameCount() == 1, "frame count past the end ignored");
+        const uint8_t* pixels = reader.Decode(0);
+        CHECK(pixels && memcmp(pixels, expected[0].pixels.data(), expected[0].pixels.size()) == 0,
+            "its frames still replay from the records");
+    }
+
+    // Background recorder: capture never waits, full buffers drop frames
+    {
+        JobSystem jobs;
+        jobs.Start(2);
+        CaptureRecorder recorder;
+        recorder.SetJobSystem(&jobs);
+        CHECK(recorder.Start(RECORDER_PATH, 640, 360, CAPTURE_CODEC_LOSSLESS), "recorder started");
+        CHECK(!recorder.Start(RECORDER_PATH, 640, 360, CAPTURE_CODEC_LOSSLESS), "second start refused");
+
+        FrameSource source;
+        source.Initialize(640, 360, SCENE_SCROLL);
+        std::vector<std::vector<uint8_t>> submitted;
+        const int frames = 60;
+        double maxSubmitMs = 0;
+        for (int i = 0; i < frames; i++) {
+            const uint8_t* pixels = source.Next();
+            int count;
+            const TileRect* rects = source.GetDirtyRects(&count);
+            auto start = std::chrono::steady_clock::now();
+            bool queued = recorder.Submit(pixels, source.GetStride(), (uint64_t)i, rects, count);
+            maxSubmitMs = std::max(maxSubmitMs,
+                std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+            if (queued) {
+                std::vector<uint8_t> copy((size_t)640 * 360 * 4);
+                for (uint32_t y = 0; y < 360; y++) memcpy(&copy[(size_t)y * 640 * 4], pixels + y * source.GetStride(), 640 * 4);
+                submitted.push_back(copy);
+            }
+            if (i < frames / 2) std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+        recorder.Stop();
+        printf("  recorder: %llu written, %llu dropped, %.1f MB, slowest Submit() %.2f ms\n",
+            (unsigned long long)recorder.GetFramesWritten(), (unsigned long long)recorder.GetFramesDropped(),
+            recorder.GetBytesWritten() / 1e6, maxSubmitMs);
+        CHECK(!recorder.IsRecording() && !recorder.HasFailed(), "recorder stopped cleanly");
+        CHECK(recorder.GetFramesWritten() + recorder.GetFramesDropped() == frames &&
+            recorder.GetFramesWritten() == submitted.size(), "every frame written or counted as dropped");
+        CHECK(!recorder.Submit(source.GetPixels(), source.GetStride(), 0, nullptr, -1), "no frames after Stop()");
+
+        CaptureFileReader reader;
+        bool allOk = reader.Open(RECORDER_PATH) && reader.IsComplete() && reader.GetFrameCount() == submitted.size();
+        for (uint32_t i = 0; allOk && i < reader.GetFrameCount(); i++) {
+            const uint8_t* pixels = reader.Next();
+            allOk = pixels && memcmp(pixels, submitted[i].data(), submitted[i].size()) == 0;
+        }
+        CHECK(allOk, "recorded frames replay pixel-exact");
+        jobs.Stop();
+    }
+
+    // Replay speed at 1080p
+    {
+        std::vector<Expected> frames;
+        CaptureFileReader reader;
+        if (Record(LOSSLESS_PATH, SCENE_NEEDLE, 1920, 1080, 120, CAPTURE_CODEC_LOSSLESS, CAPTURE_KEYFRAME_INTERVAL, &frames) &&
+            reader.Open(LOSSLESS_PATH)) {
+            uint64_t bytes = 0;
+            for (uint32_t i = 0; i < reader.GetFrameCount(); i++) {
+                uint32_t size = 0;
+                reader.GetPayload(i, &size);
+                bytes += size;
+            }
+            auto start = std::chrono::steady_clock::now();
+            while (reader.Next()) {}
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            printf("  1080p needle, lossless: %.1f KB per frame, replay %.0f FPS (one thread)\n",
+                bytes / 1024.0 / reader.GetFrameCount(), reader.GetFrameCount() * 1000 / ms);
+        }
+    }
+
+    remove(RAW_PATH);
+    remove(LOSSLESS_PATH);
+    remove(CUT_PATH);
+    remove(RECORDER_PATH);
+
+    if (failures) {
+        printf("\n%d test(s) failed\n", failures);
+        return 1;
+    }
+    printf("\nAll tests passed!\n");
+    return 0;
+}
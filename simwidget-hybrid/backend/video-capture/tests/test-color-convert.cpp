@@ -0,0 +1,184 @@
+// Tests for BGRA -> YCbCr conversion (common/color-convert.h)
+// SIMD kernels must match the scalar reference byte for byte
+// Compile: g++ -O2 -std=c++17 tests/test-color-convert.cpp -o bin/test-color-convert
+//     or:  cl /EHsc /O2 /Fe:bin\test-color-convert.exe tests\test-color-convert.cpp
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <chrono>
+#include <vector>
+#include "../common/color-convert.h"
+
+static int failures = 0;
+
+#define CHECK(cond, name) do { \
+    if (cond) { printf("OK: %s\n", name); } \
+    else { printf("FAILED: %s (%s:%d)\n", name, __FILE__, __LINE__); failures++; } \
+} while (0)
+
+// Deterministic pseudo-random fill
+static void FillNoise(uint8_t* p, size_t n, uint32_t seed) {
+    for (size_t i = 0; i < n; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        p[i] = (uint8_t)(seed >> 24);
+    }
+}
+
+struct Planes {
+    std::vector<uint8_t> y, cb, cr;
+    YCbCrPlanes view;
+
+    Planes(uint32_t w, uint32_t h, ChromaSubsampling s) {
+        // Padded strides so writes past the row end would show up
+        uint32_t yStride = w + 8, cStride = ChromaWidth(w, s) + 8;
+        y.assign((size_t)yStride * h, 0xEE);
+        cb.assign((size_t)cStride * ChromaHeight(h, s), 0xEE);
+        cr.assign(cb.size(), 0xEE);
+        view = { y.data(), cb.data(), cr.data(), yStride, cStride };
+    }
+
+    bool operator==(const Planes& o) const { return y == o.y && cb == o.cb && cr == o.cr; }
+};
+
+// Run every level available on this CPU and compare against scalar
+static bool SimdMatchesScalar(uint32_t w, uint32_t h, ChromaSubsampling s, uint32_t seed) {
+    uint32_t stride = w * 4 + 12;
+    std::vector<uint8_t> bgra((size_t)stride * h);
+    FillNoise(bgra.data(), bgra.size(), seed);
+
+    Planes ref(w, h, s);
+    ConvertBgraToYCbCr(bgra.data(), stride, w, h, s, ref.view, SIMD_SCALAR);
+
+    for (int level = SIMD_SSE2; level <= GetSimdLevel(); level++) {
+        Planes out(w, h, s);
+        ConvertBgraToYCbCr(bgra.data(), stride, w, h, s, out.view, (SimdLevel)level);
+        if (!(out == ref)) {
+            printf("  mismatch: %ux%u %s %s\n", w, h, ChromaSubsamplingName(s), SimdLevelName((SimdLevel)level));
+            return false;
+        }
+    }
+    return true;
+}
+
+static uint8_t Clamp(double v) { return (uint8_t)(v < 0 ? 0 : (v > 255 ? 255 : v)); }
+
+int main() {
+    printf("Testing color conversion (SIMD level: %s)...\n", SimdLevelName(GetSimdLevel()));
+    ChromaSubsampling modes[] = { CHROMA_444, CHROMA_422, CHROMA_420 };
+
+    // Scalar reference vs the JFIF float formulas
+    {
+        uint8_t px[256 * 4];
+        FillNoise(px, sizeof(px), 3);
+        // Include the extremes: black, white, pure blue and pure red
+        const uint8_t extremes[4][4] = { {0, 0, 0, 255}, {255, 255, 255, 255}, {255, 0, 0, 255}, {0, 0, 255, 255} };
+        memcpy(px, extremes, sizeof(extremes));
+
+        int worst = 0;
+        for (int i = 0; i < 256; i++) {
+            double b = px[i * 4], g = px[i * 4 + 1], r = px[i * 4 + 2];
+            uint8_t y, cb, cr;
+            y = colorconv::Luma(px[i * 4], px[i * 4 + 1], px[i * 4 + 2]);
+            colorconv::Chroma(px[i * 4], px[i * 4 + 1], px[i * 4 + 2], 0, &cb, &cr);
+            int ey = abs(y - Clamp(0.299 * r + 0.587 * g + 0.114 * b + 0.5));
+            int ecb = abs(cb - Clamp(-0.168736 * r - 0.331264 * g + 0.5 * b + 128.5));
+            int ecr = abs(cr - Clamp(0.5 * r - 0.418688 * g - 0.081312 * b + 128.5));
+            int e = ey > ecb ? ey : ecb;
+            if (ecr > e) e = ecr;
+            if (e > worst) worst = e;
+        }
+        CHECK(worst <= 1, "fixed point is within 1 of the float formulas");
+        CHECK(colorconv::Luma(255, 255, 255) == 255 && colorconv::Luma(0, 0, 0) == 0, "white and black map to 255 and 0");
+    }
+
+    // Flat gray converts to neutral chroma in every mode
+    {
+        std::vector<uint8_t> gray(37 * 4 * 9, 0x80);
+        bool neutral = true;
+        for (ChromaSubsampling s : modes) {
+            Planes out(37, 9, s);
+            ConvertBgraToYCbCr(gray.data(), 37 * 4, 37, 9, s, out.view);
+            for (uint32_t y = 0; y < ChromaHeight(9, s); y++) {
+                for (uint32_t x = 0; x < ChromaWidth(37, s); x++) {
+                    if (out.cb[y * out.view.cStride + x] != 128 || out.cr[y * out.view.cStride + x] != 128) neutral = false;
+                }
+            }
+            if (out.y[0] != 0x80) neutral = false;
+        }
+        CHECK(neutral, "gray has neutral chroma");
+    }
+
+    // 4:2:0 chroma is the average of the 2x2 block (including odd edges)
+    {
+        const uint32_t w = 3, h = 3;
+        std::vector<uint8_t> bgra(w * h * 4, 0);
+        bgra[0 * 4 + 0] = 200;  // pixel (0,0) blue
+        bgra[2 * 4 + 2] = 200;  // pixel (2,0) red - its block repeats column 2
+        Planes out(w, h, CHROMA_420);
+        ConvertBgraToYCbCr(bgra.data(), w * 4, w, h, CHROMA_420, out.view, SIMD_SCALAR);
+        uint8_t cb0, cr0, cb1, cr1;
+        colorconv::Chroma(200, 0, 0, 2, &cb0, &cr0);      // 1 of 4 pixels blue
+        colorconv::Chroma(0, 0, 400, 2, &cb1, &cr1);      // 2 of 4 (repeated) red
+        CHECK(out.cb[0] == cb0 && out.cr[0] == cr0 && out.cb[1] == cb1 && out.cr[1] == cr1,
+            "4:2:0 averages blocks and repeats odd edges");
+    }
+
+    // Exactness: SIMD == scalar across widths that exercise every tail length
+    for (ChromaSubsampling s : modes) {
+        bool same = true;
+        for (uint32_t w = 1; w <= 80 && same; w++) {
+            same = SimdMatchesScalar(w, 5, s, w * 31 + s);
+        }
+        same = same && SimdMatchesScalar(1920, 1080, s, 99) && SimdMatchesScalar(1366, 767, s, 100);
+        char name[64];
+        snprintf(name, sizeof(name), "SIMD matches scalar for %s", ChromaSubsamplingName(s));
+        CHECK(same, name);
+    }
+
+    // Saturated colors exercise the Cb/Cr clamp in every kernel
+    {
+        const uint32_t w = 64, h = 4;
+        std::vector<uint8_t> bgra(w * h * 4);
+        for (uint32_t i = 0; i < w * h; i++) {
+            uint32_t color = (i & 1) ? 0xFF0000FFu : 0xFFFF0000u;  // blue / red
+            memcpy(&bgra[i * 4], &color, 4);
+        }
+        bool same = true;
+        for (ChromaSubsampling s : modes) {
+            Planes ref(w, h, s);
+            ConvertBgraToYCbCr(bgra.data(), w * 4, w, h, s, ref.view, SIMD_SCALAR);
+            for (int level = SIMD_SSE2; level <= GetSimdLevel(); level++) {
+                Planes out(w, h, s);
+                ConvertBgraToYCbCr(bgra.data(), w * 4, w, h, s, out.view, (SimdLevel)level);
+                if (!(out == ref)) same = false;
+            }
+        }
+        CHECK(same, "saturated blue/red clamp identically");
+    }
+
+    // Throughput at 1080p (informational)
+    {
+        const uint32_t w = 1920, h = 1080;
+        std::vector<uint8_t> bgra((size_t)w * h * 4);
+        FillNoise(bgra.data(), bgra.size(), 5);
+        Planes out(w, h, CHROMA_420);
+        for (int level = SIMD_SCALAR; level <= GetSimdLevel(); level++) {
+            const int iterations = 20;
+            auto start = std::chrono::high_resolution_clock::now();
+            for (int i = 0; i < iterations; i++) {
+                ConvertBgraToYCbCr(bgra.data(), w * 4, w, h, CHROMA_420, out.view, (SimdLevel)level);
+            }
+            auto end = std::chrono::high_resolution_clock::now();
+            double ms = std::chrono::duration<double, std::milli>(end - start).count() / iterations;
+            printf("  1920x1080 4:2:0 %-6s %.2f ms/frame\n", SimdLevelName((SimdLevel)level), ms);
+        }
+    }
+
+    if (failures) {
+        printf("\n%d test(s) failed\n", failures);
+        return 1;
+    }
+    printf("\nAll tests passed!\n");
+    return 0;
+}
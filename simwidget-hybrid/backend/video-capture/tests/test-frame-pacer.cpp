@@ -0,0 +1,136 @@
+// Tests for the deadline-based frame pacer (common/frame-pacer.h)
+// Paces a loop with varying work at 60 FPS and checks the average interval,
+// drift over many frames, missed-deadline accounting on overruns and that
+// idle gaps are not counted. Also prints the pacer's interval jitter next to
+// the old "sleep for the remaining milliseconds" loop for comparison.
+// Timing checks are loose so a loaded machine doesn't fail them; the printed
+// numbers show the real precision.
+// Compile: g++ -O2 -std=c++17 -pthread tests/test-frame-pacer.cpp -o bin/test-frame-pacer
+//     or:  cl /EHsc /O2 /Fe:bin\test-frame-pacer.exe tests\test-frame-pacer.cpp
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <chrono>
+#include <thread>
+#include "../common/frame-pacer.h"
+
+static int failures = 0;
+
+#define CHECK(cond, name) do { \
+    if (cond) { printf("OK: %s\n", name); } \
+    else { printf("FAILED: %s (%s:%d)\n", name, __FILE__, __LINE__); failures++; } \
+} while (0)
+
+typedef std::chrono::steady_clock Clock;
+
+static double MsSince(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// Stand-in for capture work: busy for ms milliseconds
+static void Work(double ms) {
+    auto start = Clock::now();
+    while (MsSince(start) < ms) {}
+}
+
+int main() {
+    printf("Testing frame pacer...\n");
+    const double fps = 60, interval = 1000.0 / fps;
+    srand(1);
+
+    // Steady pacing with 0-8 ms of work per frame
+    {
+        FramePacer pacer;
+        pacer.Start(fps);
+        auto start = Clock::now();
+        const int frames = 120;
+        for (int i = 0; i < frames; i++) {
+            pacer.Wait();
+            Work((rand() % 800) / 100.0);
+        }
+        pacer.Wait();
+        double elapsed = MsSince(start);
+        PacerStats s;
+        pacer.TakeStats(&s);
+        PrintPacerStats("  deadline pacer: ", s);
+        CHECK(s.frames == frames + 1 && s.missed == 0, "every deadline is met with short work");
+        CHECK(fabs(s.meanIntervalMs - interval) < 0.5, "average interval matches the target");
+        CHECK(fabs(elapsed - frames * interval) < 3, "no drift over 120 frames of varying work");
+        CHECK(s.jitterMs < 3, "interval jitter stays small");
+    }
+
+    // The old shm-capture loop: sleep for the remaining whole milliseconds
+    {
+        int frameTime = (int)(1000 / fps);
+        Clock::time_point last;
+        double minMs = 1e9, maxMs = 0, sum = 0, sqSum = 0;
+        const int frames = 60;
+        for (int i = 0; i <= frames; i++) {
+            auto begin = Clock::now();
+            if (i > 0) {
+                double ms = std::chrono::duration<double, std::milli>(begin - last).count();
+                minMs = ms < minMs ? ms : minMs;
+                maxMs = ms > maxMs ? ms : maxMs;
+                sum += ms;
+                sqSum += ms * ms;
+            }
+            last = begin;
+            Work((rand() % 800) / 100.0);
+            int elapsed = (int)MsSince(begin);
+            if (elapsed < frameTime) std::this_thread::sleep_for(std::chrono::milliseconds(frameTime - elapsed));
+        }
+        double mean = sum / frames;
+        printf("  sleep-for-remaining: %.1f FPS, interval %.2f ms (min %.2f, max %.2f, jitter %.2f)\n",
+            1000 / mean, mean, minMs, maxMs, sqrt(sqSum / frames - mean * mean));
+    }
+
+    // Overruns skip deadlines instead of bursting
+    {
+        FramePacer pacer;
+        pacer.Start(fps);
+        pacer.Wait();
+        Work(3.5 * interval);   // Three deadlines pass, the late frame serves one
+        bool onTime = pacer.Wait();
+        auto lateFrame = Clock::now();
+        pacer.Wait();
+        double gap = MsSince(lateFrame);
+        PacerStats s;
+        pacer.TakeStats(&s);
+        CHECK(!onTime && s.missed == 2, "overrun reports the skipped deadlines");
+        CHECK(gap > interval * 0.8, "frame after an overrun keeps a full interval");
+    }
+
+    // Idle gaps after Reset() are neither missed deadlines nor a long interval
+    {
+        FramePacer pacer;
+        pacer.Start(fps);
+        pacer.Wait();
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        pacer.Reset();
+        bool onTime = pacer.Wait();
+        pacer.Wait();
+        PacerStats s;
+        pacer.TakeStats(&s);
+        CHECK(onTime && s.missed == 0 && s.maxIntervalMs < 50, "reset after idle starts a fresh schedule");
+    }
+
+    // Unpaced: returns at once but still measures
+    {
+        FramePacer pacer;
+        pacer.Start(0);
+        auto start = Clock::now();
+        for (int i = 0; i < 1000; i++) pacer.Wait();
+        double elapsed = MsSince(start);
+        PacerStats s;
+        pacer.TakeStats(&s);
+        CHECK(!pacer.IsPaced() && elapsed < 50 && s.frames == 1000 && s.spinUs == 0, "fps 0 doesn't wait");
+    }
+
+    if (failures) {
+        printf("\n%d test(s) failed\n", failures);
+        return 1;
+    }
+    printf("\nAll tests passed!\n");
+    return 0;
+}
@@ -0,0 +1,211 @@
+// Tests for the BGRA downscaler (common/frame-scaler.h)
+// SIMD kernels must match the scalar reference byte for byte
+// Compile: g++ -O2 -std=c++17 -pthread tests/test-frame-scaler.cpp -o bin/test-frame-scaler
+//     or:  cl /EHsc /O2 /Fe:bin\test-frame-scaler.exe tests\test-frame-scaler.cpp
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <vector>
+#include "../common/frame-scaler.h"
+
+static int failures = 0;
+
+#define CHECK(cond, name) do { \
+    if (cond) { printf("OK: %s\n", name); } \
+    else { printf("FAILED: %s (%s:%d)\n", name, __FILE__, __LINE__); failures++; } \
+} while (0)
+
+// Deterministic pseudo-random fill
+static void FillNoise(uint8_t* p, size_t n, uint32_t seed) {
+    for (size_t i = 0; i < n; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        p[i] = (uint8_t)(seed >> 24);
+    }
+}
+
+struct Image {
+    uint32_t width, height, stride;
+    std::vector<uint8_t> pixels;
+
+    // Padded stride so writes past the row end would show up
+    Image(uint32_t w, uint32_t h, uint8_t fill = 0xEE) : width(w), height(h), stride(w * 4 + 20) {
+        pixels.assign((size_t)stride * h, fill);
+    }
+    uint8_t* At(uint32_t x, uint32_t y) { return &pixels[(size_t)y * stride + x * 4]; }
+};
+
+static Image Scale(Image& src, uint32_t dw, uint32_t dh, SimdLevel level, JobSystem* jobs = nullptr) {
+    FrameScaler scaler;
+    scaler.Configure(src.width, src.height, dw, dh);
+    scaler.SetSimdLevel(level);
+    scaler.SetJobSystem(jobs);
+    Image out(dw, dh);
+    scaler.Scale(src.pixels.data(), src.stride, out.pixels.data(), out.stride);
+    return out;
+}
+
+// Run every level available on this CPU and compare against scalar
+static bool SimdMatchesScalar(uint32_t sw, uint32_t sh, uint32_t dw, uint32_t dh, uint32_t seed) {
+    Image src(sw, sh);
+    FillNoise(src.pixels.data(), src.pixels.size(), seed);
+    Image ref = Scale(src, dw, dh, SIMD_SCALAR);
+    for (int level = SIMD_SSE2; level <= GetSimdLevel(); level++) {
+        if (Scale(src, dw, dh, (SimdLevel)level).pixels != ref.pixels) {
+            printf("  mismatch: %ux%u -> %ux%u %s\n", sw, sh, dw, dh, SimdLevelName((SimdLevel)level));
+            return false;
+        }
+    }
+    return true;
+}
+
+int main() {
+    printf("Testing frame scaler (SIMD level: %s)...\n", SimdLevelName(GetSimdLevel()));
+
+    // Filter selection
+    {
+        FrameScaler s;
+        bool ok = s.Configure(1920, 1080, 960, 540) && s.GetFilter() == SCALE_BOX2;
+        ok = ok && s.Configure(1920, 1080, 480, 270) && s.GetFilter() == SCALE_BOX4;
+        ok = ok && s.Configure(1920, 1080, 1280, 720) && s.GetFilter() == SCALE_BILINEAR;
+        ok = ok && s.Configure(1920, 1080, 1920, 1080) && s.GetFilter() == SCALE_COPY;
+        ok = ok && s.Configure(1365, 767, ScaledSize(1365, 0.5), ScaledSize(767, 0.5)) && s.GetFilter() == SCALE_BOX2;
+        ok = ok && !s.Configure(100, 100, 200, 100) && !s.Configure(100, 100, 0, 50);
+        CHECK(ok, "filter follows the size ratio");
+    }
+
+    // Box filters are the rounded block average
+    {
+        Image src(8, 4);
+        FillNoise(src.pixels.data(), src.pixels.size(), 7);
+        Image half = Scale(src, 4, 2, SIMD_SCALAR);
+        Image quarter = Scale(src, 2, 1, SIMD_SCALAR);
+        bool exact = true;
+        for (int c = 0; c < 4; c++) {
+            int sum = src.At(2, 2)[c] + src.At(3, 2)[c] + src.At(2, 3)[c] + src.At(3, 3)[c];
+            exact = exact && half.At(1, 1)[c] == (sum + 2) / 4;
+            int sum16 = 0;
+            for (uint32_t y = 0; y < 4; y++) {
+                for (uint32_t x = 4; x < 8; x++) sum16 += src.At(x, y)[c];
+            }
+            exact = exact && quarter.At(1, 0)[c] == (sum16 + 8) / 16;
+        }
+        CHECK(exact, "box 2:1 and 4:1 average their blocks");
+    }
+
+    // Flat color stays flat; a horizontal ramp stays monotonic
+    {
+        Image flat(333, 77);
+        for (uint32_t y = 0; y < 77; y++) {
+            for (uint32_t x = 0; x < 333; x++) {
+                uint8_t* p = flat.At(x, y);
+                p[0] = (uint8_t)(x * 255 / 332);  // Ramp in blue
+                p[1] = 200; p[2] = 99; p[3] = 255;
+            }
+        }
+        Image out = Scale(flat, 250, 50, GetSimdLevel());
+        bool ok = true;
+        int last = -1;
+        for (uint32_t x = 0; x < 250; x++) {
+            uint8_t* p = out.At(x, 25);
+            ok = ok && p[1] == 200 && p[2] == 99 && p[3] == 255;
+            ok = ok && p[0] >= last;
+            last = p[0];
+        }
+        CHECK(ok, "bilinear keeps flat color and ramps");
+    }
+
+    // Exactness: SIMD == scalar across widths that exercise every tail length
+    {
+        bool same = true;
+        for (uint32_t w = 1; w <= 80 && same; w++) {
+            same = SimdMatchesScalar(w * 2 + (w & 1), 6, w, 3, w);
+            same = same && SimdMatchesScalar(w * 4 + 3, 9, w, 2, w + 100);
+        }
+        same = same && SimdMatchesScalar(1920, 1080, 960, 540, 1) && SimdMatchesScalar(1920, 1080, 480, 270, 2);
+        CHECK(same, "SIMD box filters match scalar");
+    }
+    {
+        bool same = true;
+        const uint32_t sizes[][4] = {
+            { 1920, 1080, 1280, 720 }, { 1920, 1080, 1152, 648 }, { 1366, 768, 500, 300 },
+            { 37, 19, 36, 18 }, { 100, 100, 1, 1 }, { 3, 3, 2, 2 }, { 2560, 1440, 1919, 1079 },
+        };
+        for (auto& s : sizes) same = same && SimdMatchesScalar(s[0], s[1], s[2], s[3], s[0] + s[2]);
+        for (uint32_t w = 1; w <= 40 && same; w++) same = SimdMatchesScalar(w + 7, 5, w, 4, w * 3);
+        CHECK(same, "SIMD bilinear matches scalar");
+    }
+
+    // Banding across a pool does not change the output
+    {
+        JobSystem jobs;
+        jobs.Start(3);
+        Image src(1920, 1080);
+        FillNoise(src.pixels.data(), src.pixels.size(), 11);
+        bool same = true;
+        const uint32_t targets[][2] = { { 960, 540 }, { 480, 270 }, { 1280, 720 }, { 1920, 1080 } };
+        for (auto& t : targets) {
+            same = same && Scale(src, t[0], t[1], GetSimdLevel(), &jobs).pixels ==
+                Scale(src, t[0], t[1], GetSimdLevel()).pixels;
+        }
+        CHECK(same, "pooled scaling matches single-threaded");
+    }
+
+    // MapRect covers every output pixel a source change can reach
+    {
+        bool covered = true;
+        const uint32_t targets[][2] = { { 960, 540 }, { 480, 270 }, { 1280, 720 }, { 700, 333 } };
+        for (auto& t : targets) {
+            Image src(1920, 1080, 0);
+            Image before = Scale(src, t[0], t[1], GetSimdLevel());
+            const int32_t rects[][4] = { { 0, 0, 1, 1 }, { 1000, 500, 1003, 517 }, { 1919, 1079, 1920, 1080 }, { 641, 0, 642, 1080 } };
+            for (auto& r : rects) {
+                Image changed(1920, 1080, 0);
+                for (int32_t y = r[1]; y < r[3]; y++) {
+                    for (int32_t x = r[0]; x < r[2]; x++) memset(changed.At(x, y), 0xFF, 4);
+                }
+                Image after = Scale(changed, t[0], t[1], GetSimdLevel());
+                FrameScaler s;
+                s.Configure(1920, 1080, t[0], t[1]);
+                int32_t left = r[0], top = r[1], right = r[2], bottom = r[3];
+                s.MapRect(&left, &top, &right, &bottom);
+                for (uint32_t y = 0; y < t[1]; y++) {
+                    for (uint32_t x = 0; x < t[0]; x++) {
+                        bool inside = (int32_t)x >= left && (int32_t)x < right && (int32_t)y >= top && (int32_t)y < bottom;
+                        if (!inside && memcmp(before.At(x, y), after.At(x, y), 4) != 0) covered = false;
+                    }
+                }
+            }
+        }
+        CHECK(covered, "MapRect covers all affected output pixels");
+    }
+
+    // Throughput from 1080p (informational)
+    {
+        Image src(1920, 1080);
+        FillNoise(src.pixels.data(), src.pixels.size(), 5);
+        const uint32_t targets[][2] = { { 960, 540 }, { 480, 270 }, { 1280, 720 } };
+        for (auto& t : targets) {
+            for (int level = SIMD_SCALAR; level <= GetSimdLevel(); level++) {
+                FrameScaler s;
+                s.Configure(1920, 1080, t[0], t[1]);
+                s.SetSimdLevel((SimdLevel)level);
+                Image out(t[0], t[1]);
+                const int iterations = 20;
+                auto start = std::chrono::high_resolution_clock::now();
+                for (int i = 0; i < iterations; i++) s.Scale(src.pixels.data(), src.stride, out.pixels.data(), out.stride);
+                auto end = std::chrono::high_resolution_clock::now();
+                double ms = std::chrono::duration<double, std::milli>(end - start).count() / iterations;
+                printf("  1920x1080 -> %4ux%-4u %-8s %-6s %.2f ms/frame\n", t[0], t[1],
+                    ScaleFilterName(s.GetFilter()), SimdLevelName((SimdLevel)level), ms);
+            }
+        }
+    }
+
+    if (failures) {
+        printf("\n%d test(s) failed\n", failures);
+        return 1;
+    }
+    printf("\nAll tests passed!\n");
+    return 0;
+}
@@ -0,0 +1,200 @@
+// Tests and scaling benchmark for the work-stealing job system (common/job-system.h)
+// Checks coverage, concurrent callers and that banded JPEG output does not
+// depend on the thread count, then times row copies and JPEG encoding of
+// synthetic 1080p and 4K frames on 1..N threads.
+// Compile: g++ -O2 -std=c++17 -pthread tests/test-job-system.cpp -o bin/test-job-system
+//     or:  cl /EHsc /O2 /Fe:bin\test-job-system.exe tests\test-job-system.cpp
+// Usage:   test-job-system [maxThreads]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <thread>
+#include <vector>
+#include "../common/job-system.h"
+#include "../common/jpeg-encoder.h"
+
+static int failures = 0;
+
+#define CHECK(cond, name) do { \
+    if (cond) { printf("OK: %s\n", name); } \
+    else { printf("FAILED: %s (%s:%d)\n", name, __FILE__, __LINE__); failures++; } \
+} while (0)
+
+// Gauge-panel-like test frame with a padded pitch, as DXGI hands it out
+static void FillFrame(std::vector<uint8_t>& frame, uint32_t w, uint32_t h, uint32_t pitch) {
+    frame.assign((size_t)pitch * h, 0);
+    for (uint32_t y = 0; y < h; y++) {
+        for (uint32_t x = 0; x < w; x++) {
+            uint8_t* p = &frame[(size_t)y * pitch + x * 4];
+            p[0] = (uint8_t)(x * 255 / w);
+            p[1] = (uint8_t)(y * 255 / h);
+            p[2] = (uint8_t)(128 + 100 * sin(x * 0.02) * cos(y * 0.015));
+            p[3] = 255;
+        }
+    }
+}
+
+static double TimeMs(int iterations, const std::function<void()>& fn) {
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < iterations; i++) fn();
+    auto end = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count() / iterations;
+}
+
+int main(int argc, char* argv[]) {
+    int maxThreads = (int)std::thread::hardware_concurrency();
+    if (maxThreads < 4) maxThreads = 4;
+    if (argc > 1) maxThreads = atoi(argv[1]);
+
+    printf("Testing job system (%u hardware threads)...\n", std::thread::hardware_concurrency());
+
+    // Every index is visited exactly once, for awkward counts and grains
+    {
+        JobSystem jobs;
+        jobs.Start(3);
+        bool exact = true;
+        uint32_t counts[] = { 1, 7, 64, 1000, 4099 };
+        uint32_t grains[] = { 1, 3, 64, 5000 };
+        for (uint32_t count : counts) {
+            for (uint32_t grain : grains) {
+                std::vector<std::atomic<int>> hits(count);
+                for (auto& h : hits) h = 0;
+                jobs.ParallelFor(count, grain, [&](uint32_t begin, uint32_t end) {
+                    for (uint32_t i = begin; i < end; i++) hits[i]++;
+                });
+                for (auto& h : hits) exact = exact && h == 1;
+            }
+        }
+        CHECK(exact, "ParallelFor covers every index once");
+    }
+
+    // Zero workers: runs inline on the caller
+    {
+        JobSystem jobs;
+        jobs.Start(0);
+        std::thread::id caller = std::this_thread::get_id();
+        bool inlineOnly = true;
+        jobs.ParallelFor(100, 10, [&](uint32_t, uint32_t) {
+            if (std::this_thread::get_id() != caller) inlineOnly = false;
+        });
+        CHECK(inlineOnly, "zero workers run inline");
+    }
+
+    // Several outside threads submitting at once (like the encode workers)
+    {
+        JobSystem jobs;
+        jobs.Start(3);
+        std::atomic<uint64_t> total(0);
+        std::vector<std::thread> callers;
+        for (int t = 0; t < 4; t++) {
+            callers.emplace_back([&] {
+                for (int round = 0; round < 200; round++) {
+                    jobs.ParallelFor(500, 7, [&](uint32_t begin, uint32_t end) {
+                        uint64_t sum = 0;
+                        for (uint32_t i = begin; i < end; i++) sum += i;
+                        total += sum;
+                    });
+                }
+            });
+        }
+        for (auto& t : callers) t.join();
+        CHECK(total == 4ull * 200 * (499ull * 500 / 2), "concurrent callers all complete");
+    }
+
+    // Nested ParallelFor from inside a job
+    {
+        JobSystem jobs;
+        jobs.Start(2);
+        std::atomic<int> inner(0);
+        jobs.ParallelFor(8, 1, [&](uint32_t, uint32_t) {
+            jobs.ParallelFor(16, 2, [&](uint32_t begin, uint32_t end) { inner += (int)(end - begin); });
+        });
+        CHECK(inner == 8 * 16, "nested ParallelFor completes");
+    }
+
+    // Pitch-stripping copy matches the sequential one
+    const uint32_t w = 1920, h = 1080, pitch = w * 4 + 256;
+    std::vector<uint8_t> frame;
+    FillFrame(frame, w, h, pitch);
+    {
+        JobSystem jobs;
+        jobs.Start(3);
+        std::vector<uint8_t> a((size_t)w * h * 4), b((size_t)w * h * 4);
+        ParallelCopyRows(nullptr, a.data(), w * 4, frame.data(), pitch, w * 4, h);
+        ParallelCopyRows(&jobs, b.data(), w * 4, frame.data(), pitch, w * 4, h);
+        CHECK(a == b, "parallel row copy matches sequential");
+    }
+
+    // Banded JPEG: same bytes for any thread count, and the same as a
+    // sequential encode with the equivalent restart interval
+    {
+        std::vector<uint8_t> reference;
+        bool same = true;
+        for (int threads = 1; threads <= 5; threads++) {
+            JobSystem jobs;
+            jobs.Start(threads - 1);
+            BaselineJpegEncoder encoder;
+            encoder.Configure(75, CHROMA_420);
+            encoder.SetJobSystem(&jobs);
+            std::vector<uint8_t> out(encoder.MaxEncodedSize(w, h));
+            for (int repeat = 0; repeat < 2; repeat++) {
+                int size = encoder.Encode(frame.data(), pitch, w, h, out.data(), out.size());
+                std::vector<uint8_t> result(out.begin(), out.begin() + (size > 0 ? size : 0));
+                if (reference.empty()) reference = result;
+                else same = same && result == reference;
+            }
+        }
+
+        BaselineJpegEncoder sequential;
+        uint32_t mcusX = (w + 15) / 16;
+        sequential.Configure(75, CHROMA_420, mcusX * JPEG_DEFAULT_BAND_ROWS);
+        std::vector<uint8_t> out(sequential.MaxEncodedSize(w, h));
+        int size = sequential.Encode(frame.data(), pitch, w, h, out.data(), out.size());
+        std::vector<uint8_t> expected(out.begin(), out.begin() + (size > 0 ? size : 0));
+
+        CHECK(!reference.empty() && same, "banded JPEG is identical for 1-5 threads");
+        CHECK(reference == expected, "banded JPEG equals sequential restart-interval encode");
+    }
+
+    // Scaling (informational). Threads = workers + the calling thread.
+    struct Size { const char* name; uint32_t w, h; } sizes[] = { { "1080p", 1920, 1080 }, { "4K", 3840, 2160 } };
+    for (const Size& size : sizes) {
+        uint32_t sizePitch = size.w * 4 + 256;
+        std::vector<uint8_t> src;
+        FillFrame(src, size.w, size.h, sizePitch);
+        std::vector<uint8_t> dst((size_t)size.w * size.h * 4);
+
+        printf("\n  %s (%ux%u)   copy ms   jpeg ms   jpeg speedup\n", size.name, size.w, size.h);
+        double baseJpeg = 0;
+        for (int threads = 1; threads <= maxThreads; threads *= 2) {
+            JobSystem jobs;
+            jobs.Start(threads - 1);
+            BaselineJpegEncoder encoder;
+            encoder.Configure(60, CHROMA_420);
+            encoder.SetJobSystem(&jobs);
+            std::vector<uint8_t> out(encoder.MaxEncodedSize(size.w, size.h));
+            encoder.Encode(src.data(), sizePitch, size.w, size.h, out.data(), out.size());  // Warm up
+
+            double copyMs = TimeMs(10, [&] {
+                ParallelCopyRows(&jobs, dst.data(), size.w * 4, src.data(), sizePitch, size.w * 4, size.h);
+            });
+            double jpegMs = TimeMs(5, [&] {
+                encoder.Encode(src.data(), sizePitch, size.w, size.h, out.data(), out.size());
+            });
+            if (threads == 1) baseJpeg = jpegMs;
+            printf("  %2d thread(s)       %7.2f   %7.2f   %.2fx\n", threads, copyMs, jpegMs, baseJpeg / jpegMs);
+            if (threads < maxThreads && threads * 2 > maxThreads) threads = maxThreads / 2;  // Always end on maxThreads
+        }
+    }
+
+    if (failures) {
+        printf("\n%d test(s) failed\n", failures);
+        return 1;
+    }
+    printf("\nAll tests passed!\n");
+    return 0;
+}
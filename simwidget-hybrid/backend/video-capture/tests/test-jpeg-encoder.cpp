@@ -0,0 +1,412 @@
+// Tests for the built-in baseline JPEG encoder (common/jpeg-encoder.h)
+// Decodes the output with a small reference decoder (below) and checks image
+// quality, SIMD/scalar exactness, restart markers and per-frame allocations.
+// Also prints encode timings for comparison with the WIC path.
+// Compile: g++ -O2 -std=c++17 tests/test-jpeg-encoder.cpp -o bin/test-jpeg-encoder
+//     or:  cl /EHsc /O2 /Fe:bin\test-jpeg-encoder.exe tests\test-jpeg-encoder.cpp
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <vector>
+#include "../common/jpeg-encoder.h"
+
+static int failures = 0;
+
+#define CHECK(cond, name) do { \
+    if (cond) { printf("OK: %s\n", name); } \
+    else { printf("FAILED: %s (%s:%d)\n", name, __FILE__, __LINE__); failures++; } \
+} while (0)
+
+// Count heap allocations so the test can prove Encode() makes none
+static std::atomic<long> allocations(0);
+void* operator new(size_t size) {
+    allocations++;
+    void* p = malloc(size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+// --- Reference decoder ------------------------------------------------------
+// Baseline, 8-bit, Huffman, up to 3 components with any 1x1/2x1/2x2 sampling,
+// DRI/RSTn. Slow (double precision IDCT) but simple enough to trust.
+
+struct Decoder {
+    struct Huff { std::vector<uint8_t> values; int bits[17]; };
+    struct Component { int id, h, v, tq, td, ta, pred; std::vector<uint8_t> plane; int stride; };
+
+    const uint8_t* p;
+    const uint8_t* end;
+    uint8_t quant[4][64];
+    Huff dc[4], ac[4];
+    Component comps[3];
+    int count = 0, width = 0, height = 0, restart = 0, hmax = 1, vmax = 1;
+    uint32_t bitBuf = 0;
+    int bitCount = 0;
+    int rstSeen = 0;
+    bool ok = true;
+
+    int ReadBit() {
+        if (bitCount == 0) {
+            if (p >= end) { ok = false; return 0; }
+            uint8_t b = *p++;
+            if (b == 0xFF) {
+                uint8_t next = p < end ? *p : 0;
+                if (next == 0) p++;
+                else { ok = false; return 0; }  // Marker inside entropy data
+            }
+            bitBuf = b;
+            bitCount = 8;
+        }
+        bitCount--;
+        return (bitBuf >> bitCount) & 1;
+    }
+
+    int Receive(int n) {
+        int v = 0;
+        for (int i = 0; i < n; i++) v = (v << 1) | ReadBit();
+        return v;
+    }
+
+    static int Extend(int v, int n) { return n && v < (1 << (n - 1)) ? v - (1 << n) + 1 : v; }
+
+    int DecodeSymbol(const Huff& h) {
+        int code = 0, first = 0, index = 0;
+        for (int len = 1; len <= 16; len++) {
+            code |= ReadBit();
+            int n = h.bits[len];
+            if (code - first < n) return h.values[index + code - first];
+            index += n;
+            first = (first + n) << 1;
+            code <<= 1;
+        }
+        ok = false;
+        return 0;
+    }
+
+    void DecodeBlock(Component& c, uint8_t* out, int stride) {
+        double coef[64] = {};
+        int t = DecodeSymbol(dc[c.td]);
+        c.pred += Extend(Receive(t), t);
+        coef[0] = c.pred * quant[c.tq][0];
+        for (int k = 1; k < 64; ) {
+            int rs = DecodeSymbol(ac[c.ta]);
+            int r = rs >> 4, s = rs & 15;
+            if (s == 0) {
+                if (r != 15) break;
+                k += 16;
+                continue;
+            }
+            k += r;
+            if (k > 63) { ok = false; return; }
+            coef[jpegenc::NATURAL_ORDER[k]] = Extend(Receive(s), s) * quant[c.tq][k];
+            k++;
+        }
+        for (int y = 0; y < 8; y++) {
+            for (int x = 0; x < 8; x++) {
+                double sum = 0;
+                for (int v = 0; v < 8; v++) {
+                    for (int u = 0; u < 8; u++) {
+                        double cu = u ? 1 : sqrt(0.5), cv = v ? 1 : sqrt(0.5);
+                        sum += cu * cv * coef[v * 8 + u] * cos((2 * x + 1) * u * M_PI / 16) * cos((2 * y + 1) * v * M_PI / 16);
+                    }
+                }
+                double val = sum / 4 + 128;
+                out[y * stride + x] = (uint8_t)(val < 0 ? 0 : (val > 255 ? 255 : lround(val)));
+            }
+        }
+    }
+
+    bool Decode(const uint8_t* data, size_t size) {
+        p = data;
+        end = data + size;
+        if (size < 4 || p[0] != 0xFF || p[1] != 0xD8) return false;
+        p += 2;
+        while (p + 4 <= end) {
+            if (p[0] != 0xFF) return false;
+            uint8_t marker = p[1];
+            int length = (p[2] << 8) | p[3];
+            const uint8_t* seg = p + 4;
+            if (marker == 0xDB) {
+                for (const uint8_t* q = seg; q < p + 2 + length; q += 65) memcpy(quant[q[0] & 3], q + 1, 64);
+            } else if (marker == 0xC4) {
+                for (const uint8_t* q = seg; q < p + 2 + length; ) {
+                    Huff& h = (q[0] >> 4) ? ac[q[0] & 3] : dc[q[0] & 3];
+                    int total = 0;
+                    h.bits[0] = 0;
+                    for (int i = 1; i <= 16; i++) total += (h.bits[i] = q[i]);
+                    h.values.assign(q + 17, q + 17 + total);
+                    q += 17 + total;
+                }
+            } else if (marker == 0xC0) {
+                height = (seg[1] << 8) | seg[2];
+                width = (seg[3] << 8) | seg[4];
+                count = seg[5];
+                for (int i = 0; i < count; i++) {
+                    comps[i].id = seg[6 + i * 3];
+                    comps[i].h = seg[7 + i * 3] >> 4;
+                    comps[i].v = seg[7 + i * 3] & 15;
+                    comps[i].tq = seg[8 + i * 3];
+                    if (comps[i].h > hmax) hmax = comps[i].h;
+                    if (comps[i].v > vmax) vmax = comps[i].v;
+                }
+            } else if (marker == 0xDD) {
+                restart = (seg[0] << 8) | seg[1];
+            } else if (marker == 0xDA) {
+                for (int i = 0; i < seg[0]; i++) {
+                    comps[i].td = seg[2 + i * 2] >> 4;
+                    comps[i].ta = seg[2 + i * 2] & 15;
+                }
+                p += 2 + length;
+                return DecodeScan();
+            } else if (marker == 0xC1 || marker == 0xC2) {
+                return false;  // Only baseline
+            }
+            p += 2 + length;
+        }
+        return false;
+    }
+
+    bool DecodeScan() {
+        int mcusX = (width + 8 * hmax - 1) / (8 * hmax);
+        int mcusY = (height + 8 * vmax - 1) / (8 * vmax);
+        for (int i = 0; i < count; i++) {
+            comps[i].stride = mcusX * comps[i].h * 8;
+            comps[i].plane.assign((size_t)comps[i].stride * mcusY * comps[i].v * 8, 0);
+            comps[i].pred = 0;
+        }
+        for (int m = 0; m < mcusX * mcusY && ok; m++) {
+            if (restart && m && m % restart == 0) {
+                bitCount = 0;
+                if (p + 2 > end || p[0] != 0xFF || p[1] != 0xD0 + (rstSeen & 7)) return false;
+                p += 2;
+                rstSeen++;
+                for (int i = 0; i < count; i++) comps[i].pred = 0;
+            }
+            int mx = m % mcusX, my = m / mcusX;
+            for (int i = 0; i < count; i++) {
+                Component& c = comps[i];
+                for (int by = 0; by < c.v; by++) {
+                    for (int bx = 0; bx < c.h; bx++) {
+                        int x = (mx * c.h + bx) * 8, y = (my * c.v + by) * 8;
+                        DecodeBlock(c, &c.plane[(size_t)y * c.stride + x], c.stride);
+                    }
+                }
+            }
+        }
+        bitCount = 0;
+        return ok && p + 2 <= end && p[0] == 0xFF && p[1] == 0xD9;
+    }
+
+    // Nearest-neighbour chroma upsampling, JFIF YCbCr -> BGRA
+    void ToBgra(std::vector<uint8_t>& out) {
+        out.assign((size_t)width * height * 4, 255);
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                double Y = comps[0].plane[(size_t)y * comps[0].stride + x];
+                int cx = x * comps[1].h / hmax, cy = y * comps[1].v / vmax;
+                double cb = comps[1].plane[(size_t)cy * comps[1].stride + cx] - 128.0;
+                double cr = comps[2].plane[(size_t)cy * comps[2].stride + cx] - 128.0;
+                double rgb[3] = { Y + 1.402 * cr, Y - 0.344136 * cb - 0.714136 * cr, Y + 1.772 * cb };
+                uint8_t* px = &out[((size_t)y * width + x) * 4];
+                px[2] = (uint8_t)(rgb[0] < 0 ? 0 : (rgb[0] > 255 ? 255 : lround(rgb[0])));
+                px[1] = (uint8_t)(rgb[1] < 0 ? 0 : (rgb[1] > 255 ? 255 : lround(rgb[1])));
+                px[0] = (uint8_t)(rgb[2] < 0 ? 0 : (rgb[2] > 255 ? 255 : lround(rgb[2])));
+            }
+        }
+    }
+};
+
+// --- Test images -------------------------------------------------------------
+
+// Smooth gradients plus a few hard edges - roughly what a gauge panel looks like
+static void FillPanel(std::vector<uint8_t>& img, uint32_t w, uint32_t h, uint32_t stride) {
+    img.assign((size_t)stride * h, 0);
+    for (uint32_t y = 0; y < h; y++) {
+        for (uint32_t x = 0; x < w; x++) {
+            uint8_t* p = &img[(size_t)y * stride + x * 4];
+            p[0] = (uint8_t)(x * 255 / (w > 1 ? w - 1 : 1));
+            p[1] = (uint8_t)(y * 255 / (h > 1 ? h - 1 : 1));
+            p[2] = (uint8_t)(128 + 100 * sin(x * 0.05) * cos(y * 0.03));
+            p[3] = 255;
+            if ((x / 40 + y / 40) % 7 == 0) { p[0] = 255; p[1] = 255; p[2] = 255; }
+        }
+    }
+}
+
+static double Psnr(const std::vector<uint8_t>& a, uint32_t aStride, const std::vector<uint8_t>& b,
+                   uint32_t w, uint32_t h) {
+    double mse = 0;
+    for (uint32_t y = 0; y < h; y++) {
+        for (uint32_t x = 0; x < w; x++) {
+            for (int c = 0; c < 3; c++) {
+                double d = (double)a[(size_t)y * aStride + x * 4 + c] - b[((size_t)y * w + x) * 4 + c];
+                mse += d * d;
+            }
+        }
+    }
+    mse /= (double)w * h * 3;
+    return mse == 0 ? 99.0 : 10 * log10(255.0 * 255.0 / mse);
+}
+
+static bool RoundTrip(uint32_t w, uint32_t h, ChromaSubsampling s, int quality, int restart, double minPsnr,
+                      double* psnrOut = nullptr) {
+    uint32_t stride = w * 4 + 16;
+    std::vector<uint8_t> img;
+    FillPanel(img, w, h, stride);
+
+    BaselineJpegEncoder encoder;
+    encoder.Configure(quality, s, restart);
+    std::vector<uint8_t> out(encoder.MaxEncodedSize(w, h));
+    int size = encoder.Encode(img.data(), stride, w, h, out.data(), out.size());
+    if (size <= 0) return false;
+
+    Decoder dec;
+    if (!dec.Decode(out.data(), size) || dec.width != (int)w || dec.height != (int)h) return false;
+    std::vector<uint8_t> decoded;
+    dec.ToBgra(decoded);
+    double psnr = Psnr(img, stride, decoded, w, h);
+    if (psnrOut) *psnrOut = psnr;
+    if (psnr < minPsnr) printf("  %ux%u %s q%d: PSNR %.1f dB\n", w, h, ChromaSubsamplingName(s), quality, psnr);
+    return psnr >= minPsnr;
+}
+
+int main() {
+    printf("Testing JPEG encoder (SIMD level: %s)...\n", SimdLevelName(GetSimdLevel()));
+
+    // DCT + quantizer: SIMD output equals the scalar reference exactly
+    {
+        BaselineJpegEncoder encoder;
+        encoder.Configure(75, CHROMA_420);
+        float recip[64];
+        for (int i = 0; i < 64; i++) recip[i] = 1.0f / (1 + i % 13);
+        uint8_t block[8 * 16];
+        bool same = true;
+        uint32_t seed = 1;
+        for (int iter = 0; iter < 2000 && same; iter++) {
+            for (auto& b : block) {
+                seed = seed * 1664525u + 1013904223u;
+                b = (uint8_t)(iter % 3 == 0 ? (seed >> 24) : (seed >> 30) * 85);  // Noise or hard edges
+            }
+            int16_t ref[64], out[64];
+            jpegenc::FdctQuantScalar(block, 16, recip, ref);
+#ifdef SIMD_X86
+            if (GetSimdLevel() >= SIMD_SSE2) {
+                jpegenc::FdctQuantSSE2(block, 16, recip, out);
+                same = same && memcmp(ref, out, sizeof(ref)) == 0;
+            }
+            if (GetSimdLevel() >= SIMD_AVX2) {
+                jpegenc::FdctQuantAVX2(block, 16, recip, out);
+                same = same && memcmp(ref, out, sizeof(ref)) == 0;
+            }
+#endif
+        }
+        CHECK(same, "SIMD DCT/quantizer matches scalar");
+    }
+
+    // Flat block: only the DC coefficient survives
+    {
+        uint8_t block[64];
+        memset(block, 200, sizeof(block));
+        float recip[64];
+        for (int i = 0; i < 64; i++) recip[i] = 1.0f / (jpegenc::AAN_SCALE[i / 8] * jpegenc::AAN_SCALE[i % 8] * 8.0f);
+        int16_t out[64];
+        jpegenc::FdctQuantScalar(block, 8, recip, out);
+        bool onlyDc = out[0] == (200 - 128) * 8;
+        for (int i = 1; i < 64; i++) onlyDc = onlyDc && out[i] == 0;
+        CHECK(onlyDc, "flat block has only a DC coefficient");
+    }
+
+    // Decoded output matches the source for every subsampling mode and odd sizes
+    CHECK(RoundTrip(320, 240, CHROMA_444, 90, 0, 38.0), "4:4:4 round trip");
+    CHECK(RoundTrip(320, 240, CHROMA_422, 90, 0, 34.0), "4:2:2 round trip");
+    CHECK(RoundTrip(320, 240, CHROMA_420, 90, 0, 32.0), "4:2:0 round trip");
+    CHECK(RoundTrip(67, 45, CHROMA_420, 90, 0, 30.0) && RoundTrip(1, 1, CHROMA_420, 90, 0, 30.0) &&
+          RoundTrip(17, 9, CHROMA_422, 90, 0, 30.0), "non-MCU-multiple sizes");
+    CHECK(RoundTrip(200, 120, CHROMA_420, 80, 7, 30.0), "restart markers decode");
+
+    // Quality setting trades size for fidelity
+    {
+        double low, high;
+        RoundTrip(320, 240, CHROMA_444, 30, 0, 0, &low);
+        RoundTrip(320, 240, CHROMA_444, 95, 0, 0, &high);
+        CHECK(high > low + 3, "higher quality gives higher PSNR");
+    }
+
+    // Every SIMD level produces the same file
+    const uint32_t w = 1920, h = 1080, stride = w * 4;
+    std::vector<uint8_t> img;
+    FillPanel(img, w, h, stride);
+    {
+        bool same = true;
+        std::vector<uint8_t> ref;
+        for (int level = SIMD_SCALAR; level <= GetSimdLevel(); level++) {
+            BaselineJpegEncoder encoder;
+            encoder.Configure(75, CHROMA_420, 16);
+            encoder.SetSimdLevel((SimdLevel)level);
+            std::vector<uint8_t> out(encoder.MaxEncodedSize(w, h));
+            int size = encoder.Encode(img.data(), stride, w, h, out.data(), out.size());
+            out.resize(size > 0 ? size : 0);
+            if (level == SIMD_SCALAR) ref = out;
+            else same = same && out == ref;
+        }
+        CHECK(!ref.empty() && same, "SIMD and scalar encoders produce identical files");
+    }
+
+    // Too small a buffer fails cleanly
+    {
+        BaselineJpegEncoder encoder;
+        encoder.Configure(75, CHROMA_420);
+        std::vector<uint8_t> out(4096);
+        CHECK(encoder.Encode(img.data(), stride, w, h, out.data(), out.size()) == -1, "small buffer returns -1");
+    }
+
+    // Steady state: no heap allocations per frame
+    {
+        BaselineJpegEncoder encoder;
+        encoder.Configure(75, CHROMA_420);
+        encoder.Reserve(w);
+        std::vector<uint8_t> out(encoder.MaxEncodedSize(w, h));
+        long before = allocations;
+        for (int i = 0; i < 3; i++) {
+            encoder.Configure(75, CHROMA_420);  // Unchanged settings are a no-op
+            encoder.Encode(img.data(), stride, w, h, out.data(), out.size());
+        }
+        CHECK(allocations == before, "Encode() does not allocate");
+    }
+
+    // Throughput at 1080p (informational)
+    {
+        ChromaSubsampling modes[] = { CHROMA_420, CHROMA_444 };
+        for (ChromaSubsampling s : modes) {
+            for (int level = SIMD_SCALAR; level <= GetSimdLevel(); level++) {
+                BaselineJpegEncoder encoder;
+                encoder.Configure(60, s);
+                encoder.SetSimdLevel((SimdLevel)level);
+                std::vector<uint8_t> out(encoder.MaxEncodedSize(w, h));
+                int size = 0;
+                const int iterations = 10;
+                auto start = std::chrono::high_resolution_clock::now();
+                for (int i = 0; i < iterations; i++) {
+                    size = encoder.Encode(img.data(), stride, w, h, out.data(), out.size());
+                }
+                auto end = std::chrono::high_resolution_clock::now();
+                double ms = std::chrono::duration<double, std::milli>(end - start).count() / iterations;
+                printf("  1920x1080 q60 %s %-6s %.2f ms/frame, %d KB\n", ChromaSubsamplingName(s),
+                    SimdLevelName((SimdLevel)level), ms, size / 1024);
+            }
+        }
+    }
+
+    if (failures) {
+        printf("\n%d test(s) failed\n", failures);
+        return 1;
+    }
+    printf("\nAll tests passed!\n");
+    return 0;
+}
@@ -0,0 +1,195 @@
+// Tests for the lock-free latency histograms (common/latency-histogram.h)
+// Checks that the log-linear buckets tile the whole range with at most 1/16
+// relative error, percentiles of known distributions, windowed snapshots and
+// that concurrent recording from several threads loses nothing while a
+// reader keeps taking snapshots. Prints the cost of Record() and a sample
+// stage report.
+// Compile: g++ -O2 -std=c++17 -pthread tests/test-latency-histogram.cpp -o bin/test-latency-histogram
+//     or:  cl /EHsc /O2 /Fe:bin\test-latency-histogram.exe tests\test-latency-histogram.cpp
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "../common/latency-histogram.h"
+
+static int failures = 0;
+
+#define CHECK(cond, name) do { \
+    if (cond) { printf("OK: %s\n", name); } \
+    else { printf("FAILED: %s (%s:%d)\n", name, __FILE__, __LINE__); failures++; } \
+} while (0)
+
+// Within the bucket resolution (1/16) of expected
+static bool Near(uint64_t value, double expected) {
+    double error = (double)value - expected;
+    if (error < 0) error = -error;
+    return error <= expected / LATENCY_SUB_BUCKETS + 1;
+}
+
+int main() {
+    printf("Testing latency histogram...\n");
+
+    // Buckets are contiguous and cover [0, 2^LATENCY_MAX_BITS)
+    {
+        bool contiguous = LatencyBucketLow(0) == 0;
+        for (int b = 0; b + 1 < LATENCY_BUCKETS; b++) {
+            if (LatencyBucketLow(b + 1) != LatencyBucketHigh(b) + 1) contiguous = false;
+        }
+        CHECK(contiguous, "buckets are contiguous");
+        CHECK(LatencyBucketHigh(LATENCY_BUCKETS - 1) == ((uint64_t)1 << LATENCY_MAX_BITS) - 1,
+            "last bucket ends at the clamp");
+        CHECK(LatencyBucket((uint64_t)1 << 50) == LATENCY_BUCKETS - 1, "huge values land in the last bucket");
+    }
+
+    // Every value lands in a bucket that contains it and is at most 1/16 wide
+    {
+        bool inside = true, narrow = true, exact = true;
+        for (uint64_t v = 0; v < 2 * LATENCY_SUB_BUCKETS; v++) {
+            if (LatencyBucketLow(LatencyBucket(v)) != v || LatencyBucketHigh(LatencyBucket(v)) != v) exact = false;
+        }
+        srand(7);
+        for (int i = 0; i < 1000000; i++) {
+            int bits = rand() % LATENCY_MAX_BITS;
+            uint64_t v = (((uint64_t)rand() << 31) ^ (uint64_t)rand()) & (((uint64_t)1 << bits) - 1);
+            v |= (uint64_t)1 << bits >> 1;
+            int b = LatencyBucket(v);
+            uint64_t low = LatencyBucketLow(b), high = LatencyBucketHigh(b);
+            if (v < low || v > high) inside = false;
+            if (high - low + 1 > (v / LATENCY_SUB_BUCKETS > 1 ? v / LATENCY_SUB_BUCKETS : 1)) narrow = false;
+        }
+        CHECK(exact, "values below 32 us are exact");
+        CHECK(inside, "values land in their bucket");
+        CHECK(narrow, "bucket width is at most 1/16 of the value");
+    }
+
+    // Percentiles of a uniform 1..10000 us distribution
+    {
+        LatencyHistogram h;
+        for (uint64_t v = 1; v <= 10000; v++) h.Record(v);
+        LatencySnapshot s;
+        h.Snapshot(&s);
+        printf("  uniform 1..10000: p50 %llu, p99 %llu, p99.9 %llu, max %llu, mean %.1f\n",
+            (unsigned long long)s.Percentile(50), (unsigned long long)s.Percentile(99),
+            (unsigned long long)s.Percentile(99.9), (unsigned long long)s.maxUs, s.MeanUs());
+        CHECK(s.count == 10000 && s.maxUs == 10000 && s.MeanUs() == 5000.5, "count, max and mean are exact");
+        CHECK(Near(s.Percentile(50), 5000) && Near(s.Percentile(99), 9900) && Near(s.Percentile(99.9), 9990),
+            "p50 / p99 / p99.9 within bucket resolution");
+        CHECK(s.Percentile(100) == 10000 && s.Percentile(0) == 1, "p0 and p100 are the extremes");
+    }
+
+    // A long tail shows up in p99.9 but not p50
+    {
+        LatencyHistogram h;
+        for (int i = 0; i < 9990; i++) h.Record(2000);
+        for (int i = 0; i < 10; i++) h.Record(80000);
+        LatencySnapshot s;
+        h.Snapshot(&s);
+        CHECK(Near(s.Percentile(50), 2000) && Near(s.Percentile(99), 2000) && Near(s.Percentile(99.95), 80000),
+            "tail of 0.1% only moves the top percentiles");
+        LatencySnapshot empty;
+        CHECK(empty.Percentile(50) == 0 && empty.MeanUs() == 0, "empty snapshot reports zero");
+    }
+
+    // Windows: subtracting an older snapshot leaves what was recorded since
+    {
+        LatencyHistogram h;
+        for (int i = 0; i < 1000; i++) h.Record(50000);
+        LatencySnapshot before, after;
+        h.Snapshot(&before);
+        for (int i = 0; i < 1000; i++) h.Record(300);
+        h.Snapshot(&after);
+        after.Subtract(before);
+        CHECK(after.count == 1000 && after.MeanUs() == 300, "window holds only the newer samples");
+        CHECK(Near(after.Percentile(99.9), 300) && Near(after.maxUs, 300), "window max comes from its own buckets");
+    }
+
+    // QPC ticks convert without overflow
+    {
+        int64_t frequency = 10000000;                        // 10 MHz, the usual QPC rate
+        int64_t ticks = (int64_t)400 * 24 * 3600 * frequency + 12345678;  // 400 days of uptime
+        uint64_t expected = (uint64_t)400 * 24 * 3600 * 1000000 + 1234567;
+        CHECK(LatencyQpcToUs(ticks, frequency) == expected, "QPC ticks -> microseconds after 400 days");
+        CHECK(LatencyQpcToUs(3579545 * 2 + 3579, 3579545) == 2000999, "QPC at an odd frequency");
+    }
+
+    // Concurrent writers while a reader keeps taking snapshots
+    {
+        const int threads = 4;
+        const int perThread = 1000000;
+        LatencyHistogram h;
+        std::atomic<bool> done(false);
+        bool monotonic = true;
+        int snapshots = 0;
+        std::thread reader([&] {
+            LatencySnapshot s;
+            uint64_t lastCount = 0;
+            while (!done) {
+                h.Snapshot(&s);
+                if (s.count < lastCount) monotonic = false;
+                lastCount = s.count;
+                snapshots++;
+            }
+        });
+
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> writers;
+        for (int t = 0; t < threads; t++) {
+            writers.emplace_back([&h, t] {
+                for (int i = 0; i < perThread; i++) h.Record((uint64_t)(i % 20000) + t);
+            });
+        }
+        for (auto& w : writers) w.join();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        done = true;
+        reader.join();
+
+        uint64_t expectedSum = 0;
+        for (int t = 0; t < threads; t++) {
+            for (int i = 0; i < perThread; i++) expectedSum += (uint64_t)(i % 20000) + t;
+        }
+        LatencySnapshot s;
+        h.Snapshot(&s);
+        printf("  %d threads x %d records: %.1f ns per record, %d snapshots taken meanwhile\n", threads, perThread,
+            seconds * 1e9 / perThread, snapshots);
+        CHECK(s.count == (uint64_t)threads * perThread && s.sumUs == expectedSum, "no record is lost across threads");
+        CHECK(s.maxUs == 19999 + threads - 1, "max is exact across threads");
+        CHECK(monotonic, "snapshots never go backwards");
+    }
+
+    // Cost on one thread (the hot-path case)
+    {
+        LatencyHistogram h;
+        const int count = 10000000;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < count; i++) h.Record((uint64_t)(i & 0xFFFF));
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        printf("  single thread: %.1f ns per record\n", seconds * 1e9 / count);
+    }
+
+    // Stage report: each call covers the window since the previous one
+    {
+        static const char* const names[] = { "capture", "encode", "send" };
+        LatencyStages stages(names, 3);
+        for (int i = 0; i < 600; i++) {
+            stages.Record(0, 800 + i % 400);
+            stages.Record(1, 6000 + (i % 50) * 40);
+        }
+        stages.Report("  ");
+        uint64_t now = LatencyNowUs();
+        stages.RecordSince(2, now - 1500, now);
+        stages.RecordSince(2, now, now - 10);   // Out of order: ignored
+        LatencySnapshot s;
+        stages[2].Snapshot(&s);
+        CHECK(s.count == 1 && s.maxUs == 1500, "RecordSince ignores reversed stamps");
+        stages.Report("  ");
+    }
+
+    if (failures) {
+        printf("\n%d test(s) failed\n", failures);
+        return 1;
+    }
+    printf("\nAll tests passed!\n");
+    return 0;
+}
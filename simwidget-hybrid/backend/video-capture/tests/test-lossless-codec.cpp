@@ -0,0 +1,317 @@
+// Tests for the lossless frame codec (common/lossless-codec.h)
+// Round trips must be bit-exact; SIMD output must match the scalar encoder
+// byte for byte. Also prints compression ratios and throughput.
+// Compile: g++ -O2 -std=c++17 -pthread tests/test-lossless-codec.cpp -o bin/test-lossless-codec
+//     or:  cl /EHsc /O2 /Fe:bin\test-lossless-codec.exe tests\test-lossless-codec.cpp
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <chrono>
+#include <vector>
+#include "../common/lossless-codec.h"
+
+static int failures = 0;
+
+#define CHECK(cond, name) do { \
+    if (cond) { printf("OK: %s\n", name); } \
+    else { printf("FAILED: %s (%s:%d)\n", name, __FILE__, __LINE__); failures++; } \
+} while (0)
+
+struct Image {
+    uint32_t width, height, stride;
+    std::vector<uint8_t> pixels;
+
+    // Padded stride, as DXGI hands frames out
+    Image(uint32_t w, uint32_t h) : width(w), height(h), stride(w * 4 + 36) {
+        pixels.assign((size_t)stride * h, 0xEE);
+    }
+    uint8_t* At(uint32_t x, uint32_t y) { return &pixels[(size_t)y * stride + x * 4]; }
+
+    // Pitch stripped, for comparing against decoder output
+    std::vector<uint8_t> Packed() const {
+        std::vector<uint8_t> out((size_t)width * height * 4);
+        for (uint32_t y = 0; y < height; y++) memcpy(&out[(size_t)y * width * 4], &pixels[(size_t)y * stride], width * 4);
+        return out;
+    }
+};
+
+static void FillNoise(Image& img, uint32_t seed) {
+    for (uint32_t y = 0; y < img.height; y++) {
+        for (uint32_t x = 0; x < img.width * 4; x++) {
+            seed = seed * 1664525u + 1013904223u;
+            img.At(0, y)[x] = (uint8_t)(seed >> 24);
+        }
+    }
+}
+
+// Gauge-panel-like frame: flat background, bezels, a soft gradient and text-ish noise
+static void FillCockpit(Image& img, uint32_t phase) {
+    for (uint32_t y = 0; y < img.height; y++) {
+        for (uint32_t x = 0; x < img.width; x++) {
+            uint8_t* p = img.At(x, y);
+            p[0] = 24; p[1] = 26; p[2] = 30; p[3] = 255;
+            if ((x / 240 + y / 240) % 3 == 0) {
+                p[0] = (uint8_t)(40 + (x % 240) / 8);
+                p[1] = (uint8_t)(60 + (y % 240) / 6);
+                p[2] = 80;
+            }
+            if (((x + phase) * 7 + y * 13) % 97 < 3 && (y / 20) % 4 == 1) {
+                p[0] = p[1] = p[2] = 230;
+            }
+        }
+    }
+}
+
+static void FillGradient(Image& img) {
+    for (uint32_t y = 0; y < img.height; y++) {
+        for (uint32_t x = 0; x < img.width; x++) {
+            uint8_t* p = img.At(x, y);
+            p[0] = (uint8_t)(x * 255 / (img.width > 1 ? img.width - 1 : 1));
+            p[1] = (uint8_t)(y * 255 / (img.height > 1 ? img.height - 1 : 1));
+            p[2] = (uint8_t)(128 + 100 * sin(x * 0.02) * cos(y * 0.015));
+            p[3] = 255;
+        }
+    }
+}
+
+static std::vector<uint8_t> Encode(LosslessEncoder& encoder, Image& img, bool useXor, bool* xorCoded = nullptr) {
+    std::vector<uint8_t> out(encoder.MaxEncodedSize());
+    int size = encoder.Encode(img.pixels.data(), img.stride, useXor, out.data(), out.size(), xorCoded);
+    out.resize(size > 0 ? size : 0);
+    return out;
+}
+
+static bool RoundTrip(Image& img, SimdLevel level) {
+    LosslessEncoder encoder;
+    encoder.Initialize(img.width, img.height, false);
+    encoder.SetSimdLevel(level);
+    std::vector<uint8_t> stream = Encode(encoder, img, false);
+    LosslessDecoder decoder;
+    decoder.SetSimdLevel(level);
+    if (stream.empty() || decoder.Decode(stream.data(), stream.size()) != 0) return false;
+    std::vector<uint8_t> packed = img.Packed();
+    return memcmp(decoder.GetFrame(), packed.data(), packed.size()) == 0;
+}
+
+// Every SIMD level on this CPU produces the scalar stream
+static bool SimdMatchesScalar(Image& img) {
+    LosslessEncoder scalar;
+    scalar.Initialize(img.width, img.height, false);
+    scalar.SetSimdLevel(SIMD_SCALAR);
+    std::vector<uint8_t> expected = Encode(scalar, img, false);
+    for (int level = SIMD_SSE2; level <= GetSimdLevel(); level++) {
+        LosslessEncoder encoder;
+        encoder.Initialize(img.width, img.height, false);
+        encoder.SetSimdLevel((SimdLevel)level);
+        if (Encode(encoder, img, false) != expected) {
+            printf("  mismatch: %ux%u %s\n", img.width, img.height, SimdLevelName((SimdLevel)level));
+            return false;
+        }
+    }
+    return true;
+}
+
+int main() {
+    printf("Testing lossless codec (SIMD level: %s)...\n", SimdLevelName(GetSimdLevel()));
+
+    // Round trips at every SIMD level, including sizes that leave tails
+    {
+        bool exact = true;
+        const uint32_t sizes[][2] = { { 1, 1 }, { 3, 2 }, { 7, 33 }, { 9, 64 }, { 17, 65 }, { 333, 77 }, { 1920, 1080 } };
+        for (auto& s : sizes) {
+            Image noise(s[0], s[1]), gradient(s[0], s[1]), cockpit(s[0], s[1]);
+            FillNoise(noise, s[0] * 31 + s[1]);
+            FillGradient(gradient);
+            FillCockpit(cockpit, 0);
+            for (int level = SIMD_SCALAR; level <= GetSimdLevel(); level++) {
+                exact = exact && RoundTrip(noise, (SimdLevel)level) && RoundTrip(gradient, (SimdLevel)level) &&
+                    RoundTrip(cockpit, (SimdLevel)level);
+            }
+        }
+        CHECK(exact, "round trip is bit-exact");
+    }
+
+    // Every residual value range: small, byte, alpha changes, and the +/-8 edges
+    {
+        Image img(64, 40);
+        for (uint32_t y = 0; y < img.height; y++) {
+            for (uint32_t x = 0; x < img.width; x++) {
+                uint8_t* p = img.At(x, y);
+                int step = (int)(y % 20) - 10;  // -10..9 per pixel, hits both nibble edges
+                p[0] = (uint8_t)(x * step);
+                p[1] = (uint8_t)(x * (y % 3 == 0 ? 7 : -8));
+                p[2] = (uint8_t)(y * 50 + x);
+                p[3] = (uint8_t)(y >= 30 && x % 5 == 0 ? x : 255);
+            }
+        }
+        bool exact = true;
+        for (int level = SIMD_SCALAR; level <= GetSimdLevel(); level++) exact = exact && RoundTrip(img, (SimdLevel)level);
+        CHECK(exact, "nibble edges and alpha changes round trip");
+    }
+
+    {
+        bool same = true;
+        for (uint32_t w = 1; w <= 40 && same; w++) {
+            Image noise(w, 5), gradient(w * 3, 7);
+            FillNoise(noise, w);
+            FillGradient(gradient);
+            same = SimdMatchesScalar(noise) && SimdMatchesScalar(gradient);
+        }
+        Image cockpit(1920, 1080);
+        FillCockpit(cockpit, 0);
+        same = same && SimdMatchesScalar(cockpit);
+        CHECK(same, "SIMD encoder matches scalar");
+    }
+
+    // Flat frames collapse to tokens
+    {
+        Image flat(1920, 1080);
+        for (uint32_t y = 0; y < flat.height; y++) {
+            for (uint32_t x = 0; x < flat.width; x++) memcpy(flat.At(x, y), "\x10\x20\x30\xFF", 4);
+        }
+        LosslessEncoder encoder;
+        encoder.Initialize(1920, 1080, false);
+        size_t size = Encode(encoder, flat, false).size();
+        CHECK(size > 0 && size < 20000, "flat frame compresses below 20 KB");
+    }
+
+    // XOR frames: a small change costs little, and a chain of them decodes exactly
+    {
+        LosslessEncoder encoder;
+        encoder.Initialize(1280, 720, true);
+        LosslessDecoder decoder;
+        Image img(1280, 720);
+        bool exact = true, firstIntra = true, restXor = true;
+        size_t intraSize = 0, xorSize = 0;
+        for (uint32_t frame = 0; frame < 6; frame++) {
+            FillCockpit(img, frame == 0 ? 0 : 1);
+            for (uint32_t y = 100; y < 140; y++) {  // A moving needle
+                for (uint32_t x = 300 + frame * 10; x < 306 + frame * 10; x++) memcpy(img.At(x, y), "\x00\x00\xFF\xFF", 4);
+            }
+            bool xorCoded = false;
+            std::vector<uint8_t> stream = Encode(encoder, img, true, &xorCoded);
+            if (frame == 0) { firstIntra = !xorCoded; intraSize = stream.size(); }
+            else { restXor = restXor && xorCoded; xorSize = stream.size(); }
+            std::vector<uint8_t> packed = img.Packed();
+            exact = exact && decoder.Decode(stream.data(), stream.size()) == 0 &&
+                memcmp(decoder.GetFrame(), packed.data(), packed.size()) == 0;
+        }
+        CHECK(exact, "XOR frame chain decodes exactly");
+        CHECK(firstIntra && restXor, "first frame is intra, the rest XOR");
+        CHECK(xorSize * 4 < intraSize, "XOR frame is much smaller than intra");
+
+        // After a reset the next frame is intra again
+        encoder.ResetReference();
+        bool xorCoded = true;
+        Encode(encoder, img, true, &xorCoded);
+        CHECK(!xorCoded, "ResetReference forces an intra frame");
+
+        // An XOR frame without the previous frame is refused
+        std::vector<uint8_t> stream = Encode(encoder, img, true, &xorCoded);
+        LosslessDecoder fresh;
+        CHECK(xorCoded && fresh.Decode(stream.data(), stream.size()) == -1, "XOR frame needs a reference");
+    }
+
+    // Corrupt and truncated input is rejected, never overruns
+    {
+        Image img(333, 77);
+        FillCockpit(img, 0);
+        LosslessEncoder encoder;
+        encoder.Initialize(img.width, img.height, false);
+        std::vector<uint8_t> stream = Encode(encoder, img, false);
+        LosslessDecoder decoder;
+        bool rejected = true;
+        for (size_t cut = 0; cut < stream.size(); cut += 7) rejected = rejected && decoder.Decode(stream.data(), cut) == -1;
+        std::vector<uint8_t> bad = stream;
+        bad[0] ^= 1;
+        rejected = rejected && decoder.Decode(bad.data(), bad.size()) == -1;
+        bad = stream;
+        bad[LOSSLESS_HEADER_SIZE] += 1;  // First band size off by one
+        rejected = rejected && decoder.Decode(bad.data(), bad.size()) == -1;
+        CHECK(rejected, "corrupt streams are rejected");
+
+        // Random garbage after a valid header must not crash either
+        uint32_t seed = 99;
+        for (int i = 0; i < 200; i++) {
+            bad = stream;
+            for (size_t j = LOSSLESS_HEADER_SIZE + 12; j < bad.size(); j += 3) {
+                seed = seed * 1664525u + 1013904223u;
+                if ((seed >> 28) == 0) bad[j] = (uint8_t)(seed >> 16);
+            }
+            decoder.Decode(bad.data(), bad.size());
+        }
+        CHECK(decoder.Decode(stream.data(), stream.size()) == 0, "decoder recovers after garbage");
+    }
+
+    // Bands across a pool: same stream, same pixels
+    {
+        JobSystem jobs;
+        jobs.Start(3);
+        Image img(1920, 1080);
+        FillCockpit(img, 0);
+        LosslessEncoder single, pooled;
+        single.Initialize(1920, 1080, false);
+        pooled.Initialize(1920, 1080, false);
+        pooled.SetJobSystem(&jobs);
+        std::vector<uint8_t> a = Encode(single, img, false), b = Encode(pooled, img, false);
+        LosslessDecoder decoder;
+        decoder.SetJobSystem(&jobs);
+        std::vector<uint8_t> packed = img.Packed();
+        CHECK(a == b, "pooled encode matches single-threaded");
+        CHECK(decoder.Decode(b.data(), b.size()) == 0 && memcmp(decoder.GetFrame(), packed.data(), packed.size()) == 0,
+            "pooled decode is exact");
+    }
+
+    // Ratio and throughput at 1080p (informational). GB/s is of raw BGRA.
+    {
+        JobSystem jobs;
+        jobs.Start(JobSystem::DefaultWorkerCount());
+        struct Content { const char* name; Image img; } contents[] = {
+            { "cockpit", Image(1920, 1080) }, { "gradient", Image(1920, 1080) }, { "noise", Image(1920, 1080) },
+        };
+        FillCockpit(contents[0].img, 0);
+        FillGradient(contents[1].img);
+        FillNoise(contents[2].img, 3);
+        double rawBytes = 1920.0 * 1080 * 4;
+
+        printf("\n  1080p      level    ratio   encode GB/s   decode GB/s   pooled enc/dec GB/s\n");
+        for (auto& c : contents) {
+            for (int level = SIMD_SCALAR; level <= GetSimdLevel(); level++) {
+                LosslessEncoder encoder;
+                encoder.Initialize(1920, 1080, false);
+                encoder.SetSimdLevel((SimdLevel)level);
+                LosslessDecoder decoder;
+                decoder.SetSimdLevel((SimdLevel)level);
+                std::vector<uint8_t> out(encoder.MaxEncodedSize());
+                int size = encoder.Encode(c.img.pixels.data(), c.img.stride, false, out.data(), out.size());
+
+                const int iterations = 20;
+                auto t0 = std::chrono::high_resolution_clock::now();
+                for (int i = 0; i < iterations; i++) encoder.Encode(c.img.pixels.data(), c.img.stride, false, out.data(), out.size());
+                auto t1 = std::chrono::high_resolution_clock::now();
+                for (int i = 0; i < iterations; i++) decoder.Decode(out.data(), size);
+                auto t2 = std::chrono::high_resolution_clock::now();
+                encoder.SetJobSystem(&jobs);
+                decoder.SetJobSystem(&jobs);
+                for (int i = 0; i < iterations; i++) encoder.Encode(c.img.pixels.data(), c.img.stride, false, out.data(), out.size());
+                auto t3 = std::chrono::high_resolution_clock::now();
+                for (int i = 0; i < iterations; i++) decoder.Decode(out.data(), size);
+                auto t4 = std::chrono::high_resolution_clock::now();
+
+                auto gbps = [&](std::chrono::high_resolution_clock::time_point a, std::chrono::high_resolution_clock::time_point b) {
+                    return rawBytes * iterations / std::chrono::duration<double>(b - a).count() / 1e9;
+                };
+                printf("  %-9s  %-6s  %6.2fx  %11.2f   %11.2f   %8.2f / %.2f\n", c.name, SimdLevelName((SimdLevel)level),
+                    rawBytes / size, gbps(t0, t1), gbps(t1, t2), gbps(t2, t3), gbps(t3, t4));
+            }
+        }
+    }
+
+    if (failures) {
+        printf("\n%d test(s) failed\n", failures);
+        return 1;
+    }
+    printf("\nAll tests passed!\n");
+    return 0;
+}
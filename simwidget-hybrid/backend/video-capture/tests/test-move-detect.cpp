@@ -0,0 +1,327 @@
+// Tests for scroll / pan detection (common/move-detect.h)
+// Portable - runs on synthetic frames (bench/frame-source.h), no DXGI needed.
+// Every frame is rebuilt on the "client" side from the moves plus the raw
+// residual tiles and compared with the original.
+// Compile: g++ -O2 -std=c++17 tests/test-move-detect.cpp -o bin/test-move-detect
+//     or:  cl /EHsc /O2 /Fe:bin\test-move-detect.exe tests\test-move-detect.cpp
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <vector>
+#include "../common/move-detect.h"
+#include "../common/tile-delta.h"
+#include "../bench/frame-source.h"
+
+static int failures = 0;
+
+#define CHECK(cond, name) do { \
+    if (cond) { printf("OK: %s\n", name); } \
+    else { printf("FAILED: %s (%s:%d)\n", name, __FILE__, __LINE__); failures++; } \
+} while (0)
+
+// Deterministic pseudo-random fill
+static void FillNoise(uint8_t* p, size_t n, uint32_t seed) {
+    for (size_t i = 0; i < n; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        p[i] = (uint8_t)(seed >> 24);
+    }
+}
+
+// Server and client ends of a delta stream with moves
+struct Stream {
+    uint32_t width, height;
+    TileDelta tiles;
+    MoveDetector moves;
+    std::vector<uint8_t> client;    // What the client shows, packed
+    std::vector<uint8_t> payload;
+    bool exact = true;              // Client matched the server after every frame
+    int frames = 0;
+    int movedTiles = 0;             // Totals over all frames
+    int residualTiles = 0;
+    int dirtyTiles = 0;             // Before moves
+    size_t bytes = 0;
+
+    bool Initialize(uint32_t w, uint32_t h) {
+        width = w;
+        height = h;
+        client.assign((size_t)w * h * 4, 0);
+        payload.resize(MoveDetector::MaxMovesSize((int)((w + 63) / 64 * ((h + 63) / 64))) +
+            DELTA_TILE_HEADER_SIZE + (size_t)w * h * 4 + 1024);
+        return tiles.Initialize(w, h) && moves.Initialize(w, h);
+    }
+
+    // Send one frame: keyframes raw, others as moves + raw residual tiles
+    void Send(const uint8_t* pixels, uint32_t stride, const TileRect* hints, int hintCount, bool keyframe,
+              const MoveVector* moveHints = nullptr, int moveHintCount = 0, bool search = true) {
+        int dirty = tiles.Detect(pixels, stride, hints, hintCount, keyframe);
+        int moved = moves.Detect(pixels, stride, &tiles, moveHints, moveHintCount, search && !keyframe);
+        frames++;
+        if (keyframe) {
+            for (uint32_t y = 0; y < height; y++) {
+                memcpy(&client[(size_t)y * width * 4], pixels + (size_t)y * stride, (size_t)width * 4);
+            }
+            return;
+        }
+        dirtyTiles += dirty;
+        movedTiles += moved;
+        residualTiles += tiles.GetDirtyCount();
+        if (tiles.GetDirtyCount() + moved != dirty) exact = false;
+
+        size_t size = moves.WriteMoves(payload.data());
+        size += tiles.WriteRawDelta(pixels, stride, payload.data() + size);
+        bytes += size;
+
+        size_t used = 0;
+        if (!ApplyMoves(payload.data(), size, client.data(), width, height, width * 4, &used) ||
+            !ApplyRawDelta(payload.data() + used, size - used, client.data(), width, height, width * 4)) {
+            exact = false;
+            return;
+        }
+        for (uint32_t y = 0; y < height; y++) {
+            if (memcmp(&client[(size_t)y * width * 4], pixels + (size_t)y * stride, (size_t)width * 4) != 0) {
+                exact = false;
+                break;
+            }
+        }
+    }
+};
+
+// Textured image larger than the view, so views at any offset look different
+struct Canvas {
+    uint32_t width, height;
+    std::vector<uint8_t> pixels;
+    Canvas(uint32_t w, uint32_t h) : width(w), height(h), pixels((size_t)w * h * 4) {
+        FillNoise(pixels.data(), pixels.size(), 99);
+    }
+    const uint8_t* At(uint32_t x, uint32_t y) const { return &pixels[((size_t)y * width + x) * 4]; }
+};
+
+int main() {
+    printf("Testing move detection (SIMD level: %s)...\n", SimdLevelName(GetSimdLevel()));
+
+    // SAD kernels agree with the scalar reference
+    {
+        std::vector<uint8_t> a(256), b(256);
+        FillNoise(a.data(), a.size(), 1);
+        FillNoise(b.data(), b.size(), 2);
+        bool same = true;
+        uint32_t scalar = movesad::SadRowScalar(a.data(), b.data(), 256);
+        if (GetSimdLevel() >= SIMD_SSE2 && movesad::SadRow(a.data(), b.data(), 256, SIMD_SSE2) != scalar) same = false;
+        if (GetSimdLevel() >= SIMD_AVX2 && movesad::SadRow(a.data(), b.data(), 256, SIMD_AVX2) != scalar) same = false;
+        CHECK(same && scalar > 0, "SAD kernels match the scalar reference");
+        CHECK(movesad::SadRow(a.data(), a.data(), 256, GetSimdLevel()) == 0, "SAD of identical rows is 0");
+    }
+
+    // Scroll scene: the map panel pans diagonally, found by block search
+    {
+        const uint32_t w = 1280, h = 720;
+        FrameSource source;
+        Stream s;
+        bool ok = source.Initialize(w, h, SCENE_SCROLL) && s.Initialize(w, h);
+        int movesPerFrame = 0;
+        for (int f = 0; f < 20 && ok; f++) {
+            const uint8_t* frame = source.Next();
+            int count;
+            const TileRect* hints = source.GetDirtyRects(&count);
+            s.Send(frame, source.GetStride(), hints, count, f == 0);
+            if (f > 0) movesPerFrame = std::max(movesPerFrame, s.moves.GetMoveCount());
+        }
+        printf("  scroll: %d dirty tiles -> %d moved + %d residual, %d moves/frame at most, %.1f KB/frame\n",
+            s.dirtyTiles, s.movedTiles, s.residualTiles, movesPerFrame, s.bytes / 1024.0 / (s.frames - 1));
+        CHECK(ok && s.exact, "scroll: moves + residual tiles rebuild every frame");
+        CHECK(s.movedTiles > s.dirtyTiles / 2, "scroll: most dirty tiles go out as moves");
+        CHECK(movesPerFrame > 0 && movesPerFrame < 16, "scroll: moved tiles merge into a few rects");
+    }
+
+    // Vertical checklist scroll by 37 rows, then a diagonal pan of the whole view
+    {
+        const uint32_t w = 640, h = 480;
+        Canvas canvas(w + 200, h + 400);
+        std::vector<uint8_t> view((size_t)w * h * 4);
+        auto render = [&](uint32_t ox, uint32_t oy) {
+            for (uint32_t y = 0; y < h; y++) memcpy(&view[(size_t)y * w * 4], canvas.At(ox, oy + y), (size_t)w * 4);
+        };
+        Stream s;
+        s.Initialize(w, h);
+        render(0, 0);
+        s.Send(view.data(), w * 4, nullptr, -1, true);
+        render(0, 37);
+        s.Send(view.data(), w * 4, nullptr, -1, false);
+        int tilesX = s.tiles.GetTilesX();
+        int moves = s.moves.GetMoveCount();
+        const MoveRect* m = s.moves.GetMoves();
+        bool vertical = moves >= 1;
+        for (int i = 0; i < moves; i++) {
+            if (m[i].dst.left - m[i].srcX != 0 || m[i].dst.top - m[i].srcY != -37) vertical = false;
+        }
+        CHECK(s.exact, "scroll by 37: frame rebuilt exactly");
+        CHECK(vertical && moves <= 2, "scroll by 37: one upward move");
+        CHECK(s.tiles.GetDirtyCount() <= 2 * tilesX, "scroll by 37: only the uncovered tile rows are residual");
+
+        render(13, 50);
+        s.Send(view.data(), w * 4, nullptr, -1, false);
+        CHECK(s.exact && s.moves.GetMovedTiles() > s.tiles.GetTileCount() / 2, "pan by (-13,-13): found and rebuilt");
+    }
+
+    // Beyond the search range only a DXGI move hint finds the shift
+    {
+        const uint32_t w = 640, h = 480;
+        Canvas canvas(w, h + 200);
+        std::vector<uint8_t> view((size_t)w * h * 4);
+        auto render = [&](uint32_t oy) {
+            for (uint32_t y = 0; y < h; y++) memcpy(&view[(size_t)y * w * 4], canvas.At(0, oy + y), (size_t)w * 4);
+        };
+        Stream searched, hinted;
+        searched.Initialize(w, h);
+        hinted.Initialize(w, h);
+        render(0);
+        searched.Send(view.data(), w * 4, nullptr, -1, true);
+        hinted.Send(view.data(), w * 4, nullptr, -1, true);
+        render(150);
+        MoveVector hint = { 0, -150 };
+        searched.Send(view.data(), w * 4, nullptr, -1, false);
+        hinted.Send(view.data(), w * 4, nullptr, -1, false, &hint, 1);
+        CHECK(searched.exact && searched.moves.GetMovedTiles() == 0, "shift of 150 rows: not found by the search");
+        CHECK(hinted.exact && hinted.moves.GetMovedTiles() > hinted.tiles.GetTileCount() / 2,
+            "shift of 150 rows: found from the DXGI move hint");
+
+        // A wrong hint costs nothing but the check
+        MoveVector wrong = { 5, 5 };
+        render(151);
+        hinted.Send(view.data(), w * 4, nullptr, -1, false, &wrong, 1);
+        CHECK(hinted.exact && hinted.moves.GetMovedTiles() > 0, "wrong hint: search still finds the 1-row scroll");
+    }
+
+    // No false moves on content that did not shift
+    {
+        const uint32_t w = 640, h = 480;
+        const FrameScene scenes[] = { SCENE_NEEDLE, SCENE_MOTION, SCENE_NOISE };
+        for (FrameScene scene : scenes) {
+            FrameSource source;
+            Stream s;
+            source.Initialize(w, h, scene);
+            s.Initialize(w, h);
+            for (int f = 0; f < 6; f++) {
+                const uint8_t* frame = source.Next();
+                int count;
+                const TileRect* hints = source.GetDirtyRects(&count);
+                s.Send(frame, source.GetStride(), hints, count, f == 0);
+            }
+            char name[64];
+            snprintf(name, sizeof(name), "%s: rebuilt exactly, no moves", FrameSceneName(scene));
+            CHECK(s.exact && s.movedTiles == 0, name);
+        }
+    }
+
+    // Flat areas repainted in another color: untextured probes, no moves
+    {
+        const uint32_t w = 256, h = 256;
+        std::vector<uint8_t> view((size_t)w * h * 4, 40);
+        Stream s;
+        s.Initialize(w, h);
+        s.Send(view.data(), w * 4, nullptr, -1, true);
+        memset(view.data(), 90, view.size());
+        s.Send(view.data(), w * 4, nullptr, -1, false);
+        CHECK(s.exact && s.movedTiles == 0, "flat repaint: no moves");
+    }
+
+    // With search off the reference still follows, so moves resume later
+    {
+        const uint32_t w = 640, h = 480;
+        Canvas canvas(w, h + 100);
+        std::vector<uint8_t> view((size_t)w * h * 4);
+        auto render = [&](uint32_t oy) {
+            for (uint32_t y = 0; y < h; y++) memcpy(&view[(size_t)y * w * 4], canvas.At(0, oy + y), (size_t)w * 4);
+        };
+        Stream s;
+        s.Initialize(w, h);
+        render(0);
+        s.Send(view.data(), w * 4, nullptr, -1, true);
+        render(4);
+        s.Send(view.data(), w * 4, nullptr, -1, false, nullptr, 0, false);
+        bool off = s.moves.GetMovedTiles() == 0 && s.exact;
+        render(8);
+        s.Send(view.data(), w * 4, nullptr, -1, false);
+        CHECK(off && s.exact && s.moves.GetMovedTiles() > 0, "search off, then on: reference kept current");
+    }
+
+    // Every SIMD level finds the same moves
+    {
+        const uint32_t w = 640, h = 480;
+        SimdLevel levels[] = { SIMD_SCALAR, SIMD_SSE2, SIMD_AVX2 };
+        std::vector<uint8_t> first;
+        bool same = true;
+        for (SimdLevel level : levels) {
+            if (level > GetSimdLevel()) continue;
+            FrameSource source;
+            Stream s;
+            source.Initialize(w, h, SCENE_SCROLL);
+            s.Initialize(w, h);
+            s.moves.SetSimdLevel(level);
+            std::vector<uint8_t> all;
+            for (int f = 0; f < 5; f++) {
+                const uint8_t* frame = source.Next();
+                int count;
+                const TileRect* hints = source.GetDirtyRects(&count);
+                s.Send(frame, source.GetStride(), hints, count, f == 0);
+                std::vector<uint8_t> bytes(s.moves.GetMovesSize());
+                s.moves.WriteMoves(bytes.data());
+                all.insert(all.end(), bytes.begin(), bytes.end());
+            }
+            if (first.empty()) first = all;
+            else if (all != first) same = false;
+        }
+        CHECK(same, "same moves at every SIMD level");
+    }
+
+    // Malformed move payloads are rejected
+    {
+        std::vector<uint8_t> frame(64 * 64 * 4);
+        MoveRect outside = { 40, 0, { 0, 0, 32, 32 } };
+        uint8_t bytes[MOVE_HEADER_SIZE + MOVE_RECT_SIZE];
+        size_t size = WriteMoves(&outside, 1, bytes);
+        size_t used = 0;
+        CHECK(!ApplyMoves(bytes, size, frame.data(), 64, 64, 64 * 4, &used), "move reading outside the frame rejected");
+        CHECK(!ApplyMoves(bytes, size - 1, frame.data(), 64, 64, 64 * 4, &used), "truncated move payload rejected");
+
+        // Overlapping moves all read the frame as it was before them
+        for (size_t i = 0; i < frame.size(); i += 4) frame[i] = (uint8_t)(i / 4 % 64);
+        MoveRect shifts[2] = { { 0, 0, { 1, 0, 33, 64 } }, { 1, 0, { 2, 0, 34, 64 } } };
+        std::vector<uint8_t> withTwo(MOVE_HEADER_SIZE + 2 * MOVE_RECT_SIZE);
+        WriteMoves(shifts, 2, withTwo.data());
+        bool applied = ApplyMoves(withTwo.data(), withTwo.size(), frame.data(), 64, 64, 64 * 4, &used);
+        CHECK(applied && used == withTwo.size() && frame[1 * 4] == 0 && frame[2 * 4] == 1 && frame[33 * 4] == 32,
+            "overlapping moves read the previous frame");
+    }
+
+    // Cost of a frame at 1080p: scroll (search hits) and motion (search misses)
+    {
+        const uint32_t w = 1920, h = 1080;
+        const FrameScene scenes[] = { SCENE_SCROLL, SCENE_MOTION };
+        for (FrameScene scene : scenes) {
+            FrameSource source;
+            Stream s;
+            source.Initialize(w, h, scene);
+            s.Initialize(w, h);
+            double ms = 0;
+            for (int f = 0; f < 12; f++) {
+                const uint8_t* frame = source.Next();
+                int count;
+                const TileRect* hints = source.GetDirtyRects(&count);
+                s.tiles.Detect(frame, source.GetStride(), hints, count, f == 0);
+                auto start = std::chrono::steady_clock::now();
+                s.moves.Detect(frame, source.GetStride(), &s.tiles, nullptr, 0, f != 0);
+                if (f >= 2) ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            }
+            printf("  1080p %s: %.3f ms per frame for move detection\n", FrameSceneName(scene), ms / 10);
+        }
+    }
+
+    if (failures) {
+        printf("\n%d test(s) failed\n", failures);
+        return 1;
+    }
+    printf("\nAll tests passed!\n");
+    return 0;
+}
@@ -0,0 +1,271 @@
+// Tests for the fused pixel pass (common/pixel-pipeline.h)
+// Every stage combination must match the separate passes byte for byte:
+// FrameScaler::Scale, TileDelta::Detect and ConvertBgraToYCbCr with JPEG
+// MCU padding (checked through BaselineJpegEncoder::EncodePlanes == Encode)
+// Compile: g++ -O2 -std=c++17 -pthread tests/test-pixel-pipeline.cpp -o bin/test-pixel-pipeline
+//     or:  cl /EHsc /O2 /Fe:bin\test-pixel-pipeline.exe tests\test-pixel-pipeline.cpp
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "../common/jpeg-encoder.h"
+#include "../common/pixel-pipeline.h"
+
+static int failures = 0;
+
+#define CHECK(cond, name) do { \
+    if (cond) { printf("OK: %s\n", name); } \
+    else { printf("FAILED: %s (%s:%d)\n", name, __FILE__, __LINE__); failures++; } \
+} while (0)
+
+// Deterministic pseudo-random fill
+static void FillNoise(uint8_t* p, size_t n, uint32_t seed) {
+    for (size_t i = 0; i < n; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        p[i] = (uint8_t)(seed >> 24);
+    }
+}
+
+// A mapped frame: padded pitch, crop origin inside it
+struct Source {
+    uint32_t width, height, pitch;
+    std::vector<uint8_t> pixels;
+
+    Source(uint32_t w, uint32_t h, uint32_t seed) : width(w), height(h), pitch(w * 4 + 64) {
+        pixels.resize((size_t)pitch * h);
+        FillNoise(pixels.data(), pixels.size(), seed);
+    }
+    const uint8_t* At(uint32_t x, uint32_t y) const { return &pixels[(size_t)y * pitch + x * 4]; }
+};
+
+// What the separate passes produce for one frame
+struct Reference {
+    std::vector<uint8_t> bgra;
+    std::vector<uint8_t> planes;
+    std::vector<uint8_t> dirty;
+    int dirtyCount = 0;
+};
+
+static const ChromaSubsampling layouts[3] = { CHROMA_444, CHROMA_422, CHROMA_420 };
+
+// Replicate the last column / row out to the JPEG padding, as the encoder's
+// strips do
+static void PadPlanes(const YCbCrPlanes& p, uint32_t w, uint32_t h, uint32_t pw, uint32_t ph, ChromaSubsampling s) {
+    uint32_t cw = ChromaWidth(w, s), ch = ChromaHeight(h, s);
+    uint32_t pcw = s == CHROMA_444 ? pw : pw / 2, pch = ChromaHeight(ph, s);
+    for (uint32_t y = 0; y < h; y++) memset(p.y + (size_t)y * p.yStride + w, p.y[(size_t)y * p.yStride + w - 1], pw - w);
+    for (uint32_t y = h; y < ph; y++) memcpy(p.y + (size_t)y * p.yStride, p.y + (size_t)(h - 1) * p.yStride, pw);
+    uint8_t* chroma[2] = { p.cb, p.cr };
+    for (uint8_t* c : chroma) {
+        for (uint32_t y = 0; y < ch; y++) memset(c + (size_t)y * p.cStride + cw, c[(size_t)y * p.cStride + cw - 1], pcw - cw);
+        for (uint32_t y = ch; y < pch; y++) memcpy(c + (size_t)y * p.cStride, c + (size_t)(ch - 1) * p.cStride, pcw);
+    }
+}
+
+static Reference MultiPass(const uint8_t* src, size_t pitch, uint32_t sw, uint32_t sh, uint32_t dw, uint32_t dh,
+                           TileDelta* tiles, ChromaSubsampling s, const TileRect* hints, int hintCount) {
+    Reference ref;
+    FrameScaler scaler;
+    scaler.Configure(sw, sh, dw, dh);
+    ref.bgra.resize((size_t)dw * dh * 4);
+    scaler.Scale(src, pitch, ref.bgra.data(), dw * 4);
+
+    if (tiles) {
+        ref.dirtyCount = tiles->Detect(ref.bgra.data(), dw * 4, hints, hintCount, false);
+        ref.dirty.assign(tiles->GetDirtyMap(), tiles->GetDirtyMap() + tiles->GetTileCount());
+    }
+
+    YCbCrPlanes planes;
+    uint32_t pw, ph;
+    ref.planes.resize(JpegFramePlanes(dw, dh, s, nullptr, nullptr));
+    JpegFramePlanes(dw, dh, s, ref.planes.data(), &planes, &pw, &ph);
+    ConvertBgraToYCbCr(ref.bgra.data(), dw * 4, dw, dh, s, planes);
+    PadPlanes(planes, dw, dh, pw, ph, s);
+    return ref;
+}
+
+// Fused pass with the stages selected; unselected outputs stay empty
+static Reference Fused(const uint8_t* src, size_t pitch, uint32_t sw, uint32_t sh, uint32_t dw, uint32_t dh,
+                       bool keepBgra, TileDelta* tiles, int chroma, const TileRect* hints, int hintCount,
+                       SimdLevel level, JobSystem* jobs, int* result) {
+    Reference out;
+    PixelPipeline pipeline;
+    pipeline.Configure(sw, sh, dw, dh);
+    pipeline.SetSimdLevel(level);
+    pipeline.SetJobSystem(jobs);
+
+    PixelTargets targets;
+    if (keepBgra) {
+        out.bgra.assign((size_t)dw * dh * 4, 0xEE);
+        targets.bgra = out.bgra.data();
+        targets.bgraStride = dw * 4;
+    }
+    targets.tiles = tiles;
+    if (chroma >= 0) {
+        ChromaSubsampling s = (ChromaSubsampling)chroma;
+        out.planes.assign(JpegFramePlanes(dw, dh, s, nullptr, nullptr), 0xEE);
+        JpegFramePlanes(dw, dh, s, out.planes.data(), &targets.planes, &targets.paddedWidth, &targets.paddedHeight);
+        targets.subsampling = s;
+    }
+    *result = pipeline.Run(src, pitch, targets, hints, hintCount, false);
+    if (tiles && *result >= 0) {
+        out.dirtyCount = *result;
+        out.dirty.assign(tiles->GetDirtyMap(), tiles->GetDirtyMap() + tiles->GetTileCount());
+    }
+    return out;
+}
+
+// Every stage combination at every SIMD level against the separate passes.
+// The tile stage runs on a second frame so hashes are compared, not just
+// marked dirty: frame b is frame a with a block changed (and hinted).
+static bool AllCombinationsMatch(uint32_t sw, uint32_t sh, uint32_t dw, uint32_t dh, uint32_t cropX, uint32_t cropY,
+                                 JobSystem* jobs, uint32_t seed) {
+    Source a(sw + cropX + 3, sh + cropY + 2, seed);
+    Source b = a;
+    uint32_t bx = sw / 3, by = sh / 2;
+    for (uint32_t y = by; y < by + 9 && y < sh; y++) {
+        for (uint32_t x = bx; x < bx + 13 && x < sw; x++) b.pixels[(size_t)(y + cropY) * b.pitch + (x + cropX) * 4 + 1] ^= 0x5A;
+    }
+    TileRect hint = { (int32_t)bx, (int32_t)by, (int32_t)(bx + 13), (int32_t)(by + 9) };
+    FrameScaler mapper;
+    mapper.Configure(sw, sh, dw, dh);
+    if (mapper.GetFilter() != SCALE_COPY) mapper.MapRect(&hint.left, &hint.top, &hint.right, &hint.bottom);
+    const uint8_t* srcA = a.At(cropX, cropY);
+    const uint8_t* srcB = b.At(cropX, cropY);
+
+    for (int chroma = PIPELINE_NO_CHROMA; chroma <= CHROMA_420; chroma++) {
+        ChromaSubsampling s = chroma < 0 ? CHROMA_420 : (ChromaSubsampling)chroma;
+        for (int hash = 0; hash < 2; hash++) {
+            for (int hinted = 0; hinted <= hash; hinted++) {
+                // Tiles primed with frame a by Detect(): the fused pass must
+                // produce the same hashes to find only the changed block
+                TileDelta refTiles;
+                refTiles.Initialize(dw, dh, 32);
+                MultiPass(srcA, a.pitch, sw, sh, dw, dh, &refTiles, s, nullptr, -1);
+                TileDelta primed = refTiles;
+                const TileRect* hints = hinted ? &hint : nullptr;
+                int hintCount = hinted ? 1 : -1;
+                Reference ref = MultiPass(srcB, b.pitch, sw, sh, dw, dh, hash ? &refTiles : nullptr, s, hints, hintCount);
+
+                for (int keep = 0; keep < 2; keep++) {
+                    for (int level = SIMD_SCALAR; level <= GetSimdLevel(); level++) {
+                        int result = 0;
+                        TileDelta tiles = primed;
+                        Reference got = Fused(srcB, b.pitch, sw, sh, dw, dh, keep != 0, hash ? &tiles : nullptr, chroma,
+                            hints, hintCount, (SimdLevel)level, jobs, &result);
+                        bool ok = result >= 0 && (!keep || got.bgra == ref.bgra) && (chroma < 0 || got.planes == ref.planes) &&
+                            (!hash || (got.dirty == ref.dirty && got.dirtyCount == ref.dirtyCount));
+                        if (!ok) {
+                            printf("  mismatch: %ux%u -> %ux%u crop %u,%u chroma %d hash %d hinted %d keep %d %s "
+                                "(result %d, dirty %d vs %d)\n", sw, sh, dw, dh, cropX, cropY, chroma, hash, hinted, keep,
+                                SimdLevelName((SimdLevel)level), result, got.dirtyCount, ref.dirtyCount);
+                            return false;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    return true;
+}
+
+static void TestCombinations() {
+    printf("\n--- Stage combinations vs. separate passes ---\n");
+    CHECK(AllCombinationsMatch(256, 128, 256, 128, 0, 0, nullptr, 1), "copy, aligned");
+    CHECK(AllCombinationsMatch(133, 77, 133, 77, 5, 3, nullptr, 2), "copy, odd size, cropped");
+    CHECK(AllCombinationsMatch(266, 154, 133, 77, 7, 1, nullptr, 3), "box 2:1, odd output");
+    CHECK(AllCombinationsMatch(400, 200, 100, 50, 0, 9, nullptr, 4), "box 4:1");
+    CHECK(AllCombinationsMatch(301, 171, 211, 97, 2, 2, nullptr, 5), "bilinear, odd sizes");
+    CHECK(AllCombinationsMatch(64, 64, 47, 33, 0, 0, nullptr, 6), "bilinear, one tile");
+    CHECK(AllCombinationsMatch(17, 3, 17, 3, 1, 1, nullptr, 7), "copy, 17x3");
+}
+
+static void TestParallel() {
+    printf("\n--- Bands on a job system ---\n");
+    JobSystem jobs;
+    jobs.Start(3);
+    CHECK(AllCombinationsMatch(333, 250, 333, 250, 4, 4, &jobs, 11), "copy on 3 workers");
+    CHECK(AllCombinationsMatch(640, 360, 320, 180, 0, 0, &jobs, 12), "box 2:1 on 3 workers");
+    CHECK(AllCombinationsMatch(640, 360, 480, 270, 0, 0, &jobs, 13), "bilinear on 3 workers");
+    jobs.Stop();
+}
+
+// The planes the pipeline writes are what the encoder would have converted
+static void TestEncodePlanes() {
+    printf("\n--- EncodePlanes == Encode ---\n");
+    const uint32_t sizes[4][2] = { { 64, 48 }, { 131, 67 }, { 17, 9 }, { 320, 250 } };
+    JobSystem jobs;
+    jobs.Start(2);
+    bool same = true;
+    for (int banded = 0; banded < 2 && same; banded++) {
+        for (ChromaSubsampling s : layouts) {
+            for (auto& size : sizes) {
+                uint32_t w = size[0], h = size[1];
+                Source src(w, h, w * 31 + h);
+                PixelPipeline pipeline;
+                pipeline.Configure(w, h, w, h);
+                PixelTargets targets;
+                std::vector<uint8_t> planes(JpegFramePlanes(w, h, s, nullptr, nullptr));
+                JpegFramePlanes(w, h, s, planes.data(), &targets.planes, &targets.paddedWidth, &targets.paddedHeight);
+                targets.subsampling = s;
+                pipeline.Run(src.At(0, 0), src.pitch, targets);
+
+                BaselineJpegEncoder encoder;
+                encoder.Configure(75, s);
+                if (banded) encoder.SetJobSystem(&jobs, 1);
+                std::vector<uint8_t> a(encoder.MaxEncodedSize(w, h)), b(a.size());
+                int sizeA = encoder.Encode(src.At(0, 0), src.pitch, w, h, a.data(), a.size());
+                int sizeB = encoder.EncodePlanes(targets.planes, w, h, b.data(), b.size());
+                if (sizeA <= 0 || sizeA != sizeB || memcmp(a.data(), b.data(), sizeA) != 0) {
+                    printf("  mismatch: %ux%u %s%s (%d vs %d bytes)\n", w, h, ChromaSubsamplingName(s),
+                        banded ? " banded" : "", sizeA, sizeB);
+                    same = false;
+                }
+            }
+        }
+    }
+    jobs.Stop();
+    CHECK(same, "same JPEG bytes for every layout, size and band mode");
+}
+
+static void TestInvalidTargets() {
+    printf("\n--- Invalid targets ---\n");
+    Source src(64, 64, 9);
+    PixelPipeline pipeline;
+    PixelTargets targets;
+    CHECK(pipeline.Run(src.At(0, 0), src.pitch, targets) == -1, "unconfigured pipeline refuses to run");
+
+    pipeline.Configure(64, 64, 32, 32);
+    TileDelta tiles;
+    tiles.Initialize(64, 64, 16);
+    targets.tiles = &tiles;
+    CHECK(pipeline.Run(src.At(0, 0), src.pitch, targets) == -1, "tile grid for the source size is refused");
+
+    tiles.Initialize(32, 32, 5);
+    std::vector<uint8_t> planes(JpegFramePlanes(32, 32, CHROMA_420, nullptr, nullptr));
+    JpegFramePlanes(32, 32, CHROMA_420, planes.data(), &targets.planes);
+    CHECK(pipeline.Run(src.At(0, 0), src.pitch, targets) == -1, "odd tiles with 4:2:0 are refused");
+
+    tiles.Initialize(32, 32, 8);
+    targets.paddedWidth = 16;
+    CHECK(pipeline.Run(src.At(0, 0), src.pitch, targets) == -1, "padding narrower than the output is refused");
+    targets.paddedWidth = 32;
+    CHECK(pipeline.Run(src.At(0, 0), src.pitch, targets) == 16, "valid targets: first frame marks every tile");
+}
+
+int main() {
+    printf("Pixel pipeline tests (SIMD: %s)\n", SimdLevelName(GetSimdLevel()));
+
+    TestCombinations();
+    TestParallel();
+    TestEncodePlanes();
+    TestInvalidTargets();
+
+    printf("\n");
+    if (failures) {
+        printf("%d test(s) failed\n", failures);
+        return 1;
+    }
+    printf("All tests passed!\n");
+    return 0;
+}
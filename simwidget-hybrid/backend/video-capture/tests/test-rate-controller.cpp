@@ -0,0 +1,368 @@
+// Tests for the adaptive quality / scale controller (common/rate-controller.h)
+// Most checks drive the controller against a simulated slow link in virtual
+// time: a socket buffer draining at a fixed rate behind the same "latest
+// frame wins" queue BroadcastServer uses, with frame size and encode time
+// modelled from quality and scale. The last check streams through a real
+// BroadcastServer on localhost to a client that reads at a throttled rate.
+// Compile: g++ -O2 -std=c++17 -pthread tests/test-rate-controller.cpp -o bin/test-rate-controller
+//     or:  cl /EHsc /O2 /Fe:bin\test-rate-controller.exe tests\test-rate-controller.cpp
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "../common/broadcast-server.h"
+#include "../common/rate-controller.h"
+
+static int failures = 0;
+
+#define CHECK(cond, name) do { \
+    if (cond) { printf("OK: %s\n", name); } \
+    else { printf("FAILED: %s (%s:%d)\n", name, __FILE__, __LINE__); failures++; } \
+} while (0)
+
+#define TEST_PORT 19998
+
+// JPEG-like frame model: bits per pixel grow faster than linearly with quality
+static double FrameBytes(double pixels, int quality, double scale) {
+    double bpp = 0.3 + 3.0 * pow(quality / 100.0, 2.5);
+    return pixels * scale * scale * bpp / 8;
+}
+
+// Encode time: a fixed cost per pixel plus entropy coding per output byte
+static double EncodeMs(double pixels, int quality, double scale, double nsPerPixel) {
+    return (pixels * scale * scale * nsPerPixel + FrameBytes(pixels, quality, scale) * 2.0) / 1e6;
+}
+
+// A socket buffer of bufferBytes draining at bytesPerMs, fed from one
+// in-flight and one pending frame like a BroadcastServer client
+struct SimulatedLink {
+    double bytesPerMs = 0;
+    double bufferBytes = 64 * 1024;
+    double buffered = 0;        // Bytes in the socket buffer
+    double inFlightLeft = 0;    // Bytes of the in-flight frame not yet in the buffer
+    double inFlightQueued = 0;
+    bool hasInFlight = false;
+    double pendingBytes = 0;
+    double pendingQueued = 0;
+    bool hasPending = false;
+
+    // Window totals for the controller
+    uint64_t sent = 0, dropped = 0;
+    double sendMs = 0;
+    uint64_t delivered = 0;     // Frames sent, never reset
+
+    void Queue(double bytes, double now) {
+        if (!hasInFlight) {
+            hasInFlight = true;
+            inFlightLeft = bytes;
+            inFlightQueued = now;
+        } else {
+            if (hasPending) dropped++;
+            hasPending = true;
+            pendingBytes = bytes;
+            pendingQueued = now;
+        }
+    }
+
+    void Advance(double now, double ms) {
+        buffered -= bytesPerMs * ms;
+        if (buffered < 0) buffered = 0;
+        while (hasInFlight) {
+            double space = bufferBytes - buffered;
+            double n = inFlightLeft < space ? inFlightLeft : space;
+            buffered += n;
+            inFlightLeft -= n;
+            if (inFlightLeft > 0) break;
+            sent++;
+            delivered++;
+            sendMs += now - inFlightQueued;
+            hasInFlight = hasPending;
+            inFlightLeft = pendingBytes;
+            inFlightQueued = pendingQueued;
+            hasPending = false;
+        }
+    }
+
+    double Backlog() const { return (hasInFlight ? inFlightLeft : 0) + (hasPending ? pendingBytes : 0); }
+};
+
+struct SimResult {
+    double deliveredFps = 0;    // Over the tail of the run
+    double kbps = 0;            // Encoded rate over the tail
+    int changes = 0;            // Quality / scale changes over the tail
+    int minQuality = 100, maxQuality = 0;
+    int quality = 0, scaleStep = 0;
+    bool sawEncodeLimit = false;
+};
+
+// Run the controller against the link for `seconds` of virtual time, 1 ms
+// per tick. linkAt(t) gives the link rate in bytes/ms at time t. Stats cover
+// the last tailSeconds.
+template <class LinkFn>
+static SimResult Simulate(RateController& rc, double pixels, double fps, double seconds, double tailSeconds,
+                          double nsPerPixel, LinkFn linkAt) {
+    SimulatedLink link;
+    SimResult r;
+    double interval = 1000.0 / fps, nextFrame = 0;
+    double tailStart = (seconds - tailSeconds) * 1000;
+    uint64_t tailDelivered = 0, tailBytes = 0;
+    for (double t = 0; t < seconds * 1000; t += 1) {
+        link.bytesPerMs = linkAt(t);
+        if (t >= nextFrame) {
+            nextFrame += interval;
+            double scale = rc.GetScaleFactor();
+            double bytes = FrameBytes(pixels, rc.GetQuality(), scale);
+            rc.AddEncoded(1, EncodeMs(pixels, rc.GetQuality(), scale, nsPerPixel), (uint64_t)bytes);
+            link.Queue(bytes, t);
+            if (t >= tailStart) tailBytes += (uint64_t)bytes;
+        }
+        uint64_t before = link.delivered;
+        link.Advance(t, 1);
+        if (t >= tailStart) tailDelivered += link.delivered - before;
+
+        rc.AddSent(link.sent, link.sendMs, link.dropped);
+        link.sent = link.dropped = 0;
+        link.sendMs = 0;
+        rc.AddBacklog((size_t)link.Backlog());
+        if (rc.Update(t) && t >= tailStart) r.changes++;
+        if (rc.GetLastStats().limit == RATE_LIMIT_ENCODE) r.sawEncodeLimit = true;
+        if (t >= tailStart) {
+            if (rc.GetQuality() < r.minQuality) r.minQuality = rc.GetQuality();
+            if (rc.GetQuality() > r.maxQuality) r.maxQuality = rc.GetQuality();
+        }
+    }
+    r.deliveredFps = tailDelivered / tailSeconds;
+    r.kbps = tailBytes * 8.0 / tailSeconds / 1000;
+    r.quality = rc.GetQuality();
+    r.scaleStep = rc.GetScaleStep();
+    return r;
+}
+
+static void PrintResult(const char* name, const SimResult& r) {
+    printf("  %s: quality %d (%d-%d in tail), scale step %d, %.1f fps delivered, %.0f kbps, %d changes in tail\n",
+        name, r.quality, r.minQuality, r.maxQuality, r.scaleStep, r.deliveredFps, r.kbps, r.changes);
+}
+
+// Localhost client reading at most bytesPerSecond, with a small receive buffer
+static void ThrottledReader(std::atomic<bool>* stop, std::atomic<uint64_t>* received, double bytesPerSecond) {
+    SOCKET s = socket(AF_INET, SOCK_STREAM, 0);
+    int rcvbuf = 16 * 1024;
+    setsockopt(s, SOL_SOCKET, SO_RCVBUF, (const char*)&rcvbuf, sizeof(rcvbuf));
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(TEST_PORT);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(s, (sockaddr*)&addr, sizeof(addr)) != 0) {
+        closesocket(s);
+        return;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    char buffer[4096];
+    while (!*stop) {
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (*received > elapsed * bytesPerSecond) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+        int n = recv(s, buffer, sizeof(buffer), 0);
+        if (n <= 0) break;
+        *received += n;
+    }
+    closesocket(s);
+}
+
+int main() {
+    printf("Testing rate controller...\n");
+    const double px720 = 1280.0 * 720;
+
+    // Idle windows change nothing; clean windows step up only after the dwell
+    {
+        RateController rc;
+        rc.SetQualityRange(20, 85);
+        rc.Configure(30, 0, 1, 60);
+        bool changed = false;
+        for (int t = 0; t <= 5000; t += 100) changed = rc.Update(t) || changed;
+        CHECK(!changed && rc.GetQuality() == 60, "idle windows leave quality alone");
+
+        int firstUp = -1;
+        for (int t = 5000; t <= 10000 && firstUp < 0; t += 100) {
+            rc.AddEncoded(3, 15, 3 * 20000);
+            rc.AddSent(3, 15, 0);
+            if (rc.Update(t)) firstUp = t;
+        }
+        CHECK(firstUp >= 5000 + (RATE_BASE_DWELL - 1) * RATE_WINDOW_MS && rc.GetQuality() == 60 + RATE_QUALITY_STEP,
+            "headroom steps quality up after the dwell");
+
+        rc.Configure(30, 0, 1, 99);
+        CHECK(rc.GetQuality() == 85, "quality is clamped to the range");
+    }
+
+    // Over the ceiling: immediate, proportional drop
+    {
+        RateController rc;
+        rc.Configure(30, 1000, 1, 80);
+        rc.Update(0);
+        rc.AddEncoded(15, 75, 15 * 8000);   // 8 KB * 30 fps = 1920 kbps, ~2x the ceiling
+        bool changed = rc.Update(RATE_WINDOW_MS);
+        CHECK(changed && rc.GetQuality() == 80 - RATE_MAX_DOWN_STEP, "far over the ceiling drops hard");
+        CHECK(rc.GetLastStats().limit == RATE_LIMIT_BANDWIDTH, "bandwidth is reported as the limit");
+
+        rc.AddEncoded(15, 75, 15 * 8000);
+        CHECK(!rc.Update(2 * RATE_WINDOW_MS), "window after a change is not judged");
+        rc.AddEncoded(15, 75, 15 * 4300);   // ~3% over
+        CHECK(rc.Update(3 * RATE_WINDOW_MS) && rc.GetQuality() < 60 && rc.GetQuality() >= 60 - 2 * RATE_QUALITY_STEP,
+            "slightly over drops a small step");
+    }
+
+    // Slow link (2 MB/s, 720p, 30 fps): settles where the link keeps up
+    {
+        RateController rc;
+        rc.Configure(30, 0, 1, 85);
+        SimResult r = Simulate(rc, px720, 30, 60, 30, 5, [](double) { return 2000.0; });
+        PrintResult("2 MB/s link", r);
+        CHECK(r.quality < 85 && r.deliveredFps >= 27, "slow link: quality drops until the target rate is delivered");
+        CHECK(r.kbps <= 2000 * 8, "slow link: settled rate fits the link");
+        CHECK(r.changes <= 4 && r.maxQuality - r.minQuality <= 2 * RATE_QUALITY_STEP,
+            "slow link: no oscillation once settled");
+    }
+
+    // Bandwidth ceiling on a fast link
+    {
+        RateController rc;
+        rc.Configure(30, 20000, 1, 85);
+        SimResult r = Simulate(rc, px720, 30, 60, 30, 5, [](double) { return 1e5; });
+        PrintResult("20 Mbps ceiling", r);
+        CHECK(r.kbps <= 20000 && r.kbps >= 20000 * 0.5, "ceiling: stays under but close to the ceiling");
+        CHECK(r.changes <= 4, "ceiling: no oscillation once settled");
+    }
+
+    // Link speeds up mid-run: quality recovers
+    {
+        RateController rc;
+        rc.Configure(30, 0, 1, 85);
+        SimResult r = Simulate(rc, px720, 30, 90, 20, 5, [](double t) { return t < 30000 ? 1000.0 : 20000.0; });
+        PrintResult("1 -> 20 MB/s link", r);
+        CHECK(r.quality == 85 && r.deliveredFps >= 29, "faster link: quality climbs back to the maximum");
+    }
+
+    // Link too slow for any quality at full size: scale steps down
+    {
+        RateController rc;
+        rc.SetAdaptiveScale(true);
+        rc.Configure(30, 0, 1, 85);
+        SimResult r = Simulate(rc, px720, 30, 60, 20, 5, [](double) { return 300.0; });
+        PrintResult("300 KB/s link, adaptive scale", r);
+        CHECK(r.scaleStep > 0 && r.deliveredFps >= 27, "very slow link: scale steps down to keep the rate");
+
+        rc.SetAdaptiveScale(false);
+        rc.Configure(30, 0, 1, 85);
+        r = Simulate(rc, px720, 30, 30, 10, 5, [](double) { return 300.0; });
+        CHECK(r.scaleStep == 0 && r.quality == 20, "without adaptive scale only quality moves");
+
+        // A client that accepts no less than 75%
+        rc.SetAdaptiveScale(true);
+        rc.Configure(30, 0, 1, 85);
+        r = Simulate(rc, px720, 30, 60, 20, 5, [](double) { return 300.0; });
+        bool clamped = rc.SetMinScale(75);
+        CHECK(clamped && rc.GetScaleStep() == 1, "min scale: current step grows back to the limit");
+        r = Simulate(rc, px720, 30, 30, 10, 5, [](double) { return 300.0; });
+        CHECK(r.scaleStep == 1, "min scale: scale never steps below the limit");
+        CHECK(!rc.SetMinScale(0), "min scale: lifting the limit changes nothing at once");
+    }
+
+    // Encode bound: 60 fps of 1080p on one slow encoder
+    {
+        RateController rc;
+        rc.SetAdaptiveScale(true);
+        rc.Configure(60, 0, 1, 85);
+        SimResult r = Simulate(rc, 1920.0 * 1080, 60, 60, 20, 12, [](double) { return 1e5; });
+        PrintResult("1080p60 on one encoder", r);
+        double encodeMs = EncodeMs(1920.0 * 1080, r.quality, RateScaleFactor(r.scaleStep), 12);
+        CHECK(r.sawEncodeLimit && r.scaleStep > 0 && encodeMs <= 1000.0 / 60,
+            "encode bound: quality and scale drop until the encoder keeps up");
+    }
+
+    // Real sockets: BroadcastServer -> localhost client reading 1.5 MB/s
+    {
+        if (!NetStartup()) {
+            printf("FAILED: Winsock startup\n");
+            return 1;
+        }
+        BroadcastServer server;
+        bool started = server.Start(TEST_PORT);
+        CHECK(started, "server listens on the test port");
+
+        std::atomic<bool> stop(false);
+        std::atomic<uint64_t> received(0);
+        std::thread reader(ThrottledReader, &stop, &received, 1.5e6);
+        for (int i = 0; i < 100 && server.GetClientCount() == 0; i++) server.Service(10);
+        CHECK(server.GetClientCount() == 1, "throttled client connects");
+
+        FrameRing ring;
+        ring.Initialize(8, 512 * 1024);
+        RateController rc;
+        rc.Configure(30, 0, 1, 85);
+        const double px = 960.0 * 540;   // 85 -> ~130 KB per frame, ~3.9 MB/s at 30 fps
+
+        auto start = std::chrono::steady_clock::now();
+        auto nextFrame = start;
+        uint64_t lastSent = 0, lastSendUs = 0, lastDropped = 0;
+        uint64_t tailStartSent = 0;
+        const double seconds = 6, tail = 2;
+        bool inTail = false;
+        while (true) {
+            auto now = std::chrono::steady_clock::now();
+            double t = std::chrono::duration<double, std::milli>(now - start).count();
+            if (t >= seconds * 1000) break;
+            if (!inTail && t >= (seconds - tail) * 1000) {
+                inTail = true;
+                tailStartSent = server.GetFramesSent();
+            }
+            if (now >= nextFrame) {
+                nextFrame += std::chrono::microseconds(33333);
+                FrameSlot* slot = ring.AcquireWrite();
+                if (slot) {
+                    size_t bytes = (size_t)FrameBytes(px, rc.GetQuality(), 1);
+                    memset(slot->data, rc.GetQuality(), bytes);
+                    slot->size = bytes;
+                    slot->flags = 0;
+                    rc.AddEncoded(1, 5, bytes);
+                    server.Broadcast(&ring, slot);
+                    ring.Release(slot);
+                }
+            }
+            server.Service(1);
+
+            uint64_t sent = server.GetFramesSent(), sendUs = server.GetSendTimeUs(), dropped = server.GetFramesDropped();
+            rc.AddSent(sent - lastSent, (sendUs - lastSendUs) / 1000.0, dropped - lastDropped);
+            rc.AddBacklog(server.GetQueuedBytes());
+            lastSent = sent;
+            lastSendUs = sendUs;
+            lastDropped = dropped;
+            rc.Update(t);
+        }
+        double tailFps = (server.GetFramesSent() - tailStartSent) / tail;
+        const RateStats& s = rc.GetLastStats();
+        printf("  localhost at 1.5 MB/s: quality %d, %.1f fps delivered in the last %.0f s, %.1f ms send time, %.0f KB/s read\n",
+            rc.GetQuality(), tailFps, tail, s.sendMs, received / seconds / 1024);
+        CHECK(rc.GetQuality() < 85, "real socket: quality drops for a slow reader");
+        CHECK(tailFps >= 20, "real socket: slow reader gets close to the target rate");
+
+        stop = true;
+        server.Stop();
+        reader.join();
+        NetCleanup();
+    }
+
+    if (failures) {
+        printf("\n%d test(s) failed\n", failures);
+        return 1;
+    }
+    printf("\nAll tests passed!\n");
+    return 0;
+}
@@ -0,0 +1,212 @@
+// Stress test for the shared-memory frame ring (common/shm-ring.h)
+// One writer thread publishes frames as fast as it can while several reader
+// threads, each with its own mapping of the region, copy out the newest
+// frame. Every pixel word of frame n holds n, so a torn read shows up as a
+// mixed frame. Also checks that blocked WaitForFrame() callers all wake on
+// publish. Runs on the POSIX shm_open backend (and futex) on Linux.
+// Compile: g++ -O2 -std=c++17 -pthread tests/test-shm-ring.cpp -o bin/test-shm-ring -lrt
+//     or:  cl /EHsc /O2 /Fe:bin\test-shm-ring.exe tests\test-shm-ring.cpp
+// Usage:   test-shm-ring [seconds] [readers]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "../common/shm-ring.h"
+
+static int failures = 0;
+
+#define CHECK(cond, name) do { \
+    if (cond) { printf("OK: %s\n", name); } \
+    else { printf("FAILED: %s (%s:%d)\n", name, __FILE__, __LINE__); failures++; } \
+} while (0)
+
+#define TEST_SHM_NAME "SimWidgetCaptureTest"
+
+// Frame sizes the writer cycles through, so dimensions change under readers
+static const uint32_t SIZES[][2] = { { 640, 360 }, { 320, 200 }, { 1280, 720 }, { 33, 17 } };
+
+static void FillFrame(uint8_t* p, size_t bytes, uint64_t n) {
+    uint64_t* words = (uint64_t*)p;
+    for (size_t i = 0; i < bytes / 8; i++) words[i] = n;
+}
+
+static bool FrameIsWhole(const uint8_t* p, size_t bytes, uint64_t n) {
+    const uint64_t* words = (const uint64_t*)p;
+    for (size_t i = 0; i < bytes / 8; i++) {
+        if (words[i] != n) return false;
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    double seconds = argc > 1 ? atof(argv[1]) : 2.0;
+    int readerCount = argc > 2 ? atoi(argv[2]) : 4;
+
+    printf("Testing shared-memory frame ring...\n");
+    const size_t maxFrame = 1280 * 720 * 4;
+
+    // Open fails cleanly without a writer
+    {
+        ShmRingReader reader;
+        CHECK(!reader.Open(TEST_SHM_NAME "Missing"), "open without a writer fails");
+    }
+
+    // Basic hand-off, return codes and metadata
+    {
+        ShmRingWriter writer;
+        bool created = writer.Create(TEST_SHM_NAME, SHM_RING_SLOTS, maxFrame);
+        CHECK(created, "writer creates the region");
+        ShmRingReader reader;
+        CHECK(reader.Open(TEST_SHM_NAME), "reader opens the region");
+        CHECK(reader.GetMaxFrameSize() == maxFrame, "reader takes the layout from the header");
+
+        std::vector<uint8_t> buffer(maxFrame);
+        ShmFrameInfo info;
+        CHECK(reader.ReadLatest(buffer.data(), buffer.size(), &info) == -2, "no frame before the first publish");
+        CHECK(writer.BeginWrite(1281, 720, 1281 * 4) == nullptr, "oversized frame is refused");
+
+        uint8_t* p = writer.BeginWrite(640, 360, 640 * 4);
+        FillFrame(p, 640 * 360 * 4, 1);
+        CHECK(reader.ReadLatest(buffer.data(), buffer.size(), &info) == -2, "unpublished frame is invisible");
+        writer.Publish();
+        int size = reader.ReadLatest(buffer.data(), buffer.size(), &info);
+        CHECK(size == 640 * 360 * 4 && info.frameNum == 1 && info.width == 640 && info.height == 360 &&
+            FrameIsWhole(buffer.data(), size, 1), "published frame reads back whole");
+        CHECK(reader.ReadLatest(buffer.data(), buffer.size(), &info) == -2, "same frame is not returned twice");
+
+        // Several publishes between reads: only the newest is returned
+        for (uint64_t n = 2; n <= 5; n++) {
+            FillFrame(writer.BeginWrite(320, 200, 320 * 4), 320 * 200 * 4, n);
+            writer.Publish();
+        }
+        size = reader.ReadLatest(buffer.data(), buffer.size(), &info);
+        CHECK(size == 320 * 200 * 4 && info.frameNum == 5 && reader.GetWidth() == 320, "reader skips to the newest frame");
+
+        FillFrame(writer.BeginWrite(640, 360, 640 * 4), 640 * 360 * 4, 6);
+        writer.Publish();
+        CHECK(reader.ReadLatest(buffer.data(), 1000, &info) == -1, "small buffer is reported");
+    }
+
+    // Blocking wait: times out without frames, wakes every waiter on publish
+    {
+        ShmRingWriter writer;
+        writer.Create(TEST_SHM_NAME, SHM_RING_SLOTS, maxFrame);
+        ShmRingReader reader;
+        reader.Open(TEST_SHM_NAME);
+
+        auto start = std::chrono::steady_clock::now();
+        int result = reader.WaitForFrame(50);
+        double waitedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        CHECK(result == -2 && waitedMs >= 45, "wait times out without a frame");
+
+        FillFrame(writer.BeginWrite(320, 200, 320 * 4), 320 * 200 * 4, 1);
+        writer.Publish();
+        start = std::chrono::steady_clock::now();
+        result = reader.WaitForFrame(1000);
+        waitedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        CHECK(result == 0 && waitedMs < 20, "pending frame returns at once");
+
+        const int waiters = 3, frames = 40;
+        std::atomic<int> ready(0), timeouts(0);
+        std::atomic<uint64_t> received(0), latencyUs(0), lastSeen[waiters];
+        std::vector<std::thread> threads;
+        for (int w = 0; w < waiters; w++) {
+            lastSeen[w] = 0;
+            threads.emplace_back([&, w] {
+                ShmRingReader r;
+                r.Open(TEST_SHM_NAME);
+                std::vector<uint8_t> buffer(maxFrame);
+                ShmFrameInfo info;
+                r.ReadLatest(buffer.data(), buffer.size(), &info);  // Consume frame 1
+                ready++;
+                while (lastSeen[w] < (uint64_t)frames + 1) {
+                    if (r.WaitForFrame(1000) != 0) {
+                        timeouts++;
+                        break;
+                    }
+                    if (r.ReadLatest(buffer.data(), buffer.size(), &info) > 0) {
+                        latencyUs += ShmTimestampUs() - info.timestampUs;
+                        received++;
+                        lastSeen[w] = info.frameNum;
+                    }
+                }
+            });
+        }
+        while (ready < waiters) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        for (int n = 2; n <= frames + 1; n++) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(3));
+            FillFrame(writer.BeginWrite(320, 200, 320 * 4), 320 * 200 * 4, n);
+            writer.Publish();
+        }
+        for (auto& t : threads) t.join();
+
+        bool allLast = true;
+        for (int w = 0; w < waiters; w++) allLast = allLast && lastSeen[w] == (uint64_t)frames + 1;
+        printf("  %d waiters, %d frames 3 ms apart: %llu wake-ups, %.1f us average publish-to-read\n", waiters, frames,
+            (unsigned long long)received.load(), received ? (double)latencyUs / received : 0.0);
+        CHECK(timeouts == 0 && allLast, "every waiter wakes up to the last frame");
+    }
+
+    // Stress: one writer, N readers with their own mappings
+    {
+        ShmRingWriter writer;
+        writer.Create(TEST_SHM_NAME, SHM_RING_SLOTS, maxFrame);
+
+        std::atomic<bool> stop(false);
+        std::atomic<uint64_t> torn(0), badOrder(0), badSize(0), framesRead(0), retries(0);
+        std::vector<std::thread> readers;
+        for (int r = 0; r < readerCount; r++) {
+            readers.emplace_back([&] {
+                ShmRingReader reader;
+                if (!reader.Open(TEST_SHM_NAME)) {
+                    torn++;
+                    return;
+                }
+                std::vector<uint8_t> buffer(maxFrame);
+                uint64_t last = 0;
+                while (!stop) {
+                    ShmFrameInfo info;
+                    int size = reader.ReadLatest(buffer.data(), buffer.size(), &info);
+                    if (size < 0) continue;
+                    const uint32_t* dims = SIZES[info.frameNum % 4];
+                    if ((uint32_t)size != dims[0] * dims[1] * 4 || info.width != dims[0]) badSize++;
+                    if (!FrameIsWhole(buffer.data(), size, info.frameNum)) torn++;
+                    if (info.frameNum <= last) badOrder++;
+                    last = info.frameNum;
+                    framesRead++;
+                }
+                retries += reader.GetRetries();
+            });
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        uint64_t written = 0;
+        while (std::chrono::steady_clock::now() - start < std::chrono::duration<double>(seconds)) {
+            uint64_t n = writer.GetFrameNum() + 1;
+            const uint32_t* dims = SIZES[n % 4];
+            uint8_t* p = writer.BeginWrite(dims[0], dims[1], dims[0] * 4);
+            FillFrame(p, (size_t)dims[0] * dims[1] * 4, n);
+            writer.Publish();
+            written++;
+        }
+        stop = true;
+        for (auto& t : readers) t.join();
+
+        printf("  %.1f s, %d readers: %llu frames written, %llu read, %llu retried copies\n", seconds, readerCount,
+            (unsigned long long)written, (unsigned long long)framesRead.load(), (unsigned long long)retries.load());
+        CHECK(framesRead > 0, "readers receive frames under load");
+        CHECK(torn == 0, "no torn frames");
+        CHECK(badSize == 0, "dimensions match the frame");
+        CHECK(badOrder == 0, "frame numbers only increase per reader");
+    }
+
+    if (failures) {
+        printf("\n%d test(s) failed\n", failures);
+        return 1;
+    }
+    printf("\nAll tests passed!\n");
+    return 0;
+}
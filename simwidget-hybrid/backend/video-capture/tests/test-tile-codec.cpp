@@ -0,0 +1,311 @@
+// Tests for per-tile codec selection (common/tile-codec.h)
+// Portable - synthetic tiles and frames (bench/frame-source.h), no DXGI needed.
+// Checks the classifier on flat, text, symbology and photographic tiles,
+// exact round trips of the solid / palette / lossless codecs, malformed
+// tiles, and bytes against JPEG at quality 70 for whole frames.
+// Compile: g++ -O2 -std=c++17 -pthread tests/test-tile-codec.cpp -o bin/test-tile-codec
+//     or:  cl /EHsc /O2 /Fe:bin\test-tile-codec.exe tests\test-tile-codec.cpp
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <chrono>
+#include <vector>
+#include "../common/tile-codec.h"
+#include "../common/jpeg-encoder.h"
+#include "../common/tile-delta.h"
+#include "../bench/frame-source.h"
+
+static int failures = 0;
+
+#define CHECK(cond, name) do { \
+    if (cond) { printf("OK: %s\n", name); } \
+    else { printf("FAILED: %s (%s:%d)\n", name, __FILE__, __LINE__); failures++; } \
+} while (0)
+
+// Deterministic pseudo-random fill
+static void FillNoise(uint8_t* p, size_t n, uint32_t seed) {
+    for (size_t i = 0; i < n; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        p[i] = (uint8_t)(seed >> 24);
+    }
+}
+
+// A BGRA test tile
+struct Tile {
+    uint32_t w, h;
+    std::vector<uint8_t> pixels;
+    Tile(uint32_t width, uint32_t height, uint32_t color = 0xFF101418) : w(width), h(height), pixels((size_t)width * height * 4) {
+        Fill(0, 0, w, h, color);
+    }
+    uint32_t Stride() const { return w * 4; }
+    void Set(uint32_t x, uint32_t y, uint32_t c) { memcpy(&pixels[((size_t)y * w + x) * 4], &c, 4); }
+    void Fill(uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1, uint32_t c) {
+        for (uint32_t y = y0; y < y1 && y < h; y++) {
+            for (uint32_t x = x0; x < x1 && x < w; x++) Set(x, y, c);
+        }
+    }
+};
+
+static uint32_t Bgra(int b, int g, int r) { return 0xFF000000u | (uint32_t)(r << 16) | (uint32_t)(g << 8) | (uint32_t)b; }
+
+// Blocky "glyphs" in two colors on a flat background, like a checklist line
+static void DrawText(Tile& t, uint32_t seed, bool antialias) {
+    for (uint32_t gx = 2; gx + 6 < t.w; gx += 8) {
+        for (uint32_t gy = 4; gy + 10 < t.h; gy += 14) {
+            for (int s = 0; s < 4; s++) {
+                seed = seed * 1664525u + 1013904223u;
+                uint32_t x = gx + (seed >> 28) % 5, y = gy + (seed >> 24) % 9;
+                bool across = (seed >> 20) & 1;
+                for (int i = 0; i < 4; i++) {
+                    uint32_t px = across ? x + i : x, py = across ? y : y + i;
+                    if (px >= t.w || py >= t.h) continue;
+                    t.Set(px, py, Bgra(230, 230, 230));
+                    // Coverage-weighted edge pixels, eight levels as a font rasterizer gives
+                    if (antialias && px + 1 < t.w) {
+                        int a = 40 + (int)((gx / 8 + gy / 14 + s) % 8) * 20;
+                        t.Set(px + 1, py, Bgra(24 + a, 20 + a, 16 + a));
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Smooth terrain-like texture: every pixel differs a little from its neighbours
+static void DrawPhoto(Tile& t, double phase) {
+    for (uint32_t y = 0; y < t.h; y++) {
+        for (uint32_t x = 0; x < t.w; x++) {
+            double v = 0.5 + 0.25 * sin(x * 0.21 + phase) * cos(y * 0.17 - phase) + 0.12 * sin((x + 2 * y) * 0.57);
+            int n = (int)(((x * 2654435761u) ^ (y * 40503u)) >> 28) - 8;
+            int g = std::max(0, std::min(255, (int)(v * 200) + n));
+            t.Set(x, y, Bgra(g / 2 + 20, g, std::max(0, std::min(255, g + 30 - n))));
+        }
+    }
+}
+
+// Encode with the classifier, decode, compare
+static bool RoundTrip(TileCodecEncoder& enc, TileCodecDecoder& dec, const Tile& t, int* codec, int* size) {
+    std::vector<uint8_t> out((size_t)t.w * t.h * 4 + 1024);
+    *size = enc.Encode(t.pixels.data(), t.Stride(), t.w, t.h, out.data(), out.size(), codec);
+    if (*size < 0) return false;
+    if (*codec == TILE_CODEC_JPEG) return true;
+    std::vector<uint8_t> back(t.pixels.size(), 0x55);
+    return dec.Decode(*codec, out.data(), (size_t)*size, back.data(), t.Stride(), t.w, t.h) && back == t.pixels;
+}
+
+static int JpegSize(BaselineJpegEncoder& jpeg, const uint8_t* pixels, uint32_t stride, uint32_t w, uint32_t h) {
+    std::vector<uint8_t> out(jpeg.MaxEncodedSize(w, h));
+    return jpeg.Encode(pixels, stride, w, h, out.data(), out.size());
+}
+
+int main() {
+    printf("Testing tile codecs (SIMD level: %s)...\n", SimdLevelName(GetSimdLevel()));
+    TileCodecEncoder enc;
+    TileCodecDecoder dec;
+    BaselineJpegEncoder jpeg;
+    jpeg.Configure(70, CHROMA_420);
+
+    // Classification and exact round trips of typical tiles
+    {
+        int codec, size;
+        Tile solid(64, 64, Bgra(20, 24, 28));
+        CHECK(RoundTrip(enc, dec, solid, &codec, &size) && codec == TILE_CODEC_SOLID && size == 4, "flat tile: solid, 4 bytes");
+
+        Tile text(64, 64);
+        DrawText(text, 5, false);
+        text.Fill(0, 60, 64, 62, Bgra(90, 230, 120));
+        bool ok = RoundTrip(enc, dec, text, &codec, &size);
+        int jpegSize = JpegSize(jpeg, text.pixels.data(), text.Stride(), 64, 64);
+        printf("  text tile: palette %d bytes, JPEG q70 %d bytes\n", size, jpegSize);
+        CHECK(ok && codec == TILE_CODEC_PALETTE, "text tile: palette, exact");
+        CHECK(size * 3 < jpegSize, "text tile: under a third of the JPEG bytes");
+
+        Tile smooth(64, 64);
+        DrawText(smooth, 9, true);
+        ok = RoundTrip(enc, dec, smooth, &codec, &size);
+        jpegSize = JpegSize(jpeg, smooth.pixels.data(), smooth.Stride(), 64, 64);
+        printf("  anti-aliased text tile: %s %d bytes, JPEG q70 %d bytes\n", TileCodecName(codec), size, jpegSize);
+        CHECK(ok && codec != TILE_CODEC_JPEG, "anti-aliased text: exact codec");
+        CHECK(size < jpegSize, "anti-aliased text: smaller than JPEG");
+
+        Tile gradient(64, 64);
+        for (uint32_t y = 0; y < 64; y++) gradient.Fill(0, y, 64, y + 1, Bgra(200 - y, 120 + y, 40 + 2 * y));
+        ok = RoundTrip(enc, dec, gradient, &codec, &size);
+        jpegSize = JpegSize(jpeg, gradient.pixels.data(), gradient.Stride(), 64, 64);
+        printf("  gradient tile: %s %d bytes, JPEG q70 %d bytes\n", TileCodecName(codec), size, jpegSize);
+        CHECK(ok && codec == TILE_CODEC_LOSSLESS && size < 64 * 64 * 4 / 8, "attitude-indicator gradient: lossless, exact");
+
+        Tile photo(64, 64);
+        DrawPhoto(photo, 0.3);
+        CHECK(RoundTrip(enc, dec, photo, &codec, &size) && codec == TILE_CODEC_JPEG && size == 0, "terrain tile: JPEG");
+
+        Tile noise(64, 64);
+        FillNoise(noise.pixels.data(), noise.pixels.size(), 3);
+        CHECK(RoundTrip(enc, dec, noise, &codec, &size) && codec == TILE_CODEC_JPEG, "noise tile: JPEG");
+
+        // 40 colors in one-pixel runs: too big for a palette tile, and no flat areas
+        Tile speckle(64, 64);
+        for (uint32_t y = 0; y < 64; y++) {
+            for (uint32_t x = 0; x < 64; x++) speckle.Set(x, y, Bgra((int)((x * 7 + y * 13) % 40) * 6, 80, 80));
+        }
+        CHECK(RoundTrip(enc, dec, speckle, &codec, &size) && codec == TILE_CODEC_JPEG,
+            "palette tile too big for its runs falls back");
+    }
+
+    // Clipped edge tiles, long runs and every palette size
+    {
+        bool ok = true;
+        const uint32_t sizes[][2] = { { 1, 1 }, { 17, 33 }, { 64, 7 }, { 3, 64 } };
+        for (auto& s : sizes) {
+            for (int colors = 1; colors <= TILE_PALETTE_MAX; colors++) {
+                Tile t(s[0], s[1]);
+                for (uint32_t y = 0; y < t.h; y++) {
+                    for (uint32_t x = 0; x < t.w; x++) t.Set(x, y, Bgra((int)((x / 5 + y) % colors) * 3, 0, 0));
+                }
+                int codec, size;
+                ok = ok && RoundTrip(enc, dec, t, &codec, &size) && codec != TILE_CODEC_JPEG;
+            }
+        }
+        CHECK(ok, "edge-sized tiles with 1..16 colors round trip");
+
+        Tile runs(64, 64, Bgra(1, 2, 3));
+        runs.Set(63, 63, Bgra(9, 9, 9));
+        int codec, size;
+        CHECK(RoundTrip(enc, dec, runs, &codec, &size) && codec == TILE_CODEC_PALETTE && size < 48,
+            "runs longer than 271 pixels split");
+    }
+
+    // Forced codecs: every exact codec on every kind of tile still decodes
+    {
+        Tile text(64, 64);
+        DrawText(text, 1, true);
+        bool ok = true;
+        for (int forced = TILE_CODEC_SOLID; forced <= TILE_CODEC_LOSSLESS; forced++) {
+            enc.ForceCodec(forced);
+            int codec, size;
+            ok = ok && RoundTrip(enc, dec, text, &codec, &size) && codec != TILE_CODEC_SOLID;
+        }
+        enc.ForceCodec(-1);
+        CHECK(ok, "forced exact codecs fall back where they can't code a tile");
+    }
+
+    // Malformed tile data is rejected
+    {
+        Tile text(64, 64);
+        DrawText(text, 2, false);
+        std::vector<uint8_t> out(64 * 64 * 4), back(64 * 64 * 4);
+        int codec;
+        int size = enc.Encode(text.pixels.data(), text.Stride(), 64, 64, out.data(), out.size(), &codec);
+        bool palette = codec == TILE_CODEC_PALETTE && size > 0;
+        CHECK(palette && !dec.Decode(codec, out.data(), size - 1, back.data(), 256, 64, 64), "truncated palette tile rejected");
+        CHECK(palette && !dec.Decode(codec, out.data(), size, back.data(), 256, 64, 65), "palette runs short of the tile rejected");
+        out[1 + out[0] * 4] = 0xF0;  // Index 15 of a smaller palette
+        CHECK(palette && out[0] < 15 && !dec.Decode(codec, out.data(), size, back.data(), 256, 64, 64),
+            "palette index out of range rejected");
+        uint8_t color[4] = { 1, 2, 3, 4 };
+        CHECK(!dec.Decode(TILE_CODEC_SOLID, color, 3, back.data(), 256, 64, 64), "short solid tile rejected");
+        CHECK(!dec.Decode(TILE_CODEC_JPEG, color, 4, back.data(), 256, 64, 64), "JPEG tiles are left to the caller");
+
+        Tile gradient(64, 64);
+        for (uint32_t y = 0; y < 64; y++) gradient.Fill(0, y, 64, y + 1, Bgra(40 + y, 90, 200 - 2 * y));
+        size = enc.Encode(gradient.pixels.data(), gradient.Stride(), 64, 64, out.data(), out.size(), &codec);
+        CHECK(codec == TILE_CODEC_LOSSLESS && !dec.Decode(codec, out.data(), size, back.data(), 256, 32, 64),
+            "lossless tile of another size rejected");
+    }
+
+    // Statistics are the same at every SIMD level
+    {
+        FrameSource source;
+        source.Initialize(640, 480, SCENE_NEEDLE);
+        const uint8_t* frame = source.Next();
+        bool same = true;
+        for (uint32_t ty = 0; ty + 64 <= 480; ty += 64) {
+            for (uint32_t tx = 0; tx + 61 <= 640; tx += 61) {
+                TileStats ref;
+                const uint8_t* p = frame + (size_t)ty * source.GetStride() + tx * 4;
+                MeasureTile(p, source.GetStride(), 61, 64, SIMD_SCALAR, &ref);
+                SimdLevel levels[] = { SIMD_SSE2, SIMD_AVX2 };
+                for (SimdLevel level : levels) {
+                    if (level > GetSimdLevel()) continue;
+                    TileStats s;
+                    MeasureTile(p, source.GetStride(), 61, 64, level, &s);
+                    same = same && s.colors == ref.colors && s.flat == ref.flat && s.steps == ref.steps &&
+                        memcmp(s.palette, ref.palette, sizeof(s.palette)) == 0;
+                }
+            }
+        }
+        CHECK(same, "same statistics at every SIMD level");
+    }
+
+    // Whole 1080p frames: codec mix and bytes against all-JPEG tiles
+    {
+        const uint32_t w = 1920, h = 1080;
+        const FrameScene scenes[] = { SCENE_NEEDLE, SCENE_SCROLL, SCENE_MOTION, SCENE_NOISE };
+        for (FrameScene scene : scenes) {
+            FrameSource source;
+            source.Initialize(w, h, scene);
+            const uint8_t* frame = source.Next();
+            TileDelta tiles;
+            tiles.Initialize(w, h);
+            int counts[TILE_CODEC_COUNT] = {};
+            size_t mixed = 0, allJpeg = 0, panel = 0, panelJpeg = 0;
+            bool jpegInMap = true;
+            const TileRect& map = source.GetMapRect();
+            double classifyMs = 0;
+            bool exact = true;
+            std::vector<uint8_t> out(64 * 64 * 4 + 1024), back(64 * 64 * 4);
+            for (int t = 0; t < tiles.GetTileCount(); t++) {
+                uint32_t x, y, tw, th;
+                tiles.GetTileRect(t, &x, &y, &tw, &th);
+                const uint8_t* p = frame + (size_t)y * source.GetStride() + x * 4;
+                int codec;
+                auto start = std::chrono::steady_clock::now();
+                int size = enc.Encode(p, source.GetStride(), tw, th, out.data(), out.size(), &codec);
+                classifyMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+                int jpegSize = JpegSize(jpeg, p, source.GetStride(), tw, th);
+                if (codec == TILE_CODEC_JPEG) {
+                    size = jpegSize;
+                } else if (size > 0) {
+                    exact = exact && dec.Decode(codec, out.data(), size, back.data(), tw * 4, tw, th);
+                    for (uint32_t row = 0; row < th && exact; row++) {
+                        exact = memcmp(&back[(size_t)row * tw * 4], p + (size_t)row * source.GetStride(), tw * 4) == 0;
+                    }
+                }
+                counts[codec]++;
+                mixed += 4 + size;
+                allJpeg += 4 + jpegSize;
+                bool inMap = (int32_t)x < map.right && (int32_t)(x + tw) > map.left && (int32_t)y < map.bottom &&
+                    (int32_t)(y + th) > map.top;
+                if (!inMap) {
+                    panel += 4 + size;
+                    panelJpeg += 4 + jpegSize;
+                    jpegInMap = jpegInMap && codec != TILE_CODEC_JPEG;
+                }
+            }
+            printf("  %-6s %4d solid %4d palette %4d lossless %4d jpeg: %7.1f KB vs %7.1f KB all-JPEG, %.2f ms\n",
+                FrameSceneName(scene), counts[0], counts[1], counts[2], counts[3], mixed / 1024.0, allJpeg / 1024.0,
+                classifyMs);
+            char name[96];
+            snprintf(name, sizeof(name), "%s: exact tiles decode exactly", FrameSceneName(scene));
+            CHECK(exact, name);
+            if (scene == SCENE_NEEDLE) {
+                printf("  needle panel outside the map: %7.1f KB vs %7.1f KB all-JPEG\n", panel / 1024.0, panelJpeg / 1024.0);
+                CHECK(jpegInMap, "cockpit panel: JPEG only for the map");
+                CHECK(panel * 3 < panelJpeg && mixed < allJpeg, "cockpit panel: under a third of the JPEG bytes");
+            } else if (scene == SCENE_NOISE) {
+                CHECK(counts[TILE_CODEC_JPEG] == tiles.GetTileCount(), "noise: every tile JPEG");
+            } else {
+                snprintf(name, sizeof(name), "%s: no more bytes than all-JPEG", FrameSceneName(scene));
+                CHECK(mixed <= allJpeg + allJpeg / 20, name);
+            }
+        }
+    }
+
+    if (failures) {
+        printf("\n%d test(s) failed\n", failures);
+        return 1;
+    }
+    printf("\nAll tests passed!\n");
+    return 0;
+}
@@ -0,0 +1,118 @@
+// Tests for tile-based dirty-region detection (common/tile-delta.h)
+// Portable - runs on synthetic frames, no DXGI needed
+// Compile: g++ -O2 -std=c++17 tests/test-tile-delta.cpp -o bin/test-tile-delta
+//     or:  cl /EHsc /O2 /Fe:bin\test-tile-delta.exe tests\test-tile-delta.cpp
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "../common/tile-delta.h"
+
+static int failures = 0;
+
+#define CHECK(cond, name) do { \
+    if (cond) { printf("OK: %s\n", name); } \
+    else { printf("FAILED: %s (%s:%d)\n", name, __FILE__, __LINE__); failures++; } \
+} while (0)
+
+// Deterministic pseudo-random fill
+static void FillNoise(uint8_t* p, size_t n, uint32_t seed) {
+    for (size_t i = 0; i < n; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        p[i] = (uint8_t)(seed >> 24);
+    }
+}
+
+static void SetPixel(std::vector<uint8_t>& frame, uint32_t stride, uint32_t x, uint32_t y, uint32_t bgra) {
+    memcpy(&frame[(size_t)y * stride + x * 4], &bgra, 4);
+}
+
+int main() {
+    printf("Testing tile delta (SIMD level: %s)...\n", SimdLevelName(GetSimdLevel()));
+
+    // Hash: every implementation agrees, for tile widths with and without tails
+    {
+        std::vector<uint8_t> buf(300 * 4 * 80);
+        FillNoise(buf.data(), buf.size(), 7);
+        bool same = true;
+        uint32_t widths[] = { 1, 15, 16, 17, 33, 64, 100, 128, 300 };
+        for (uint32_t w : widths) {
+            uint64_t scalar = HashTile(buf.data(), 300 * 4, w, 70, SIMD_SCALAR);
+            if (GetSimdLevel() >= SIMD_SSE2 && HashTile(buf.data(), 300 * 4, w, 70, SIMD_SSE2) != scalar) same = false;
+            if (GetSimdLevel() >= SIMD_AVX2 && HashTile(buf.data(), 300 * 4, w, 70, SIMD_AVX2) != scalar) same = false;
+        }
+        CHECK(same, "SIMD hash matches scalar reference");
+    }
+
+    // Hash: moving content between stripes or rows must change the hash
+    {
+        const uint32_t stride = 64 * 4;
+        std::vector<uint8_t> a(stride * 64, 0), b(stride * 64, 0), c(stride * 64, 0);
+        memset(&a[0], 0xFF, 64);                // stripe 0 of row 0
+        memset(&b[64], 0xFF, 64);               // stripe 1 of row 0
+        memset(&c[stride], 0xFF, 64);           // stripe 0 of row 1
+        uint64_t ha = HashTile(a.data(), stride, 64, 64);
+        uint64_t hb = HashTile(b.data(), stride, 64, 64);
+        uint64_t hc = HashTile(c.data(), stride, 64, 64);
+        CHECK(ha != hb && ha != hc && hb != hc, "hash is position dependent");
+    }
+
+    // Detection on a 1080p-like frame whose height is not a tile multiple
+    const uint32_t width = 1920, height = 1080, stride = width * 4 + 64;  // padded pitch
+    std::vector<uint8_t> frame((size_t)stride * height);
+    FillNoise(frame.data(), frame.size(), 42);
+
+    TileDelta delta;
+    CHECK(delta.Initialize(width, height), "initialize 1920x1080");
+    CHECK(delta.GetTilesX() == 30 && delta.GetTilesY() == 17, "tile grid is 30x17");
+
+    CHECK(delta.Detect(frame.data(), stride, nullptr, 0, false) == 30 * 17, "first frame is all dirty");
+    CHECK(delta.Detect(frame.data(), stride, nullptr, 0, false) == 0, "static frame has no dirty tiles");
+
+    // One pixel in tile (5, 3) and one in the clipped bottom-right tile
+    SetPixel(frame, stride, 5 * 64 + 10, 3 * 64 + 20, 0x12345678);
+    SetPixel(frame, stride, width - 1, height - 1, 0x87654321);
+    int dirty = delta.Detect(frame.data(), stride, nullptr, 0, false);
+    CHECK(dirty == 2 && delta.IsDirty(3 * 30 + 5) && delta.IsDirty(16 * 30 + 29),
+        "single-pixel changes mark exactly their tiles");
+
+    // Hints: a change outside the hinted rects is ignored, one inside is found
+    SetPixel(frame, stride, 100, 100, 0x11111111);    // tile (1, 1) - not hinted
+    SetPixel(frame, stride, 1000, 500, 0x22222222);   // tile (15, 7) - hinted
+    TileRect hint = { 990, 490, 1010, 510 };
+    dirty = delta.Detect(frame.data(), stride, &hint, 1, false);
+    CHECK(dirty == 1 && delta.IsDirty(7 * 30 + 15), "dirty-rect hints limit hashing");
+
+    TileRect none = {};
+    CHECK(delta.Detect(frame.data(), stride, &none, 0, false) == 0, "empty hint list means no change");
+    CHECK(delta.Detect(frame.data(), stride, nullptr, 0, true) == 30 * 17, "keyframe marks every tile");
+
+    // Round trip: previous frame + raw delta == current frame
+    {
+        std::vector<uint8_t> previous = frame;
+        delta.Detect(frame.data(), stride, nullptr, 0, false);
+        for (int i = 0; i < 50; i++) {
+            SetPixel(frame, stride, (i * 397) % width, (i * 211) % height, 0xA0000000u + i);
+        }
+        delta.Detect(frame.data(), stride, nullptr, 0, false);
+
+        std::vector<uint8_t> payload(delta.GetRawDeltaSize());
+        size_t written = delta.WriteRawDelta(frame.data(), stride, payload.data());
+        CHECK(written == payload.size(), "raw delta size matches GetRawDeltaSize()");
+
+        bool applied = ApplyRawDelta(payload.data(), written, previous.data(), width, height, stride);
+        bool equal = true;
+        for (uint32_t y = 0; y < height && equal; y++) {
+            equal = memcmp(&previous[(size_t)y * stride], &frame[(size_t)y * stride], width * 4) == 0;
+        }
+        CHECK(applied && equal, "applying the delta reconstructs the frame");
+        CHECK(written < (size_t)width * height * 4 / 5, "delta is much smaller than the frame");
+    }
+
+    if (failures) {
+        printf("\n%d test(s) failed\n", failures);
+        return 1;
+    }
+    printf("\nAll tests passed!\n");
+    return 0;
+}
@@ -0,0 +1,374 @@
+// Tests for the WebSocket endpoint (common/websocket.h, BroadcastServer::StartWebSocket)
+// Checks SHA-1 / base64 / Sec-WebSocket-Accept against known values, the
+// upgrade handshake and frame parser, then runs browser-like clients over
+// localhost next to a TCP client: hello and reply as binary messages, frames
+// of every length encoding, keyframes only for clients without a hello,
+// ping / pong both ways, close, and refused upgrade requests.
+// Compile: g++ -O2 -std=c++17 -pthread tests/test-websocket.cpp -o bin/test-websocket
+//     or:  cl /EHsc /O2 /Fe:bin\test-websocket.exe tests\test-websocket.cpp
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "../common/broadcast-server.h"
+
+static int failures = 0;
+
+#define CHECK(cond, name) do { \
+    if (cond) { printf("OK: %s\n", name); } \
+    else { printf("FAILED: %s (%s:%d)\n", name, __FILE__, __LINE__); failures++; } \
+} while (0)
+
+#define TEST_PORT 19993
+#define WS_PORT 19994
+
+static const uint8_t testMask[4] = { 0x37, 0xFA, 0x21, 0x3D };
+
+static std::string Hex(const uint8_t* data, size_t len) {
+    std::string out;
+    char byte[3];
+    for (size_t i = 0; i < len; i++) {
+        snprintf(byte, sizeof(byte), "%02x", data[i]);
+        out += byte;
+    }
+    return out;
+}
+
+static SOCKET Connect(int port) {
+    SOCKET s = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((unsigned short)port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(s, (sockaddr*)&addr, sizeof(addr)) != 0) {
+        closesocket(s);
+        return INVALID_SOCKET;
+    }
+    return s;
+}
+
+static bool Readable(SOCKET s, int timeoutMs) {
+    NetPollFd fd = {};
+    fd.fd = s;
+    fd.events = POLLIN;
+    return NetPoll(&fd, 1, timeoutMs) > 0;
+}
+
+// Read exactly size bytes, servicing the server while waiting (its sends
+// are non-blocking and large frames need several rounds)
+static bool ReadExact(BroadcastServer& server, SOCKET s, uint8_t* out, size_t size) {
+    size_t got = 0;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+    while (got < size) {
+        if (std::chrono::steady_clock::now() > deadline) return false;
+        server.Service(0);
+        if (!Readable(s, 2)) continue;
+        int n = recv(s, (char*)out + got, (int)(size - got), 0);
+        if (n <= 0) return false;
+        got += n;
+    }
+    return true;
+}
+
+// One server frame (never masked)
+static bool ReadMessage(BroadcastServer& server, SOCKET s, int* opcode, std::vector<uint8_t>* payload) {
+    uint8_t header[10];
+    if (!ReadExact(server, s, header, 2)) return false;
+    if (header[1] & 0x80) return false;
+    *opcode = header[0] & 0x0F;
+    uint64_t len = header[1] & 0x7F;
+    if (len == 126) {
+        if (!ReadExact(server, s, header + 2, 2)) return false;
+        len = (uint64_t)header[2] << 8 | header[3];
+    } else if (len == 127) {
+        if (!ReadExact(server, s, header + 2, 8)) return false;
+        len = 0;
+        for (int i = 0; i < 8; i++) len = len << 8 | header[2 + i];
+    }
+    payload->resize((size_t)len);
+    return len == 0 || ReadExact(server, s, payload->data(), (size_t)len);
+}
+
+static void SendFrame(SOCKET s, int opcode, const uint8_t* payload, size_t len) {
+    std::vector<uint8_t> frame(len + WS_MAX_HEADER_SIZE);
+    size_t size = WsWriteClientFrame(frame.data(), opcode, payload, len, testMask);
+    send(s, (const char*)frame.data(), (int)size, 0);
+}
+
+static void Pump(BroadcastServer& server, int ms) {
+    auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(ms);
+    while (std::chrono::steady_clock::now() < end) server.Service(1);
+}
+
+// Upgrade; returns the response's status line
+static std::string Upgrade(BroadcastServer& server, SOCKET s, const char* request) {
+    send(s, request, (int)strlen(request), 0);
+    std::string response;
+    uint8_t byte;
+    while (response.size() < 4 || response.compare(response.size() - 4, 4, "\r\n\r\n") != 0) {
+        if (!ReadExact(server, s, &byte, 1)) break;
+        response += (char)byte;
+    }
+    return response;
+}
+
+static SOCKET ConnectWebSocket(BroadcastServer& server, std::string* response) {
+    SOCKET s = Connect(WS_PORT);
+    char request[512];
+    WsWriteRequest(request, sizeof(request), "localhost", "dGhlIHNhbXBsZSBub25jZQ==");
+    *response = Upgrade(server, s, request);
+    return s;
+}
+
+static void SendHello(SOCKET s, bool deltas) {
+    WireHello hello;
+    hello.flags = deltas ? WIRE_HELLO_DELTAS : 0;
+    hello.codecs = 1u << WIRE_CODEC_JPEG;
+    uint8_t bytes[WIRE_HELLO_SIZE];
+    WireWriteHello(hello, bytes);
+    SendFrame(s, WS_OP_BINARY, bytes, WIRE_HELLO_SIZE);
+}
+
+// v2 header, then payloadSize bytes that depend on seq
+static void Publish(BroadcastServer& server, FrameRing& ring, uint64_t seq, size_t payloadSize, bool delta) {
+    FrameSlot* slot = ring.AcquireWrite();
+    WireFrameHeader h;
+    h.codec = WIRE_CODEC_JPEG;
+    h.flags = delta ? WIRE_FLAG_DELTA : WIRE_FLAG_KEYFRAME;
+    h.seq = seq;
+    WireWriteHeader(h, slot->data);
+    for (size_t i = 0; i < payloadSize; i++) slot->data[WIRE_HEADER_SIZE + i] = (uint8_t)(seq + i * 7);
+    slot->size = WIRE_HEADER_SIZE + payloadSize;
+    slot->seq = seq;
+    slot->flags = delta ? FRAME_FLAG_DELTA : 0;
+    server.Broadcast(&ring, slot);
+    ring.Release(slot);
+}
+
+static bool CheckFrame(const std::vector<uint8_t>& message, uint64_t seq, size_t payloadSize) {
+    if (message.size() != WIRE_HEADER_SIZE + payloadSize) return false;
+    WireFrameHeader h;
+    WireReadHeader(message.data(), &h);
+    if (h.version != WIRE_VERSION || h.seq != seq) return false;
+    for (size_t i = 0; i < payloadSize; i++) {
+        if (message[WIRE_HEADER_SIZE + i] != (uint8_t)(seq + i * 7)) return false;
+    }
+    return true;
+}
+
+// Next binary message, answering pings on the way
+static bool ReadBinary(BroadcastServer& server, SOCKET s, std::vector<uint8_t>* message) {
+    int opcode;
+    while (ReadMessage(server, s, &opcode, message)) {
+        if (opcode == WS_OP_BINARY) return true;
+        if (opcode == WS_OP_PING) SendFrame(s, WS_OP_PONG, message->data(), message->size());
+    }
+    return false;
+}
+
+int main() {
+    printf("Testing WebSocket endpoint...\n");
+
+    // Building blocks against known values
+    {
+        uint8_t digest[20];
+        WsSha1((const uint8_t*)"abc", 3, digest);
+        CHECK(Hex(digest, 20) == "a9993e364706816aba3e25717850c26c9cd0d89d", "SHA-1 of \"abc\"");
+        WsSha1(nullptr, 0, digest);
+        CHECK(Hex(digest, 20) == "da39a3ee5e6b4b0d3255bfef95601890afd80709", "SHA-1 of nothing");
+        const char* twoBlocks = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+        WsSha1((const uint8_t*)twoBlocks, strlen(twoBlocks), digest);
+        CHECK(Hex(digest, 20) == "84983e441c3bd26ebaae4aa1f95129e5e54670f1", "SHA-1 across a block boundary");
+
+        char b64[16];
+        WsBase64((const uint8_t*)"foob", 4, b64);
+        CHECK(strcmp(b64, "Zm9vYg==") == 0, "base64 with padding");
+
+        char accept[29];
+        const char* key = "dGhlIHNhbXBsZSBub25jZQ==";
+        WsAcceptKey(key, strlen(key), accept);
+        CHECK(strcmp(accept, "s3pPLMBiTxaQ9kYGzzhZRbK+xOo=") == 0, "Sec-WebSocket-Accept matches RFC 6455");
+    }
+
+    // Upgrade request parsing
+    {
+        char request[512], response[WS_RESPONSE_SIZE];
+        size_t responseLen = 0;
+        size_t len = WsWriteRequest(request, sizeof(request), "localhost", "dGhlIHNhbXBsZSBub25jZQ==");
+        CHECK(WsHandshake(request, len - 2, response, &responseLen) == 0, "partial request waits for more");
+        CHECK(WsHandshake(request, len, response, &responseLen) == 1 &&
+            strstr(response, "101 Switching Protocols") && strstr(response, "s3pPLMBiTxaQ9kYGzzhZRbK+xOo="),
+            "upgrade accepted with the right key");
+
+        const char* mixedCase = "GET /stream HTTP/1.1\r\nhost: x\r\nconnection: keep-alive, Upgrade\r\n"
+            "upgrade: WebSocket\r\nsec-websocket-key: dGhlIHNhbXBsZSBub25jZQ==\r\nsec-websocket-version: 13\r\n\r\n";
+        CHECK(WsHandshake(mixedCase, strlen(mixedCase), response, &responseLen) == 1,
+            "header names and tokens are case-insensitive");
+
+        const char* plain = "GET / HTTP/1.1\r\nHost: x\r\n\r\n";
+        CHECK(WsHandshake(plain, strlen(plain), response, &responseLen) == -1 && strstr(response, "400"),
+            "plain HTTP request gets 400");
+        const char* oldVersion = "GET / HTTP/1.1\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+            "Sec-WebSocket-Key: abc\r\nSec-WebSocket-Version: 8\r\n\r\n";
+        CHECK(WsHandshake(oldVersion, strlen(oldVersion), response, &responseLen) == -1 && strstr(response, "426"),
+            "other protocol versions get 426");
+    }
+
+    // Frame parsing
+    {
+        std::vector<uint8_t> payload(300), frame(300 + WS_MAX_HEADER_SIZE);
+        for (size_t i = 0; i < payload.size(); i++) payload[i] = (uint8_t)(i * 13);
+        bool allOk = true;
+        const size_t sizes[] = { 0, 5, 125, 126, 300 };
+        for (size_t size : sizes) {
+            size_t len = WsWriteClientFrame(frame.data(), WS_OP_BINARY, payload.data(), size, testMask);
+            WsFrame f;
+            allOk = allOk && WsParseFrame(frame.data(), len - 1, &f) == 0;
+            allOk = allOk && WsParseFrame(frame.data(), len, &f) == (int)len && f.fin && f.opcode == WS_OP_BINARY &&
+                f.payloadSize == size && memcmp(frame.data() + f.headerSize, payload.data(), size) == 0;
+        }
+        CHECK(allOk, "masked frames of every length form parse and unmask");
+
+        WsFrame f;
+        uint8_t unmasked[2] = { 0x82, 0x00 };
+        CHECK(WsParseFrame(unmasked, 2, &f) == -1, "unmasked client frame is a protocol error");
+        uint8_t huge[14];
+        WsWriteHeader(huge, WS_OP_BINARY, WS_MAX_MESSAGE_SIZE + 1);
+        huge[1] |= 0x80;
+        CHECK(WsParseFrame(huge, sizeof(huge), &f) == -1, "oversized client message is refused");
+        uint8_t server[WS_SERVER_HEADER_SIZE];
+        CHECK(WsWriteHeader(server, WS_OP_BINARY, 100) == 2 && WsWriteHeader(server, WS_OP_BINARY, 1000) == 4 &&
+            WsWriteHeader(server, WS_OP_BINARY, 100000) == 10, "server headers pick the shortest length form");
+    }
+
+    if (!NetStartup()) {
+        printf("FAILED: Winsock startup\n");
+        return 1;
+    }
+
+    // Browser-like clients and a TCP client on one stream
+    {
+        BroadcastServer server;
+        CHECK(server.Start(TEST_PORT) && server.StartWebSocket(WS_PORT), "server listens on TCP and WebSocket ports");
+        server.SetStreamInfo(WIRE_CODEC_JPEG, 640, 480, 30);
+        server.SetPingInterval(300);
+        FrameRing ring;
+        ring.Initialize(8, 200 * 1024);
+
+        std::string response;
+        SOCKET a = ConnectWebSocket(server, &response);
+        CHECK(response.compare(0, 12, "HTTP/1.1 101") == 0 && response.find("s3pPLMBiTxaQ9kYGzzhZRbK+xOo=") != std::string::npos,
+            "browser client upgrades");
+        SOCKET b = ConnectWebSocket(server, &response);
+        SOCKET silent = ConnectWebSocket(server, &response);
+        SOCKET tcp = Connect(TEST_PORT);
+
+        SendHello(a, true);
+        SendHello(b, true);
+        std::vector<uint8_t> message;
+        WireReply reply;
+        bool replied = ReadBinary(server, a, &message) && message.size() == WIRE_REPLY_SIZE &&
+            WireReadReply(message.data(), &reply) && reply.status == WIRE_STATUS_OK && reply.width == 640;
+        replied = replied && ReadBinary(server, b, &message) && message.size() == WIRE_REPLY_SIZE;
+        CHECK(replied, "hello and reply travel as binary messages");
+
+        Pump(server, WIRE_HANDSHAKE_MS + 50);
+        CHECK(server.GetStreamingClientCount() == 4 && !server.AllClientsTakeDeltas(),
+            "silent browser client defaults to keyframes only");
+
+        // 7-bit, 16-bit and 64-bit lengths, then a delta
+        const size_t sizes[] = { 50, 1000, 150 * 1024 };
+        bool intact = true;
+        for (int i = 0; i < 3; i++) {
+            Publish(server, ring, i + 1, sizes[i], false);
+            intact = intact && ReadBinary(server, a, &message) && CheckFrame(message, i + 1, sizes[i]);
+            intact = intact && ReadBinary(server, b, &message) && CheckFrame(message, i + 1, sizes[i]);
+            intact = intact && ReadBinary(server, silent, &message) && CheckFrame(message, i + 1, sizes[i]);
+            uint8_t prefix[4];
+            uint32_t size = 0;
+            intact = intact && ReadExact(server, tcp, prefix, 4);
+            memcpy(&size, prefix, 4);
+            message.resize(size);
+            intact = intact && size == WIRE_HEADER_SIZE + sizes[i] && ReadExact(server, tcp, message.data(), size) &&
+                CheckFrame(message, i + 1, sizes[i]);
+        }
+        CHECK(intact, "every client gets every keyframe intact, whatever its length form");
+
+        Publish(server, ring, 4, 64, true);
+        Publish(server, ring, 5, 64, false);
+        bool gotDelta = ReadBinary(server, a, &message) && CheckFrame(message, 4, 64);
+        bool skipped = ReadBinary(server, silent, &message) && CheckFrame(message, 5, 64);
+        CHECK(gotDelta && skipped, "deltas reach clients that asked for them only");
+        ReadBinary(server, a, &message);
+        ReadBinary(server, b, &message);
+        ReadBinary(server, b, &message);
+
+        // Keyframe request as a binary message
+        server.TakeKeyframeRequest();
+        uint8_t request[WIRE_MESSAGE_SIZE];
+        WireMessage m;
+        m.type = WIRE_MSG_KEYFRAME;
+        WireWriteMessage(m, request);
+        SendFrame(b, WS_OP_BINARY, request, WIRE_MESSAGE_SIZE);
+        Pump(server, 50);
+        CHECK(server.TakeKeyframeRequest(), "keyframe request arrives over WebSocket");
+
+        // Client ping: pong with the same payload
+        SendFrame(a, WS_OP_PING, (const uint8_t*)"hi", 2);
+        int opcode = 0;
+        bool pong = ReadMessage(server, a, &opcode, &message) && opcode == WS_OP_PONG &&
+            message.size() == 2 && memcmp(message.data(), "hi", 2) == 0;
+        CHECK(pong, "server answers pings");
+
+        // Server pings: a and b answer, the silent client never reads
+        auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(800);
+        int pings = 0;
+        while (std::chrono::steady_clock::now() < end) {
+            server.Service(1);
+            SOCKET answering[2] = { a, b };
+            for (SOCKET s : answering) {
+                if (!Readable(s, 0)) continue;
+                if (ReadMessage(server, s, &opcode, &message) && opcode == WS_OP_PING) {
+                    SendFrame(s, WS_OP_PONG, message.data(), message.size());
+                    pings++;
+                }
+            }
+        }
+        CHECK(pings >= 2, "server pings its WebSocket clients");
+        CHECK(server.GetClientCount() == 3, "client that doesn't answer pings is dropped");
+
+        // Close handshake
+        uint8_t status[2] = { 0x03, 0xE8 };  // 1000, normal closure
+        SendFrame(b, WS_OP_CLOSE, status, 2);
+        bool echoed = ReadMessage(server, b, &opcode, &message) && opcode == WS_OP_CLOSE &&
+            message.size() == 2 && message[0] == 0x03 && message[1] == 0xE8;
+        char byte;
+        bool closed = echoed && Readable(b, 1000) && recv(b, &byte, 1, 0) == 0;
+        CHECK(echoed && closed, "close is echoed, then the connection ends");
+        CHECK(server.GetClientCount() == 2, "closed client is gone");
+
+        // Plain HTTP on the WebSocket port
+        SOCKET plain = Connect(WS_PORT);
+        response = Upgrade(server, plain, "GET / HTTP/1.1\r\nHost: localhost\r\n\r\n");
+        CHECK(response.compare(0, 12, "HTTP/1.1 400") == 0, "request without upgrade is refused");
+        Pump(server, 50);
+        CHECK(Readable(plain, 1000) && recv(plain, &byte, 1, 0) == 0, "refused connection is closed");
+
+        closesocket(plain);
+        closesocket(a);
+        closesocket(b);
+        closesocket(silent);
+        closesocket(tcp);
+        server.Stop();
+    }
+
+    NetCleanup();
+    if (failures) {
+        printf("\n%d test(s) failed\n", failures);
+        return 1;
+    }
+    printf("\nAll tests passed!\n");
+    return 0;
+}
@@ -0,0 +1,427 @@
+// Tests for wire protocol v2 (common/wire-protocol.h) as the broadcast
+// server speaks it: message encoding, the hello / reply handshake, codec and
+// version rejection, v1 clients falling back to the legacy header, and the
+// capabilities a hello declares - keyframe-only clients, max fps and
+// on-demand keyframes. Clients are plain sockets driven from the test thread.
+// Compile: g++ -O2 -std=c++17 -pthread tests/test-wire-protocol.cpp -o bin/test-wire-protocol
+//     or:  cl /EHsc /O2 /Fe:bin\test-wire-protocol.exe tests\test-wire-protocol.cpp
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include "../common/broadcast-server.h"
+
+static int failures = 0;
+
+#define CHECK(cond, name) do { \
+    if (cond) { printf("OK: %s\n", name); } \
+    else { printf("FAILED: %s (%s:%d)\n", name, __FILE__, __LINE__); failures++; } \
+} while (0)
+
+#define TEST_PORT 19995
+#define PAYLOAD_SIZE 8
+
+static SOCKET Connect() {
+    SOCKET s = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(TEST_PORT);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(s, (sockaddr*)&addr, sizeof(addr)) != 0) {
+        closesocket(s);
+        return INVALID_SOCKET;
+    }
+    return s;
+}
+
+static void SendHello(SOCKET s, const WireHello& hello) {
+    uint8_t bytes[WIRE_HELLO_SIZE];
+    WireWriteHello(hello, bytes);
+    send(s, (const char*)bytes, WIRE_HELLO_SIZE, 0);
+}
+
+static void SendClientMessage(SOCKET s, uint8_t type, uint16_t arg) {
+    WireMessage m;
+    m.type = type;
+    m.arg = arg;
+    uint8_t bytes[WIRE_MESSAGE_SIZE];
+    WireWriteMessage(m, bytes);
+    send(s, (const char*)bytes, WIRE_MESSAGE_SIZE, 0);
+}
+
+// Bytes waiting on the socket within timeoutMs
+static bool Readable(SOCKET s, int timeoutMs) {
+    NetPollFd fd = {};
+    fd.fd = s;
+    fd.events = POLLIN;
+    return NetPoll(&fd, 1, timeoutMs) > 0;
+}
+
+// Exactly size bytes, or false on timeout / close
+static bool ReadExact(SOCKET s, uint8_t* out, int size) {
+    int got = 0;
+    while (got < size) {
+        if (!Readable(s, 2000)) return false;
+        int n = recv(s, (char*)out + got, size - got, 0);
+        if (n <= 0) return false;
+        got += n;
+    }
+    return true;
+}
+
+static bool ReadReply(SOCKET s, WireReply* reply) {
+    uint8_t bytes[WIRE_REPLY_SIZE];
+    return ReadExact(s, bytes, WIRE_REPLY_SIZE) && WireReadReply(bytes, reply);
+}
+
+// One frame: header bytes as sent and the payload's sequence number
+static bool ReadFrame(SOCKET s, uint8_t* header, uint64_t* payloadSeq) {
+    uint8_t prefix[4];
+    uint32_t size;
+    if (!ReadExact(s, prefix, 4)) return false;
+    memcpy(&size, prefix, 4);
+    if (size != WIRE_HEADER_SIZE + PAYLOAD_SIZE) return false;
+    uint8_t payload[PAYLOAD_SIZE];
+    if (!ReadExact(s, header, WIRE_HEADER_SIZE) || !ReadExact(s, payload, PAYLOAD_SIZE)) return false;
+    memcpy(payloadSeq, payload, 8);
+    return true;
+}
+
+static void Pump(BroadcastServer& server, int ms) {
+    auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(ms);
+    while (std::chrono::steady_clock::now() < end) server.Service(1);
+}
+
+static bool WaitForStreaming(BroadcastServer& server, int count) {
+    for (int i = 0; i < 100 && server.GetStreamingClientCount() < count; i++) server.Service(10);
+    return server.GetStreamingClientCount() == count;
+}
+
+// A frame as the services publish it: v2 header in the data, v1 header beside it
+static void Publish(BroadcastServer& server, FrameRing& ring, uint64_t seq, bool delta, bool moves = false,
+                    bool tileCodecs = false) {
+    FrameSlot* slot = ring.AcquireWrite();
+    WireFrameHeader h;
+    h.codec = WIRE_CODEC_JPEG;
+    h.flags = delta ? WIRE_FLAG_DELTA : WIRE_FLAG_KEYFRAME;
+    if (moves) h.flags |= WIRE_FLAG_MOVES;
+    if (tileCodecs) h.flags |= WIRE_FLAG_TILE_CODECS;
+    h.width = 320;
+    h.height = 200;
+    h.seq = seq;
+    h.captureUs = 1000 + seq;
+    WireWriteHeader(h, slot->data);
+    memcpy(slot->data + WIRE_HEADER_SIZE, &seq, 8);
+    for (int i = 0; i < FRAME_LEGACY_HEADER_SIZE; i++) slot->legacyHeader[i] = (uint8_t)(0xA0 + i);
+    slot->hasLegacyHeader = true;
+    slot->size = WIRE_HEADER_SIZE + PAYLOAD_SIZE;
+    slot->width = 320;
+    slot->height = 200;
+    slot->seq = seq;
+    slot->flags = (delta ? FRAME_FLAG_DELTA : 0) | (moves ? FRAME_FLAG_MOVES : 0) |
+        (tileCodecs ? FRAME_FLAG_TILE_CODECS : 0);
+    server.Broadcast(&ring, slot);
+    ring.Release(slot);
+    server.Service(1);
+}
+
+// Frames that arrive within a short wait
+static int Drain(SOCKET s) {
+    int frames = 0;
+    uint8_t header[WIRE_HEADER_SIZE];
+    uint64_t seq;
+    while (Readable(s, 50) && ReadFrame(s, header, &seq)) frames++;
+    return frames;
+}
+
+int main() {
+    printf("Testing wire protocol v2...\n");
+    if (!NetStartup()) {
+        printf("FAILED: Winsock startup\n");
+        return 1;
+    }
+
+    // Encoding round trips
+    {
+        uint8_t bytes[WIRE_HEADER_SIZE];
+        WireHello hello, helloOut;
+        hello.flags = WIRE_HELLO_DELTAS;
+        hello.maxFps = 45;
+        hello.codecs = (1u << WIRE_CODEC_JPEG) | (1u << WIRE_CODEC_LOSSLESS);
+        hello.minScalePercent = 150;
+        WireWriteHello(hello, bytes);
+        CHECK(WireReadHello(bytes, &helloOut) && helloOut.version == WIRE_VERSION && helloOut.flags == WIRE_HELLO_DELTAS &&
+            helloOut.maxFps == 45 && helloOut.codecs == hello.codecs, "hello round trip");
+        CHECK(helloOut.minScalePercent == 100, "hello min scale is clamped to 100%");
+        bytes[0] = 0;
+        CHECK(!WireReadHello(bytes, &helloOut), "anything without the magic is not a hello");
+
+        WireReply reply, replyOut;
+        reply.status = WIRE_STATUS_CODEC;
+        reply.codec = WIRE_CODEC_BGRA;
+        reply.width = 2560;
+        reply.height = 1440;
+        reply.fps = 60;
+        WireWriteReply(reply, bytes);
+        CHECK(WireReadReply(bytes, &replyOut) && replyOut.status == WIRE_STATUS_CODEC && replyOut.codec == WIRE_CODEC_BGRA &&
+            replyOut.width == 2560 && replyOut.height == 1440 && replyOut.fps == 60, "reply round trip");
+
+        WireFrameHeader h, hOut;
+        h.codec = WIRE_CODEC_LOSSLESS;
+        h.flags = WIRE_FLAG_DELTA | WIRE_FLAG_TILES;
+        h.width = 3840;
+        h.height = 2160;
+        h.seq = 0x123456789ull;
+        h.captureUs = 0xABCDEF012345ull;
+        WireWriteHeader(h, bytes);
+        WireReadHeader(bytes, &hOut);
+        CHECK(hOut.version == WIRE_VERSION && hOut.codec == WIRE_CODEC_LOSSLESS && hOut.flags == h.flags &&
+            hOut.width == 3840 && hOut.height == 2160 && hOut.seq == h.seq && hOut.captureUs == h.captureUs,
+            "frame header round trip");
+
+        WireMessage m, mOut;
+        m.type = WIRE_MSG_MAX_FPS;
+        m.arg = 24;
+        WireWriteMessage(m, bytes);
+        WireReadMessage(bytes, &mOut);
+        CHECK(mOut.type == WIRE_MSG_MAX_FPS && mOut.arg == 24, "message round trip");
+
+        CHECK(WireCappedFps(60, 0) == 60 && WireCappedFps(60, 30) == 30 && WireCappedFps(30, 60) == 30 &&
+            WireCappedFps(0, 20) == 20 && WireCappedFps(0, 0) == 0, "client caps only ever slow capture down");
+    }
+
+    // v2 and v1 clients on one stream
+    {
+        BroadcastServer server;
+        CHECK(server.Start(TEST_PORT), "server listens on the test port");
+        server.SetStreamInfo(WIRE_CODEC_JPEG, 1280, 720, 60);
+        FrameRing ring;
+        ring.Initialize(4, 256);
+
+        SOCKET v2 = Connect();
+        SOCKET v1 = Connect();
+        server.Service(10);
+        server.Service(10);
+        CHECK(server.GetClientCount() == 2 && server.GetStreamingClientCount() == 0, "clients wait for the handshake");
+        server.TakeKeyframeRequest();
+
+        WireHello hello;
+        hello.flags = WIRE_HELLO_DELTAS;
+        hello.maxFps = 30;
+        hello.codecs = 1u << WIRE_CODEC_JPEG;
+        hello.minScalePercent = 50;
+        SendHello(v2, hello);
+        CHECK(WaitForStreaming(server, 1), "hello starts the stream at once");
+        CHECK(server.TakeKeyframeRequest(), "new client asks for a keyframe");
+
+        WireReply reply;
+        CHECK(ReadReply(v2, &reply) && reply.status == WIRE_STATUS_OK && reply.codec == WIRE_CODEC_JPEG &&
+            reply.flags == WIRE_HELLO_DELTAS && reply.width == 1280 && reply.height == 720 && reply.fps == 30,
+            "reply announces codec, size, deltas and the capped rate");
+        CHECK(server.GetClientFpsLimit() == 30 && server.GetMinScalePercent() == 50,
+            "server exposes the client's caps");
+
+        CHECK(WaitForStreaming(server, 2), "silent client becomes v1 after the handshake window");
+        CHECK(server.GetClientFpsLimit() == 0, "v1 client has no rate cap");
+
+        Publish(server, ring, 7, false);
+        uint8_t header[WIRE_HEADER_SIZE];
+        uint64_t seq = 0;
+        WireFrameHeader h;
+        bool got = ReadFrame(v2, header, &seq);
+        WireReadHeader(header, &h);
+        CHECK(got && seq == 7 && h.version == WIRE_VERSION && h.codec == WIRE_CODEC_JPEG &&
+            h.flags == WIRE_FLAG_KEYFRAME && h.seq == 7 && h.captureUs == 1007 && h.width == 320,
+            "v2 client gets the v2 header");
+
+        got = ReadFrame(v1, header, &seq);
+        bool legacy = got;
+        for (int i = 0; i < FRAME_LEGACY_HEADER_SIZE; i++) legacy = legacy && header[i] == (uint8_t)(0xA0 + i);
+        CHECK(legacy && seq == 7, "v1 client gets the legacy header and the same payload");
+
+        // Resync on demand
+        Publish(server, ring, 8, true);
+        CHECK(Drain(v2) == 1, "v2 client takes deltas");
+        server.TakeKeyframeRequest();
+        SendClientMessage(v2, WIRE_MSG_KEYFRAME, 0);
+        Pump(server, 50);
+        CHECK(server.TakeKeyframeRequest(), "keyframe message raises a keyframe request");
+        Publish(server, ring, 9, true);
+        CHECK(Drain(v2) == 0, "deltas stop until the keyframe");
+        Publish(server, ring, 10, false);
+        got = ReadFrame(v2, header, &seq);
+        CHECK(got && seq == 10, "keyframe resyncs the client");
+        CHECK(Drain(v1) == 3, "other clients are not affected");
+
+        SendClientMessage(v2, WIRE_MSG_MAX_FPS, 20);
+        Pump(server, 50);
+        closesocket(v1);
+        Pump(server, 50);
+        CHECK(server.GetClientFpsLimit() == 20, "max fps message changes the cap");
+
+        closesocket(v2);
+        server.Stop();
+    }
+
+    // Rejections
+    {
+        BroadcastServer server;
+        server.Start(TEST_PORT);
+        server.SetStreamInfo(WIRE_CODEC_LOSSLESS, 0, 0, 0);
+
+        SOCKET s = Connect();
+        WireHello hello;
+        hello.codecs = 1u << WIRE_CODEC_JPEG;
+        SendHello(s, hello);
+        Pump(server, 50);
+        WireReply reply;
+        char byte;
+        CHECK(ReadReply(s, &reply) && reply.status == WIRE_STATUS_CODEC, "unsupported codec is refused");
+        CHECK(Readable(s, 1000) && recv(s, &byte, 1, 0) == 0 && server.GetClientCount() == 0,
+            "refused client is disconnected");
+        closesocket(s);
+
+        s = Connect();
+        hello.version = 1;
+        hello.codecs = 1u << WIRE_CODEC_LOSSLESS;
+        SendHello(s, hello);
+        Pump(server, 50);
+        CHECK(ReadReply(s, &reply) && reply.status == WIRE_STATUS_VERSION, "older protocol version is refused");
+        closesocket(s);
+        server.Stop();
+    }
+
+    // Keyframe-only client with a rate cap
+    {
+        BroadcastServer server;
+        server.Start(TEST_PORT);
+        server.SetStreamInfo(WIRE_CODEC_JPEG, 320, 200, 60);
+        FrameRing ring;
+        ring.Initialize(4, 256);
+
+        SOCKET s = Connect();
+        WireHello hello;
+        hello.maxFps = 10;
+        hello.codecs = 1u << WIRE_CODEC_JPEG;
+        SendHello(s, hello);
+        WaitForStreaming(server, 1);
+        WireReply reply;
+        CHECK(ReadReply(s, &reply) && reply.flags == 0 && reply.fps == 10, "reply: no deltas, 10 fps");
+        CHECK(!server.AllClientsTakeDeltas(), "service is told to send keyframes only");
+
+        Publish(server, ring, 1, false);
+        Publish(server, ring, 2, true);
+        uint8_t header[WIRE_HEADER_SIZE];
+        uint64_t seq = 0;
+        CHECK(ReadFrame(s, header, &seq) && seq == 1 && Drain(s) == 0, "deltas are never sent to it");
+
+        // One second of 60 fps keyframes
+        auto start = std::chrono::steady_clock::now();
+        auto next = start;
+        uint64_t n = 100;
+        while (std::chrono::steady_clock::now() - start < std::chrono::seconds(1)) {
+            if (std::chrono::steady_clock::now() >= next) {
+                next += std::chrono::microseconds(16667);
+                Publish(server, ring, n++, false);
+            }
+            server.Service(1);
+        }
+        int frames = Drain(s);
+        printf("  10 fps cap on a 60 fps stream: %d frames in 1 s\n", frames);
+        CHECK(frames >= 8 && frames <= 12, "max fps thins the stream");
+
+        closesocket(s);
+        Pump(server, 50);
+        CHECK(server.AllClientsTakeDeltas(), "deltas resume once it is gone");
+        server.Stop();
+    }
+
+    // Deltas with moves only go to clients that apply them
+    {
+        BroadcastServer server;
+        server.Start(TEST_PORT);
+        server.SetStreamInfo(WIRE_CODEC_BGRA, 320, 200, 60);
+        server.SetStreamMoves(true);
+        FrameRing ring;
+        ring.Initialize(4, 256);
+
+        SOCKET withMoves = Connect();
+        WireHello hello;
+        hello.flags = WIRE_HELLO_DELTAS | WIRE_HELLO_MOVES;
+        hello.codecs = 1u << WIRE_CODEC_BGRA;
+        SendHello(withMoves, hello);
+        WaitForStreaming(server, 1);
+        WireReply reply;
+        CHECK(ReadReply(withMoves, &reply) && reply.flags == (WIRE_HELLO_DELTAS | WIRE_HELLO_MOVES),
+            "reply announces moves");
+        CHECK(server.AllClientsTakeMoves(), "service may send moves");
+
+        SOCKET deltasOnly = Connect();
+        hello.flags = WIRE_HELLO_DELTAS;
+        SendHello(deltasOnly, hello);
+        WaitForStreaming(server, 2);
+        CHECK(ReadReply(deltasOnly, &reply) && reply.flags == WIRE_HELLO_DELTAS, "reply: deltas without moves");
+        CHECK(!server.AllClientsTakeMoves() && server.AllClientsTakeDeltas(), "service is told to send plain deltas");
+
+        Publish(server, ring, 1, false);
+        Publish(server, ring, 2, true, true);
+        Publish(server, ring, 3, true);
+        CHECK(Drain(withMoves) == 3, "moves client gets every frame");
+        CHECK(Drain(deltasOnly) == 1 && server.TakeKeyframeRequest(), "a move frame resyncs the other client");
+
+        closesocket(deltasOnly);
+        Pump(server, 50);
+        CHECK(server.AllClientsTakeMoves(), "moves resume once it is gone");
+        closesocket(withMoves);
+        server.Stop();
+    }
+
+    // Deltas with per-tile codecs only go to clients that decode them
+    {
+        BroadcastServer server;
+        server.Start(TEST_PORT);
+        server.SetStreamInfo(WIRE_CODEC_JPEG, 320, 200, 60);
+        server.SetStreamTileCodecs(true);
+        FrameRing ring;
+        ring.Initialize(4, 256);
+
+        SOCKET withCodecs = Connect();
+        WireHello hello;
+        hello.flags = WIRE_HELLO_DELTAS | WIRE_HELLO_TILE_CODECS;
+        hello.codecs = 1u << WIRE_CODEC_JPEG;
+        SendHello(withCodecs, hello);
+        WaitForStreaming(server, 1);
+        WireReply reply;
+        CHECK(ReadReply(withCodecs, &reply) && reply.flags == (WIRE_HELLO_DELTAS | WIRE_HELLO_TILE_CODECS),
+            "reply announces tile codecs");
+        CHECK(server.AllClientsTakeTileCodecs(), "service may send tile codecs");
+
+        SOCKET jpegOnly = Connect();
+        hello.flags = WIRE_HELLO_DELTAS | WIRE_HELLO_MOVES;
+        SendHello(jpegOnly, hello);
+        WaitForStreaming(server, 2);
+        CHECK(ReadReply(jpegOnly, &reply) && reply.flags == WIRE_HELLO_DELTAS, "reply: deltas without tile codecs");
+        CHECK(!server.AllClientsTakeTileCodecs() && server.AllClientsTakeDeltas(),
+            "service is told to send JPEG tiles");
+
+        Publish(server, ring, 1, false);
+        Publish(server, ring, 2, true, false, true);
+        Publish(server, ring, 3, true);
+        CHECK(Drain(withCodecs) == 3, "tile codec client gets every frame");
+        CHECK(Drain(jpegOnly) == 1 && server.TakeKeyframeRequest(), "a tile codec frame resyncs the other client");
+
+        closesocket(jpegOnly);
+        Pump(server, 50);
+        CHECK(server.AllClientsTakeTileCodecs(), "tile codecs resume once it is gone");
+        closesocket(withCodecs);
+        server.Stop();
+    }
+
+    NetCleanup();
+    if (failures) {
+        printf("\n%d test(s) failed\n", failures);
+        return 1;
+    }
+    printf("\nAll tests passed!\n");
+    return 0;
+}
@@ -1,6 +1,11 @@
 // WebSocket Bridge to JPEG Capture Service
 // Connects to TCP capture-jpeg.exe and bridges to WebSocket clients
 // Much faster than nircmd + sharp method
+// Reports how old frames are when they arrive (capture timestamp from the
+// frame header vs. process.hrtime, the same QPC clock on Windows)
+// Speaks wire protocol v2 (common/wire-protocol.h): the hello asks for JPEG
+// keyframes only, so the service encodes full frames while the bridge is
+// connected, whatever --delta says.
 
 const WebSocket = require('ws');
 const net = require('net');
@@ -8,6 +13,12 @@ const net = require('net');
 const WS_PORT = 9997;
 const TCP_HOST = '127.0.0.1';
 const TCP_PORT = 9998;
+const FRAME_HEADER_SIZE = 24;  // version(1) codec(1) flags(2) width(2) height(2) seq(8) captureUs(8)
+const WIRE_MAGIC = Buffer.from('SWV2');
+const WIRE_VERSION = 2;
+const WIRE_REPLY_SIZE = 16;
+const WIRE_CODEC_JPEG = 2;
+const WIRE_FLAG_DELTA = 0x2;
 
 class CaptureStreamBridge {
     constructor() {
@@ -16,8 +27,13 @@ class CaptureStreamBridge {
         this.clients = new Set();
         this.buffer = Buffer.alloc(0);
         this.expectedSize = 0;
+        this.handshakeDone = false;
         this.frameCount = 0;
         this.lastStats = Date.now();
+        this.latencySumUs = 0;
+        this.latencyMaxUs = 0;
+        this.lastSeq = 0n;
+        this.skipped = 0;
         this.connected = false;
     }
 
@@ -68,6 +84,8 @@ class CaptureStreamBridge {
         this.tcpClient.connect(TCP_PORT, TCP_HOST, () => {
             console.log('Connected to capture service');
             this.connected = true;
+            this.handshakeDone = false;
+            this.tcpClient.write(this.buildHello());
             this.broadcast({ type: 'connected' });
         });
 
@@ -81,6 +99,8 @@ class CaptureStreamBridge {
             this.tcpClient = null;
             this.buffer = Buffer.alloc(0);
             this.expectedSize = 0;
+            this.handshakeDone = false;
+            this.lastSeq = 0n;
             this.broadcast({ type: 'disconnected' });
         });
 
@@ -99,8 +119,38 @@ class CaptureStreamBridge {
         }
     }
 
+    // Hello: magic(4) version(1) flags(1) maxFps(2) codecMask(4) minScale%(1) reserved(3)
+    buildHello() {
+        const hello = Buffer.alloc(16);
+        WIRE_MAGIC.copy(hello, 0);
+        hello.writeUInt8(WIRE_VERSION, 4);
+        hello.writeUInt8(0, 5);                     // No deltas: keyframes only
+        hello.writeUInt16LE(0, 6);                  // No frame rate cap
+        hello.writeUInt32LE(1 << WIRE_CODEC_JPEG, 8);
+        hello.writeUInt8(0, 12);                    // Any scale
+        return hello;
+    }
+
+    // Reply: magic(4) version(1) status(1) codec(1) flags(1) width(2) height(2) fps(2) reserved(2)
+    handleReply() {
+        const reply = this.buffer.slice(0, WIRE_REPLY_SIZE);
+        this.buffer = this.buffer.slice(WIRE_REPLY_SIZE);
+        if (!reply.slice(0, 4).equals(WIRE_MAGIC) || reply.readUInt8(5) !== 0) {
+            console.error(`Capture service refused the stream (status ${reply.readUInt8(5)})`);
+            this.disconnectTCP();
+            return false;
+        }
+        this.handshakeDone = true;
+        console.log(`Stream: protocol v${reply.readUInt8(4)}, ${reply.readUInt16LE(8)}x${reply.readUInt16LE(10)}, ` +
+            `${reply.readUInt16LE(12) || 'unpaced'} FPS`);
+        return true;
+    }
+
     handleTCPData(data) {
         this.buffer = Buffer.concat([this.buffer, data]);
+        if (!this.handshakeDone) {
+            if (this.buffer.length < WIRE_REPLY_SIZE || !this.handleReply()) return;
+        }
 
         while (true) {
             // Need frame size header (4 bytes)
@@ -111,16 +161,30 @@ class CaptureStreamBridge {
 
             // Have complete frame?
             if (this.expectedSize > 0 && this.buffer.length >= this.expectedSize) {
-                // Parse frame header (2-byte width, 2-byte height, 4-byte jpegSize)
-                const width = this.buffer.readUInt16LE(0);
-                const height = this.buffer.readUInt16LE(2);
-                const jpegSize = this.buffer.readUInt32LE(4);
-
-                // Extract JPEG data (skip 8-byte header)
-                const jpegData = this.buffer.slice(8, 8 + jpegSize);
+                // Parse v2 frame header (version, codec, 2-byte flags, 2-byte width,
+                // 2-byte height, 8-byte sequence number, 8-byte capture timestamp in us)
+                const codec = this.buffer.readUInt8(1);
+                const flags = this.buffer.readUInt16LE(2);
+                const width = this.buffer.readUInt16LE(4);
+                const height = this.buffer.readUInt16LE(6);
+                const seq = this.buffer.readBigUInt64LE(8);
+                const captureUs = this.buffer.readBigUInt64LE(16);
+
+                // Extract JPEG data (the rest of the frame). The hello asked
+                // for keyframes only, so anything else is not ours to show.
+                if (codec === WIRE_CODEC_JPEG && !(flags & WIRE_FLAG_DELTA)) {
+                    const jpegData = this.buffer.slice(FRAME_HEADER_SIZE, this.expectedSize);
+                    this.broadcastBinary(width, height, seq, captureUs, jpegData);
+                }
 
-                // Send to WebSocket clients
-                this.broadcastBinary(width, height, jpegData);
+                // Capture -> bridge latency and frames the service dropped for us
+                const ageUs = Number(process.hrtime.bigint() / 1000n - captureUs);
+                if (ageUs >= 0) {
+                    this.latencySumUs += ageUs;
+                    this.latencyMaxUs = Math.max(this.latencyMaxUs, ageUs);
+                }
+                if (this.lastSeq > 0n && seq > this.lastSeq + 1n) this.skipped += Number(seq - this.lastSeq - 1n);
+                this.lastSeq = seq;
 
                 // Move to next frame
                 this.buffer = this.buffer.slice(this.expectedSize);
@@ -143,12 +207,14 @@ class CaptureStreamBridge {
         }
     }
 
-    broadcastBinary(width, height, jpegData) {
-        // Create header: size(4) + width(2) + height(2)
-        const header = Buffer.alloc(8);
+    broadcastBinary(width, height, seq, captureUs, jpegData) {
+        // Create header: size(4) + width(2) + height(2) + seq(8) + captureUs(8)
+        const header = Buffer.alloc(24);
         header.writeUInt32LE(jpegData.length, 0);
         header.writeUInt16LE(width, 4);
         header.writeUInt16LE(height, 6);
+        header.writeBigUInt64LE(seq, 8);
+        header.writeBigUInt64LE(captureUs, 16);
 
         for (const client of this.clients) {
             if (client.readyState === WebSocket.OPEN) {
@@ -162,8 +228,14 @@ class CaptureStreamBridge {
         const now = Date.now();
         if (now - this.lastStats >= 2000) {
             const fps = Math.round(this.frameCount * 1000 / (now - this.lastStats));
-            console.log(`Bridge: ${fps} FPS -> ${this.clients.size} clients`);
+            const avgMs = (this.latencySumUs / this.frameCount / 1000).toFixed(1);
+            const maxMs = (this.latencyMaxUs / 1000).toFixed(1);
+            console.log(`Bridge: ${fps} FPS -> ${this.clients.size} clients, ` +
+                `capture->bridge ${avgMs} ms avg, ${maxMs} ms max, ${this.skipped} skipped`);
             this.frameCount = 0;
+            this.latencySumUs = 0;
+            this.latencyMaxUs = 0;
+            this.skipped = 0;
             this.lastStats = now;
         }
     }